@@ -15,27 +15,44 @@
 
 #include <stdbool.h>
 #include <string.h>
-#include <math.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/event_groups.h>
 #include <driver/gpio.h>
 #include <driver/i2s.h>
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 
 #include <esp_event.h>
 
 #include "audio.h"
 #include "audio_event.h"
+#include "audio_ring.h"
+#include "audio_mixer.h"
+#include "audio_convert.h"
+#include "audio_resample.h"
+#include "audio_sched.h"
+#include "audio_pool.h"
+#include "audio_synth.h"
+#include "audio_histogram.h"
 
 #define TAG "audio"
 
 #define AUDIO_I2S_NUM           (I2S_NUM_0)
+#ifdef CONFIG_AUDIO_OUTPUT_SAMPLE_RATE
+#define AUDIO_I2S_SAMPLE_RATE   CONFIG_AUDIO_OUTPUT_SAMPLE_RATE
+#else
 #define AUDIO_I2S_SAMPLE_RATE   (16000)
+#endif
 #define AUDIO_I2S_BUFF_LEN      (4 * 1024)
 
-#define AUDIO_DMA_BUF_COUNT     2
-#define AUDIO_DMA_BUF_LEN       1024
+/* DMA buffers are installed once at init, sized for lowest latency.
+ * profiles get throughput from depth of PCM ring and size of writes. */
+#define AUDIO_DMA_BUF_COUNT     4
+#define AUDIO_DMA_BUF_LEN       128
+#define AUDIO_DMA_SIZE          (AUDIO_DMA_BUF_COUNT * AUDIO_DMA_BUF_LEN * 2)
 
 #define AUDIO_USE_INTERNAL_DAC  0
 #define AUDIO_USE_AMP           0
@@ -48,113 +65,612 @@
 #define AUDIO_AMP_EN_PIN    GPIO_NUM_26
 #endif
 
-#define DMA_SIZE    (AUDIO_DMA_BUF_COUNT * AUDIO_DMA_BUF_LEN)
+#ifdef CONFIG_AUDIO_RING_BUFFER_SIZE
+#define AUDIO_RING_BUFF_SIZE    CONFIG_AUDIO_RING_BUFFER_SIZE
+#else
+#define AUDIO_RING_BUFF_SIZE    (8 * 1024)
+#endif
+/* number of samples mixed at once */
+#define AUDIO_MIX_BLOCK         256
+/* number of input samples converted at once for resampling */
+#define AUDIO_PCM_CHUNK         512
+
+#if AUDIO_USE_INTERNAL_DAC
+/* DAC uses only highest 8bit data value. */
+#define AUDIO_MIXER_FORMAT      AUDIO_MIXER_OFFSET_BINARY
+#else
+#define AUDIO_MIXER_FORMAT      AUDIO_MIXER_SIGNED
+#endif
+
+#define AUDIO_RING_WAIT         (100 / portTICK_PERIOD_MS)
+
+/* event bit set while no audio is playing nor queued */
+#define AUDIO_IDLE_BIT          BIT0
 
 ESP_EVENT_DEFINE_BASE(AUDIO_EVENT);
 
 typedef struct {
-    bool playing;
-    bool stop;
-    QueueHandle_t queue;
-    TaskHandle_t task_handle;
-    uint8_t *read_buff;
-    uint8_t *i2s_write_buff;
-    uint32_t samplerate;
-} audio_task_t;
+    const char *name;
+    uint32_t write_chunk;   /* bytes passed to i2s_write at once */
+    uint32_t ring_limit;    /* bytes of PCM ring filled ahead */
+    int read_size;          /* bytes requested from audio data function at once */
+} audio_profile_conf_t;
+
+#define AUDIO_MIN(a, b)     ((a) < (b)? (a): (b))
+
+static const audio_profile_conf_t s_profiles[AUDIO_PROFILE_MAX] = {
+    [AUDIO_PROFILE_DEFAULT] = {
+        "default", AUDIO_DMA_SIZE,
+        AUDIO_RING_BUFF_SIZE, AUDIO_I2S_BUFF_LEN },
+    /* about 30msec of ring and DMA each */
+    [AUDIO_PROFILE_LOW_LATENCY] = {
+        "low_latency", AUDIO_DMA_BUF_LEN * 2,
+        AUDIO_MIN(1024, AUDIO_RING_BUFF_SIZE), 1024 },
+    /* writer wakes less often and deep ring rides out slow reads */
+    [AUDIO_PROFILE_THROUGHPUT] = {
+        "throughput", AUDIO_MIN(2 * AUDIO_DMA_SIZE, AUDIO_RING_BUFF_SIZE / 2),
+        AUDIO_RING_BUFF_SIZE, AUDIO_I2S_BUFF_LEN },
+};
+
+/* tone played by audio_beep or audio_play_melody */
+struct synth {
+    audio_melody_note_t note;
+    audio_melody_t melody;
+    audio_melody_player_t player;
+};
+
+/* beeps are played only on mix voices, melodies are usually alarms */
+AUDIO_POOL_DEFINE(synth_pool, struct synth, AUDIO_MIX_VOICES * 2)
 
 typedef struct {
     audio_data_func_t func;
+    audio_data_ptr_func_t ptr_func;
     void *arg;
     uint32_t samplerate;
     int channels;
     int bps;
+    int gain;
+    int64_t start_time;     /* time to start in usec, 0 to start as soon as possible */
+    int64_t queued_time;    /* time when queued in usec */
+    audio_profile_t profile;
+    SemaphoreHandle_t completion;   /* given when play is done, or NULL */
 } audio_item_t;
 
-static int audio_convert_8bit(int16_t* d_buff, uint8_t* s_buff, int size)
+typedef struct {
+    audio_item_t item;
+    audio_resample_t resample;
+    bool active;
+    bool last;          /* func returned last chunk */
+    uint32_t delay;     /* samples of silence before start */
+    const uint8_t *data;    /* buff or pointer returned by ptr_func */
+    uint8_t *buff;
+    int buff_size;
+    int pos;
+    int len;
+} audio_voice_t;
+
+typedef struct {
+    /* playing, pending and stop are changed with lock held.
+     * pending is counted before item is sent to queue. */
+    SemaphoreHandle_t lock;
+    EventGroupHandle_t events;
+    bool playing;       /* I2S is running */
+    uint32_t pending;   /* number of items not done yet */
+    bool stop;          /* stop requested. read by tasks without lock */
+    bool flush;         /* discard data in ring instead of writing to I2S */
+    bool producing;     /* producer may add more data to ring */
+    bool restarted;     /* output started at output_start. tells writer new session */
+    int64_t output_start;
+    uint32_t stall_time;    /* usec output stalled, added by writer and applied to sched by task */
+    QueueHandle_t queue;
+    QueueHandle_t mix_queue;
+    TaskHandle_t task_handle;
+    TaskHandle_t writer_handle;
+    /* voices[0] plays items in queue one by one, others play items in mix_queue. */
+    audio_voice_t voices[AUDIO_MIX_VOICES];
+    int32_t *mix_buff;
+    int16_t *pcm_buff;
+    audio_ring_t ring;
+    audio_sched_t sched;
+    uint64_t position;  /* samples output to ring since I2S started */
+    uint32_t underruns;
+    uint32_t ring_min_level;
+    uint32_t dma_min_level;
+    uint32_t dma_starvations;
+    uint32_t max_pending;
+    audio_histogram_t callback_time;
+    audio_histogram_t start_latency;
+    audio_profile_t profile;    /* profile output is configured for */
+    audio_profile_stats_t profile_stats[AUDIO_PROFILE_MAX];
+    int32_t schedule_error;
+    uint32_t late_starts;
+    int32_t stop_latency;
+} audio_task_t;
+
+static bool is_stopping(audio_task_t *task)
 {
-    int i, j;
-    for (i = 0, j = 0; i < size; i++, j++) {
-#if AUDIO_USE_INTERNAL_DAC
-        /* DAC uses only highest 8bit data value. */
-        d_buff[j] = (s_buff[i]<<8);
-#else
-        d_buff[j++] = s_buff[i]*257 - 0x8000;
-#endif
+    return __atomic_load_n(&task->stop, __ATOMIC_ACQUIRE);
+}
+
+/* set idle if nothing is playing nor queued. must be called with lock held. */
+static void update_idle(audio_task_t *task)
+{
+    if (!task->playing && task->pending == 0) {
+        /* stop requested by audio_stop is done, even if raised while last
+         * session was ending. it must not stop next session. */
+        __atomic_store_n(&task->stop, false, __ATOMIC_RELEASE);
+        __atomic_store_n(&task->flush, false, __ATOMIC_RELEASE);
+        xEventGroupSetBits(task->events, AUDIO_IDLE_BIT);
     }
-    return j*2;
 }
 
-static int audio_convert_16bit(int16_t* d_buff, int16_t* s_buff, int size)
+static uint32_t queued_items(audio_task_t *task)
 {
-    int i, j;
-    size /= 2;
-    for (i = 0, j = 0; i < size; i++, j++) {
-#if AUDIO_USE_INTERNAL_DAC
-        /* DAC uses only highest 8bit data value. */
-        d_buff[j] = s_buff[i] + 0x8000;
-#else
-        d_buff[j] = s_buff[i];
-#endif
+    return uxQueueMessagesWaiting(task->queue) + uxQueueMessagesWaiting(task->mix_queue);
+}
+
+/* true if item counted in pending is being sent to queue. no voice must be active. */
+static bool item_in_transit(audio_task_t *task)
+{
+    bool ret;
+    xSemaphoreTake(task->lock, portMAX_DELAY);
+    ret = task->pending > queued_items(task);
+    xSemaphoreGive(task->lock);
+    return ret;
+}
+
+/* notify play of item is done to its user. */
+static void item_done(audio_task_t *task, const audio_item_t *item)
+{
+    item->func(item->arg, NULL, NULL);
+    if (item->completion != NULL) {
+        xSemaphoreGive(item->completion);
+    }
+    xSemaphoreTake(task->lock, portMAX_DELAY);
+    task->pending--;
+    update_idle(task);
+    xSemaphoreGive(task->lock);
+}
+
+/* space of ring to write, up to ring limit of profile. */
+static uint32_t ring_space(audio_task_t *task, void **ptr)
+{
+    uint32_t space = audio_ring_write_ptr(&task->ring, ptr);
+    uint32_t used = audio_ring_used(&task->ring);
+    uint32_t limit = s_profiles[task->profile].ring_limit;
+    uint32_t room = used < limit? limit - used: 0;
+    return space < room? space: room;
+}
+
+static uint32_t wait_ring_space(audio_task_t *task, void **ptr)
+{
+    uint32_t space;
+    while ((space = ring_space(task, ptr)) == 0 && !is_stopping(task)) {
+        ulTaskNotifyTake(pdTRUE, AUDIO_RING_WAIT);
+    }
+    return space;
+}
+
+/* wait until writer consumes all data in ring. */
+static void drain_ring(audio_task_t *task)
+{
+    task->producing = false;
+    xTaskNotifyGive(task->writer_handle);
+    while (audio_ring_used(&task->ring) > 0) {
+        ulTaskNotifyTake(pdTRUE, AUDIO_RING_WAIT);
+    }
+}
+
+static void output_ring(audio_task_t *task, const int32_t *acc, int samples)
+{
+    while (samples > 0 && !is_stopping(task)) {
+        void *ptr;
+        int n = wait_ring_space(task, &ptr) / 2;
+        if (n == 0) {
+            break;
+        }
+        if (n > samples) {
+            n = samples;
+        }
+        audio_mixer_output((int16_t*)ptr, acc, n, AUDIO_MIXER_FORMAT);
+        audio_ring_write_commit(&task->ring, n*2);
+        xTaskNotifyGive(task->writer_handle);
+        acc += n;
+        samples -= n;
+    }
+}
+
+/* start item on voice. position is where in output stream the voice starts. */
+static void voice_start(audio_task_t *task, audio_voice_t *voice, const audio_item_t *item, uint64_t position)
+{
+    ESP_LOGV(TAG, "start item(%p)", item->arg);
+    voice->item = *item;
+    voice->delay = 0;
+    if (item->start_time != 0) {
+        int32_t error;
+        voice->delay = audio_sched_delay(&task->sched, position, item->start_time, &error);
+        task->schedule_error = error;
+        if (error > 1000000 / AUDIO_I2S_SAMPLE_RATE) {
+            task->late_starts++;
+        }
+        ESP_LOGD(TAG, "item(%p) starts after %u samples, error %d us", item->arg, voice->delay, error);
+    } else {
+        int64_t latency = audio_sched_time(&task->sched, position) - item->queued_time;
+        uint32_t value = latency > 0? (uint32_t)latency: 0;
+        audio_histogram_add(&task->start_latency, value);
+        audio_histogram_add(&task->profile_stats[task->profile].start_latency, value);
+    }
+    audio_resample_init(&voice->resample, item->samplerate, AUDIO_I2S_SAMPLE_RATE);
+    voice->active = true;
+    voice->last = false;
+    voice->pos = 0;
+    voice->len = 0;
+}
+
+static void voice_finish(audio_task_t *task, audio_voice_t *voice)
+{
+    voice->active = false;
+    item_done(task, &voice->item);
+    ESP_LOGV(TAG, "item(%p) done", voice->item.arg);
+}
+
+static bool voice_is_done(const audio_voice_t *voice)
+{
+    return voice->last && voice->len - voice->pos < voice->item.bps/8 * voice->item.channels;
+}
+
+/* convert and add samples of voice to acc. return number of added samples. */
+static int voice_mix(audio_task_t *task, audio_voice_t *voice, int32_t *acc, int samples)
+{
+    audio_item_t *item = &voice->item;
+    int bytes = item->bps / 8 * item->channels;
+    bool bypass = audio_resample_is_bypass(&voice->resample);
+    int mixed = 0;
+    while (mixed < samples) {
+        const uint8_t *src;
+        int64_t start;
+        int n;
+        if (voice->len - voice->pos < bytes) {
+            if (voice->last) {
+                break;
+            }
+            voice->pos = 0;
+            voice->len = AUDIO_MIN(voice->buff_size, s_profiles[task->profile].read_size);
+            start = esp_timer_get_time();
+            if (item->ptr_func != NULL) {
+                const void *ptr = NULL;
+                voice->last = item->ptr_func(item->arg, &ptr, &voice->len) == 0;
+                voice->data = ptr;
+            } else {
+                voice->last = item->func(item->arg, voice->buff, &voice->len) == 0;
+                voice->data = voice->buff;
+            }
+            audio_histogram_add(&task->callback_time, (uint32_t)(esp_timer_get_time() - start));
+            if (voice->len < bytes) {
+                /* no data available for now */
+                break;
+            }
+        }
+        n = (voice->len - voice->pos) / bytes;
+        src = voice->data + voice->pos;
+        if (bypass && item->channels == 1) {
+            /* same sampling rate. add directly from read buffer. */
+            if (n > samples - mixed) {
+                n = samples - mixed;
+            }
+            if (item->bps == 8) {
+                audio_mixer_add_8bit(acc + mixed, src, n, item->gain);
+            } else {
+                audio_mixer_add_16bit(acc + mixed, (const int16_t*)src, n, item->gain);
+            }
+            voice->pos += n * bytes;
+            mixed += n;
+            continue;
+        }
+        if (n > AUDIO_PCM_CHUNK) {
+            n = AUDIO_PCM_CHUNK;
+        }
+        if (bypass && n > samples - mixed) {
+            n = samples - mixed;
+        }
+        /* downmix and convert to 16bit in one pass */
+        if (item->bps == 8) {
+            audio_convert_8bit(task->pcm_buff, src, n, item->channels);
+        } else {
+            audio_convert_16bit(task->pcm_buff, (const int16_t*)src, n, item->channels);
+        }
+        if (bypass) {
+            audio_mixer_add_16bit(acc + mixed, task->pcm_buff, n, item->gain);
+            voice->pos += n * bytes;
+            mixed += n;
+        } else {
+            int consumed;
+            mixed += audio_resample_mix(&voice->resample, acc + mixed, samples - mixed,
+                task->pcm_buff, n, &consumed, item->gain);
+            voice->pos += consumed * bytes;
+        }
     }
-    return j*2;
+    return mixed;
 }
 
-static void play_task(audio_task_t *task)
+static bool has_mix_voice(audio_task_t *task)
+{
+    int i;
+    for (i = 1; i < AUDIO_MIX_VOICES; i++) {
+        if (task->voices[i].active) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* start next item in queue on main voice.
+ * item of other profile is left in queue, so that output restarts for it. */
+static void start_main_voice(audio_task_t *task, uint64_t position)
 {
-    uint8_t *read_buff = task->read_buff;
-    uint8_t *i2s_write_buff = task->i2s_write_buff;
-    int length;
     audio_item_t item;
-    bool item_done = false;
+    if (xQueuePeek(task->queue, &item, 0) == pdTRUE && item.profile == task->profile &&
+        xQueueReceive(task->queue, &item, 0) == pdTRUE) {
+        voice_start(task, &task->voices[0], &item, position);
+    }
+}
 
-    if (xQueuePeek(task->queue, &item, 0) != pdTRUE) {
-        ESP_LOGV(TAG, "no item");
-        task->stop = true;
+/* start items in mix_queue on free voices. */
+static void start_mix_voices(audio_task_t *task)
+{
+    audio_item_t item;
+    int i;
+    for (i = 1; i < AUDIO_MIX_VOICES; i++) {
+        if (task->voices[i].active) {
+            continue;
+        }
+        if (xQueueReceive(task->mix_queue, &item, 0) != pdTRUE) {
+            break;
+        }
+        voice_start(task, &task->voices[i], &item, task->position);
+    }
+}
+
+/* shift timeline by time output stalled, as following samples are played later by it.
+ * silence before scheduled audio is shortened, so audio still starts on time. */
+static void sched_stall(audio_task_t *task)
+{
+    uint32_t gap = __atomic_exchange_n(&task->stall_time, 0, __ATOMIC_ACQ_REL);
+    uint32_t samples;
+    int i;
+    if (gap == 0) {
         return;
     }
-    length = AUDIO_I2S_BUFF_LEN;
-    ESP_LOGV(TAG, "read item(%p)", item.arg);
-    if (item.func(item.arg, read_buff, &length) == 0) {
-        /* remove item from queue */
-        xQueueReceive(task->queue, &item, 0);
-        item_done = true;
-    }
-    if (length > 0) {
-        ESP_LOGV(TAG, "item(%p): %d", item.arg, length);
-        int offset = 0;
-        if (task->samplerate != item.samplerate) {
-            ESP_LOGV(TAG, "play task: change samplerate: %d -> %d", task->samplerate, item.samplerate);
-            task->samplerate = item.samplerate;
-            i2s_set_sample_rates(AUDIO_I2S_NUM, task->samplerate);
-        }
-        ESP_LOGV(TAG, "play start");
-        while (!task->stop && offset < length) {
-            int size = (length - offset) < DMA_SIZE ? (length - offset) : DMA_SIZE;
-            size_t i2s_write_len;
-            if (item.bps == 8) {
-                i2s_write_len = audio_convert_8bit((int16_t*)i2s_write_buff, (read_buff + offset), size);
-            } else {
-                i2s_write_len = audio_convert_16bit((int16_t*)i2s_write_buff, (int16_t*)(read_buff + offset), size);
+    ESP_LOGD(TAG, "output stalled %u us", gap);
+    audio_sched_shift(&task->sched, gap);
+    samples = (uint64_t)gap * AUDIO_I2S_SAMPLE_RATE / 1000000;
+    for (i = 0; i < AUDIO_MIX_VOICES; i++) {
+        audio_voice_t *voice = &task->voices[i];
+        if (!voice->active || voice->delay == 0) {
+            continue;
+        }
+        if (voice->delay >= samples) {
+            voice->delay -= samples;
+            continue;
+        }
+        /* silence already output is not enough to absorb gap */
+        if (task->schedule_error <= 1000000 / AUDIO_I2S_SAMPLE_RATE) {
+            task->late_starts++;
+        }
+        task->schedule_error += (int64_t)(samples - voice->delay) * 1000000 / AUDIO_I2S_SAMPLE_RATE;
+        voice->delay = 0;
+    }
+}
+
+/* mix one block and output it. return false if there is nothing to play. */
+static bool mix_task(audio_task_t *task)
+{
+    audio_voice_t *main_voice = &task->voices[0];
+    int32_t *acc = task->mix_buff;
+    int samples = 0;
+    bool mixing;
+    int i;
+
+    sched_stall(task);
+    start_mix_voices(task);
+    mixing = has_mix_voice(task);
+    if (!main_voice->active) {
+        start_main_voice(task, task->position);
+    }
+    if (!main_voice->active && !mixing) {
+        ESP_LOGV(TAG, "no item");
+        return false;
+    }
+
+    memset(acc, 0, AUDIO_MIX_BLOCK * sizeof(*acc));
+    while (main_voice->active && samples < AUDIO_MIX_BLOCK) {
+        if (main_voice->delay > 0) {
+            /* silence until scheduled time */
+            int n = AUDIO_MIX_BLOCK - samples;
+            if ((uint32_t)n > main_voice->delay) {
+                n = main_voice->delay;
             }
-            i2s_write(AUDIO_I2S_NUM, i2s_write_buff, i2s_write_len, &i2s_write_len, portMAX_DELAY);
-            offset += size;
+            main_voice->delay -= n;
+            samples += n;
+            continue;
+        }
+        samples += voice_mix(task, main_voice, acc + samples, AUDIO_MIX_BLOCK - samples);
+        if (!voice_is_done(main_voice)) {
+            break;
         }
-        ESP_LOGV(TAG, "play done");
+        voice_finish(task, main_voice);
+        /* continue to next item without gap */
+        start_main_voice(task, task->position + samples);
     }
-    if (item_done) {
-        item.func(item.arg, NULL, NULL);
-        ESP_LOGV(TAG, "item(%p) done", item.arg);
+    if (mixing) {
+        samples = AUDIO_MIX_BLOCK;
+        for (i = 1; i < AUDIO_MIX_VOICES; i++) {
+            audio_voice_t *voice = &task->voices[i];
+            int offset;
+            if (!voice->active) {
+                continue;
+            }
+            offset = voice->delay < AUDIO_MIX_BLOCK? voice->delay: AUDIO_MIX_BLOCK;
+            voice->delay -= offset;
+            if (offset == AUDIO_MIX_BLOCK) {
+                continue;
+            }
+            voice_mix(task, voice, acc + offset, samples - offset);
+            if (voice_is_done(voice)) {
+                voice_finish(task, voice);
+            }
+        }
     }
+    output_ring(task, acc, samples);
+    task->position += samples;
+    return true;
 }
 
-static void audio_task(void *arg)
+static int64_t bytes_to_usec(uint32_t bytes)
+{
+    return (int64_t)bytes / 2 * 1000000 / AUDIO_I2S_SAMPLE_RATE;
+}
+
+static uint32_t usec_to_bytes(int64_t usec)
+{
+    return (uint32_t)(usec * AUDIO_I2S_SAMPLE_RATE / 1000000) * 2;
+}
+
+static void writer_task(void *arg)
 {
     audio_task_t *task = (audio_task_t*)arg;
+    bool primed = false;
+    /* estimated time when DMA plays out data written so far */
+    int64_t dma_end = 0;
+
+    while (1) {
+        const audio_profile_conf_t *conf;
+        audio_profile_stats_t *stats;
+        const void *ptr;
+        uint32_t length, level;
+        size_t written;
+        int64_t now;
+
+        conf = &s_profiles[task->profile];
+        stats = &task->profile_stats[task->profile];
+        level = audio_ring_used(&task->ring);
+        if (primed && task->producing && level < task->ring_min_level) {
+            task->ring_min_level = level;
+        }
+        length = audio_ring_read_ptr(&task->ring, &ptr);
+        /* checked after ring, as it is set before data of new session is written */
+        if (__atomic_exchange_n(&task->restarted, false, __ATOMIC_ACQ_REL)) {
+            /* DMA plays zeroed buffers first */
+            primed = false;
+            dma_end = task->output_start + bytes_to_usec(AUDIO_DMA_SIZE);
+        }
+        if (length == 0) {
+            if (primed && task->producing) {
+                task->underruns++;
+                stats->underruns++;
+                ESP_LOGV(TAG, "writer: underrun");
+            }
+            primed = false;
+            xTaskNotifyGive(task->task_handle);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (__atomic_load_n(&task->flush, __ATOMIC_ACQUIRE)) {
+            audio_ring_read_commit(&task->ring, length);
+            continue;
+        }
+        if (length > conf->write_chunk) {
+            length = conf->write_chunk;
+        }
+        now = esp_timer_get_time();
+        if (dma_end < now) {
+            if (primed) {
+                task->dma_starvations++;
+                stats->dma_starvations++;
+                ESP_LOGV(TAG, "writer: DMA starved");
+            }
+            /* output stopped until now after underrun or starvation */
+            __atomic_add_fetch(&task->stall_time, (uint32_t)(now - dma_end), __ATOMIC_ACQ_REL);
+            dma_end = now;
+        } else if (primed && usec_to_bytes(dma_end - now) < task->dma_min_level) {
+            task->dma_min_level = usec_to_bytes(dma_end - now);
+        }
+        i2s_write(AUDIO_I2S_NUM, ptr, length, &written, portMAX_DELAY);
+        audio_ring_read_commit(&task->ring, written);
+        /* DMA cannot hold more than its buffers */
+        dma_end += bytes_to_usec(written);
+        now = esp_timer_get_time() + bytes_to_usec(AUDIO_DMA_SIZE);
+        if (dma_end > now) {
+            dma_end = now;
+        }
+        primed = true;
+        xTaskNotifyGive(task->task_handle);
+    }
+}
+
+static esp_err_t install_i2s(void)
+{
+    esp_err_t err;
+    i2s_config_t i2s_config = {
+        .mode = I2S_MODE_MASTER | I2S_MODE_TX
+#if AUDIO_USE_INTERNAL_DAC
+                    | I2S_MODE_DAC_BUILT_IN
+#else
+                    | I2S_MODE_PDM
+#endif
+        ,
+        .sample_rate =  AUDIO_I2S_SAMPLE_RATE,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .communication_format =
+#if AUDIO_USE_INTERNAL_DAC
+            I2S_COMM_FORMAT_I2S_MSB
+#else
+            I2S_COMM_FORMAT_PCM
+#endif
+        ,
+        .channel_format = I2S_CHANNEL_FMT_ONLY_RIGHT,
+        .intr_alloc_flags = 0,
+        .dma_buf_count = AUDIO_DMA_BUF_COUNT,
+        .dma_buf_len = AUDIO_DMA_BUF_LEN,
+    };
+    err = i2s_driver_install(AUDIO_I2S_NUM, &i2s_config, 0, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+#if AUDIO_USE_INTERNAL_DAC
+    /* init DAC pad */
+    i2s_set_dac_mode(I2S_DAC_CHANNEL_RIGHT_EN);
+#endif
+    return ESP_OK;
+}
+
+/* profile of next item. main queue has priority as mixed items join any profile. */
+static audio_profile_t next_profile(audio_task_t *task)
+{
     audio_item_t item;
+    if (xQueuePeek(task->queue, &item, 0) == pdTRUE ||
+        xQueuePeek(task->mix_queue, &item, 0) == pdTRUE) {
+        return item.profile;
+    }
+    return task->profile;
+}
+
+/* select profile of session. DMA buffers stay as installed, so no heap is used. */
+static void set_profile(audio_task_t *task, audio_profile_t profile)
+{
+    if (profile == task->profile) {
+        return;
+    }
+    ESP_LOGD(TAG, "profile %s -> %s", s_profiles[task->profile].name, s_profiles[profile].name);
+    task->profile = profile;
+}
 
-    task->read_buff = malloc(AUDIO_I2S_BUFF_LEN);
-    task->i2s_write_buff = malloc(DMA_SIZE);
-    task->samplerate = AUDIO_I2S_SAMPLE_RATE;
+static void audio_task(void *arg)
+{
+    audio_task_t *task = (audio_task_t*)arg;
+    audio_item_t item;
+    bool stopped;
+    int i;
 
     while (1) {
 #if AUDIO_USE_AMP
@@ -162,17 +678,26 @@ static void audio_task(void *arg)
         gpio_set_direction(AUDIO_AMP_EN_PIN, GPIO_MODE_OUTPUT);
 #endif
         i2s_stop(AUDIO_I2S_NUM);
-        task->playing = false;
 #if !AUDIO_USE_INTERNAL_DAC
         gpio_set_level(AUDIO_OUT_PIN, 0);
         gpio_set_direction(AUDIO_OUT_PIN, GPIO_MODE_DISABLE);
 #endif
-        while (task->stop) {
-            ESP_LOGV(TAG, "play task: stopping");
-            vTaskSuspend(NULL);
+        xSemaphoreTake(task->lock, portMAX_DELAY);
+        task->playing = false;
+        update_idle(task);
+        /* wait for item itself, not only its count, so that no empty session is run */
+        while (task->pending == 0 || queued_items(task) == 0) {
+            ESP_LOGV(TAG, "play task: idle");
+            xSemaphoreGive(task->lock);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            xSemaphoreTake(task->lock, portMAX_DELAY);
         }
         task->playing = true;
+        xEventGroupClearBits(task->events, AUDIO_IDLE_BIT);
+        xSemaphoreGive(task->lock);
         esp_event_post(AUDIO_EVENT, AUDIO_EVENT_STARTED, NULL, 0, 0);
+        set_profile(task, next_profile(task));
+        task->profile_stats[task->profile].sessions++;
 #if !AUDIO_USE_INTERNAL_DAC
         gpio_set_direction(AUDIO_OUT_PIN, GPIO_MODE_OUTPUT);
         i2s_pin_config_t pin_config = {
@@ -185,64 +710,105 @@ static void audio_task(void *arg)
 #endif
         i2s_zero_dma_buffer(AUDIO_I2S_NUM);
         i2s_start(AUDIO_I2S_NUM);
+        /* zeroed DMA buffers are played before first sample */
+        task->position = 0;
+        task->output_start = esp_timer_get_time();
+        audio_sched_start(&task->sched, AUDIO_I2S_SAMPLE_RATE, task->output_start,
+            AUDIO_DMA_BUF_COUNT * AUDIO_DMA_BUF_LEN);
+        __atomic_store_n(&task->stall_time, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&task->restarted, true, __ATOMIC_RELEASE);
 #if AUDIO_USE_AMP
         gpio_set_level(AUDIO_AMP_EN_PIN, 0);
 #endif
-        while (!task->stop) {
-            play_task(task);
+        task->producing = true;
+        while (!is_stopping(task)) {
+            if (mix_task(task)) {
+                continue;
+            }
+            if (!item_in_transit(task)) {
+                break;
+            }
+            /* keep output running for item being queued by audio_play_ex */
+            ulTaskNotifyTake(pdTRUE, 1);
         }
+        /* let writer finish (or discard when stopped) remaining data */
+        drain_ring(task);
+        xSemaphoreTake(task->lock, portMAX_DELAY);
+        stopped = task->stop;
+        task->stop = false;
+        __atomic_store_n(&task->flush, false, __ATOMIC_RELEASE);
+        xSemaphoreGive(task->lock);
         /* release resources */
-        while (xQueueReceive(task->queue, &item, 0) == pdTRUE) {
+        for (i = 0; i < AUDIO_MIX_VOICES; i++) {
+            if (task->voices[i].active) {
+                voice_finish(task, &task->voices[i]);
+            }
+        }
+        /* items queued after last block are played in next round unless stopped */
+        while (stopped && xQueueReceive(task->queue, &item, 0) == pdTRUE) {
+            ESP_LOGV(TAG, "fill task: discard item(%p)", item.arg);
+            item_done(task, &item);
+        }
+        while (stopped && xQueueReceive(task->mix_queue, &item, 0) == pdTRUE) {
             ESP_LOGV(TAG, "fill task: discard item(%p)", item.arg);
-            item.func(item.arg, NULL, NULL);
+            item_done(task, &item);
         }
         esp_event_post(AUDIO_EVENT, AUDIO_EVENT_STOPPED, NULL, 0, 0);
     }
-    free(task->read_buff);
-    free(task->i2s_write_buff);
     vTaskDelete(NULL);
 }
 
+/* allocate all buffers used while playing, so that no heap is used after init. */
+static esp_err_t alloc_buffers(audio_task_t *task)
+{
+    int i;
+    for (i = 0; i < AUDIO_MIX_VOICES; i++) {
+        audio_voice_t *voice = &task->voices[i];
+        voice->active = false;
+        voice->buff_size = i == 0? AUDIO_I2S_BUFF_LEN: AUDIO_MIX_BLOCK * 2;
+        voice->buff = malloc(voice->buff_size);
+        if (voice->buff == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    task->mix_buff = malloc(AUDIO_MIX_BLOCK * sizeof(*task->mix_buff));
+    task->pcm_buff = malloc(AUDIO_PCM_CHUNK * sizeof(*task->pcm_buff));
+    if (task->mix_buff == NULL || task->pcm_buff == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/* free buffers allocated by alloc_buffers, even partially. */
+static void free_buffers(audio_task_t *task)
+{
+    int i;
+    for (i = 0; i < AUDIO_MIX_VOICES; i++) {
+        free(task->voices[i].buff);
+        task->voices[i].buff = NULL;
+    }
+    free(task->mix_buff);
+    task->mix_buff = NULL;
+    free(task->pcm_buff);
+    task->pcm_buff = NULL;
+}
+
 static audio_task_t s_audio_task;
 static bool s_audio_initialized = false;
 
 esp_err_t audio_init(void)
 {
+    uint8_t *ring_buff = NULL;
     esp_err_t err;
     if (s_audio_initialized) {
         return ESP_OK;
     }
-    i2s_config_t i2s_config = {
-        .mode = I2S_MODE_MASTER | I2S_MODE_TX
-#if AUDIO_USE_INTERNAL_DAC
-                    | I2S_MODE_DAC_BUILT_IN
-#else
-                    | I2S_MODE_PDM
-#endif
-        ,
-        .sample_rate =  AUDIO_I2S_SAMPLE_RATE,
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
-        .communication_format =
-#if AUDIO_USE_INTERNAL_DAC
-            I2S_COMM_FORMAT_I2S_MSB
-#else
-            I2S_COMM_FORMAT_PCM
-#endif
-        ,
-        .channel_format = I2S_CHANNEL_FMT_ONLY_RIGHT,
-        .intr_alloc_flags = 0,
-        .dma_buf_count = AUDIO_DMA_BUF_COUNT,
-        .dma_buf_len = AUDIO_DMA_BUF_LEN,
-    };
     /* install and start i2s driver */
-    err = i2s_driver_install(AUDIO_I2S_NUM, &i2s_config, 0, NULL);
+    err = install_i2s();
     if (err != ESP_OK) {
         return err;
     }
-#if AUDIO_USE_INTERNAL_DAC
-    /* init DAC pad */
-    i2s_set_dac_mode(I2S_DAC_CHANNEL_RIGHT_EN);
-#else
+#if !AUDIO_USE_INTERNAL_DAC
     gpio_set_level(AUDIO_OUT_PIN, 0);
     gpio_set_direction(AUDIO_OUT_PIN, GPIO_MODE_DISABLE);
 #endif
@@ -253,135 +819,319 @@ esp_err_t audio_init(void)
 
     /* 何をしたいのか分からなくなってきた。 */
     s_audio_task.playing = false;
-    s_audio_task.stop = true;
-    s_audio_task.queue = xQueueCreate(10, sizeof(audio_item_t));
+    s_audio_task.pending = 0;
+    s_audio_task.stop = false;
+    s_audio_task.flush = false;
+    s_audio_task.producing = false;
+    s_audio_task.underruns = 0;
+    s_audio_task.ring_min_level = AUDIO_RING_BUFF_SIZE;
+    s_audio_task.dma_min_level = AUDIO_DMA_SIZE;
+    s_audio_task.profile = AUDIO_PROFILE_DEFAULT;
+    s_audio_task.schedule_error = 0;
+    s_audio_task.late_starts = 0;
+    s_audio_task.stop_latency = 0;
+    s_audio_task.lock = xSemaphoreCreateMutex();
+    s_audio_task.events = xEventGroupCreate();
+    if (s_audio_task.lock == NULL || s_audio_task.events == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto end;
+    }
+    xEventGroupSetBits(s_audio_task.events, AUDIO_IDLE_BIT);
+    err = alloc_buffers(&s_audio_task);
+    if (err != ESP_OK) {
+        goto end;
+    }
+    ring_buff = malloc(AUDIO_RING_BUFF_SIZE);
+    if (ring_buff == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto end;
+    }
+    if (audio_ring_init(&s_audio_task.ring, ring_buff, AUDIO_RING_BUFF_SIZE) != 0) {
+        ESP_LOGE(TAG, "ring buffer size must be power of 2: %d", AUDIO_RING_BUFF_SIZE);
+        err = ESP_ERR_INVALID_SIZE;
+        goto end;
+    }
+    s_audio_task.queue = xQueueCreate(AUDIO_QUEUE_LENGTH, sizeof(audio_item_t));
+    s_audio_task.mix_queue = xQueueCreate(AUDIO_MIX_VOICES, sizeof(audio_item_t));
+    if (s_audio_task.queue == NULL || s_audio_task.mix_queue == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto end;
+    }
     if (xTaskCreate(audio_task, "audio_task", 8 * 1024, &s_audio_task, 1, &s_audio_task.task_handle) != pdTRUE) {
-        vQueueDelete(s_audio_task.queue);
-        return ESP_ERR_NO_MEM;
+        err = ESP_ERR_NO_MEM;
+        goto end;
+    }
+    /* writer has higher priority than audio_task to keep DMA buffers filled */
+    if (xTaskCreate(writer_task, "audio_writer", 3 * 1024, &s_audio_task, 2, &s_audio_task.writer_handle) != pdTRUE) {
+        vTaskDelete(s_audio_task.task_handle);
+        err = ESP_ERR_NO_MEM;
+        goto end;
     }
     s_audio_initialized = true;
     return ESP_OK;
+
+end:
+    /* undo everything, so that init can be tried again */
+    if (s_audio_task.mix_queue != NULL) {
+        vQueueDelete(s_audio_task.mix_queue);
+        s_audio_task.mix_queue = NULL;
+    }
+    if (s_audio_task.queue != NULL) {
+        vQueueDelete(s_audio_task.queue);
+        s_audio_task.queue = NULL;
+    }
+    free(ring_buff);
+    free_buffers(&s_audio_task);
+    if (s_audio_task.events != NULL) {
+        vEventGroupDelete(s_audio_task.events);
+        s_audio_task.events = NULL;
+    }
+    if (s_audio_task.lock != NULL) {
+        vSemaphoreDelete(s_audio_task.lock);
+        s_audio_task.lock = NULL;
+    }
+    i2s_driver_uninstall(AUDIO_I2S_NUM);
+    return err;
 }
 
 void audio_stop(void)
 {
+    int64_t start;
+    bool busy;
     if (!s_audio_initialized) {
         return;
     }
-    if (s_audio_task.playing) {
-        s_audio_task.stop = true;
+    start = esp_timer_get_time();
+    xSemaphoreTake(s_audio_task.lock, portMAX_DELAY);
+    busy = s_audio_task.playing || s_audio_task.pending > 0;
+    if (busy) {
+        __atomic_store_n(&s_audio_task.flush, true, __ATOMIC_RELEASE);
+        __atomic_store_n(&s_audio_task.stop, true, __ATOMIC_RELEASE);
+    }
+    xSemaphoreGive(s_audio_task.lock);
+    if (busy) {
+        xTaskNotifyGive(s_audio_task.task_handle);
         audio_wait();
+        s_audio_task.stop_latency = esp_timer_get_time() - start;
+        ESP_LOGD(TAG, "stopped in %d us", s_audio_task.stop_latency);
     }
 }
 
-void audio_wait(void)
+esp_err_t audio_wait_timeout(int timeout)
 {
+    TickType_t ticks = timeout < 0? portMAX_DELAY: timeout / portTICK_PERIOD_MS;
+    EventBits_t bits;
     if (!s_audio_initialized) {
-        return;
-    }
-    while (s_audio_task.playing) {
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        return ESP_OK;
     }
+    bits = xEventGroupWaitBits(s_audio_task.events, AUDIO_IDLE_BIT, pdFALSE, pdTRUE, ticks);
+    return (bits & AUDIO_IDLE_BIT)? ESP_OK: ESP_ERR_TIMEOUT;
+}
+
+void audio_wait(void)
+{
+    audio_wait_timeout(-1);
 }
 
 bool audio_is_playing(void)
 {
-    return s_audio_initialized && s_audio_task.playing;
+    return s_audio_initialized &&
+        (xEventGroupGetBits(s_audio_task.events) & AUDIO_IDLE_BIT) == 0;
 }
 
-#define BEEP_V  0x7fff
-#define BEEP_S  15
+audio_completion_t audio_completion_create(void)
+{
+    return (audio_completion_t)xSemaphoreCreateBinary();
+}
 
-struct beep {
-    int length;
-    int cycle;
-    int count;
-    int x, y, c, s;
-};
+void audio_completion_delete(audio_completion_t completion)
+{
+    vSemaphoreDelete((SemaphoreHandle_t)completion);
+}
 
-static int audio_beep_data_func(void *arg, void *data, int *size)
+esp_err_t audio_completion_wait(audio_completion_t completion, int timeout)
+{
+    TickType_t ticks = timeout < 0? portMAX_DELAY: timeout / portTICK_PERIOD_MS;
+    if (xSemaphoreTake((SemaphoreHandle_t)completion, ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+void audio_get_stats(audio_stats_t *stats)
 {
-    struct beep *beep = (struct beep*)arg;
-    int16_t *pdata = (int16_t *)data;
-    int x0, y0;
     int i;
+    stats->ring_size = AUDIO_RING_BUFF_SIZE;
+    stats->ring_min_level = s_audio_task.ring_min_level;
+    stats->underruns = s_audio_task.underruns;
+    stats->schedule_error = s_audio_task.schedule_error;
+    stats->late_starts = s_audio_task.late_starts;
+    stats->stop_latency = s_audio_task.stop_latency;
+    audio_pool_get_stats(&synth_pool, &stats->beeps);
+    stats->dma_size = AUDIO_DMA_SIZE;
+    stats->dma_min_level = s_audio_task.dma_min_level;
+    stats->dma_starvations = s_audio_task.dma_starvations;
+    stats->queue_depth = s_audio_task.pending;
+    stats->queue_max_depth = s_audio_task.max_pending;
+    stats->callback_time = s_audio_task.callback_time;
+    stats->start_latency = s_audio_task.start_latency;
+    stats->profile = s_audio_task.profile;
+    for (i = 0; i < AUDIO_PROFILE_MAX; i++) {
+        const audio_profile_conf_t *conf = &s_profiles[i];
+        stats->profiles[i] = s_audio_task.profile_stats[i];
+        stats->profiles[i].latency = bytes_to_usec(conf->ring_limit + AUDIO_DMA_SIZE);
+    }
+}
+
+void audio_reset_stats(void)
+{
+    s_audio_task.ring_min_level = AUDIO_RING_BUFF_SIZE;
+    s_audio_task.underruns = 0;
+    s_audio_task.schedule_error = 0;
+    s_audio_task.late_starts = 0;
+    s_audio_task.dma_min_level = AUDIO_DMA_SIZE;
+    s_audio_task.dma_starvations = 0;
+    s_audio_task.max_pending = s_audio_task.pending;
+    memset(&s_audio_task.callback_time, 0, sizeof(s_audio_task.callback_time));
+    memset(&s_audio_task.start_latency, 0, sizeof(s_audio_task.start_latency));
+    memset(s_audio_task.profile_stats, 0, sizeof(s_audio_task.profile_stats));
+}
+
+const char *audio_profile_name(audio_profile_t profile)
+{
+    if (profile < 0 || profile >= AUDIO_PROFILE_MAX) {
+        return "unknown";
+    }
+    return s_profiles[profile].name;
+}
+
+static int audio_synth_data_func(void *arg, void *data, int *size)
+{
+    struct synth *synth = (struct synth*)arg;
     if (data == NULL && size == NULL) {
-        free(beep);
+        synth_pool_release(synth);
         return 0;
     }
-    for (i = 0; i < *size; i+=2) {
-        *pdata++ = beep->y>>3;
-        x0 = beep->x, y0 = beep->y;
-        beep->x = (x0*beep->c - y0*beep->s)>>BEEP_S;
-        beep->y = (x0*beep->s + y0*beep->c)>>BEEP_S;
-        if (--beep->count <= 0) {
-            if (--beep->cycle < 0) {
-                break;
-            }
-            beep->count += beep->length;
-            beep->x = BEEP_V-1;
-            beep->y = 0;
-        }
-    }
-    *size = i;
-    return beep->count > 0;
+    *size = audio_melody_render(&synth->player, (int16_t*)data, *size/2) * 2;
+    return !audio_melody_finished(&synth->player);
 }
 
 void audio_beep(int frequency, int duration)
 {
-    struct beep *beep;
+    /* key clicks should sound without pipeline delay */
+    audio_play_opts_t opts = {
+        .gain = AUDIO_GAIN_UNITY,
+        .profile = AUDIO_PROFILE_LOW_LATENCY,
+    };
+    struct synth *synth;
     if (!s_audio_initialized) {
         return;
     }
-    beep = malloc(sizeof(struct beep));
-    if (frequency == 0) {
-        beep->length = AUDIO_I2S_SAMPLE_RATE;
-        beep->cycle = duration/1000;
-        beep->count = duration%1000;
-        beep->x = 0;
-        beep->y = 0;
-        beep->c = 0;
-        beep->s = 0;
-    } else {
-        float angle = (float)(frequency*2*M_PI)/AUDIO_I2S_SAMPLE_RATE, c, s;
-        sincosf(angle, &s, &c);
-        beep->length = AUDIO_I2S_SAMPLE_RATE*4/frequency;
-        beep->cycle = (duration*AUDIO_I2S_SAMPLE_RATE/1000+beep->length)/beep->length;
-        beep->count = 0;
-        beep->x = BEEP_V;
-        beep->y = 0;
-        beep->c = (int)(BEEP_V*c+0.5f);
-        beep->s = (int)(BEEP_V*s+0.5f);
+    synth = synth_pool_acquire();
+    if (synth == NULL) {
+        ESP_LOGW(TAG, "too many beeps");
+        return;
+    }
+    synth->note.frequency = frequency;
+    synth->note.duration = duration;
+    synth->note.envelope = AUDIO_ENV_FLAT;
+    /* 1/8 of full scale */
+    synth->note.volume = 32;
+    synth->melody.notes = &synth->note;
+    synth->melody.count = 1;
+    synth->melody.wave = AUDIO_WAVE_SINE;
+    synth->melody.repeat = 1;
+    audio_melody_start(&synth->player, &synth->melody, AUDIO_I2S_SAMPLE_RATE);
+    ESP_LOGV(TAG, "add beep item(%p)", synth);
+    audio_play_ex(audio_synth_data_func, (void*)synth,
+        AUDIO_I2S_SAMPLE_RATE, 1, 16, AUDIO_MIX, &opts);
+}
+
+void audio_play_melody(const audio_melody_t *melody, audio_queue_mode_t mode)
+{
+    struct synth *synth;
+    if (!s_audio_initialized) {
+        return;
     }
-    ESP_LOGV(TAG, "add beep item(%p)", beep);
-    audio_play(audio_beep_data_func, (void*)beep,
-        AUDIO_I2S_SAMPLE_RATE, 1, 16, AUDIO_IMMEDIATE);
+    synth = synth_pool_acquire();
+    if (synth == NULL) {
+        ESP_LOGW(TAG, "too many melodies");
+        return;
+    }
+    audio_melody_start(&synth->player, melody, AUDIO_I2S_SAMPLE_RATE);
+    ESP_LOGV(TAG, "add melody item(%p)", synth);
+    audio_play(audio_synth_data_func, (void*)synth,
+        AUDIO_I2S_SAMPLE_RATE, 1, 16, mode);
 }
 
 void audio_play(audio_data_func_t func, void *arg,
     int samplerate, int channels, int bits,
     audio_queue_mode_t mode)
+{
+    audio_play_ex(func, arg, samplerate, channels, bits, mode, NULL);
+}
+
+void audio_play_ex(audio_data_func_t func, void *arg,
+    int samplerate, int channels, int bits,
+    audio_queue_mode_t mode, const audio_play_opts_t *opts)
 {
     if (!s_audio_initialized) {
         func(arg, NULL, NULL);
+        if (opts != NULL && opts->completion != NULL) {
+            xSemaphoreGive((SemaphoreHandle_t)opts->completion);
+        }
         return;
     }
     audio_item_t item = {
         .func = func,
+        .ptr_func = NULL,
         .arg = arg,
         .samplerate = samplerate,
         .channels = channels,
         .bps = bits,
+        .gain = AUDIO_GAIN_UNITY,
+        .start_time = 0,
+        .queued_time = esp_timer_get_time(),
+        .completion = NULL,
+        .profile = AUDIO_PROFILE_DEFAULT,
     };
+    if (opts != NULL) {
+        item.gain = opts->gain < 0? 0:
+            opts->gain > AUDIO_MIXER_MAX_GAIN? AUDIO_MIXER_MAX_GAIN: opts->gain;
+        item.ptr_func = opts->data_ptr_func;
+        item.start_time = opts->start_time;
+        item.completion = (SemaphoreHandle_t)opts->completion;
+        if (opts->profile > AUDIO_PROFILE_DEFAULT && opts->profile < AUDIO_PROFILE_MAX) {
+            item.profile = opts->profile;
+        }
+    }
     if (mode == AUDIO_REPLACE) {
         audio_stop();
     }
     ESP_LOGV(TAG, "add play item(%p)", item.arg);
-    if (mode == AUDIO_IMMEDIATE) {
+    xSemaphoreTake(s_audio_task.lock, portMAX_DELAY);
+    s_audio_task.pending++;
+    if (s_audio_task.pending > s_audio_task.max_pending) {
+        s_audio_task.max_pending = s_audio_task.pending;
+    }
+    xEventGroupClearBits(s_audio_task.events, AUDIO_IDLE_BIT);
+    xSemaphoreGive(s_audio_task.lock);
+    if (mode == AUDIO_MIX) {
+        xQueueSendToBack(s_audio_task.mix_queue, &item, portMAX_DELAY);
+    } else if (mode == AUDIO_IMMEDIATE) {
         xQueueSendToFront(s_audio_task.queue, &item, portMAX_DELAY);
     } else {
         xQueueSendToBack(s_audio_task.queue, &item, portMAX_DELAY);
     }
-    s_audio_task.stop = false;
-    vTaskResume(s_audio_task.task_handle);
+    xTaskNotifyGive(s_audio_task.task_handle);
+}
+
+void audio_play_at(audio_data_func_t func, void *arg,
+    int samplerate, int channels, int bits, int64_t time)
+{
+    audio_play_opts_t opts = {
+        .gain = AUDIO_GAIN_UNITY,
+        .start_time = time,
+    };
+    audio_play_ex(func, arg, samplerate, channels, bits, AUDIO_ENQUEUE, &opts);
 }
@@ -0,0 +1,123 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include "audio_adpcm.h"
+
+static const int8_t s_index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static const int16_t s_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static inline int16_t decode_nibble(audio_adpcm_t *st, int code)
+{
+    int step = s_step_table[st->index];
+    int diff = step >> 3;
+    int index = st->index + s_index_table[code];
+    int32_t predictor = st->predictor;
+    if (code & 1) {
+        diff += step >> 2;
+    }
+    if (code & 2) {
+        diff += step >> 1;
+    }
+    if (code & 4) {
+        diff += step;
+    }
+    predictor += (code & 8)? -diff: diff;
+    st->predictor = predictor > 32767? 32767: predictor < -32768? -32768: predictor;
+    st->index = index < 0? 0: index > 88? 88: index;
+    return st->predictor;
+}
+
+static inline int encode_nibble(audio_adpcm_t *st, int16_t sample)
+{
+    int step = s_step_table[st->index];
+    int diff = sample - st->predictor;
+    int code = 0;
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step) {
+        code |= 4;
+        diff -= step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 2;
+        diff -= step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 1;
+    }
+    /* track what decoder will see */
+    decode_nibble(st, code);
+    return code;
+}
+
+int16_t audio_adpcm_decode_header(audio_adpcm_t *st, const uint8_t *header)
+{
+    st->predictor = (int16_t)(header[0] | (header[1] << 8));
+    st->index = header[2] > 88? 88: header[2];
+    return st->predictor;
+}
+
+void audio_adpcm_decode(audio_adpcm_t *st, int16_t *dst, const uint8_t *src, int bytes)
+{
+    int i;
+    for (i = 0; i < bytes; i++) {
+        /* read code before writing dst, which may overlap src */
+        uint8_t code = src[i];
+        dst[i*2] = decode_nibble(st, code & 0xf);
+        dst[i*2+1] = decode_nibble(st, code >> 4);
+    }
+}
+
+void audio_adpcm_encode_block(audio_adpcm_t *st, uint8_t *dst, int block_align,
+    const int16_t *src, int samples)
+{
+    int n = audio_adpcm_block_samples(block_align);
+    int16_t last = samples > 0? src[0]: 0;
+    int i;
+    st->predictor = last;
+    dst[0] = (uint16_t)last & 0xff;
+    dst[1] = (uint16_t)last >> 8;
+    dst[2] = st->index;
+    dst[3] = 0;
+    dst += AUDIO_ADPCM_HEADER_SIZE;
+    for (i = 1; i < n; i += 2) {
+        int16_t s0, s1;
+        s0 = i < samples? src[i]: last;
+        last = s0;
+        s1 = i+1 < samples? src[i+1]: last;
+        last = s1;
+        *dst++ = encode_nibble(st, s0) | (encode_nibble(st, s1) << 4);
+    }
+}
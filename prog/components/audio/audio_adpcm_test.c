@@ -0,0 +1,149 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_adpcm.c. encodes and decodes PCM and checks error. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_adpcm.h"
+
+#define BLOCK_ALIGN     256
+#define SAMPLES         16000
+
+static int s_failed = 0;
+
+static void test_vector(void)
+{
+    /* predictor 0, index 0, then codes 0x7 and 0xf */
+    static const uint8_t block[] = { 0x00, 0x00, 0x00, 0x00, 0xf7 };
+    audio_adpcm_t st;
+    int16_t out[2];
+    int16_t first = audio_adpcm_decode_header(&st, block);
+    audio_adpcm_decode(&st, out, block + 4, 1);
+    /* 0x7: 7/8+7/4+7/2+7 = 11, step index 0 -> 8.
+     * 0xf: -(16/8+16/4+16/2+16) = -30 */
+    if (first != 0 || out[0] != 11 || out[1] != -19 || st.index != 16) {
+        printf("FAIL vector: %d %d %d index %d\n", first, out[0], out[1], st.index);
+        s_failed++;
+        return;
+    }
+    printf("ok   vector\n");
+}
+
+/* encode src to blocks. return size of coded data. */
+static int encode(uint8_t *dst, const int16_t *src, int samples)
+{
+    int block_samples = audio_adpcm_block_samples(BLOCK_ALIGN);
+    audio_adpcm_t st;
+    int size = 0;
+    memset(&st, 0, sizeof(st));
+    while (samples > 0) {
+        int n = samples < block_samples? samples: block_samples;
+        audio_adpcm_encode_block(&st, dst + size, BLOCK_ALIGN, src, n);
+        size += BLOCK_ALIGN;
+        src += n;
+        samples -= n;
+    }
+    return size;
+}
+
+/* decode whole blocks. chunked decoding is tested through riffwave.c by riffwave_test. */
+static void decode(int16_t *dst, const uint8_t *src, int samples)
+{
+    int block_samples = audio_adpcm_block_samples(BLOCK_ALIGN);
+    int16_t block_out[BLOCK_ALIGN * 2];
+    audio_adpcm_t st;
+    int n;
+    for (n = 0; n < samples; n += block_samples) {
+        const uint8_t *block = src + n / block_samples * BLOCK_ALIGN;
+        int count = samples - n < block_samples? samples - n: block_samples;
+        block_out[0] = audio_adpcm_decode_header(&st, block);
+        audio_adpcm_decode(&st, block_out + 1, block + AUDIO_ADPCM_HEADER_SIZE,
+            BLOCK_ALIGN - AUDIO_ADPCM_HEADER_SIZE);
+        memcpy(dst + n, block_out, count * sizeof(*dst));
+    }
+}
+
+static double snr(const int16_t *ref, const int16_t *actual, int samples)
+{
+    double signal = 0, noise = 0;
+    int i;
+    for (i = 0; i < samples; i++) {
+        double d = actual[i] - ref[i];
+        signal += (double)ref[i] * ref[i];
+        noise += d * d;
+    }
+    return noise == 0? INFINITY: 10 * log10(signal / noise);
+}
+
+static void test_roundtrip(const char *name, const int16_t *src, int samples, double min_snr)
+{
+    int block_samples = audio_adpcm_block_samples(BLOCK_ALIGN);
+    int blocks = (samples + block_samples - 1) / block_samples;
+    uint8_t *coded = malloc(blocks * BLOCK_ALIGN);
+    int16_t *out = malloc((samples + 1) * sizeof(*out));
+    int size = encode(coded, src, samples);
+    double r;
+    decode(out, coded, samples);
+    r = snr(src, out, samples);
+    if (r < min_snr) {
+        printf("FAIL %s: SNR %.1f dB\n", name, r);
+        s_failed++;
+    } else {
+        printf("ok   %s: SNR %.1f dB, %d -> %d bytes\n", name, r, samples * 2, size);
+    }
+    free(coded);
+    free(out);
+}
+
+int main(void)
+{
+    static int16_t src[SAMPLES];
+    int i;
+
+    test_vector();
+
+    for (i = 0; i < SAMPLES; i++) {
+        src[i] = (int16_t)lrint(16000 * sin(2 * M_PI * 440 * i / 16000.0));
+    }
+    test_roundtrip("sine 440Hz", src, SAMPLES, 25);
+
+    /* two tones with decaying envelope, like a chime */
+    for (i = 0; i < SAMPLES; i++) {
+        double env = exp(-3.0 * i / SAMPLES);
+        src[i] = (int16_t)lrint(env * (12000 * sin(2 * M_PI * 660 * i / 16000.0) +
+                                       8000 * sin(2 * M_PI * 1320 * i / 16000.0)));
+    }
+    test_roundtrip("chime", src, SAMPLES, 20);
+
+    /* full scale square wave must not overflow */
+    for (i = 0; i < SAMPLES; i++) {
+        src[i] = (i / 20) % 2? 32767: -32768;
+    }
+    test_roundtrip("square", src, SAMPLES, 5);
+
+    /* partial last block */
+    test_roundtrip("partial block", src, 1000, 5);
+
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
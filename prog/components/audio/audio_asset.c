@@ -0,0 +1,107 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_partition.h>
+#include <esp_log.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "audio_asset.h"
+
+#define TAG "audio"
+
+#ifdef ESP_PLATFORM
+
+int audio_asset_open(audio_asset_t *asset, const char *name)
+{
+    const esp_partition_t *partition;
+    spi_flash_mmap_handle_t handle;
+    const void *ptr;
+    esp_err_t err;
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+        ESP_PARTITION_SUBTYPE_ANY, name);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "No asset partition: %s", name);
+        return -1;
+    }
+    /* data mapping allows byte access, which 8bit audio needs */
+    err = esp_partition_mmap(partition, 0, partition->size,
+        SPI_FLASH_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map asset partition: %s: %d", name, err);
+        return -1;
+    }
+    asset->data = ptr;
+    asset->size = partition->size;
+    asset->handle = handle;
+    return 0;
+}
+
+void audio_asset_close(audio_asset_t *asset)
+{
+    if (asset->data != NULL) {
+        spi_flash_munmap(asset->handle);
+        asset->data = NULL;
+        asset->size = 0;
+    }
+}
+
+#else /* !ESP_PLATFORM */
+
+int audio_asset_open(audio_asset_t *asset, const char *name)
+{
+    struct stat st;
+    void *ptr;
+    int fd;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    /* mapping is kept after close */
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return -1;
+    }
+    asset->data = ptr;
+    asset->size = st.st_size;
+    asset->handle = 0;
+    return 0;
+}
+
+void audio_asset_close(audio_asset_t *asset)
+{
+    if (asset->data != NULL) {
+        munmap((void*)asset->data, asset->size);
+        asset->data = NULL;
+        asset->size = 0;
+    }
+}
+
+#endif /* ESP_PLATFORM */
@@ -0,0 +1,79 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_asset.c. maps image file and reads samples without copy. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "audio_asset.h"
+#include "audio_convert.h"
+
+#define SAMPLES     4096
+
+static int s_failed = 0;
+
+static void check(const char *name, int ok)
+{
+    if (!ok) {
+        printf("FAIL %s\n", name);
+        s_failed++;
+    } else {
+        printf("ok   %s\n", name);
+    }
+}
+
+int main(void)
+{
+    char path[] = "/tmp/audio_asset_testXXXXXX";
+    static int16_t image[SAMPLES], out[SAMPLES];
+    audio_asset_t asset;
+    int fd, i;
+
+    for (i = 0; i < SAMPLES; i++) {
+        image[i] = (int16_t)(i * 37);
+    }
+    fd = mkstemp(path);
+    if (fd < 0 || write(fd, image, sizeof(image)) != sizeof(image)) {
+        printf("FAIL create image\n");
+        return 1;
+    }
+    close(fd);
+
+    check("open missing", audio_asset_open(&asset, "/nonexistent/audio.bin") != 0);
+    check("open", audio_asset_open(&asset, path) == 0);
+    unlink(path);
+    check("size", asset.size == sizeof(image));
+    check("content", memcmp(asset.data, image, sizeof(image)) == 0);
+    /* conversion stage reads mapped data directly */
+    audio_convert_16bit(out, (const int16_t*)asset.data + 1, SAMPLES/2 - 1, 2);
+    for (i = 0; i < SAMPLES/2 - 1; i++) {
+        if (out[i] != (image[i*2+1] + image[i*2+2]) >> 1) {
+            break;
+        }
+    }
+    check("convert from mapped", i == SAMPLES/2 - 1);
+    audio_asset_close(&asset);
+    check("close", asset.data == NULL && asset.size == 0);
+
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
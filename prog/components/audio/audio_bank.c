@@ -0,0 +1,129 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "audio_bank.h"
+
+int audio_bank_init(audio_bank_t *bank, const void *data, uint32_t size)
+{
+    const audio_bank_header_t *header = data;
+    uint32_t dir_end;
+    int i;
+
+    if (size < sizeof(*header) || ((uintptr_t)data & 3) != 0) {
+        return -1;
+    }
+    if (header->magic != AUDIO_BANK_MAGIC || header->version != AUDIO_BANK_VERSION) {
+        return -1;
+    }
+    dir_end = sizeof(*header) + header->count * sizeof(audio_bank_entry_t);
+    if (header->data_offset < dir_end || header->data_offset > size ||
+        header->data_length > size - header->data_offset ||
+        (header->data_offset & 3) != 0) {
+        return -1;
+    }
+    bank->header = header;
+    bank->entries = (const audio_bank_entry_t*)(header + 1);
+    bank->data = (const uint8_t*)data + header->data_offset;
+    for (i = 0; i < header->count; i++) {
+        const audio_bank_entry_t *entry = &bank->entries[i];
+        if (entry->offset > header->data_length ||
+            entry->length > header->data_length - entry->offset) {
+            return -1;
+        }
+        if (i > 0 && entry[-1].hash >= entry->hash) {
+            /* not sorted or duplicated */
+            return -1;
+        }
+    }
+    return 0;
+}
+
+uint32_t audio_bank_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name != '\0') {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+const audio_bank_entry_t *audio_bank_find(const audio_bank_t *bank, uint32_t hash)
+{
+    int lo = 0, hi = bank->header->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        uint32_t h = bank->entries[mid].hash;
+        if (h == hash) {
+            return &bank->entries[mid];
+        }
+        if (h < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+int audio_bank_resolve(const audio_bank_t *bank, const char *const *names, int count,
+    audio_bank_range_t *ranges)
+{
+    int i;
+    for (i = 0; i < count; i++) {
+        const audio_bank_entry_t *entry = audio_bank_find(bank, audio_bank_hash(names[i]));
+        if (entry == NULL || entry->format != 1) {
+            return -1;
+        }
+        ranges[i].data = bank->data + entry->offset;
+        ranges[i].length = entry->length;
+    }
+    return count;
+}
+
+void audio_bank_play_init(audio_bank_play_t *play, const audio_bank_range_t *ranges, int count)
+{
+    play->ranges = ranges;
+    play->count = count;
+    play->index = 0;
+    play->pos = 0;
+}
+
+int audio_bank_data_ptr_func(void *arg, const void **data, int *size)
+{
+    audio_bank_play_t *play = arg;
+    const audio_bank_range_t *range;
+    uint32_t length = *size;
+
+    while (play->index < play->count && play->pos >= play->ranges[play->index].length) {
+        play->index++;
+        play->pos = 0;
+    }
+    if (play->index >= play->count) {
+        *size = 0;
+        return 0;
+    }
+    range = &play->ranges[play->index];
+    if (length > range->length - play->pos) {
+        length = range->length - play->pos;
+    }
+    *data = range->data + play->pos;
+    *size = length;
+    play->pos += length;
+    return play->index + 1 < play->count || play->pos < range->length;
+}
@@ -0,0 +1,177 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_bank.c.
+ * builds bank on memory and resolves phrases. pass a bank file made by
+ * tools/time_vo.pl as argument to validate it and list clips. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "audio_asset.h"
+#include "audio_bank.h"
+
+#define ARRAY_SIZE(a)   (sizeof(a)/sizeof((a)[0]))
+
+static int s_failed = 0;
+
+static void check(const char *name, int ok)
+{
+    if (!ok) {
+        printf("FAIL %s\n", name);
+        s_failed++;
+    } else {
+        printf("ok   %s\n", name);
+    }
+}
+
+static const char *s_names[] = { "num001.wav", "num010.wav", "time_ji.wav", "time_fun.wav", "num005.wav" };
+
+/* build bank of s_names where clip i has (i+1)*10+1 samples of value i+1. */
+static uint32_t build(uint32_t *buff, uint32_t size)
+{
+    audio_bank_header_t *header = (audio_bank_header_t*)buff;
+    audio_bank_entry_t *entries = (audio_bank_entry_t*)(header + 1);
+    int count = ARRAY_SIZE(s_names);
+    uint8_t *data = (uint8_t*)(entries + count);
+    uint32_t offset = 0;
+    int i, j;
+
+    memset(buff, 0, size);
+    for (i = 0; i < count; i++) {
+        int samples = (i + 1) * 10 + 1;
+        int16_t *pcm = (int16_t*)(data + offset);
+        audio_bank_entry_t entry = {
+            .hash = audio_bank_hash(s_names[i]),
+            .offset = offset,
+            .length = samples * 2,
+            .format = 1,
+        };
+        for (j = 0; j < samples; j++) {
+            pcm[j] = i + 1;
+        }
+        offset += (entry.length + 3) & ~3;
+        /* insertion sort by hash */
+        for (j = i; j > 0 && entries[j-1].hash > entry.hash; j--) {
+            entries[j] = entries[j-1];
+        }
+        entries[j] = entry;
+    }
+    header->magic = AUDIO_BANK_MAGIC;
+    header->version = AUDIO_BANK_VERSION;
+    header->count = count;
+    header->samplerate = 16000;
+    header->channels = 1;
+    header->bits = 16;
+    header->data_offset = data - (uint8_t*)buff;
+    header->data_length = offset;
+    return header->data_offset + offset;
+}
+
+static void test_bank(void)
+{
+    static uint32_t buff[1024];
+    static const char *phrase[] = { "num010.wav", "num001.wav", "time_ji.wav", "num005.wav", "time_fun.wav" };
+    audio_bank_range_t ranges[ARRAY_SIZE(phrase)];
+    audio_bank_play_t play;
+    audio_bank_t bank;
+    audio_bank_header_t *header = (audio_bank_header_t*)buff;
+    audio_bank_entry_t *entries, swap;
+    uint32_t size = build(buff, sizeof(buff));
+    int16_t out[1024], expected[1024];
+    int n = 0, m = 0, more, i;
+
+    check("hash", audio_bank_hash("") == 2166136261u && audio_bank_hash("num001.wav") == 0xb5ddc5de);
+    check("init", audio_bank_init(&bank, buff, size) == 0);
+    check("init short", audio_bank_init(&bank, buff, size - 4) != 0);
+    check("find", audio_bank_find(&bank, audio_bank_hash("time_ji.wav")) != NULL &&
+        audio_bank_find(&bank, audio_bank_hash("num002.wav")) == NULL);
+    check("resolve missing", audio_bank_resolve(&bank, (const char *const[]){ "num001.wav", "nope.wav" }, 2, ranges) < 0);
+    check("resolve", audio_bank_resolve(&bank, phrase, ARRAY_SIZE(phrase), ranges) == ARRAY_SIZE(phrase));
+
+    /* play ranges in small chunks and check clips follow without gap */
+    audio_bank_play_init(&play, ranges, ARRAY_SIZE(phrase));
+    do {
+        const void *ptr;
+        int chunk = 2 * (1 + rand() % 16);
+        more = audio_bank_data_ptr_func(&play, &ptr, &chunk);
+        memcpy(out + n, ptr, chunk);
+        n += chunk / 2;
+    } while (more);
+    for (i = 0; i < (int)ARRAY_SIZE(phrase); i++) {
+        int id = 0, j;
+        for (j = 0; j < (int)ARRAY_SIZE(s_names); j++) {
+            if (strcmp(s_names[j], phrase[i]) == 0) {
+                id = j + 1;
+            }
+        }
+        for (j = 0; j < id * 10 + 1; j++) {
+            expected[m++] = id;
+        }
+    }
+    check("play ranges", n == m && memcmp(out, expected, m * 2) == 0);
+
+    /* broken banks */
+    entries = (audio_bank_entry_t*)(header + 1);
+    swap = entries[0];
+    entries[0] = entries[1];
+    entries[1] = swap;
+    check("init unsorted", audio_bank_init(&bank, buff, size) != 0);
+    entries[1] = entries[0];
+    entries[0] = swap;
+    header->magic = 0;
+    check("init magic", audio_bank_init(&bank, buff, size) != 0);
+}
+
+/* validate bank file and list clips. */
+static int dump(const char *path)
+{
+    audio_asset_t asset;
+    audio_bank_t bank;
+    int i;
+    if (audio_asset_open(&asset, path) != 0) {
+        printf("FAIL open %s\n", path);
+        return 1;
+    }
+    if (audio_bank_init(&bank, asset.data, asset.size) != 0) {
+        printf("FAIL invalid bank %s\n", path);
+        audio_asset_close(&asset);
+        return 1;
+    }
+    printf("%d clips, %uHz %dch %dbit, %u bytes\n", bank.header->count,
+        bank.header->samplerate, bank.header->channels, bank.header->bits,
+        bank.header->data_length);
+    for (i = 0; i < bank.header->count; i++) {
+        const audio_bank_entry_t *entry = &bank.entries[i];
+        printf("%08x %8u %8u\n", entry->hash, entry->offset, entry->length);
+    }
+    audio_asset_close(&asset);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1) {
+        return dump(argv[1]);
+    }
+    test_bank();
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "audio_convert.h"
+
+#define IS_ALIGNED(p)   (((uintptr_t)(p) & 3) == 0)
+
+/* 32bit word which may alias sample buffers */
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+
+/* store 2 samples packed in v. dst is only 16bit aligned. */
+static inline void store2(int16_t *dst, uint32_t v)
+{
+    memcpy(dst, &v, sizeof(v));
+}
+
+/* u8 to s16: b*257 - 0x8000, that is, byte repeated in both halves with sign flipped. */
+static inline int16_t u8_to_s16(uint8_t b)
+{
+    return b*257 - 0x8000;
+}
+
+/* average of two u8 converted to s16: (l+r)*257/2 - 0x8000 */
+static inline int16_t u8x2_to_s16(uint8_t l, uint8_t r)
+{
+    return (((l + r) * 257) >> 1) - 0x8000;
+}
+
+static int convert_8bit_mono(int16_t *dst, const uint8_t *src, int frames)
+{
+    const word_t *s;
+    int i = 0;
+    while (i < frames && !IS_ALIGNED(src + i)) {
+        dst[i] = u8_to_s16(src[i]);
+        i++;
+    }
+    s = (const word_t*)(src + i);
+    for (; i + 4 <= frames; i += 4) {
+        uint32_t w = *s++;
+        /* spread 2 bytes into 16bit lanes, then duplicate to upper byte */
+        uint32_t lo = (w & 0x000000ff) | ((w & 0x0000ff00) << 8);
+        uint32_t hi = ((w & 0x00ff0000) >> 16) | ((w & 0xff000000) >> 8);
+        store2(dst + i, (lo | (lo << 8)) ^ 0x80008000);
+        store2(dst + i + 2, (hi | (hi << 8)) ^ 0x80008000);
+    }
+    for (; i < frames; i++) {
+        dst[i] = u8_to_s16(src[i]);
+    }
+    return frames;
+}
+
+static int convert_8bit_stereo(int16_t *dst, const uint8_t *src, int frames)
+{
+    const word_t *s;
+    int i = 0;
+    if (((uintptr_t)src & 1) != 0) {
+        /* frame straddles 32bit boundary. rare, do it slowly. */
+        for (; i < frames; i++) {
+            dst[i] = u8x2_to_s16(src[i*2], src[i*2+1]);
+        }
+        return frames;
+    }
+    if (!IS_ALIGNED(src) && i < frames) {
+        dst[i] = u8x2_to_s16(src[0], src[1]);
+        i++;
+    }
+    s = (const word_t*)(src + i*2);
+    for (; i + 2 <= frames; i += 2) {
+        uint32_t w = *s++;
+        /* l+r of 2 frames in 16bit lanes, at most 510 */
+        uint32_t sum = (w & 0x00ff00ff) + ((w >> 8) & 0x00ff00ff);
+        /* sum*257/2 == sum*128 + sum/2, at most 65535 so lanes do not carry */
+        store2(dst + i, ((sum << 7) + ((sum >> 1) & 0x00ff00ff)) ^ 0x80008000);
+    }
+    for (; i < frames; i++) {
+        dst[i] = u8x2_to_s16(src[i*2], src[i*2+1]);
+    }
+    return frames;
+}
+
+static int convert_16bit_stereo(int16_t *dst, const int16_t *src, int frames)
+{
+    const word_t *s;
+    int i = 0;
+    if (!IS_ALIGNED(src)) {
+        /* frame straddles 32bit boundary. rare, do it slowly. */
+        for (; i < frames; i++) {
+            dst[i] = (src[i*2] + src[i*2+1]) >> 1;
+        }
+        return frames;
+    }
+    s = (const word_t*)src;
+    for (; i + 2 <= frames; i += 2) {
+        uint32_t w0 = *s++, w1 = *s++;
+        int32_t m0 = ((int16_t)w0 + ((int32_t)w0 >> 16)) >> 1;
+        int32_t m1 = ((int16_t)w1 + ((int32_t)w1 >> 16)) >> 1;
+        store2(dst + i, (uint16_t)m0 | ((uint32_t)m1 << 16));
+    }
+    for (; i < frames; i++) {
+        dst[i] = (src[i*2] + src[i*2+1]) >> 1;
+    }
+    return frames;
+}
+
+int audio_convert_8bit(int16_t *dst, const uint8_t *src, int frames, int channels)
+{
+    if (channels == 2) {
+        return convert_8bit_stereo(dst, src, frames);
+    }
+    return convert_8bit_mono(dst, src, frames);
+}
+
+int audio_convert_16bit(int16_t *dst, const int16_t *src, int frames, int channels)
+{
+    if (channels == 2) {
+        return convert_16bit_stereo(dst, src, frames);
+    }
+    memcpy(dst, src, frames * sizeof(*dst));
+    return frames;
+}
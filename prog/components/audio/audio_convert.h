@@ -0,0 +1,52 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * convert audio data to signed 16bit mono samples.
+ * stereo is downmixed to mono by averaging channels in the same pass.
+ * aligned data is processed 32bit at a time assuming little endian.
+ */
+
+/**
+ * @brief convert unsigned 8bit samples to signed 16bit mono samples.
+ * @param[out] dst      destination of frames samples.
+ * @param[in] src       source of frames * channels samples.
+ * @param[in] frames    number of frames to convert.
+ * @param[in] channels  number of channels in src. must be 1 or 2.
+ * @return number of converted samples.
+ */
+extern int audio_convert_8bit(int16_t *dst, const uint8_t *src, int frames, int channels);
+/**
+ * @brief convert signed 16bit samples to signed 16bit mono samples.
+ * @param[out] dst      destination of frames samples.
+ * @param[in] src       source of frames * channels samples.
+ * @param[in] frames    number of frames to convert.
+ * @param[in] channels  number of channels in src. must be 1 or 2.
+ * @return number of converted samples.
+ */
+extern int audio_convert_16bit(int16_t *dst, const int16_t *src, int frames, int channels);
+
+#ifdef __cplusplus
+}
+#endif
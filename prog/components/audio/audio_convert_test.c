@@ -0,0 +1,202 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_convert.c.
+ * compares 32bit kernels with sample by sample loops for every alignment.
+ * run with "bench" argument to compare speed of them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "audio_convert.h"
+
+#define MAX_FRAMES  64
+
+static int s_failed = 0;
+
+/* sample by sample loops, as audio.c converted before. */
+static void ref_8bit(int16_t *dst, const uint8_t *src, int frames, int channels)
+{
+    int i;
+    for (i = 0; i < frames; i++) {
+        if (channels == 2) {
+            dst[i] = (((src[i*2] + src[i*2+1]) * 257) >> 1) - 0x8000;
+        } else {
+            dst[i] = src[i]*257 - 0x8000;
+        }
+    }
+}
+
+static void ref_16bit(int16_t *dst, const int16_t *src, int frames, int channels)
+{
+    int i;
+    for (i = 0; i < frames; i++) {
+        if (channels == 2) {
+            dst[i] = (src[i*2] + src[i*2+1]) >> 1;
+        } else {
+            dst[i] = src[i];
+        }
+    }
+}
+
+static void test_8bit(int channels)
+{
+    /* extra room to offset src and dst */
+    static uint8_t src[MAX_FRAMES * 2 + 4];
+    static int16_t dst[MAX_FRAMES + 2], expected[MAX_FRAMES + 2];
+    int so, d_o, frames, i;
+    for (i = 0; i < (int)sizeof(src); i++) {
+        src[i] = rand();
+    }
+    /* include extremes */
+    src[5] = 0; src[6] = 255; src[7] = 255; src[8] = 0;
+    for (so = 0; so < 4; so++) {
+        for (d_o = 0; d_o < 2; d_o++) {
+            for (frames = 0; frames <= MAX_FRAMES; frames++) {
+                memset(dst, 0x55, sizeof(dst));
+                memset(expected, 0x55, sizeof(expected));
+                audio_convert_8bit(dst + d_o, src + so, frames, channels);
+                ref_8bit(expected + d_o, src + so, frames, channels);
+                if (memcmp(dst, expected, sizeof(dst)) != 0) {
+                    printf("FAIL 8bit %dch: src+%d dst+%d frames %d\n", channels, so, d_o, frames);
+                    s_failed++;
+                    return;
+                }
+            }
+        }
+    }
+    printf("ok   8bit %dch\n", channels);
+}
+
+static void test_16bit(int channels)
+{
+    static int16_t src[MAX_FRAMES * 2 + 2];
+    static int16_t dst[MAX_FRAMES + 2], expected[MAX_FRAMES + 2];
+    int so, d_o, frames, i;
+    for (i = 0; i < (int)(sizeof(src)/sizeof(src[0])); i++) {
+        src[i] = rand();
+    }
+    src[3] = 32767; src[4] = 32767; src[5] = -32768; src[6] = -32768;
+    for (so = 0; so < 2; so++) {
+        for (d_o = 0; d_o < 2; d_o++) {
+            for (frames = 0; frames <= MAX_FRAMES; frames++) {
+                memset(dst, 0x55, sizeof(dst));
+                memset(expected, 0x55, sizeof(expected));
+                audio_convert_16bit(dst + d_o, src + so, frames, channels);
+                ref_16bit(expected + d_o, src + so, frames, channels);
+                if (memcmp(dst, expected, sizeof(dst)) != 0) {
+                    printf("FAIL 16bit %dch: src+%d dst+%d frames %d\n", channels, so, d_o, frames);
+                    s_failed++;
+                    return;
+                }
+            }
+        }
+    }
+    printf("ok   16bit %dch\n", channels);
+}
+
+static uint64_t now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#define BENCH_FRAMES    512
+#define BENCH_ROUNDS    20000
+
+static void report(const char *name, uint64_t ref, uint64_t opt)
+{
+    double total = (double)BENCH_FRAMES * BENCH_ROUNDS;
+#if defined(__x86_64__) || defined(__i386__)
+    const char *unit = "cycles";
+#else
+    const char *unit = "ns";
+#endif
+    printf("%-10s loop %.2f, kernel %.2f %s/sample (x%.1f)\n",
+        name, ref / total, opt / total, unit, (double)ref / opt);
+}
+
+static void bench(void)
+{
+    static uint8_t src[BENCH_FRAMES * 4];
+    static int16_t dst[BENCH_FRAMES];
+    /* keep compiler from dropping the loops */
+    static volatile int16_t sink;
+    int channels, r, i;
+    uint64_t t0, t1, t2;
+    for (i = 0; i < (int)sizeof(src); i++) {
+        src[i] = rand();
+    }
+    for (channels = 1; channels <= 2; channels++) {
+        char name[16];
+        t0 = now();
+        for (r = 0; r < BENCH_ROUNDS; r++) {
+            ref_8bit(dst, src, BENCH_FRAMES, channels);
+            sink = dst[r % BENCH_FRAMES];
+        }
+        t1 = now();
+        for (r = 0; r < BENCH_ROUNDS; r++) {
+            audio_convert_8bit(dst, src, BENCH_FRAMES, channels);
+            sink = dst[r % BENCH_FRAMES];
+        }
+        t2 = now();
+        snprintf(name, sizeof(name), "8bit %dch", channels);
+        report(name, t1 - t0, t2 - t1);
+
+        t0 = now();
+        for (r = 0; r < BENCH_ROUNDS; r++) {
+            ref_16bit(dst, (const int16_t*)src, BENCH_FRAMES, channels);
+            sink = dst[r % BENCH_FRAMES];
+        }
+        t1 = now();
+        for (r = 0; r < BENCH_ROUNDS; r++) {
+            audio_convert_16bit(dst, (const int16_t*)src, BENCH_FRAMES, channels);
+            sink = dst[r % BENCH_FRAMES];
+        }
+        t2 = now();
+        snprintf(name, sizeof(name), "16bit %dch", channels);
+        report(name, t1 - t0, t2 - t1);
+    }
+    (void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(1);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+    test_8bit(1);
+    test_8bit(2);
+    test_16bit(1);
+    test_16bit(2);
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include "audio_histogram.h"
+
+static int bin_of(uint32_t value)
+{
+    int bin = value == 0? 0: 32 - __builtin_clz(value);
+    return bin < AUDIO_HISTOGRAM_BINS? bin: AUDIO_HISTOGRAM_BINS - 1;
+}
+
+void audio_histogram_add(audio_histogram_t *hist, uint32_t value)
+{
+    hist->bins[bin_of(value)]++;
+    hist->count++;
+    hist->sum += value;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+uint32_t audio_histogram_percentile(const audio_histogram_t *hist, int percent)
+{
+    uint64_t rank, seen = 0;
+    int i;
+    if (hist->count == 0) {
+        return 0;
+    }
+    /* rank of the value counted from 1 */
+    rank = ((uint64_t)hist->count * percent + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (i = 0; i < AUDIO_HISTOGRAM_BINS - 1; i++) {
+        seen += hist->bins[i];
+        if (seen >= rank) {
+            uint32_t upper = i == 0? 0: (1u << i) - 1;
+            return upper < hist->max? upper: hist->max;
+        }
+    }
+    return hist->max;
+}
@@ -0,0 +1,95 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_histogram.c. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "audio_histogram.h"
+
+static int s_failed = 0;
+
+static void check(const char *name, uint32_t actual, uint32_t expected)
+{
+    if (actual != expected) {
+        printf("FAIL %s: %u != %u\n", name, actual, expected);
+        s_failed++;
+    }
+}
+
+static void test_bins(void)
+{
+    audio_histogram_t hist;
+    int failed = s_failed;
+    memset(&hist, 0, sizeof(hist));
+    audio_histogram_add(&hist, 0);
+    audio_histogram_add(&hist, 1);
+    audio_histogram_add(&hist, 2);
+    audio_histogram_add(&hist, 3);
+    audio_histogram_add(&hist, 4);
+    audio_histogram_add(&hist, 1000);
+    audio_histogram_add(&hist, 0xffffffff);
+    check("bin 0", hist.bins[0], 1);
+    check("bin 1", hist.bins[1], 1);
+    check("bin 2", hist.bins[2], 2);
+    check("bin 3", hist.bins[3], 1);
+    /* 512 <= 1000 < 1024 */
+    check("bin 10", hist.bins[10], 1);
+    check("last bin", hist.bins[AUDIO_HISTOGRAM_BINS - 1], 1);
+    check("count", hist.count, 7);
+    check("max", hist.max, 0xffffffff);
+    if (failed == s_failed) {
+        printf("ok   bins\n");
+    }
+}
+
+static void test_percentile(void)
+{
+    audio_histogram_t hist;
+    int failed = s_failed, i;
+    memset(&hist, 0, sizeof(hist));
+    check("empty", audio_histogram_percentile(&hist, 50), 0);
+    check("empty mean", audio_histogram_mean(&hist), 0);
+    /* 90 values of 100 and 10 values of 5000 */
+    for (i = 0; i < 90; i++) {
+        audio_histogram_add(&hist, 100);
+    }
+    for (i = 0; i < 10; i++) {
+        audio_histogram_add(&hist, 5000);
+    }
+    check("p0", audio_histogram_percentile(&hist, 0), 127);
+    check("p50", audio_histogram_percentile(&hist, 50), 127);
+    check("p90", audio_histogram_percentile(&hist, 90), 127);
+    /* upper bound of bin is clipped to max */
+    check("p91", audio_histogram_percentile(&hist, 91), 5000);
+    check("p100", audio_histogram_percentile(&hist, 100), 5000);
+    check("mean", audio_histogram_mean(&hist), 590);
+    if (failed == s_failed) {
+        printf("ok   percentile\n");
+    }
+}
+
+int main(void)
+{
+    test_bins();
+    test_percentile();
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
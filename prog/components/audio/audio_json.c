@@ -0,0 +1,94 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <json_str.h>
+
+#include "audio.h"
+#include "audio_histogram.h"
+#include "audio_json.h"
+
+int audio_histogram_to_json(json_str_t *json, const char *key, const audio_histogram_t *hist)
+{
+    int err, i;
+    JSON_STR_OBJECT_WITH(json, key, err, return err, {
+        JSON_STR_CHECK(json_str_add_integer(json, "count", hist->count), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "mean", audio_histogram_mean(hist)), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "p50", audio_histogram_percentile(hist, 50)), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "p90", audio_histogram_percentile(hist, 90)), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "p99", audio_histogram_percentile(hist, 99)), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "max", hist->max), err, return err);
+        /* bins[i] counts values less than 2^i */
+        JSON_STR_ARRAY_WITH(json, "bins", err, return err, {
+            for (i = 0; i < AUDIO_HISTOGRAM_BINS; i++) {
+                JSON_STR_CHECK(json_str_add_integer(json, NULL, hist->bins[i]), err, return err);
+            }
+        });
+    });
+    return JSON_STR_OK;
+}
+
+int audio_pool_stats_to_json(json_str_t *json, const char *key, const audio_pool_stats_t *stats)
+{
+    int err;
+    JSON_STR_OBJECT_WITH(json, key, err, return err, {
+        JSON_STR_CHECK(json_str_add_integer(json, "count", stats->count), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "used", stats->used), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "high_water", stats->high_water), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "exhausted", stats->exhausted), err, return err);
+    });
+    return JSON_STR_OK;
+}
+
+static int audio_profile_stats_to_json(json_str_t *json, const char *key, const audio_profile_stats_t *stats)
+{
+    int err;
+    JSON_STR_OBJECT_WITH(json, key, err, return err, {
+        JSON_STR_CHECK(json_str_add_integer(json, "latency", stats->latency), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "sessions", stats->sessions), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "underruns", stats->underruns), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "dma_starvations", stats->dma_starvations), err, return err);
+        JSON_STR_CHECK(audio_histogram_to_json(json, "start_latency", &stats->start_latency), err, return err);
+    });
+    return JSON_STR_OK;
+}
+
+int audio_stats_to_json(json_str_t *json, const char *key, const audio_stats_t *stats)
+{
+    int err, i;
+    JSON_STR_OBJECT_WITH(json, key, err, return err, {
+        JSON_STR_CHECK(json_str_add_integer(json, "ring_size", stats->ring_size), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "ring_min_level", stats->ring_min_level), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "underruns", stats->underruns), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "dma_size", stats->dma_size), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "dma_min_level", stats->dma_min_level), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "dma_starvations", stats->dma_starvations), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "queue_depth", stats->queue_depth), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "queue_max_depth", stats->queue_max_depth), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "schedule_error", stats->schedule_error), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "late_starts", stats->late_starts), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "stop_latency", stats->stop_latency), err, return err);
+        JSON_STR_CHECK(audio_pool_stats_to_json(json, "beeps", &stats->beeps), err, return err);
+        JSON_STR_CHECK(audio_histogram_to_json(json, "callback_time", &stats->callback_time), err, return err);
+        JSON_STR_CHECK(audio_histogram_to_json(json, "start_latency", &stats->start_latency), err, return err);
+        JSON_STR_CHECK(json_str_add_string(json, "profile", audio_profile_name(stats->profile)), err, return err);
+        JSON_STR_OBJECT_WITH(json, "profiles", err, return err, {
+            for (i = 0; i < AUDIO_PROFILE_MAX; i++) {
+                JSON_STR_CHECK(audio_profile_stats_to_json(json, audio_profile_name(i), &stats->profiles[i]), err, return err);
+            }
+        });
+    });
+    return JSON_STR_OK;
+}
@@ -0,0 +1,62 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include "audio_mixer.h"
+
+void audio_mixer_add_8bit(int32_t *acc, const uint8_t *src, int samples, int gain)
+{
+    int i;
+    if (gain == AUDIO_MIXER_UNITY_GAIN) {
+        for (i = 0; i < samples; i++) {
+            acc[i] += src[i]*257 - 0x8000;
+        }
+    } else {
+        for (i = 0; i < samples; i++) {
+            acc[i] += ((src[i]*257 - 0x8000) * gain) >> 8;
+        }
+    }
+}
+
+void audio_mixer_add_16bit(int32_t *acc, const int16_t *src, int samples, int gain)
+{
+    int i;
+    if (gain == AUDIO_MIXER_UNITY_GAIN) {
+        for (i = 0; i < samples; i++) {
+            acc[i] += src[i];
+        }
+    } else {
+        for (i = 0; i < samples; i++) {
+            acc[i] += (src[i] * gain) >> 8;
+        }
+    }
+}
+
+void audio_mixer_output(int16_t *dst, const int32_t *acc, int samples, audio_mixer_format_t format)
+{
+    /* offset binary is signed value with inverted sign bit */
+    uint16_t flip = format == AUDIO_MIXER_OFFSET_BINARY? 0x8000: 0;
+    int i;
+    for (i = 0; i < samples; i++) {
+        int32_t v = acc[i];
+        if (v > INT16_MAX) {
+            v = INT16_MAX;
+        } else if (v < INT16_MIN) {
+            v = INT16_MIN;
+        }
+        dst[i] = (int16_t)((uint16_t)v ^ flip);
+    }
+}
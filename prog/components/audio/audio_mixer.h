@@ -0,0 +1,70 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * fixed point mixer of audio voices.
+ * each voice is converted to signed 16bit, scaled by gain and added to
+ * 32bit accumulator in one pass, then accumulator is saturated to 16bit
+ * output format.
+ */
+
+/** gain to mix voice as is. gain is fixed point value with 8 fractional bits. */
+#define AUDIO_MIXER_UNITY_GAIN  256
+/** maximum gain. large enough not to overflow accumulator of 8 voices. */
+#define AUDIO_MIXER_MAX_GAIN    (4 * AUDIO_MIXER_UNITY_GAIN)
+
+/** output sample format of @ref audio_mixer_output */
+typedef enum {
+    AUDIO_MIXER_SIGNED,         /**< signed 16bit, for PDM. */
+    AUDIO_MIXER_OFFSET_BINARY,  /**< unsigned 16bit centered at 0x8000, for internal DAC. */
+} audio_mixer_format_t;
+
+/**
+ * @brief add unsigned 8bit samples to accumulator.
+ * @param[in,out] acc   accumulator.
+ * @param[in] src       source samples.
+ * @param[in] samples   number of samples.
+ * @param[in] gain      gain of the voice.
+ */
+extern void audio_mixer_add_8bit(int32_t *acc, const uint8_t *src, int samples, int gain);
+/**
+ * @brief add signed 16bit samples to accumulator.
+ * @param[in,out] acc   accumulator.
+ * @param[in] src       source samples.
+ * @param[in] samples   number of samples.
+ * @param[in] gain      gain of the voice.
+ */
+extern void audio_mixer_add_16bit(int32_t *acc, const int16_t *src, int samples, int gain);
+/**
+ * @brief saturate accumulator to 16bit output samples.
+ * @param[out] dst      output samples.
+ * @param[in] acc       accumulator.
+ * @param[in] samples   number of samples.
+ * @param[in] format    output format.
+ */
+extern void audio_mixer_output(int16_t *dst, const int32_t *acc, int samples, audio_mixer_format_t format);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,148 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_mixer.c. mixes known PCM and compares bit exactly. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_mixer.h"
+
+#define ARRAY_SIZE(a)   (sizeof(a)/sizeof((a)[0]))
+
+static int s_failed = 0;
+
+static void check(const char *name, const int16_t *actual, const int16_t *expected, int samples)
+{
+    int i;
+    for (i = 0; i < samples; i++) {
+        if (actual[i] != expected[i]) {
+            printf("FAIL %s: [%d] %d != %d\n", name, i, actual[i], expected[i]);
+            s_failed++;
+            return;
+        }
+    }
+    printf("ok   %s\n", name);
+}
+
+static void mix(int16_t *dst, int samples, audio_mixer_format_t format,
+    const int16_t *v16, int g16, const uint8_t *v8, int g8)
+{
+    int32_t acc[64];
+    memset(acc, 0, sizeof(acc));
+    if (v16 != NULL) {
+        audio_mixer_add_16bit(acc, v16, samples, g16);
+    }
+    if (v8 != NULL) {
+        audio_mixer_add_8bit(acc, v8, samples, g8);
+    }
+    audio_mixer_output(dst, acc, samples, format);
+}
+
+static void test_unity(void)
+{
+    static const int16_t src[] = { 0, 1, -1, 1000, -1000, 32767, -32768, 12345 };
+    int16_t out[ARRAY_SIZE(src)];
+    mix(out, ARRAY_SIZE(src), AUDIO_MIXER_SIGNED, src, AUDIO_MIXER_UNITY_GAIN, NULL, 0);
+    check("16bit unity", out, src, ARRAY_SIZE(src));
+}
+
+static void test_8bit(void)
+{
+    static const uint8_t src[] = { 0, 1, 127, 128, 129, 255 };
+    static const int16_t expected[] = { -32768, -32511, -129, 128, 385, 32767 };
+    int16_t out[ARRAY_SIZE(src)];
+    mix(out, ARRAY_SIZE(src), AUDIO_MIXER_SIGNED, NULL, 0, src, AUDIO_MIXER_UNITY_GAIN);
+    check("8bit unity", out, expected, ARRAY_SIZE(src));
+}
+
+static void test_gain(void)
+{
+    static const int16_t a[] = { 1000, -1000, 3, -3, 20000, -20000 };
+    static const uint8_t b[] = { 128, 128, 255, 0, 192, 64 };
+    /* a + ((b*257-32768)*96 >> 8) */
+    static const int16_t expected[] = { 1048, -952, 12290, -12291, 26216, -26120 };
+    int16_t out[ARRAY_SIZE(a)];
+    mix(out, ARRAY_SIZE(a), AUDIO_MIXER_SIGNED, a, AUDIO_MIXER_UNITY_GAIN, b, 96);
+    check("two voices with gain", out, expected, ARRAY_SIZE(a));
+}
+
+static void test_saturation(void)
+{
+    static const int16_t a[] = { 30000, -30000, 32767, -32768, 16384, -16384 };
+    static const int16_t expected[] = { 32767, -32768, 32767, -32768, 32767, -32768 };
+    int16_t out[ARRAY_SIZE(a)];
+    /* a * 2.0 */
+    mix(out, ARRAY_SIZE(a), AUDIO_MIXER_SIGNED, a, 2*AUDIO_MIXER_UNITY_GAIN, NULL, 0);
+    check("saturation", out, expected, ARRAY_SIZE(a));
+}
+
+static void test_offset_binary(void)
+{
+    static const int16_t a[] = { 0, -32768, 32767, 1, -1 };
+    static const int16_t expected[] = { (int16_t)0x8000, 0, (int16_t)0xffff, (int16_t)0x8001, 0x7fff };
+    int16_t out[ARRAY_SIZE(a)];
+    mix(out, ARRAY_SIZE(a), AUDIO_MIXER_OFFSET_BINARY, a, AUDIO_MIXER_UNITY_GAIN, NULL, 0);
+    check("offset binary", out, expected, ARRAY_SIZE(a));
+}
+
+/* compare with reference calculated in floating point */
+static void test_random(void)
+{
+    enum { SAMPLES = 4096, VOICES = 3 };
+    static int16_t src[VOICES][SAMPLES];
+    static int16_t expected[SAMPLES], out[SAMPLES];
+    static int32_t acc[SAMPLES];
+    int gains[VOICES];
+    int i, v;
+    srand(1);
+    for (v = 0; v < VOICES; v++) {
+        gains[v] = rand() % (AUDIO_MIXER_MAX_GAIN + 1);
+        for (i = 0; i < SAMPLES; i++) {
+            src[v][i] = (int16_t)(rand() & 0xffff);
+        }
+    }
+    memset(acc, 0, sizeof(acc));
+    for (v = 0; v < VOICES; v++) {
+        audio_mixer_add_16bit(acc, src[v], SAMPLES, gains[v]);
+    }
+    audio_mixer_output(out, acc, SAMPLES, AUDIO_MIXER_SIGNED);
+    for (i = 0; i < SAMPLES; i++) {
+        double sum = 0;
+        for (v = 0; v < VOICES; v++) {
+            sum += floor((double)src[v][i] * gains[v] / 256.0);
+        }
+        expected[i] = sum > 32767? 32767: sum < -32768? -32768: (int16_t)sum;
+    }
+    check("random 3 voices", out, expected, SAMPLES);
+}
+
+int main(void)
+{
+    test_unity();
+    test_8bit();
+    test_gain();
+    test_saturation();
+    test_offset_binary();
+    test_random();
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "audio_pool.h"
+
+void *audio_pool_acquire(audio_pool_t *pool)
+{
+    uint32_t used = __atomic_load_n(&pool->used, __ATOMIC_RELAXED);
+    uint32_t all = pool->count == 32? UINT32_MAX: (1u << pool->count) - 1;
+    uint32_t bit, n, high;
+    int index;
+
+    do {
+        if ((used & all) == all) {
+            __atomic_add_fetch(&pool->exhausted, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        index = __builtin_ctz(~used);
+        bit = 1u << index;
+    } while (!__atomic_compare_exchange_n(&pool->used, &used, used | bit,
+        true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    n = __builtin_popcount(used | bit);
+    high = __atomic_load_n(&pool->high_water, __ATOMIC_RELAXED);
+    while (n > high && !__atomic_compare_exchange_n(&pool->high_water, &high, n,
+        true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    return (uint8_t*)pool->blocks + index * pool->block_size;
+}
+
+void audio_pool_release(audio_pool_t *pool, void *obj)
+{
+    uint32_t index;
+    if (obj == NULL) {
+        return;
+    }
+    index = ((uint8_t*)obj - (uint8_t*)pool->blocks) / pool->block_size;
+    __atomic_and_fetch(&pool->used, ~(1u << index), __ATOMIC_RELEASE);
+}
+
+void audio_pool_get_stats(const audio_pool_t *pool, audio_pool_stats_t *stats)
+{
+    stats->count = pool->count;
+    stats->used = __builtin_popcount(__atomic_load_n(&pool->used, __ATOMIC_RELAXED));
+    stats->high_water = pool->high_water;
+    stats->exhausted = pool->exhausted;
+}
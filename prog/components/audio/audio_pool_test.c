@@ -0,0 +1,158 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_pool.c. acquires and releases objects from threads. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "audio_pool.h"
+
+#define THREADS     4
+#define ROUNDS      100000
+
+struct item {
+    int owner;
+    int value[3];
+};
+
+AUDIO_POOL_DEFINE(item_pool, struct item, 6)
+AUDIO_POOL_DEFINE(full_pool, int, 32)
+
+static int s_failed = 0;
+static int s_broken = 0;
+
+static void test_basic(void)
+{
+    struct item *items[6];
+    audio_pool_stats_t stats;
+    int i, j;
+    for (i = 0; i < 6; i++) {
+        items[i] = item_pool_acquire();
+        for (j = 0; j < i; j++) {
+            if (items[i] == NULL || items[i] == items[j]) {
+                printf("FAIL basic: acquire %d\n", i);
+                s_failed++;
+                return;
+            }
+        }
+    }
+    if (item_pool_acquire() != NULL) {
+        printf("FAIL basic: acquired from empty pool\n");
+        s_failed++;
+        return;
+    }
+    item_pool_release(items[3]);
+    if (item_pool_acquire() != items[3]) {
+        printf("FAIL basic: released item is not reused\n");
+        s_failed++;
+        return;
+    }
+    audio_pool_get_stats(&item_pool, &stats);
+    if (stats.count != 6 || stats.used != 6 || stats.high_water != 6 || stats.exhausted != 1) {
+        printf("FAIL basic: stats %u %u %u %u\n", stats.count, stats.used, stats.high_water, stats.exhausted);
+        s_failed++;
+        return;
+    }
+    for (i = 0; i < 6; i++) {
+        item_pool_release(items[i]);
+    }
+    item_pool_release(NULL);
+    item_pool.high_water = 0;
+    item_pool.exhausted = 0;
+    printf("ok   basic\n");
+}
+
+static void test_full(void)
+{
+    int *objs[32];
+    int i;
+    for (i = 0; i < 32; i++) {
+        objs[i] = full_pool_acquire();
+        if (objs[i] == NULL) {
+            printf("FAIL full: acquire %d\n", i);
+            s_failed++;
+            return;
+        }
+    }
+    if (full_pool_acquire() != NULL) {
+        printf("FAIL full: acquired 33rd\n");
+        s_failed++;
+        return;
+    }
+    for (i = 0; i < 32; i++) {
+        full_pool_release(objs[i]);
+    }
+    printf("ok   full\n");
+}
+
+static void *worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    struct item *held[2] = { NULL, NULL };
+    int r;
+    for (r = 0; r < ROUNDS; r++) {
+        int slot = r & 1;
+        if (held[slot] != NULL) {
+            if (held[slot]->owner != id || held[slot]->value[0] != r - 2) {
+                __atomic_add_fetch(&s_broken, 1, __ATOMIC_RELAXED);
+            }
+            item_pool_release(held[slot]);
+        }
+        held[slot] = item_pool_acquire();
+        if (held[slot] != NULL) {
+            held[slot]->owner = id;
+            held[slot]->value[0] = r;
+        }
+    }
+    item_pool_release(held[0]);
+    item_pool_release(held[1]);
+    return NULL;
+}
+
+static void test_threads(void)
+{
+    pthread_t threads[THREADS];
+    audio_pool_stats_t stats;
+    int i;
+    for (i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, worker, (void*)(intptr_t)i);
+    }
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    audio_pool_get_stats(&item_pool, &stats);
+    if (s_broken || stats.used != 0 || stats.high_water > 6) {
+        printf("FAIL threads: %d broken, %u used, high water %u\n", s_broken, stats.used, stats.high_water);
+        s_failed++;
+        return;
+    }
+    printf("ok   threads: high water %u, exhausted %u times\n", stats.high_water, stats.exhausted);
+}
+
+int main(void)
+{
+    test_basic();
+    test_full();
+    test_threads();
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
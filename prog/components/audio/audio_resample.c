@@ -0,0 +1,64 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include "audio_mixer.h"
+#include "audio_resample.h"
+
+void audio_resample_init(audio_resample_t *rs, uint32_t in_rate, uint32_t out_rate)
+{
+    rs->step = (uint32_t)((((uint64_t)in_rate << AUDIO_RESAMPLE_FRAC_BITS) + out_rate/2) / out_rate);
+    rs->pos = 0;
+    rs->last = 0;
+}
+
+int audio_resample_mix(audio_resample_t *rs, int32_t *acc, int out_samples,
+    const int16_t *src, int src_samples, int *consumed, int gain)
+{
+    uint32_t pos = rs->pos;
+    uint32_t k;
+    int n = 0;
+
+    /* output sample interpolates between s[i] and s[i+1] where s[0] is
+     * last and s[i] is src[i-1]. */
+    while (n < out_samples) {
+        uint32_t i = pos >> AUDIO_RESAMPLE_FRAC_BITS;
+        int32_t a, b, y;
+        if (i >= (uint32_t)src_samples) {
+            break;
+        }
+        a = i == 0? rs->last: src[i-1];
+        b = src[i];
+        /* use 15bit fraction not to overflow 32bit multiplication */
+        y = a + (((b - a) * (int32_t)((pos & (AUDIO_RESAMPLE_ONE-1)) >> 1)) >> 15);
+        if (gain == AUDIO_MIXER_UNITY_GAIN) {
+            acc[n++] += y;
+        } else {
+            acc[n++] += (y * gain) >> 8;
+        }
+        pos += rs->step;
+    }
+    k = pos >> AUDIO_RESAMPLE_FRAC_BITS;
+    if (k > (uint32_t)src_samples) {
+        k = src_samples;
+    }
+    if (k > 0) {
+        rs->last = src[k-1];
+    }
+    rs->pos = pos - (k << AUDIO_RESAMPLE_FRAC_BITS);
+    *consumed = k;
+    return n;
+}
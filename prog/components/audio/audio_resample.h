@@ -0,0 +1,69 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * streaming sample rate converter using linear interpolation.
+ * converts signed 16bit mono samples and adds result to mixer accumulator.
+ * state is kept per voice so that input can be given in arbitrary chunks.
+ */
+
+#define AUDIO_RESAMPLE_FRAC_BITS    16
+#define AUDIO_RESAMPLE_ONE          (1u << AUDIO_RESAMPLE_FRAC_BITS)
+
+typedef struct {
+    uint32_t step;  /* input samples advanced per output sample in Q16 */
+    uint32_t pos;   /* position of next output sample in Q16, relative to last */
+    int16_t last;   /* last input sample consumed */
+} audio_resample_t;
+
+/**
+ * @brief initialize resampler to convert in_rate to out_rate.
+ */
+extern void audio_resample_init(audio_resample_t *rs, uint32_t in_rate, uint32_t out_rate);
+
+/** @brief return true if resampler does not need to convert sampling rate. */
+static inline bool audio_resample_is_bypass(const audio_resample_t *rs)
+{
+    return rs->step == AUDIO_RESAMPLE_ONE;
+}
+
+/**
+ * @brief resample src and add result to acc with gain.
+ * @param[in,out] rs    resampler state.
+ * @param[in,out] acc   mixer accumulator.
+ * @param[in] out_samples   maximum number of output samples.
+ * @param[in] src       input samples.
+ * @param[in] src_samples   number of input samples.
+ * @param[out] consumed number of input samples consumed.
+ *                      remaining input must be passed again on next call.
+ * @param[in] gain      gain, see @ref AUDIO_MIXER_UNITY_GAIN.
+ * @return number of output samples added to acc.
+ */
+extern int audio_resample_mix(audio_resample_t *rs, int32_t *acc, int out_samples,
+    const int16_t *src, int src_samples, int *consumed, int gain);
+
+#ifdef __cplusplus
+}
+#endif
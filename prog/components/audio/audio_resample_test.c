@@ -0,0 +1,190 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_resample.c.
+ * resamples sine wave fed in random sized chunks and compares to ideal sine.
+ * run with "bench" argument to measure cost per output sample. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "audio_mixer.h"
+#include "audio_resample.h"
+
+#define OUT_RATE    16000
+#define OUT_SAMPLES 16000
+#define TONE        440.0
+#define AMPLITUDE   20000.0
+/* skip transient from initial zero history */
+#define SKIP        4
+
+static int s_failed = 0;
+
+static void make_sine(int16_t *dst, int samples, int rate)
+{
+    int i;
+    for (i = 0; i < samples; i++) {
+        dst[i] = (int16_t)lrint(AMPLITUDE * sin(2 * M_PI * TONE * i / rate));
+    }
+}
+
+/* resample src feeding random sized chunks and at most max_out samples at once. */
+static int resample(int32_t *acc, int out_samples, const int16_t *src, int src_samples,
+    int in_rate, int max_out)
+{
+    audio_resample_t rs;
+    int in = 0, out = 0;
+    audio_resample_init(&rs, in_rate, OUT_RATE);
+    while (out < out_samples && in < src_samples) {
+        int chunk = 1 + rand() % 300, consumed, n;
+        int limit = 1 + rand() % max_out;
+        if (chunk > src_samples - in) {
+            chunk = src_samples - in;
+        }
+        if (limit > out_samples - out) {
+            limit = out_samples - out;
+        }
+        n = audio_resample_mix(&rs, acc + out, limit, src + in, chunk, &consumed, AUDIO_MIXER_UNITY_GAIN);
+        if (n == 0 && consumed == 0) {
+            printf("FAIL rate %d: no progress at in=%d out=%d\n", in_rate, in, out);
+            s_failed++;
+            break;
+        }
+        in += consumed;
+        out += n;
+    }
+    return out;
+}
+
+static void test_accuracy(int in_rate, double min_snr)
+{
+    int src_samples = (int)((int64_t)OUT_SAMPLES * in_rate / OUT_RATE) + 2;
+    int16_t *src = malloc(src_samples * sizeof(*src));
+    int32_t *acc = calloc(OUT_SAMPLES, sizeof(*acc));
+    audio_resample_t rs;
+    double signal = 0, noise = 0, snr;
+    int out, i;
+
+    make_sine(src, src_samples, in_rate);
+    audio_resample_init(&rs, in_rate, OUT_RATE);
+    out = resample(acc, OUT_SAMPLES, src, src_samples, in_rate, 97);
+    for (i = SKIP; i < out; i++) {
+        /* output i is at input position i*step where position 1 is src[0] */
+        double t = ((double)i * rs.step / AUDIO_RESAMPLE_ONE - 1) / in_rate;
+        double ref = AMPLITUDE * sin(2 * M_PI * TONE * t);
+        signal += ref * ref;
+        noise += (acc[i] - ref) * (acc[i] - ref);
+    }
+    snr = noise == 0? INFINITY: 10 * log10(signal / noise);
+    if (out < OUT_SAMPLES - 2 || snr < min_snr) {
+        printf("FAIL %5d -> %d: %d samples, SNR %.1f dB\n", in_rate, OUT_RATE, out, snr);
+        s_failed++;
+    } else {
+        printf("ok   %5d -> %d: SNR %.1f dB\n", in_rate, OUT_RATE, snr);
+    }
+    free(src);
+    free(acc);
+}
+
+static void test_bypass(void)
+{
+    int16_t src[1000];
+    int32_t acc[1000];
+    int i, out;
+    for (i = 0; i < 1000; i++) {
+        src[i] = (int16_t)(rand() & 0xffff);
+    }
+    memset(acc, 0, sizeof(acc));
+    out = resample(acc, 1000, src, 1000, OUT_RATE, 50);
+    /* output is delayed by one sample because s[0] is history */
+    for (i = 1; i < out; i++) {
+        if (acc[i] != src[i-1]) {
+            printf("FAIL bypass: [%d] %d != %d\n", i, acc[i], src[i-1]);
+            s_failed++;
+            return;
+        }
+    }
+    printf("ok   bypass\n");
+}
+
+static uint64_t now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void bench(int in_rate)
+{
+    enum { BLOCK = 256, ROUNDS = 4000 };
+    int src_samples = BLOCK * 4;
+    int16_t *src = malloc(src_samples * sizeof(*src));
+    int32_t acc[BLOCK];
+    audio_resample_t rs;
+    uint64_t start, elapsed;
+    long total = 0;
+    int r;
+
+    make_sine(src, src_samples, in_rate);
+    audio_resample_init(&rs, in_rate, OUT_RATE);
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        int consumed;
+        total += audio_resample_mix(&rs, acc, BLOCK, src, src_samples, &consumed, AUDIO_MIXER_UNITY_GAIN);
+        rs.pos &= AUDIO_RESAMPLE_ONE - 1;
+    }
+    elapsed = now() - start;
+#if defined(__x86_64__) || defined(__i386__)
+    printf("%5d -> %d: %.2f cycles/sample\n", in_rate, OUT_RATE, (double)elapsed / total);
+#else
+    printf("%5d -> %d: %.2f ns/sample\n", in_rate, OUT_RATE, (double)elapsed / total);
+#endif
+    free(src);
+}
+
+int main(int argc, char *argv[])
+{
+    srand(1);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench(8000);
+        bench(11025);
+        bench(22050);
+        bench(44100);
+        bench(48000);
+        return 0;
+    }
+    test_bypass();
+    test_accuracy(8000, 30);
+    test_accuracy(11025, 30);
+    test_accuracy(22050, 30);
+    test_accuracy(44100, 30);
+    test_accuracy(48000, 30);
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
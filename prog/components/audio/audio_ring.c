@@ -0,0 +1,67 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "audio_ring.h"
+
+int audio_ring_init(audio_ring_t *ring, void *buffer, uint32_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return -1;
+    }
+    ring->buffer = buffer;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+    return 0;
+}
+
+uint32_t audio_ring_write_ptr(audio_ring_t *ring, void **ptr)
+{
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t pos = head & (ring->size - 1);
+    uint32_t n = ring->size - (head - tail);
+    if (n > ring->size - pos) {
+        n = ring->size - pos;
+    }
+    *ptr = ring->buffer + pos;
+    return n;
+}
+
+void audio_ring_write_commit(audio_ring_t *ring, uint32_t size)
+{
+    __atomic_store_n(&ring->head, ring->head + size, __ATOMIC_RELEASE);
+}
+
+uint32_t audio_ring_read_ptr(audio_ring_t *ring, const void **ptr)
+{
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t pos = tail & (ring->size - 1);
+    uint32_t n = head - tail;
+    if (n > ring->size - pos) {
+        n = ring->size - pos;
+    }
+    *ptr = ring->buffer + pos;
+    return n;
+}
+
+void audio_ring_read_commit(audio_ring_t *ring, uint32_t size)
+{
+    __atomic_store_n(&ring->tail, ring->tail + size, __ATOMIC_RELEASE);
+}
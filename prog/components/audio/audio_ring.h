@@ -0,0 +1,77 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * single producer, single consumer ring buffer of PCM data.
+ * head is only modified by producer and tail is only modified by consumer,
+ * so that the ring can be shared between two tasks without lock.
+ * head and tail are free running counters and size must be power of 2.
+ */
+
+typedef struct {
+    uint8_t *buffer;
+    uint32_t size;
+    uint32_t head;      /* written by producer */
+    uint32_t tail;      /* written by consumer */
+} audio_ring_t;
+
+/**
+ * @brief initialize ring with buffer.
+ * @return 0 for success, -1 if size is not power of 2.
+ */
+extern int audio_ring_init(audio_ring_t *ring, void *buffer, uint32_t size);
+
+/** @brief number of bytes available to read. */
+static inline uint32_t audio_ring_used(const audio_ring_t *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/** @brief number of bytes available to write. */
+static inline uint32_t audio_ring_free(const audio_ring_t *ring)
+{
+    return ring->size - audio_ring_used(ring);
+}
+
+/**
+ * @brief get contiguous writable region. producer only.
+ * @param[out] ptr  start of the region.
+ * @return size of the region in bytes.
+ */
+extern uint32_t audio_ring_write_ptr(audio_ring_t *ring, void **ptr);
+/** @brief publish size bytes written to the region returned by @ref audio_ring_write_ptr. */
+extern void audio_ring_write_commit(audio_ring_t *ring, uint32_t size);
+
+/**
+ * @brief get contiguous readable region. consumer only.
+ * @param[out] ptr  start of the region.
+ * @return size of the region in bytes.
+ */
+extern uint32_t audio_ring_read_ptr(audio_ring_t *ring, const void **ptr);
+/** @brief release size bytes read from the region returned by @ref audio_ring_read_ptr. */
+extern void audio_ring_read_commit(audio_ring_t *ring, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
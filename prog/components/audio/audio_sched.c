@@ -0,0 +1,40 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include "audio_sched.h"
+
+void audio_sched_start(audio_sched_t *sched, uint32_t rate, int64_t now, uint32_t latency)
+{
+    sched->rate = rate;
+    sched->origin = now + (int64_t)latency * 1000000 / rate;
+}
+
+uint32_t audio_sched_delay(const audio_sched_t *sched, uint64_t position, int64_t time, int32_t *error)
+{
+    int64_t target, late;
+    uint32_t delay = 0;
+    if (time > sched->origin) {
+        /* nearest sample to time */
+        target = ((time - sched->origin) * sched->rate + 500000) / 1000000;
+        if (target > (int64_t)position) {
+            delay = target - position > UINT32_MAX? UINT32_MAX: target - position;
+        }
+    }
+    late = audio_sched_time(sched, position + delay) - time;
+    *error = late > INT32_MAX? INT32_MAX: late < INT32_MIN? INT32_MIN: late;
+    return delay;
+}
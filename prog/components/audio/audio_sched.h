@@ -0,0 +1,75 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * maps position in output stream to time when the sample is played,
+ * to start audio at requested time by inserting silence before it.
+ * output is assumed to be played continuously at fixed rate since start,
+ * except gaps reported by @ref audio_sched_shift.
+ */
+
+typedef struct {
+    int64_t origin;     /* time when sample 0 of stream is played in usec */
+    uint32_t rate;      /* output sampling rate */
+} audio_sched_t;
+
+/**
+ * @brief start timeline of output stream.
+ * @param[out] sched    timeline.
+ * @param[in] rate      output sampling rate.
+ * @param[in] now       time when output hardware started in usec.
+ * @param[in] latency   number of samples played before sample 0, e.g. zeroed DMA buffers.
+ */
+extern void audio_sched_start(audio_sched_t *sched, uint32_t rate, int64_t now, uint32_t latency);
+
+/**
+ * @brief delay timeline after output stalled, e.g. DMA ran out of data.
+ * @param[in,out] sched timeline.
+ * @param[in] gap       time output was stopped in usec. samples after it are played later by this.
+ */
+static inline void audio_sched_shift(audio_sched_t *sched, int64_t gap)
+{
+    sched->origin += gap;
+}
+
+/** @brief return time when sample at position is played in usec. */
+static inline int64_t audio_sched_time(const audio_sched_t *sched, uint64_t position)
+{
+    return sched->origin + (int64_t)(position * 1000000 / sched->rate);
+}
+
+/**
+ * @brief number of silent samples to insert at position so that next sample is played at time.
+ * @param[in] sched     timeline.
+ * @param[in] position  position in output stream where audio would start.
+ * @param[in] time      requested time in usec.
+ * @param[out] error    time the audio will actually start minus requested time in usec.
+ *                      positive when it is too late to start at time.
+ * @return number of samples of silence.
+ */
+extern uint32_t audio_sched_delay(const audio_sched_t *sched, uint64_t position, int64_t time, int32_t *error);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,245 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_sched.c.
+ * simulates audio_task and writer_task feeding fake I2S with DMA buffers,
+ * and checks first sample of scheduled audio is played at requested time
+ * within one DMA buffer. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "audio_sched.h"
+
+#define RATE            16000
+#define DMA_BUF_COUNT   2
+#define DMA_BUF_LEN     1024
+#define MIX_BLOCK       256
+#define RING_SAMPLES    4096
+#define CLIP_SAMPLES    100
+#define CLIP_VALUE      1000
+/* I2S output of simulation */
+#define SINK_SAMPLES    (RATE * 8)
+
+static int s_failed = 0;
+
+/* fake I2S. zeroed DMA buffers are played first after start,
+ * then buffer of written data is played in order without gap. */
+typedef struct {
+    double start;           /* time when I2S started in usec */
+    uint64_t written;       /* samples passed to i2s_write */
+    int16_t out[SINK_SAMPLES];
+} fake_i2s_t;
+
+/* time when sample index w passed to i2s_write is played */
+static double i2s_play_time(const fake_i2s_t *i2s, uint64_t w)
+{
+    return i2s->start + (DMA_BUF_COUNT * DMA_BUF_LEN + w) * 1e6 / RATE;
+}
+
+/* i2s_write of one DMA buffer blocks until the buffer played before is freed. return time it returns. */
+static double i2s_write(fake_i2s_t *i2s, const int16_t *data, int n, double now)
+{
+    double freed = i2s->start + (i2s->written / DMA_BUF_LEN + 1) * (double)DMA_BUF_LEN * 1e6 / RATE;
+    if (i2s->written + n <= SINK_SAMPLES) {
+        memcpy(i2s->out + i2s->written, data, n * sizeof(*data));
+    }
+    i2s->written += n;
+    return now > freed? now: freed;
+}
+
+typedef struct {
+    int64_t request;    /* requested time to start */
+    double arrival;     /* time when audio_play_at is called */
+    int late;           /* expected to be too late */
+} request_t;
+
+/* run stream started by first request. return worst error in usec. */
+static double simulate(const request_t *reqs, int count, double wake, double jitter)
+{
+    static fake_i2s_t i2s;
+    static int16_t ring[RING_SAMPLES];
+    audio_sched_t sched;
+    uint64_t produced = 0, first[8];
+    int32_t reported[8];
+    double now = reqs[0].arrival + wake, worst = 0;
+    int next = 0, playing = -1, clip_pos = 0, i;
+    uint32_t delay = 0;
+
+    memset(&i2s, 0, sizeof(i2s));
+    /* audio_task reads esp_timer, then I2S starts a bit later */
+    audio_sched_start(&sched, RATE, (int64_t)now, DMA_BUF_COUNT * DMA_BUF_LEN);
+    i2s.start = now + jitter;
+
+    while (i2s.written < SINK_SAMPLES - DMA_BUF_LEN) {
+        /* mix_task fills ring by blocks */
+        while (produced - i2s.written + MIX_BLOCK <= RING_SAMPLES) {
+            int16_t *block = ring + produced % RING_SAMPLES;
+            int n = 0;
+            memset(block, 0, MIX_BLOCK * sizeof(*block));
+            while (n < MIX_BLOCK) {
+                if (playing < 0) {
+                    if (next >= count || reqs[next].arrival > now) {
+                        break;
+                    }
+                    /* start voice of next item */
+                    playing = next++;
+                    delay = audio_sched_delay(&sched, produced + n, reqs[playing].request, &reported[playing]);
+                    first[playing] = produced + n + delay;
+                    clip_pos = 0;
+                }
+                if (delay > 0) {
+                    int d = delay < (uint32_t)(MIX_BLOCK - n)? (int)delay: MIX_BLOCK - n;
+                    delay -= d;
+                    n += d;
+                    continue;
+                }
+                block[n++] = CLIP_VALUE;
+                if (++clip_pos == CLIP_SAMPLES) {
+                    playing = -1;
+                }
+            }
+            produced += MIX_BLOCK;
+        }
+        /* writer_task passes one DMA buffer to I2S */
+        now = i2s_write(&i2s, ring + i2s.written % RING_SAMPLES, DMA_BUF_LEN, now);
+    }
+
+    for (i = 0; i < count; i++) {
+        double played, error;
+        if (i >= next || first[i] >= SINK_SAMPLES || i2s.out[first[i]] != CLIP_VALUE ||
+            (first[i] > 0 && i2s.out[first[i] - 1] != 0)) {
+            printf("FAIL request %d is not played\n", i);
+            s_failed++;
+            return -1;
+        }
+        played = i2s_play_time(&i2s, first[i]);
+        error = played - reqs[i].request;
+        /* reported error does not know jitter and is rounded to sample */
+        if ((reqs[i].late? error <= 0: error < -1e6 / RATE || error > 1e6 * DMA_BUF_LEN / RATE) ||
+            error - reported[i] > jitter + 1e6 / RATE || error - reported[i] < -1e6 / RATE) {
+            printf("FAIL request %d error %.0f us, reported %d us\n", i, error, reported[i]);
+            s_failed++;
+            return -1;
+        }
+        if (!reqs[i].late && (error > worst || -error > worst)) {
+            worst = error > 0? error: -error;
+        }
+    }
+    return worst;
+}
+
+/* starting from idle, audio starts at requested time with error of I2S start jitter */
+static void test_idle(void)
+{
+    double worst = 0;
+    int round;
+    for (round = 0; round < 200; round++) {
+        request_t req = { 0, 0, 0 };
+        double wake = rand() % 3000, jitter = rand() % 300;
+        double error;
+        req.arrival = 1000000 + rand() % 1000000;
+        req.request = (int64_t)req.arrival + 200000 + rand() % 800000;
+        error = simulate(&req, 1, wake, jitter);
+        if (error < 0) {
+            return;
+        }
+        if (error > jitter + 1e6 / RATE) {
+            printf("FAIL idle: error %.0f us with jitter %.0f us\n", error, jitter);
+            s_failed++;
+            return;
+        }
+        if (error > worst) {
+            worst = error;
+        }
+    }
+    printf("ok   idle: worst error %.0f us\n", worst);
+}
+
+/* requests queued while playing. audio already in ring and DMA buffers,
+ * 384 ms here, cannot be delayed. */
+static void test_stream(void)
+{
+    request_t reqs[4] = {
+        { 1300000, 1000000, 0 },
+        { 2000000, 1500000, 0 },
+        { 2500000, 2050000, 0 },
+        { 3000000, 2800000, 1 },    /* too late */
+    };
+    double error = simulate(reqs, 4, 500, 100);
+    if (error >= 0) {
+        printf("ok   stream: worst error %.0f us\n", error);
+    }
+}
+
+static void test_delay(void)
+{
+    audio_sched_t sched;
+    int32_t error;
+    uint32_t delay;
+    audio_sched_start(&sched, RATE, 1000000, DMA_BUF_COUNT * DMA_BUF_LEN);
+    /* first sample is played after two DMA buffers: 128 ms */
+    delay = audio_sched_delay(&sched, 0, 1128000, &error);
+    if (delay != 0 || error != 0) {
+        printf("FAIL delay: origin %d %d\n", delay, error);
+        s_failed++;
+        return;
+    }
+    /* one second later is RATE samples later */
+    delay = audio_sched_delay(&sched, 100, 2128000, &error);
+    if (delay != RATE - 100 || error != 0) {
+        printf("FAIL delay: 1 sec %d %d\n", delay, error);
+        s_failed++;
+        return;
+    }
+    /* rounded to nearest sample */
+    delay = audio_sched_delay(&sched, 0, 1128000 + 40, &error);
+    if (delay != 1 || error != 22) {
+        printf("FAIL delay: rounding %d %d\n", delay, error);
+        s_failed++;
+        return;
+    }
+    /* too late */
+    delay = audio_sched_delay(&sched, RATE, 1128000, &error);
+    if (delay != 0 || error != 1000000) {
+        printf("FAIL delay: late %d %d\n", delay, error);
+        s_failed++;
+        return;
+    }
+    /* output stalled 1 sec, so position of 1 sec is played at 2 sec */
+    audio_sched_shift(&sched, 1000000);
+    delay = audio_sched_delay(&sched, RATE, 3128000, &error);
+    if (delay != 0 || error != 0) {
+        printf("FAIL delay: shift %d %d\n", delay, error);
+        s_failed++;
+        return;
+    }
+    printf("ok   delay\n");
+}
+
+int main(void)
+{
+    srand(1);
+    test_delay();
+    test_idle();
+    test_stream();
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,645 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio.c on simulated FreeRTOS and I2S of sim/.
+ * whole pipeline of queue, mixer and writer task runs on threads and output
+ * written to I2S is checked sample by sample.
+ * set SIM_WAV to directory to save output of each test as WAV and CSV log.
+ * set SIM_LOG_LEVEL to 1..5 to see ESP_LOG of audio.c.
+ * run with "bench" argument to measure CPU time per sample of whole pipeline.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio.h"
+#include "audio_event.h"
+#include "esp_timer.h"
+#include "riffwave.h"
+#include "sim_i2s.h"
+
+#define RATE        16000
+
+/* audio source generating samples identifying itself */
+struct source {
+    int id;
+    int samples;
+    int pos;
+    int calls;
+    int done;
+    int stall_at;       /* position to block once like slow decoder */
+    int stall_usec;
+};
+
+static int s_failed = 0;
+
+static int16_t source_value(int id, int pos)
+{
+    return (id + 1) * 1000 + pos % 500;
+}
+
+static int source_data_func(void *arg, void *data, int *size)
+{
+    struct source *src = (struct source*)arg;
+    int16_t *dst = (int16_t*)data;
+    int n, i;
+    if (data == NULL) {
+        __atomic_add_fetch(&src->done, 1, __ATOMIC_RELEASE);
+        return 0;
+    }
+    __atomic_add_fetch(&src->calls, 1, __ATOMIC_RELEASE);
+    if (src->stall_usec > 0 && src->pos >= src->stall_at) {
+        usleep(src->stall_usec);
+        src->stall_usec = 0;
+    }
+    n = *size / 2;
+    if (n > src->samples - src->pos) {
+        n = src->samples - src->pos;
+    }
+    for (i = 0; i < n; i++) {
+        dst[i] = source_value(src->id, src->pos + i);
+    }
+    src->pos += n;
+    *size = n * 2;
+    return src->pos < src->samples;
+}
+
+static void source_init(struct source *src, int id, int samples)
+{
+    memset(src, 0, sizeof(*src));
+    src->id = id;
+    src->samples = samples;
+}
+
+static void play_source(struct source *src, audio_queue_mode_t mode)
+{
+    audio_play(source_data_func, src, RATE, 1, 16, mode);
+}
+
+static void wait_called(struct source *src)
+{
+    while (__atomic_load_n(&src->calls, __ATOMIC_ACQUIRE) == 0) {
+        usleep(1000);
+    }
+}
+
+static void save_output(const char *name)
+{
+    const char *dir = getenv("SIM_WAV");
+    char path[256];
+    if (dir == NULL) {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/%s.wav", dir, name);
+    sim_i2s_save_wav(path);
+    snprintf(path, sizeof(path), "%s/%s.csv", dir, name);
+    sim_i2s_save_log(path);
+}
+
+/* compare output from pos with samples of source. return position after it or -1. */
+static int match_source(const char *name, const int16_t *out, size_t count, int pos,
+    const struct source *src)
+{
+    int i;
+    if (pos < 0 || pos + src->samples > (int)count) {
+        printf("FAIL %s: source %d exceeds output %d + %d > %d\n", name, src->id, pos, src->samples, (int)count);
+        s_failed++;
+        return -1;
+    }
+    for (i = 0; i < src->samples; i++) {
+        if (out[pos + i] != source_value(src->id, i)) {
+            printf("FAIL %s: source %d sample %d at %d is %d\n", name, src->id, i, pos + i, out[pos + i]);
+            s_failed++;
+            return -1;
+        }
+    }
+    return pos + src->samples;
+}
+
+/* skip zeros played from DMA buffers cleared at start */
+static int skip_preroll(const char *name, const int16_t *out, size_t count)
+{
+    int dma = sim_i2s_get_dma_samples();
+    int i;
+    for (i = 0; i < dma && i < (int)count; i++) {
+        if (out[i] != 0) {
+            printf("FAIL %s: pre-roll sample %d is %d\n", name, i, out[i]);
+            s_failed++;
+            return -1;
+        }
+    }
+    return dma;
+}
+
+static bool check_done(const char *name, struct source *srcs, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        if (srcs[i].done != 1) {
+            printf("FAIL %s: source %d done %d times\n", name, srcs[i].id, srcs[i].done);
+            s_failed++;
+            return false;
+        }
+    }
+    return true;
+}
+
+/* queued audio plays back to back in one output session */
+static void test_gapless(void)
+{
+    struct source srcs[3];
+    const int16_t *out;
+    size_t count;
+    int pos, i;
+    sim_i2s_reset();
+    sim_i2s_hold(true);
+    /* larger than PCM ring, so session waits for writer until all are queued */
+    source_init(&srcs[0], 0, 6000);
+    source_init(&srcs[1], 1, 777);
+    source_init(&srcs[2], 2, 5001);
+    for (i = 0; i < 3; i++) {
+        play_source(&srcs[i], AUDIO_ENQUEUE);
+    }
+    sim_i2s_hold(false);
+    audio_wait();
+    save_output("gapless");
+    out = sim_i2s_get_samples(&count);
+    pos = skip_preroll("gapless", out, count);
+    for (i = 0; i < 3; i++) {
+        pos = match_source("gapless", out, count, pos, &srcs[i]);
+    }
+    if (pos < 0 || !check_done("gapless", srcs, 3)) {
+        return;
+    }
+    if (pos != (int)count || sim_i2s_get_starts() != 1) {
+        printf("FAIL gapless: %d samples after audio, %d starts\n", (int)count - pos, sim_i2s_get_starts());
+        s_failed++;
+        return;
+    }
+    printf("ok   gapless\n");
+}
+
+/* immediate audio plays before queued audio */
+static void test_immediate(void)
+{
+    struct source srcs[3];
+    const int16_t *out;
+    size_t count;
+    int pos;
+    sim_i2s_reset();
+    sim_i2s_hold(true);
+    source_init(&srcs[0], 0, 16000);
+    source_init(&srcs[1], 1, 2000);
+    source_init(&srcs[2], 2, 2000);
+    play_source(&srcs[0], AUDIO_ENQUEUE);
+    wait_called(&srcs[0]);
+    play_source(&srcs[1], AUDIO_ENQUEUE);
+    play_source(&srcs[2], AUDIO_IMMEDIATE);
+    sim_i2s_hold(false);
+    audio_wait();
+    save_output("immediate");
+    out = sim_i2s_get_samples(&count);
+    pos = skip_preroll("immediate", out, count);
+    pos = match_source("immediate", out, count, pos, &srcs[0]);
+    pos = match_source("immediate", out, count, pos, &srcs[2]);
+    pos = match_source("immediate", out, count, pos, &srcs[1]);
+    if (pos < 0 || !check_done("immediate", srcs, 3)) {
+        return;
+    }
+    printf("ok   immediate\n");
+}
+
+/* replace stops playing and queued audio and restarts output */
+static void test_replace(void)
+{
+    struct source srcs[3];
+    const int16_t *out;
+    size_t count;
+    int pos, i;
+    sim_i2s_reset();
+    /* writer must keep draining while audio_stop waits */
+    sim_i2s_set_speed(20);
+    source_init(&srcs[0], 0, 32000);
+    source_init(&srcs[1], 1, 2000);
+    source_init(&srcs[2], 3, 4000);
+    play_source(&srcs[0], AUDIO_ENQUEUE);
+    play_source(&srcs[1], AUDIO_ENQUEUE);
+    wait_called(&srcs[0]);
+    play_source(&srcs[2], AUDIO_REPLACE);
+    audio_wait();
+    sim_i2s_set_speed(0);
+    save_output("replace");
+    out = sim_i2s_get_samples(&count);
+    if (!check_done("replace", srcs, 3)) {
+        return;
+    }
+    for (i = 0; i < (int)count; i++) {
+        if (out[i] / 1000 == 2) {
+            printf("FAIL replace: replaced source played at %d\n", i);
+            s_failed++;
+            return;
+        }
+    }
+    if (srcs[0].pos == srcs[0].samples || srcs[1].calls != 0) {
+        printf("FAIL replace: replaced source played to end\n");
+        s_failed++;
+        return;
+    }
+    pos = match_source("replace", out, count, (int)count - srcs[2].samples, &srcs[2]);
+    if (pos < 0) {
+        return;
+    }
+    if (sim_i2s_get_starts() != 2) {
+        printf("FAIL replace: %d starts\n", sim_i2s_get_starts());
+        s_failed++;
+        return;
+    }
+    printf("ok   replace\n");
+}
+
+static uint8_t *make_wav(const int16_t *samples, int count, uint32_t *size)
+{
+    uint32_t data_length = count * 2;
+    uint8_t *wav = malloc(MIN_RIFFWAVE_SIZE + data_length);
+    uint8_t *p = wav;
+#define PUT(value, bytes) do { uint32_t v_ = (value); int b_; \
+        for (b_ = 0; b_ < (bytes); b_++) { *p++ = v_ & 0xff; v_ >>= 8; } } while (0)
+    memcpy(p, "RIFF", 4); p += 4;
+    PUT(36 + data_length, 4);
+    memcpy(p, "WAVEfmt ", 8); p += 8;
+    PUT(16, 4);
+    PUT(1, 2);
+    PUT(1, 2);
+    PUT(RATE, 4);
+    PUT(RATE * 2, 4);
+    PUT(2, 2);
+    PUT(16, 2);
+    memcpy(p, "data", 4); p += 4;
+    PUT(data_length, 4);
+#undef PUT
+    memcpy(p, samples, data_length);
+    *size = MIN_RIFFWAVE_SIZE + data_length;
+    return wav;
+}
+
+/* wav loops until playsize is played, by copy and by pointer */
+static int s_stop_hook;    /* 1 if armed, 2 while audio task is held */
+
+/* hold audio task after its last stop check, while it still plays */
+static void stop_hook(esp_event_base_t event_base, int32_t event_id)
+{
+    int armed = 1;
+    if (event_base == AUDIO_EVENT && event_id == AUDIO_EVENT_STOPPED &&
+        __atomic_compare_exchange_n(&s_stop_hook, &armed, 2, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        usleep(20000);
+    }
+}
+
+/* audio_stop at end of previous audio must not drop next audio,
+ * like voice_saynow after audio_stop in app_mode_clock.c */
+static void test_stop_at_end(void)
+{
+    struct source first, next;
+    sim_i2s_reset();
+    source_init(&first, 0, 300);
+    source_init(&next, 1, 300);
+    sim_event_hook = stop_hook;
+    s_stop_hook = 1;
+    play_source(&first, AUDIO_ENQUEUE);
+    while (__atomic_load_n(&s_stop_hook, __ATOMIC_ACQUIRE) != 2) {
+        usleep(1000);
+    }
+    audio_stop();
+    play_source(&next, AUDIO_ENQUEUE);
+    audio_wait();
+    sim_event_hook = NULL;
+    if (first.done != 1 || next.done != 1 || next.pos != next.samples) {
+        printf("FAIL stop at end: next played %d of %d, done %d\n", next.pos, next.samples, next.done);
+        s_failed++;
+        return;
+    }
+    printf("ok   stop at end\n");
+}
+
+static void play_source_profile(struct source *src, audio_profile_t profile)
+{
+    audio_play_opts_t opts = {
+        .gain = AUDIO_GAIN_UNITY,
+        .profile = profile,
+    };
+    audio_play_ex(source_data_func, src, RATE, 1, 16, AUDIO_ENQUEUE, &opts);
+}
+
+/* switching profile restarts output without reinstalling driver, which would use heap */
+static void test_profile_switch(void)
+{
+    struct source srcs[3];
+    const int16_t *out;
+    size_t count;
+    int installs = sim_i2s_get_installs();
+    int pos, i;
+    sim_i2s_reset();
+    source_init(&srcs[0], 0, 500);
+    source_init(&srcs[1], 1, 700);
+    source_init(&srcs[2], 2, 300);
+    play_source_profile(&srcs[0], AUDIO_PROFILE_LOW_LATENCY);
+    play_source_profile(&srcs[1], AUDIO_PROFILE_DEFAULT);
+    play_source_profile(&srcs[2], AUDIO_PROFILE_THROUGHPUT);
+    audio_wait();
+    out = sim_i2s_get_samples(&count);
+    pos = 0;
+    for (i = 0; i < 3; i++) {
+        /* each profile plays in its own session after zeroed DMA buffers */
+        int dma = skip_preroll("profile", out + pos, count - pos);
+        if (dma < 0) {
+            return;
+        }
+        pos = match_source("profile", out, count, pos + dma, &srcs[i]);
+        if (pos < 0) {
+            return;
+        }
+    }
+    if (sim_i2s_get_installs() != installs || sim_i2s_get_starts() != 3) {
+        printf("FAIL profile: %d installs, %d starts\n", sim_i2s_get_installs() - installs,
+            sim_i2s_get_starts());
+        s_failed++;
+        return;
+    }
+    printf("ok   profile switch\n");
+}
+
+/* audio_play_at after underrun starts at requested time, as output stalled
+ * while decoder is blocked delays timeline. needs paced DMA to make underrun. */
+static void test_underrun_schedule(void)
+{
+    struct source first, next;
+    audio_stats_t stats;
+    const sim_i2s_log_t *log;
+    const int16_t *out;
+    size_t count, entries;
+    int64_t start, actual;
+    int i;
+    sim_i2s_reset();
+    sim_i2s_set_speed(1);
+    audio_reset_stats();
+    source_init(&first, 0, 4000);
+    first.stall_at = 1000;
+    first.stall_usec = 200000;
+    source_init(&next, 1, 1000);
+    start = esp_timer_get_time() + 600000;
+    play_source(&first, AUDIO_ENQUEUE);
+    audio_play_at(source_data_func, &next, RATE, 1, 16, start);
+    audio_wait();
+    sim_i2s_set_speed(0);
+    save_output("underrun_schedule");
+    audio_get_stats(&stats);
+    out = sim_i2s_get_samples(&count);
+    log = sim_i2s_get_log(&entries);
+    if (!check_done("underrun schedule", &first, 1) || !check_done("underrun schedule", &next, 1)) {
+        return;
+    }
+    if (stats.underruns == 0) {
+        printf("FAIL underrun schedule: no underrun\n");
+        s_failed++;
+        return;
+    }
+    for (i = 0; i < (int)count && out[i] / 1000 != 2; i++) {
+    }
+    if (entries == 0 || log[0].event != SIM_I2S_START || match_source("underrun schedule", out, count, i, &next) < 0) {
+        return;
+    }
+    /* recording has silence for stall, so position is time since start */
+    actual = log[0].time + (int64_t)i * 1000000 / RATE;
+    if (llabs(actual - start) > 10000 || llabs(stats.schedule_error) > 10000) {
+        printf("FAIL underrun schedule: played %lld usec late, schedule error %d\n",
+            (long long)(actual - start), stats.schedule_error);
+        s_failed++;
+        return;
+    }
+    printf("ok   underrun schedule\n");
+}
+
+static void test_playsize(void)
+{
+    const char *name = "playsize";
+    int16_t samples[1000];
+    struct wav_play_info info;
+    const int16_t *out;
+    size_t count;
+    uint8_t *wav;
+    uint32_t size;
+    int pos, i, total;
+    for (i = 0; i < 1000; i++) {
+        samples[i] = source_value(5, i) + i / 500;
+    }
+    wav = make_wav(samples, 1000, &size);
+    if (audio_wav_play_init(&info, wav, size) != ESP_OK) {
+        printf("FAIL %s: init\n", name);
+        s_failed++;
+        free(wav);
+        return;
+    }
+    info.playsize = info.wav_info.data_length * 5 / 2;
+    total = 2500;
+    sim_i2s_reset();
+    audio_wav_play(&info, NULL);
+    audio_wait();
+    save_output("playsize");
+    out = sim_i2s_get_samples(&count);
+    pos = skip_preroll(name, out, count);
+    if (pos < 0) {
+        free(wav);
+        return;
+    }
+    if ((int)count - pos != total) {
+        printf("FAIL %s: %d samples played, expected %d\n", name, (int)count - pos, total);
+        s_failed++;
+        free(wav);
+        return;
+    }
+    for (i = 0; i < total; i++) {
+        if (out[pos + i] != samples[i % 1000]) {
+            printf("FAIL %s: sample %d is %d\n", name, i, out[pos + i]);
+            s_failed++;
+            free(wav);
+            return;
+        }
+    }
+    free(wav);
+    printf("ok   %s\n", name);
+}
+
+/* samples read in place by data_ptr_func, like memory mapped flash */
+struct mapped {
+    const int16_t *samples;
+    int count;
+    int pos;
+    int done;
+};
+
+static int mapped_ptr_func(void *arg, const void **data, int *size)
+{
+    struct mapped *src = (struct mapped*)arg;
+    int n = *size / 2;
+    if (n > src->count - src->pos) {
+        n = src->count - src->pos;
+    }
+    *data = src->samples + src->pos;
+    *size = n * 2;
+    src->pos += n;
+    return src->pos < src->count;
+}
+
+static int mapped_done_func(void *arg, void *data, int *size)
+{
+    struct mapped *src = (struct mapped*)arg;
+    if (data == NULL && size == NULL) {
+        src->done++;
+    }
+    return 0;
+}
+
+static void test_mapped(void)
+{
+    int16_t samples[2500];
+    struct mapped src = { samples, 2500, 0, 0 };
+    audio_play_opts_t opts = {
+        .gain = AUDIO_GAIN_UNITY,
+        .data_ptr_func = mapped_ptr_func,
+    };
+    const int16_t *out;
+    size_t count;
+    int pos, i;
+    for (i = 0; i < src.count; i++) {
+        samples[i] = source_value(6, i);
+    }
+    sim_i2s_reset();
+    audio_play_ex(mapped_done_func, &src, RATE, 1, 16, AUDIO_ENQUEUE, &opts);
+    audio_wait();
+    save_output("mapped");
+    out = sim_i2s_get_samples(&count);
+    pos = skip_preroll("mapped", out, count);
+    if (pos < 0) {
+        return;
+    }
+    if ((int)count - pos != src.count || src.done != 1) {
+        printf("FAIL mapped: %d samples played, done %d\n", (int)count - pos, src.done);
+        s_failed++;
+        return;
+    }
+    for (i = 0; i < src.count; i++) {
+        if (out[pos + i] != samples[i]) {
+            printf("FAIL mapped: sample %d is %d\n", i, out[pos + i]);
+            s_failed++;
+            return;
+        }
+    }
+    printf("ok   mapped\n");
+}
+
+static double cpu_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* tone source of any format for bench */
+struct tone {
+    int channels;
+    int remain;
+    int phase;
+};
+
+static int tone_data_func(void *arg, void *data, int *size)
+{
+    struct tone *tone = (struct tone*)arg;
+    int16_t *dst = (int16_t*)data;
+    int frames, i, c;
+    if (data == NULL) {
+        return 0;
+    }
+    frames = *size / 2 / tone->channels;
+    if (frames > tone->remain) {
+        frames = tone->remain;
+    }
+    for (i = 0; i < frames; i++) {
+        int16_t value = (tone->phase++ & 0x3f) * 256 - 8192;
+        for (c = 0; c < tone->channels; c++) {
+            *dst++ = value;
+        }
+    }
+    tone->remain -= frames;
+    *size = frames * 2 * tone->channels;
+    return tone->remain > 0;
+}
+
+static void bench_one(const char *name, int samplerate, int channels)
+{
+    const int seconds = 60;
+    struct tone tone = { channels, samplerate * seconds, 0 };
+    double start;
+    size_t count;
+    sim_i2s_reset();
+    start = cpu_sec();
+    audio_play(tone_data_func, &tone, samplerate, channels, 16, AUDIO_ENQUEUE);
+    audio_wait();
+    sim_i2s_get_samples(&count);
+    printf("%-24s %6.1f nsec/output sample (%d samples)\n", name,
+        (cpu_sec() - start) * 1e9 / count, (int)count);
+}
+
+static void bench(void)
+{
+    bench_one("16000Hz mono", 16000, 1);
+    bench_one("22050Hz stereo", 22050, 2);
+    bench_one("44100Hz stereo", 44100, 2);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *level = getenv("SIM_LOG_LEVEL");
+    if (level != NULL) {
+        extern int sim_log_level;
+        sim_log_level = atoi(level);
+    }
+    if (audio_init() != ESP_OK) {
+        printf("FAIL audio_init\n");
+        return 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+    test_gapless();
+    test_immediate();
+    test_replace();
+    test_stop_at_end();
+    test_profile_switch();
+    test_underrun_schedule();
+    test_playsize();
+    test_mapped();
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
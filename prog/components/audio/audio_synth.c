@@ -0,0 +1,329 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "audio_synth.h"
+
+/* tables are generated by
+ *   sine:        32767*sin(2*pi*i/N)
+ *   square:      +-32767
+ *   soft square: sin(x)+sin(3x)/3+sin(5x)/5 normalized to 32767 */
+static const int16_t s_sine[AUDIO_SYNTH_TABLE_SIZE] = {
+         0,    804,   1608,   2410,   3212,   4011,   4808,   5602,
+      6393,   7179,   7962,   8739,   9512,  10278,  11039,  11793,
+     12539,  13279,  14010,  14732,  15446,  16151,  16846,  17530,
+     18204,  18868,  19519,  20159,  20787,  21403,  22005,  22594,
+     23170,  23731,  24279,  24811,  25329,  25832,  26319,  26790,
+     27245,  27683,  28105,  28510,  28898,  29268,  29621,  29956,
+     30273,  30571,  30852,  31113,  31356,  31580,  31785,  31971,
+     32137,  32285,  32412,  32521,  32609,  32678,  32728,  32757,
+     32767,  32757,  32728,  32678,  32609,  32521,  32412,  32285,
+     32137,  31971,  31785,  31580,  31356,  31113,  30852,  30571,
+     30273,  29956,  29621,  29268,  28898,  28510,  28105,  27683,
+     27245,  26790,  26319,  25832,  25329,  24811,  24279,  23731,
+     23170,  22594,  22005,  21403,  20787,  20159,  19519,  18868,
+     18204,  17530,  16846,  16151,  15446,  14732,  14010,  13279,
+     12539,  11793,  11039,  10278,   9512,   8739,   7962,   7179,
+      6393,   5602,   4808,   4011,   3212,   2410,   1608,    804,
+         0,   -804,  -1608,  -2410,  -3212,  -4011,  -4808,  -5602,
+     -6393,  -7179,  -7962,  -8739,  -9512, -10278, -11039, -11793,
+    -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530,
+    -18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+    -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+    -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956,
+    -30273, -30571, -30852, -31113, -31356, -31580, -31785, -31971,
+    -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+    -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285,
+    -32137, -31971, -31785, -31580, -31356, -31113, -30852, -30571,
+    -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+    -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731,
+    -23170, -22594, -22005, -21403, -20787, -20159, -19519, -18868,
+    -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+    -12539, -11793, -11039, -10278,  -9512,  -8739,  -7962,  -7179,
+     -6393,  -5602,  -4808,  -4011,  -3212,  -2410,  -1608,   -804,
+};
+
+static const int16_t s_square[AUDIO_SYNTH_TABLE_SIZE] = {
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+     32767,  32767,  32767,  32767,  32767,  32767,  32767,  32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+    -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+};
+
+static const int16_t s_soft_square[AUDIO_SYNTH_TABLE_SIZE] = {
+         0,   2583,   5147,   7675,  10150,  12555,  14873,  17091,
+     19193,  21168,  23005,  24695,  26231,  27606,  28817,  29862,
+     30740,  31455,  32009,  32407,  32657,  32767,  32746,  32607,
+     32359,  32017,  31594,  31104,  30561,  29979,  29373,  28756,
+     28141,  27541,  26967,  26431,  25941,  25507,  25133,  24827,
+     24593,  24431,  24345,  24333,  24393,  24522,  24716,  24969,
+     25275,  25626,  26014,  26431,  26866,  27311,  27756,  28192,
+     28610,  29001,  29358,  29672,  29939,  30152,  30307,  30401,
+     30433,  30401,  30307,  30152,  29939,  29672,  29358,  29001,
+     28610,  28192,  27756,  27311,  26866,  26431,  26014,  25626,
+     25275,  24969,  24716,  24522,  24393,  24333,  24345,  24431,
+     24593,  24827,  25133,  25507,  25941,  26431,  26967,  27541,
+     28141,  28756,  29373,  29979,  30561,  31104,  31594,  32017,
+     32359,  32607,  32746,  32767,  32657,  32407,  32009,  31455,
+     30740,  29862,  28817,  27606,  26231,  24695,  23005,  21168,
+     19193,  17091,  14873,  12555,  10150,   7675,   5147,   2583,
+         0,  -2583,  -5147,  -7675, -10150, -12555, -14873, -17091,
+    -19193, -21168, -23005, -24695, -26231, -27606, -28817, -29862,
+    -30740, -31455, -32009, -32407, -32657, -32767, -32746, -32607,
+    -32359, -32017, -31594, -31104, -30561, -29979, -29373, -28756,
+    -28141, -27541, -26967, -26431, -25941, -25507, -25133, -24827,
+    -24593, -24431, -24345, -24333, -24393, -24522, -24716, -24969,
+    -25275, -25626, -26014, -26431, -26866, -27311, -27756, -28192,
+    -28610, -29001, -29358, -29672, -29939, -30152, -30307, -30401,
+    -30433, -30401, -30307, -30152, -29939, -29672, -29358, -29001,
+    -28610, -28192, -27756, -27311, -26866, -26431, -26014, -25626,
+    -25275, -24969, -24716, -24522, -24393, -24333, -24345, -24431,
+    -24593, -24827, -25133, -25507, -25941, -26431, -26967, -27541,
+    -28141, -28756, -29373, -29979, -30561, -31104, -31594, -32017,
+    -32359, -32607, -32746, -32767, -32657, -32407, -32009, -31455,
+    -30740, -29862, -28817, -27606, -26231, -24695, -23005, -21168,
+    -19193, -17091, -14873, -12555, -10150,  -7675,  -5147,  -2583,
+};
+
+/* level of envelope at peak is volume << LEVEL_SHIFT.
+ * level >> 15 is gain applied to table, so that volume 255 is almost full scale. */
+#define LEVEL_SHIFT     22
+
+enum {
+    SEGMENT_ATTACK,
+    SEGMENT_BODY,
+    SEGMENT_RELEASE,
+};
+
+static const int16_t *wave_table(audio_wave_t wave)
+{
+    switch (wave) {
+    case AUDIO_WAVE_SQUARE:
+        return s_square;
+    case AUDIO_WAVE_SOFT_SQUARE:
+        return s_soft_square;
+    case AUDIO_WAVE_SINE:
+    default:
+        return s_sine;
+    }
+}
+
+void audio_osc_init(audio_osc_t *osc, audio_wave_t wave, int frequency, int rate)
+{
+    osc->table = frequency > 0? wave_table(wave): NULL;
+    osc->phase = 0;
+    osc->step = (uint32_t)(((uint64_t)frequency << 32) / rate);
+}
+
+void audio_osc_render(audio_osc_t *osc, int16_t *dst, int samples, int gain)
+{
+    const int16_t *table = osc->table;
+    uint32_t phase = osc->phase, step = osc->step;
+    int i;
+    if (table == NULL) {
+        memset(dst, 0, samples * sizeof(*dst));
+        return;
+    }
+    for (i = 0; i < samples; i++) {
+        dst[i] = (table[phase >> (32 - AUDIO_SYNTH_TABLE_BITS)] * gain) >> 15;
+        phase += step;
+    }
+    osc->phase = phase;
+}
+
+static int note_samples(const audio_melody_note_t *note, int rate)
+{
+    return (int)((int64_t)note->duration * rate / 1000);
+}
+
+int audio_melody_samples(const audio_melody_t *melody, int rate)
+{
+    int samples = 0, i;
+    for (i = 0; i < melody->count; i++) {
+        samples += note_samples(&melody->notes[i], rate);
+    }
+    return samples * (melody->repeat > 1? melody->repeat: 1);
+}
+
+static void start_note(audio_melody_player_t *player)
+{
+    const audio_melody_note_t *note = &player->melody->notes[player->index];
+    int samples = note_samples(note, player->rate);
+    uint32_t phase = player->osc.phase;
+
+    /* keep phase across notes */
+    audio_osc_init(&player->osc, player->melody->wave,
+        note->volume > 0? note->frequency: 0, player->rate);
+    player->osc.phase = phase;
+    player->ramp = player->rate * AUDIO_SYNTH_RAMP_MS / 1000;
+    if (player->ramp > samples / 2) {
+        player->ramp = samples / 2;
+    }
+    player->body = samples - player->ramp * 2;
+    player->level = 0;
+    player->segment = SEGMENT_ATTACK;
+    player->remain = player->ramp;
+    player->delta = player->ramp > 0? ((int32_t)note->volume << LEVEL_SHIFT) / player->ramp: 0;
+    player->shift = 31;
+}
+
+static void start_body(audio_melody_player_t *player)
+{
+    const audio_melody_note_t *note = &player->melody->notes[player->index];
+    int body = player->body;
+    player->level = (int32_t)note->volume << LEVEL_SHIFT;
+    player->segment = SEGMENT_BODY;
+    player->remain = body;
+    player->delta = 0;
+    player->shift = 31;
+    if (body == 0) {
+        return;
+    }
+    switch (note->envelope) {
+    case AUDIO_ENV_DECAY:
+        player->delta = -player->level / body;
+        break;
+    case AUDIO_ENV_PLUCK:
+        /* time constant 2^shift is about quarter of body */
+        player->shift = 1;
+        while ((2 << player->shift) <= body / 4) {
+            player->shift++;
+        }
+        break;
+    case AUDIO_ENV_FLAT:
+    default:
+        break;
+    }
+}
+
+static void start_release(audio_melody_player_t *player)
+{
+    player->segment = SEGMENT_RELEASE;
+    player->remain = player->ramp;
+    player->delta = player->ramp > 0? -player->level / player->ramp: 0;
+    player->shift = 31;
+}
+
+/* advance to next segment. melody is set to NULL at end. */
+static void next_segment(audio_melody_player_t *player)
+{
+    const audio_melody_t *melody = player->melody;
+    switch (player->segment) {
+    case SEGMENT_ATTACK:
+        start_body(player);
+        return;
+    case SEGMENT_BODY:
+        start_release(player);
+        return;
+    default:
+        break;
+    }
+    if (++player->index >= melody->count) {
+        if (player->repeat <= 0) {
+            player->melody = NULL;
+            return;
+        }
+        player->repeat--;
+        player->index = 0;
+    }
+    start_note(player);
+}
+
+static void skip_empty_segments(audio_melody_player_t *player)
+{
+    while (player->melody != NULL && player->remain == 0) {
+        next_segment(player);
+    }
+}
+
+void audio_melody_start(audio_melody_player_t *player, const audio_melody_t *melody, int rate)
+{
+    memset(player, 0, sizeof(*player));
+    player->melody = melody;
+    player->rate = rate;
+    player->repeat = melody->repeat - 1;
+    if (melody->count <= 0) {
+        player->melody = NULL;
+        return;
+    }
+    start_note(player);
+    skip_empty_segments(player);
+}
+
+static void render_segment(audio_melody_player_t *player, int16_t *dst, int samples)
+{
+    const int16_t *table = player->osc.table;
+    uint32_t phase = player->osc.phase, step = player->osc.step;
+    int32_t level = player->level, delta = player->delta;
+    int shift = player->shift;
+    int i;
+    if (table == NULL) {
+        memset(dst, 0, samples * sizeof(*dst));
+        return;
+    }
+    for (i = 0; i < samples; i++) {
+        dst[i] = (table[phase >> (32 - AUDIO_SYNTH_TABLE_BITS)] * (level >> 15)) >> 15;
+        phase += step;
+        level += delta - (level >> shift);
+    }
+    player->osc.phase = phase;
+    player->level = level;
+}
+
+int audio_melody_render(audio_melody_player_t *player, int16_t *dst, int samples)
+{
+    int done = 0;
+    while (done < samples && player->melody != NULL) {
+        int n = samples - done;
+        if (n > player->remain) {
+            n = player->remain;
+        }
+        render_segment(player, dst + done, n);
+        player->remain -= n;
+        done += n;
+        skip_empty_segments(player);
+    }
+    return done;
+}
@@ -0,0 +1,321 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of audio_synth.c.
+ * checks frequency, length and envelope of generated tones.
+ * run with "bench" argument to compare cost per sample with rotation method
+ * which audio_beep used before. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "audio_note.h"
+#include "audio_synth.h"
+
+#define RATE        16000
+
+static int s_failed = 0;
+
+static int zero_crossings(const int16_t *src, int samples)
+{
+    int n = 0, i;
+    for (i = 1; i < samples; i++) {
+        if ((src[i - 1] < 0) != (src[i] < 0)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+static void test_frequency(audio_wave_t wave, int frequency)
+{
+    static int16_t buf[RATE];
+    audio_osc_t osc;
+    int n, peak = 0, i;
+    audio_osc_init(&osc, wave, frequency, RATE);
+    /* render in two chunks to check phase is carried over */
+    audio_osc_render(&osc, buf, 1000, 32768);
+    audio_osc_render(&osc, buf + 1000, RATE - 1000, 32768);
+    n = zero_crossings(buf, RATE);
+    for (i = 0; i < RATE; i++) {
+        peak = abs(buf[i]) > peak? abs(buf[i]): peak;
+    }
+    if (abs(n - frequency * 2) > 2 || peak < 30000) {
+        printf("FAIL wave %d %dHz: %d crossings, peak %d\n", wave, frequency, n, peak);
+        s_failed++;
+        return;
+    }
+    printf("ok   wave %d %dHz\n", wave, frequency);
+}
+
+static void test_silence(void)
+{
+    int16_t buf[100];
+    audio_osc_t osc;
+    int i;
+    memset(buf, 0x55, sizeof(buf));
+    audio_osc_init(&osc, AUDIO_WAVE_SQUARE, 0, RATE);
+    audio_osc_render(&osc, buf, 100, 32768);
+    for (i = 0; i < 100; i++) {
+        if (buf[i] != 0) {
+            printf("FAIL silence: [%d] %d\n", i, buf[i]);
+            s_failed++;
+            return;
+        }
+    }
+    printf("ok   silence\n");
+}
+
+/* render whole melody in random sized chunks. return number of samples. */
+static int render(const audio_melody_t *melody, int16_t *dst, int max)
+{
+    audio_melody_player_t player;
+    int total = 0;
+    audio_melody_start(&player, melody, RATE);
+    while (!audio_melody_finished(&player)) {
+        int chunk = 1 + rand() % 300, n;
+        if (chunk > max - total) {
+            chunk = max - total;
+        }
+        n = audio_melody_render(&player, dst + total, chunk);
+        total += n;
+        if (n < chunk && !audio_melody_finished(&player)) {
+            printf("FAIL short render without finish\n");
+            s_failed++;
+            break;
+        }
+        if (total >= max) {
+            break;
+        }
+    }
+    return total;
+}
+
+static const audio_melody_note_t s_notes[] = {
+    { NOTE_C5, 250, AUDIO_ENV_FLAT, 255 },
+    { NOTE_E5, 125, AUDIO_ENV_DECAY, 128 },
+    { 0, 100, AUDIO_ENV_FLAT, 255 },
+    { NOTE_G5, 333, AUDIO_ENV_PLUCK, 200 },
+    { NOTE_C6, 1, AUDIO_ENV_FLAT, 255 },
+    { NOTE_C6, 0, AUDIO_ENV_FLAT, 255 },
+};
+
+static void test_length(void)
+{
+    static int16_t buf[RATE * 10];
+    audio_melody_t melody = { s_notes, sizeof(s_notes)/sizeof(s_notes[0]), AUDIO_WAVE_SINE, 3 };
+    int expected = 0, total, i;
+    for (i = 0; i < melody.count; i++) {
+        expected += s_notes[i].duration * RATE / 1000 * melody.repeat;
+    }
+    total = render(&melody, buf, sizeof(buf)/sizeof(buf[0]));
+    if (total != expected || audio_melody_samples(&melody, RATE) != expected) {
+        printf("FAIL length: %d %d != %d\n", total, audio_melody_samples(&melody, RATE), expected);
+        s_failed++;
+        return;
+    }
+    printf("ok   length\n");
+}
+
+static double rms(const int16_t *src, int samples)
+{
+    double sum = 0;
+    int i;
+    for (i = 0; i < samples; i++) {
+        sum += (double)src[i] * src[i];
+    }
+    return sqrt(sum / samples);
+}
+
+static void test_envelope(void)
+{
+    static int16_t buf[RATE];
+    int offset = 0, i, failed = 0;
+    audio_melody_t melody = { s_notes, 4, AUDIO_WAVE_SQUARE, 1 };
+    render(&melody, buf, RATE);
+    for (i = 0; i < 4; i++) {
+        const audio_melody_note_t *note = &s_notes[i];
+        int samples = note->duration * RATE / 1000;
+        int peak = note->volume << 7, max = 0, j;
+        int16_t *p = buf + offset;
+        for (j = 0; j < samples; j++) {
+            max = abs(p[j]) > max? abs(p[j]): max;
+        }
+        if (note->frequency == 0) {
+            if (max != 0) {
+                printf("FAIL envelope: rest is not silent: %d\n", max);
+                failed++;
+            }
+        } else {
+            /* ramps avoid click at both ends */
+            if (abs(p[0]) > peak / 16 || abs(p[samples - 1]) > peak / 16) {
+                printf("FAIL envelope: note %d click %d %d\n", i, p[0], p[samples - 1]);
+                failed++;
+            }
+            if (max > peak || max < peak * 9 / 10) {
+                printf("FAIL envelope: note %d peak %d, expected %d\n", i, max, peak);
+                failed++;
+            }
+            if (note->envelope != AUDIO_ENV_FLAT &&
+                rms(p + samples * 3 / 4, samples / 4) > rms(p, samples / 4) / 2) {
+                printf("FAIL envelope: note %d does not decay\n", i);
+                failed++;
+            }
+        }
+        offset += samples;
+    }
+    if (failed) {
+        s_failed++;
+        return;
+    }
+    printf("ok   envelope\n");
+}
+
+/* audio_beep before audio_synth.c. rotates vector by angle of a sample. */
+#define BEEP_V  0x7fff
+#define BEEP_S  15
+
+struct beep {
+    int length;
+    int cycle;
+    int count;
+    int x, y, c, s;
+};
+
+static void beep_init(struct beep *beep, int frequency, int duration)
+{
+    float angle = (float)(frequency*2*M_PI)/RATE, c, s;
+    c = cosf(angle);
+    s = sinf(angle);
+    beep->length = RATE*4/frequency;
+    beep->cycle = (duration*RATE/1000+beep->length)/beep->length;
+    beep->count = 0;
+    beep->x = BEEP_V;
+    beep->y = 0;
+    beep->c = (int)(BEEP_V*c+0.5f);
+    beep->s = (int)(BEEP_V*s+0.5f);
+}
+
+static int beep_data_func(void *arg, void *data, int *size)
+{
+    struct beep *beep = (struct beep*)arg;
+    int16_t *pdata = (int16_t *)data;
+    int x0, y0;
+    int i;
+    for (i = 0; i < *size; i+=2) {
+        *pdata++ = beep->y>>3;
+        x0 = beep->x, y0 = beep->y;
+        beep->x = (x0*beep->c - y0*beep->s)>>BEEP_S;
+        beep->y = (x0*beep->s + y0*beep->c)>>BEEP_S;
+        if (--beep->count <= 0) {
+            if (--beep->cycle < 0) {
+                break;
+            }
+            beep->count += beep->length;
+            beep->x = BEEP_V-1;
+            beep->y = 0;
+        }
+    }
+    *size = i;
+    return beep->count > 0;
+}
+
+static uint64_t now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#define BENCH_SAMPLES   256
+/* a minute of tone */
+#define BENCH_ROUNDS    3000
+
+static void bench(void)
+{
+    static const audio_melody_note_t note = { NOTE_A4, 60000, AUDIO_ENV_PLUCK, 32 };
+    static const audio_melody_t melody = { &note, 1, AUDIO_WAVE_SINE, 1 };
+    static int16_t dst[BENCH_SAMPLES];
+    /* keep compiler from dropping the loops */
+    static volatile int16_t sink;
+    double total = (double)BENCH_SAMPLES * BENCH_ROUNDS;
+    struct beep beep;
+    audio_osc_t osc;
+    audio_melody_player_t player;
+    uint64_t t0, t1, t2, t3;
+    int r;
+#if defined(__x86_64__) || defined(__i386__)
+    const char *unit = "cycles";
+#else
+    const char *unit = "ns";
+#endif
+
+    beep_init(&beep, NOTE_A4, 60000);
+    audio_osc_init(&osc, AUDIO_WAVE_SINE, NOTE_A4, RATE);
+    audio_melody_start(&player, &melody, RATE);
+    t0 = now();
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        int size = sizeof(dst);
+        beep_data_func(&beep, dst, &size);
+        sink = dst[r % BENCH_SAMPLES];
+    }
+    t1 = now();
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        audio_osc_render(&osc, dst, BENCH_SAMPLES, 4096);
+        sink = dst[r % BENCH_SAMPLES];
+    }
+    t2 = now();
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        audio_melody_render(&player, dst, BENCH_SAMPLES);
+        sink = dst[r % BENCH_SAMPLES];
+    }
+    t3 = now();
+    printf("rotation   %.2f %s/sample\n", (t1 - t0) / total, unit);
+    printf("wavetable  %.2f %s/sample\n", (t2 - t1) / total, unit);
+    printf("melody     %.2f %s/sample (with envelope)\n", (t3 - t2) / total, unit);
+    (void)sink;
+}
+
+int main(int argc, char *argv[])
+{
+    srand(1);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+    test_frequency(AUDIO_WAVE_SINE, NOTE_A4);
+    test_frequency(AUDIO_WAVE_SINE, NOTE_C7);
+    test_frequency(AUDIO_WAVE_SQUARE, NOTE_A4);
+    test_frequency(AUDIO_WAVE_SOFT_SQUARE, 1000);
+    test_silence();
+    test_length();
+    test_envelope();
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
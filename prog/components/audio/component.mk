@@ -1 +1,2 @@
 COMPONENT_NAME := audio
+COMPONENT_OBJS := audio.o audio_ring.o audio_mixer.o audio_convert.o audio_resample.o audio_adpcm.o audio_asset.o audio_bank.o audio_sched.o audio_pool.o audio_synth.o audio_histogram.o audio_json.o riffwave.o
@@ -19,6 +19,10 @@
 #include <stdint.h>
 #include <esp_err.h>
 
+#include "audio_pool.h"
+#include "audio_histogram.h"
+#include "audio_synth.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -49,13 +53,96 @@ extern "C" {
  */
 typedef int (*audio_data_func_t)(void *arg, void *data, int *size);
 
+/**
+ * @brief user defined function to get audio data without copy.
+ * used instead of @ref audio_data_func_t to request audio data when given by
+ * @ref audio_play_opts_t. play done is still notified by @ref audio_data_func_t.
+ * @param[in] arg       user specifed pointer passed to @ref audio_play_ex.
+ * @param[out] data     the function must set pointer to audio data.
+ *                      the data must be valid until next call or play done notification.
+ *                      16bit data must be aligned to 2 bytes.
+ * @param[in,out] size  maximum size of data audio system requests. and size of data pointed by data.
+ * @return 0 to indicate this is last chunk and there is no more audio data.
+ *         1 to indicate there is remaining audio data.
+ */
+typedef int (*audio_data_ptr_func_t)(void *arg, const void **data, int *size);
+
 /** queueing mode when @ref audio_play */
 typedef enum {
-    AUDIO_ENQUEUE,
-    AUDIO_REPLACE,
-    AUDIO_IMMEDIATE,
+    AUDIO_ENQUEUE,      /**< play after queueing audio. */
+    AUDIO_REPLACE,      /**< stop all audio and play. */
+    AUDIO_IMMEDIATE,    /**< play before queueing audio. */
+    AUDIO_MIX,          /**< play over currently playing audio. */
 } audio_queue_mode_t;
 
+/** handle to wait for play of an audio is done. see @ref audio_completion_create. */
+typedef struct audio_completion *audio_completion_t;
+
+#ifdef CONFIG_AUDIO_MIX_VOICES
+#define AUDIO_MIX_VOICES        CONFIG_AUDIO_MIX_VOICES
+#else
+#define AUDIO_MIX_VOICES        3
+#endif
+/** number of audio which can wait in queue of @ref AUDIO_ENQUEUE and @ref AUDIO_IMMEDIATE. */
+#define AUDIO_QUEUE_LENGTH      10
+/** maximum number of audio being played or waiting at once. use to size pool of play state. */
+#define AUDIO_MAX_ITEMS         (AUDIO_QUEUE_LENGTH + AUDIO_MIX_VOICES * 2)
+
+/** gain to play audio as is. */
+#define AUDIO_GAIN_UNITY    256
+
+/**
+ * buffering profile of audio output, selected by @ref audio_play_opts_t.
+ * I2S DMA buffers are the same for all profiles and allocated once by @ref audio_init.
+ * profile is selected only when output starts, so an audio with different
+ * profile waits for playing audio to finish and output restarts with a short gap.
+ * mixed audio plays with profile of running output.
+ */
+typedef enum {
+    AUDIO_PROFILE_DEFAULT,      /**< whole PCM ring, written to DMA buffers all at once. */
+    AUDIO_PROFILE_LOW_LATENCY,  /**< shallow PCM ring written one DMA buffer at once for key clicks and beeps. */
+    AUDIO_PROFILE_THROUGHPUT,   /**< whole PCM ring, large writes and reads for long playback under load. */
+    AUDIO_PROFILE_MAX,
+} audio_profile_t;
+
+/** optional parameters of @ref audio_play_ex. */
+typedef struct {
+    int gain;   /**< gain of the audio in 1/256 unit. @ref AUDIO_GAIN_UNITY plays audio as is. maximum is 4 times of unity. */
+    audio_data_ptr_func_t data_ptr_func;    /**< get audio data by pointer instead of copy, e.g. from memory mapped flash. can be NULL. */
+    int64_t start_time; /**< time to play first sample in esp_timer_get_time() usec. 0 to play as soon as possible. see @ref audio_play_at. */
+    audio_completion_t completion;  /**< signaled after play done notification of the audio. can be NULL. */
+    audio_profile_t profile;    /**< buffering profile. */
+} audio_play_opts_t;
+
+/** statistics of audio output for each profile. */
+typedef struct {
+    uint32_t latency;           /**< depth of PCM ring and DMA buffers in usec. */
+    uint32_t sessions;          /**< number of times output started. */
+    uint32_t underruns;         /**< number of times I2S writer found PCM ring empty while playing. */
+    uint32_t dma_starvations;   /**< number of times DMA buffers ran out before writer wrote next data. */
+    audio_histogram_t start_latency;    /**< time from @ref audio_play to its first sample played in usec. */
+} audio_profile_stats_t;
+
+/** statistics of audio output pipeline. */
+typedef struct {
+    uint32_t ring_size;         /**< size of PCM ring buffer between decoder and I2S writer in bytes. */
+    uint32_t ring_min_level;    /**< lowest fill level of PCM ring observed while playing in bytes. */
+    uint32_t underruns;         /**< number of times I2S writer found PCM ring empty while playing. */
+    int32_t schedule_error;     /**< actual minus requested start time of last scheduled audio in usec. */
+    uint32_t late_starts;       /**< number of scheduled audio started later than requested. */
+    int32_t stop_latency;       /**< time taken by last @ref audio_stop in usec. */
+    audio_pool_stats_t beeps;   /**< usage of pool of @ref audio_beep and @ref audio_play_melody. */
+    uint32_t dma_size;          /**< size of I2S DMA buffers in bytes. */
+    uint32_t dma_min_level;     /**< lowest estimated fill level of DMA buffers observed when writing in bytes. */
+    uint32_t dma_starvations;   /**< number of times DMA buffers ran out before writer wrote next data. */
+    uint32_t queue_depth;       /**< number of audio playing or waiting now. */
+    uint32_t queue_max_depth;   /**< largest number of audio playing or waiting at once. */
+    audio_histogram_t callback_time;    /**< time taken by each call of @ref audio_data_func_t to get data in usec. */
+    audio_histogram_t start_latency;    /**< time from @ref audio_play to its first sample played in usec, except scheduled audio. */
+    audio_profile_t profile;    /**< profile of running or last output. */
+    audio_profile_stats_t profiles[AUDIO_PROFILE_MAX];  /**< statistics for each profile. */
+} audio_stats_t;
+
 /**
  * @brief initialize audio system and I2S hardware.
  * @return ESP_OK for success, other value for error.
@@ -64,23 +151,67 @@ extern esp_err_t audio_init(void);
 /**
  * @brief play sine wave of specified frequency and duration.
  * this function may block if there is too many queueing audio.
+ * beep is dropped if too many beeps are playing.
  * @param[in] frequency frequency of sine wave.
  * @param[in] duration  duration in msec.
  */
 extern void audio_beep(int frequency, int duration);
+/**
+ * @brief play melody by wavetable synthesizer of audio_synth.h.
+ * this function may block if there is too many queueing audio.
+ * melody is dropped if too many beeps and melodies are playing.
+ * @param[in] melody    melody. must be valid until play is done, usually static const.
+ * @param[in] mode      queueing mode.
+ */
+extern void audio_play_melody(const audio_melody_t *melody, audio_queue_mode_t mode);
 /**
  * @brief play audio data generated by callback function.
  * this function may block if there is too many queueing audio.
  * @param[in] callback  callback function. see @ref audio_data_func_t for detail.
  * @param[in] arg       pointer passed to callback.
  * @param[in] samplerate sampling rate of which callback function would generate.
- * @param[in] channels  number of channels of which callback function would generate. must be 1.
+ * @param[in] channels  number of channels of which callback function would generate. must be 1 or 2.
+ *                      stereo is downmixed to mono.
  * @param[in] bits      bits per sample of which callback function would generate. must be 8 or 16.
  * @param[in] mode      queueing mode.
  */
 extern void audio_play(audio_data_func_t callback, void *arg,
     int samplerate, int channels, int bits,
     audio_queue_mode_t mode);
+/**
+ * @brief play audio data generated by callback function with optional parameters.
+ * @param[in] callback  callback function. see @ref audio_data_func_t for detail.
+ * @param[in] arg       pointer passed to callback.
+ * @param[in] samplerate sampling rate of which callback function would generate.
+ * @param[in] channels  number of channels of which callback function would generate. must be 1 or 2.
+ *                      stereo is downmixed to mono.
+ * @param[in] bits      bits per sample of which callback function would generate. must be 8 or 16.
+ * @param[in] mode      queueing mode.
+ * @param[in] opts      optional parameters. can be NULL.
+ * @note output runs at fixed sampling rate and each audio is resampled to it,
+ *       so audio of any sampling rate can be mixed and queued without gap.
+ */
+extern void audio_play_ex(audio_data_func_t callback, void *arg,
+    int samplerate, int channels, int bits,
+    audio_queue_mode_t mode, const audio_play_opts_t *opts);
+/**
+ * @brief play audio data so that its first sample is played at specified time.
+ * silence is inserted before the audio. audio is queued like @ref AUDIO_ENQUEUE
+ * and following audio waits for it.
+ * @note audio already in PCM ring and DMA buffers cannot be delayed,
+ *       so time should be ahead of now by that much when audio is playing.
+ *       audio starts immediately if it is too late, and error is recorded to
+ *       @ref audio_stats_t. output stalled by underrun before audio starts
+ *       is taken into account.
+ * @param[in] callback  callback function. see @ref audio_data_func_t for detail.
+ * @param[in] arg       pointer passed to callback.
+ * @param[in] samplerate sampling rate of which callback function would generate.
+ * @param[in] channels  number of channels of which callback function would generate.
+ * @param[in] bits      bits per sample of which callback function would generate.
+ * @param[in] time      time to play first sample in esp_timer_get_time() usec.
+ */
+extern void audio_play_at(audio_data_func_t callback, void *arg,
+    int samplerate, int channels, int bits, int64_t time);
 /**
  * @brief stop all playing and queueing audio and wait.
  * this function does not return until all audio released.
@@ -90,11 +221,48 @@ extern void audio_stop(void);
  * @brief wait for finish playing.
  */
 extern void audio_wait(void);
+/**
+ * @brief wait for finish playing with timeout.
+ * returns as soon as all audio is released and output is stopped.
+ * @param[in] timeout   timeout in msec. negative value to wait forever.
+ * @return ESP_OK if finished, ESP_ERR_TIMEOUT if timed out.
+ */
+extern esp_err_t audio_wait_timeout(int timeout);
 /**
  * @brief return true if audio is playing.
  */
 extern bool audio_is_playing(void);
 
+/**
+ * @brief create handle to wait for an audio. pass it by @ref audio_play_opts_t.
+ * a handle can be reused for next audio after waited.
+ * @return handle, or NULL if no memory.
+ */
+extern audio_completion_t audio_completion_create(void);
+/** @brief delete handle created by @ref audio_completion_create. */
+extern void audio_completion_delete(audio_completion_t completion);
+/**
+ * @brief wait for play of the audio given the handle is done, including stopped.
+ * @param[in] completion handle.
+ * @param[in] timeout   timeout in msec. negative value to wait forever.
+ * @return ESP_OK if done, ESP_ERR_TIMEOUT if timed out.
+ */
+extern esp_err_t audio_completion_wait(audio_completion_t completion, int timeout);
+
+/**
+ * @brief get statistics of audio output pipeline.
+ * @param[out] stats    pointer to store statistics.
+ */
+extern void audio_get_stats(audio_stats_t *stats);
+/**
+ * @brief reset statistics of audio output pipeline.
+ */
+extern void audio_reset_stats(void);
+/**
+ * @brief return name of profile, e.g. "low_latency".
+ */
+extern const char *audio_profile_name(audio_profile_t profile);
+
 /**
  * @brief helper function to convert duration to number of bytes.
  * @param[in] duration  duration in msec.
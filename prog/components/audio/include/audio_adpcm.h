@@ -0,0 +1,81 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * IMA ADPCM codec for mono wave data (WAVE format tag 0x11).
+ * a block starts with 4 bytes header which holds first sample and step index,
+ * followed by 4bit codes of remaining samples, low nibble first.
+ */
+
+/** WAVE format tag of IMA ADPCM. */
+#define AUDIO_ADPCM_FORMAT_TAG      0x11
+/** size of block header. */
+#define AUDIO_ADPCM_HEADER_SIZE     4
+
+/** state of encoder or decoder. */
+typedef struct {
+    int16_t predictor;  /**< last decoded sample */
+    uint8_t index;      /**< index of step size table */
+} audio_adpcm_t;
+
+/** @brief number of samples in mono block of block_align bytes. */
+static inline int audio_adpcm_block_samples(int block_align)
+{
+    return (block_align - AUDIO_ADPCM_HEADER_SIZE) * 2 + 1;
+}
+
+/**
+ * @brief start decoding block with header.
+ * @param[out] st       decoder state.
+ * @param[in] header    @ref AUDIO_ADPCM_HEADER_SIZE bytes of block header.
+ * @return first sample of the block.
+ */
+extern int16_t audio_adpcm_decode_header(audio_adpcm_t *st, const uint8_t *header);
+/**
+ * @brief decode codes following header or previous call.
+ * src may overlap the last half of dst, so that codes can be read into
+ * output buffer and decoded in place.
+ * @param[in,out] st    decoder state.
+ * @param[out] dst      destination of bytes * 2 samples.
+ * @param[in] src       codes.
+ * @param[in] bytes     number of bytes of codes.
+ */
+extern void audio_adpcm_decode(audio_adpcm_t *st, int16_t *dst, const uint8_t *src, int bytes);
+
+/**
+ * @brief encode samples into a block.
+ * state is carried over to next block to keep step size.
+ * samples missing at end of last block are encoded as repetition of last sample.
+ * @param[in,out] st    encoder state. zero initialize before first block.
+ * @param[out] dst      destination of block_align bytes.
+ * @param[in] block_align size of block in bytes.
+ * @param[in] src       source samples.
+ * @param[in] samples   number of samples in src. at most @ref audio_adpcm_block_samples.
+ */
+extern void audio_adpcm_encode_block(audio_adpcm_t *st, uint8_t *dst, int block_align,
+    const int16_t *src, int samples);
+
+#ifdef __cplusplus
+}
+#endif
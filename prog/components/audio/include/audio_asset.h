@@ -0,0 +1,53 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * read-only audio asset mapped to memory, so that audio can be played
+ * without copy by @ref audio_data_ptr_func_t, e.g. @ref audio_bank_data_ptr_func.
+ * on ESP32, asset is a raw data partition mapped by esp_partition_mmap.
+ * on host, asset is an image file of the partition mapped by mmap.
+ */
+
+/** mapped asset. */
+typedef struct {
+    const uint8_t *data;    /**< start of mapped asset */
+    uint32_t size;          /**< size of mapped asset */
+    uint32_t handle;        /**< platform specific handle of mapping */
+} audio_asset_t;
+
+/**
+ * @brief map asset to memory.
+ * @param[out] asset    mapped asset.
+ * @param[in] name      label of partition on ESP32, or path of image file on host.
+ * @return 0 for success, -1 for error.
+ */
+extern int audio_asset_open(audio_asset_t *asset, const char *name);
+/**
+ * @brief unmap asset. data in asset must not be used after this.
+ */
+extern void audio_asset_close(audio_asset_t *asset);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,125 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * voice bank: pack of audio clips looked up by name.
+ * layout, all values are little endian:
+ * - @ref audio_bank_header_t
+ * - @ref audio_bank_entry_t * count, sorted by hash
+ * - audio data of clips, each aligned to 4 bytes
+ *
+ * all clips share sampling rate, channels and bits in header, so that
+ * clips can be played one after another as single audio without gap.
+ * bank is usually memory mapped, see @ref audio_asset_t.
+ */
+
+/** magic at top of bank */
+#define AUDIO_BANK_MAGIC    0x4b4e4256  /* "VBNK" */
+/** version of bank layout */
+#define AUDIO_BANK_VERSION  1
+
+/** header of bank. */
+typedef struct {
+    uint32_t magic;         /**< @ref AUDIO_BANK_MAGIC */
+    uint16_t version;       /**< @ref AUDIO_BANK_VERSION */
+    uint16_t count;         /**< number of entries */
+    uint32_t samplerate;    /**< sampling rate of all clips */
+    uint16_t channels;      /**< number of channels of all clips */
+    uint16_t bits;          /**< bits per sample of all clips */
+    uint32_t data_offset;   /**< offset of audio data from top of bank */
+    uint32_t data_length;   /**< length of audio data */
+} audio_bank_header_t;
+
+/** directory entry of a clip. */
+typedef struct {
+    uint32_t hash;      /**< @ref audio_bank_hash of name */
+    uint32_t offset;    /**< offset of clip from data_offset */
+    uint32_t length;    /**< length of clip in bytes */
+    uint16_t format;    /**< WAVE format tag of clip. 1 for PCM */
+    uint16_t reserved;
+} audio_bank_entry_t;
+
+/** parsed bank. */
+typedef struct {
+    const audio_bank_header_t *header;
+    const audio_bank_entry_t *entries;
+    const uint8_t *data;    /**< start of audio data */
+} audio_bank_t;
+
+/** range of audio data of a clip. */
+typedef struct {
+    const uint8_t *data;
+    uint32_t length;
+} audio_bank_range_t;
+
+/** state to play list of ranges by @ref audio_bank_data_ptr_func. */
+typedef struct {
+    const audio_bank_range_t *ranges;
+    int count;
+    int index;      /**< range currently playing */
+    uint32_t pos;   /**< position in current range */
+} audio_bank_play_t;
+
+/**
+ * @brief validate bank on memory and initialize bank.
+ * @param[out] bank     parsed bank.
+ * @param[in] data      top of bank.
+ * @param[in] size      size of memory which data points to.
+ * @return 0 for success, -1 if data is not valid bank.
+ */
+extern int audio_bank_init(audio_bank_t *bank, const void *data, uint32_t size);
+/**
+ * @brief hash of clip name. 32bit FNV-1a.
+ */
+extern uint32_t audio_bank_hash(const char *name);
+/**
+ * @brief find entry of clip by hash.
+ * @return pointer to entry, or NULL if not found.
+ */
+extern const audio_bank_entry_t *audio_bank_find(const audio_bank_t *bank, uint32_t hash);
+/**
+ * @brief resolve names of clips into ranges of audio data.
+ * @param[in] bank      bank to look up.
+ * @param[in] names     names of clips.
+ * @param[in] count     number of names.
+ * @param[out] ranges   count ranges to be filled in order of names.
+ * @return count for success. -1 if any of clips is not found or not PCM.
+ */
+extern int audio_bank_resolve(const audio_bank_t *bank, const char *const *names, int count,
+    audio_bank_range_t *ranges);
+
+/**
+ * @brief initialize state to play ranges.
+ */
+extern void audio_bank_play_init(audio_bank_play_t *play, const audio_bank_range_t *ranges, int count);
+/**
+ * @brief audio_data_ptr_func_t to play ranges in order without copy.
+ * arg is @ref audio_bank_play_t. returned chunk does not cross ranges,
+ * and ranges are played one after another without gap.
+ */
+extern int audio_bank_data_ptr_func(void *arg, const void **data, int *size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,65 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * histogram of durations with power of two bins, cheap enough to update
+ * from audio task for every callback.
+ * bin 0 counts 0, bin i counts values in [2^(i-1), 2^i) and
+ * the last bin counts all larger values.
+ */
+
+/** number of bins. the last bin starts at 2^(AUDIO_HISTOGRAM_BINS-2). */
+#define AUDIO_HISTOGRAM_BINS    20
+
+/** histogram. zero initialize to reset. */
+typedef struct {
+    uint32_t count;     /**< number of values. */
+    uint32_t max;       /**< largest value. */
+    uint64_t sum;       /**< sum of values. */
+    uint32_t bins[AUDIO_HISTOGRAM_BINS];    /**< number of values in each bin. */
+} audio_histogram_t;
+
+/**
+ * @brief add a value.
+ * @param[in,out] hist  histogram.
+ * @param[in] value     value to add.
+ */
+extern void audio_histogram_add(audio_histogram_t *hist, uint32_t value);
+/**
+ * @brief estimate percentile.
+ * @param[in] hist      histogram.
+ * @param[in] percent   percentile, 0 to 100.
+ * @return upper bound of the bin where the percentile falls, but at most max.
+ *         0 if histogram is empty.
+ */
+extern uint32_t audio_histogram_percentile(const audio_histogram_t *hist, int percent);
+/** @brief return average of values, or 0 if histogram is empty. */
+static inline uint32_t audio_histogram_mean(const audio_histogram_t *hist)
+{
+    return hist->count > 0? (uint32_t)(hist->sum / hist->count): 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
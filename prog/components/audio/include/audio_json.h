@@ -0,0 +1,58 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <json_str.h>
+
+#include "audio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * export of statistics of audio output pipeline as JSON.
+ */
+
+/**
+ * @brief add histogram to JSON as object of count, mean, percentiles, max and bins.
+ * @param[in,out] json  JSON string buffer.
+ * @param[in] key       key of the object. NULL when adding to array.
+ * @param[in] hist      histogram.
+ * @return JSON_STR_OK for success, other value for error.
+ */
+extern int audio_histogram_to_json(json_str_t *json, const char *key, const audio_histogram_t *hist);
+/**
+ * @brief add usage of object pool to JSON as object of count, used, high_water and exhausted.
+ * @param[in,out] json  JSON string buffer.
+ * @param[in] key       key of the object. NULL when adding to array.
+ * @param[in] stats     statistics got by @ref audio_pool_get_stats.
+ * @return JSON_STR_OK for success, other value for error.
+ */
+extern int audio_pool_stats_to_json(json_str_t *json, const char *key, const audio_pool_stats_t *stats);
+/**
+ * @brief add statistics to JSON as object.
+ * @param[in,out] json  JSON string buffer.
+ * @param[in] key       key of the object. NULL when adding to array or as root.
+ * @param[in] stats     statistics got by @ref audio_get_stats.
+ * @return JSON_STR_OK for success, other value for error.
+ */
+extern int audio_stats_to_json(json_str_t *json, const char *key, const audio_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
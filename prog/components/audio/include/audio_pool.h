@@ -0,0 +1,90 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * statically allocated pool of fixed size objects, e.g. state of audio
+ * being played, to avoid heap use while playing.
+ * objects may be acquired and released from different tasks.
+ */
+
+/** maximum number of objects in a pool. */
+#define AUDIO_POOL_MAX_COUNT    32
+
+/** pool of objects. use @ref AUDIO_POOL_DEFINE to define a pool. */
+typedef struct {
+    void *blocks;           /**< storage of objects */
+    uint32_t block_size;    /**< size of an object */
+    uint32_t count;         /**< number of objects */
+    uint32_t used;          /**< bitmap of acquired objects */
+    uint32_t high_water;    /**< maximum number of objects acquired at once */
+    uint32_t exhausted;     /**< number of times acquire failed */
+} audio_pool_t;
+
+/** statistics of pool. */
+typedef struct {
+    uint32_t count;         /**< number of objects */
+    uint32_t used;          /**< number of objects acquired now */
+    uint32_t high_water;    /**< maximum number of objects acquired at once */
+    uint32_t exhausted;     /**< number of times acquire failed */
+} audio_pool_stats_t;
+
+/** static initializer of @ref audio_pool_t. */
+#define AUDIO_POOL_INITIALIZER(blocks_, block_size_, count_) \
+    { .blocks = (blocks_), .block_size = (block_size_), .count = (count_), \
+      .used = 0, .high_water = 0, .exhausted = 0 }
+
+/**
+ * @brief define static pool named name of count objects of type,
+ * with typed helpers name_acquire() and name_release().
+ */
+#define AUDIO_POOL_DEFINE(name, type, count_) \
+    _Static_assert((count_) > 0 && (count_) <= AUDIO_POOL_MAX_COUNT, "pool size of " #name); \
+    static type name##_blocks[count_]; \
+    static audio_pool_t name = AUDIO_POOL_INITIALIZER(name##_blocks, sizeof(type), count_); \
+    static inline type *name##_acquire(void) \
+    { \
+        return (type*)audio_pool_acquire(&name); \
+    } \
+    static inline void name##_release(type *obj) \
+    { \
+        audio_pool_release(&name, obj); \
+    }
+
+/**
+ * @brief acquire an object from pool.
+ * @return pointer to object, or NULL if all objects are in use.
+ */
+extern void *audio_pool_acquire(audio_pool_t *pool);
+/**
+ * @brief release object acquired from pool.
+ * @param[in] pool  pool.
+ * @param[in] obj   object. NULL is ignored.
+ */
+extern void audio_pool_release(audio_pool_t *pool, void *obj);
+/** @brief get statistics of pool. */
+extern void audio_pool_get_stats(const audio_pool_t *pool, audio_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,138 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * wavetable tone synthesizer and melody sequencer.
+ * oscillator is a 32bit phase accumulator indexing one cycle table in flash,
+ * so generating tones costs no file I/O nor floating point.
+ * melody is an array of notes whose frequency is given by NOTE_* of audio_note.h.
+ */
+
+/** number of bits of table index. */
+#define AUDIO_SYNTH_TABLE_BITS      8
+/** number of samples in one cycle table. */
+#define AUDIO_SYNTH_TABLE_SIZE      (1 << AUDIO_SYNTH_TABLE_BITS)
+/** length of attack and release ramp of every note to avoid click. */
+#define AUDIO_SYNTH_RAMP_MS         2
+
+/** waveform of oscillator. */
+typedef enum {
+    AUDIO_WAVE_SINE,            /**< sine wave. */
+    AUDIO_WAVE_SQUARE,          /**< square wave. loud like a buzzer. */
+    AUDIO_WAVE_SOFT_SQUARE,     /**< first three odd harmonics of square wave. */
+} audio_wave_t;
+
+/** envelope of note. */
+typedef enum {
+    AUDIO_ENV_FLAT,             /**< constant volume. */
+    AUDIO_ENV_DECAY,            /**< linear decay to silence at end of note. */
+    AUDIO_ENV_PLUCK,            /**< exponential decay like a plucked string. */
+} audio_envelope_t;
+
+/** state of oscillator. */
+typedef struct {
+    const int16_t *table;       /**< one cycle table. NULL for silence. */
+    uint32_t phase;             /**< phase. full scale is one cycle. */
+    uint32_t step;              /**< phase increment per sample. */
+} audio_osc_t;
+
+/** note of melody. */
+typedef struct {
+    uint16_t frequency;         /**< frequency in Hz. NOTE_* of audio_note.h, or 0 for rest. */
+    uint16_t duration;          /**< duration in msec. */
+    uint8_t envelope;           /**< @ref audio_envelope_t. */
+    uint8_t volume;             /**< peak volume. 255 is full scale. */
+} audio_melody_note_t;
+
+/** melody. */
+typedef struct {
+    const audio_melody_note_t *notes;   /**< array of notes. */
+    int count;                  /**< number of notes. */
+    audio_wave_t wave;          /**< waveform of all notes. */
+    int repeat;                 /**< number of times to play notes. 0 is same as 1. */
+} audio_melody_t;
+
+/** state of melody player. */
+typedef struct {
+    const audio_melody_t *melody;   /**< playing melody. NULL when finished. */
+    int rate;
+    int index;                  /**< index of current note. */
+    int repeat;                 /**< remaining times to play notes after current one. */
+    int segment;                /**< attack, body or release of current note. */
+    int remain;                 /**< remaining samples of current segment. */
+    int ramp;                   /**< samples of attack and release of current note. */
+    int body;                   /**< samples of body of current note. */
+    int32_t level;              /**< envelope level. */
+    int32_t delta;              /**< envelope level increment per sample. */
+    int shift;                  /**< exponential decay of level per sample. */
+    audio_osc_t osc;
+} audio_melody_player_t;
+
+/**
+ * @brief initialize oscillator.
+ * @param[out] osc      oscillator.
+ * @param[in] wave      waveform.
+ * @param[in] frequency frequency in Hz. 0 for silence.
+ * @param[in] rate      sampling rate.
+ */
+extern void audio_osc_init(audio_osc_t *osc, audio_wave_t wave, int frequency, int rate);
+/**
+ * @brief generate samples.
+ * @param[in,out] osc   oscillator.
+ * @param[out] dst      destination of samples.
+ * @param[in] samples   number of samples.
+ * @param[in] gain      gain. 32768 is full scale.
+ */
+extern void audio_osc_render(audio_osc_t *osc, int16_t *dst, int samples, int gain);
+
+/**
+ * @brief number of samples of a melody including repeat.
+ * @param[in] melody    melody.
+ * @param[in] rate      sampling rate.
+ */
+extern int audio_melody_samples(const audio_melody_t *melody, int rate);
+/**
+ * @brief start playing melody.
+ * @param[out] player   player.
+ * @param[in] melody    melody. must be valid until finished.
+ * @param[in] rate      sampling rate.
+ */
+extern void audio_melody_start(audio_melody_player_t *player, const audio_melody_t *melody, int rate);
+/**
+ * @brief generate samples of melody.
+ * @param[in,out] player player.
+ * @param[out] dst      destination of samples.
+ * @param[in] samples   maximum number of samples.
+ * @return number of samples generated. less than samples at end of melody.
+ */
+extern int audio_melody_render(audio_melody_player_t *player, int16_t *dst, int samples);
+/** @brief return non-zero if all samples of melody are generated. */
+static inline int audio_melody_finished(const audio_melody_player_t *player)
+{
+    return player->melody == NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -19,6 +19,7 @@
 #include <esp_err.h>
 
 #include "audio.h"
+#include "audio_adpcm.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,9 +38,11 @@ struct wav_play_info;
  * @param[in]  info     @ref wav_play_info containing wav_data,
  *                      passed to @ref audio_play or @ref audio_wav_play.
  * @param[in]  offset   offset of audio in wav_data. this value is relative to 'data' chunk data.
+ *                      for compressed wave, this is offset of coded data.
  * @param[out] data     pointer to buffer where the function should copy audio data to.
  * @param[in]  size     size of buffer pointed by data. user must copy exactly this size of data.
- * @return negative value to indicate error. 0 or positive value for success.
+ * @return negative value to indicate error, or number of bytes copied.
+ *         less than size is taken as end of data and play stops there.
  */
 typedef int (*wav_copy_data_func_t)(struct wav_play_info *info, int offset, void *data, int size);
 
@@ -47,9 +50,20 @@ typedef int (*wav_copy_data_func_t)(struct wav_play_info *info, int offset, void
 struct wav_info {
     uint32_t samplerate;    /**< sampling rate of wave data */
     uint16_t channels;      /**< number of channels in wave data */
-    uint16_t bits;          /**< number of bits of wave data */
+    uint16_t bits;          /**< number of bits of wave data. 16 for IMA ADPCM as it is decoded to 16bit */
     uint32_t data_offset;   /**< position where wave data starts */
-    uint32_t data_length;   /**< lenth of wave data in bytes */
+    uint32_t data_length;   /**< lenth of wave data in bytes. length after decode for IMA ADPCM */
+    uint16_t format;        /**< WAVE format tag, 1 for PCM or @ref AUDIO_ADPCM_FORMAT_TAG */
+    uint16_t block_align;   /**< size of block of coded data */
+    uint32_t coded_length;  /**< length of 'data' chunk in bytes */
+};
+
+/** state to decode IMA ADPCM in @ref wav_play_info. zero initialized state starts from top. */
+struct wav_adpcm_state {
+    audio_adpcm_t adpcm;    /**< decoder state */
+    uint32_t sample;        /**< index of next sample to be decoded */
+    int16_t pending;        /**< decoded sample not yet returned */
+    bool has_pending;       /**< pending is valid */
 };
 
 /** structure to hold info needed to play wave data. */
@@ -59,14 +73,18 @@ struct wav_play_info {
     int64_t playsize;               /**< remaining number of bytes to be played. play loops if it is greather than wav_info.data_length */
     wav_copy_data_func_t data_func; /**< copy data from wav_data */
     const void *wav_data;           /**< abstracted wave data to be used in data_func */
+    struct wav_adpcm_state adpcm;   /**< decoder state for IMA ADPCM */
 };
 
 /**
  * @brief parse wav header in wav_data and store result to info.
  * wav_data can be partial as long as it is long enough to contains 'data'
  * chunk header.
- * @attention this function assumes wav_data contains only 'fmt ' and  'data'
- *            chunks in this order (after 'RIFF' XXXX 'WAVE') and does not support multiple 'data' chunks.
+ * @attention this function assumes 'fmt ' chunk comes first (after 'RIFF' XXXX 'WAVE') and
+ *            'data' chunk follows within wav_data_size. chunks between them, e.g. 'fact',
+ *            are skipped. multiple 'data' chunks are not supported.
+ * @note PCM and mono IMA ADPCM are supported. IMA ADPCM is decoded to 16bit
+ *       by @ref audio_wav_data_func.
  * @param[in] wav_data      pointer to buffer contains wav header.
  * @param[in] wav_data_size size of wav_data.
  * @param[in] total_size    size of wav_data. this value is checked against 'data' chunk size.
@@ -19,6 +19,7 @@
 #include <esp_log.h>
 
 #include "audio.h"
+#include "audio_adpcm.h"
 #include "riffwave.h"
 
 #define TAG "audio"
@@ -27,6 +28,7 @@ const uint32_t FCC_RIFF = 0x46464952;
 const uint32_t FCC_WAVE = 0x45564157;
 const uint32_t FCC_FMT = 0x20746d66;
 const uint32_t FCC_DATA = 0x61746164;
+const uint32_t FCC_FACT = 0x74636166;
 
 struct wave_header {
     uint32_t riff;
@@ -47,13 +49,21 @@ struct wave_data {
     uint32_t data_size;
 };
 
+/* extension of 'fmt ' for IMA ADPCM */
+struct wave_fmt_adpcm {
+    uint16_t cb_size;
+    uint16_t samples_per_block;
+};
+
 esp_err_t audio_wav_parse(const void *wav_data,
     uint32_t wav_data_size, uint32_t total_size,
     struct wav_info *info)
 {
     struct wave_header header;
     struct wave_data data;
-    uint32_t data_offset;
+    /* 64 bit so sizes in header cannot wrap offset */
+    uint64_t data_offset, next_offset;
+    uint32_t samples = 0;
 
     if (wav_data == NULL) {
         return ESP_ERR_INVALID_ARG;
@@ -71,16 +81,17 @@ esp_err_t audio_wav_parse(const void *wav_data,
             header.riff, header.wave, header.fmt);
         return ESP_FAIL;
     }
-    if (8+header.riff_size > total_size || 20+header.fmt_size+8 > wav_data_size) {
+    if (8+(uint64_t)header.riff_size > total_size || 20+(uint64_t)header.fmt_size+8 > wav_data_size) {
         ESP_LOGE(TAG, "Invalid size: riff=%d fmt=%d size=%d",
             header.riff_size, header.fmt_size, total_size);
         return ESP_FAIL;
     }
-    if (header.fmt_tag != 1) {
+    if (header.fmt_tag != 1 && header.fmt_tag != AUDIO_ADPCM_FORMAT_TAG) {
         ESP_LOGE(TAG, "Unsupported wave format: %d", header.fmt_tag);
         return ESP_ERR_NOT_SUPPORTED;
     }
-    if (header.fmt_samplerate != 48000 && header.fmt_samplerate != 44100 && header.fmt_samplerate != 16000 && header.fmt_samplerate != 8000) {
+    /* any rate is resampled to output rate. limit to range resampler handles well. */
+    if (header.fmt_samplerate < 4000 || header.fmt_samplerate > 48000) {
         ESP_LOGE(TAG, "Unsupported sample rate: %d", header.fmt_samplerate);
         return ESP_ERR_NOT_SUPPORTED;
     }
@@ -88,15 +99,45 @@ esp_err_t audio_wav_parse(const void *wav_data,
         ESP_LOGE(TAG, "Unsupported channels: %d", header.fmt_channels);
         return ESP_ERR_NOT_SUPPORTED;
     }
-    if (header.fmt_bps != 8 && header.fmt_bps != 16) {
+    if (header.fmt_tag == AUDIO_ADPCM_FORMAT_TAG) {
+        struct wave_fmt_adpcm adpcm;
+        if (header.fmt_channels != 1 || header.fmt_bps != 4 || header.fmt_size < 20 ||
+            header.fmt_block <= AUDIO_ADPCM_HEADER_SIZE) {
+            ESP_LOGE(TAG, "Unsupported ADPCM: channels=%d bits=%d block=%d",
+                header.fmt_channels, header.fmt_bps, header.fmt_block);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        memcpy(&adpcm, (uint8_t*)wav_data+sizeof(header), sizeof(adpcm));
+        if (adpcm.samples_per_block != audio_adpcm_block_samples(header.fmt_block)) {
+            ESP_LOGE(TAG, "Invalid ADPCM samples per block: %d", adpcm.samples_per_block);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    } else if (header.fmt_bps != 8 && header.fmt_bps != 16) {
         ESP_LOGE(TAG, "Unsupported bits: %d", header.fmt_bps);
         return ESP_ERR_NOT_SUPPORTED;
     }
-    data_offset = 20+header.fmt_size;
-    memcpy(&data, (uint8_t*)wav_data+data_offset, sizeof(data));
-    if (data.data != FCC_DATA) {
-        ESP_LOGE(TAG, "Chunk after fmt is not data");
-        return ESP_ERR_NOT_SUPPORTED;
+    /* skip chunks, e.g. 'fact', until 'data' */
+    data_offset = 20+(((uint64_t)header.fmt_size+1)&~1);
+    while (1) {
+        if (data_offset + sizeof(data) > wav_data_size) {
+            ESP_LOGE(TAG, "No data chunk in header");
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        memcpy(&data, (uint8_t*)wav_data+data_offset, sizeof(data));
+        if (data.data == FCC_DATA) {
+            break;
+        }
+        if (data.data == FCC_FACT && data.data_size >= 4 &&
+            data_offset + 12 <= wav_data_size) {
+            memcpy(&samples, (uint8_t*)wav_data+data_offset+8, sizeof(samples));
+        }
+        /* offset strictly increases and stays in file, so loop ends */
+        next_offset = data_offset + 8 + (((uint64_t)data.data_size+1)&~1);
+        if (next_offset > total_size) {
+            ESP_LOGE(TAG, "Invalid chunk size: size=%u at %u", data.data_size, (uint32_t)data_offset);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        data_offset = next_offset;
     }
     if (data_offset + 8 + data.data_size > total_size) {
         ESP_LOGE(TAG, "Invalid data size: data=%d, size=%d",
@@ -109,6 +150,24 @@ esp_err_t audio_wav_parse(const void *wav_data,
     info->bits = header.fmt_bps;
     info->data_offset = data_offset + 8;
     info->data_length = data.data_size;
+    info->format = header.fmt_tag;
+    info->block_align = header.fmt_block;
+    info->coded_length = data.data_size;
+    if (header.fmt_tag == AUDIO_ADPCM_FORMAT_TAG) {
+        /* length of last block may be short */
+        uint32_t blocks = data.data_size / header.fmt_block;
+        uint32_t rest = data.data_size % header.fmt_block;
+        uint32_t max_samples = blocks * audio_adpcm_block_samples(header.fmt_block);
+        if (rest >= AUDIO_ADPCM_HEADER_SIZE) {
+            max_samples += audio_adpcm_block_samples(rest);
+        }
+        /* 'fact' has exact number of samples without padding of last block */
+        if (samples == 0 || samples > max_samples) {
+            samples = max_samples;
+        }
+        info->bits = 16;
+        info->data_length = samples * 2;
+    }
     return ESP_OK;
 }
 
@@ -119,6 +178,124 @@ static int audio_wav_copy_data_func(struct wav_play_info *info, int offset, void
     return size;
 }
 
+/* decode samples from current decoder position into out.
+ * coded data is read into last part of out and decoded in place. */
+static int wav_adpcm_decode(struct wav_play_info *info, wav_copy_data_func_t data_func,
+    int16_t *out, int samples)
+{
+    const struct wav_info *wav_info = &info->wav_info;
+    struct wav_adpcm_state *st = &info->adpcm;
+    int block_samples = audio_adpcm_block_samples(wav_info->block_align);
+    int n = 0;
+    int ret;
+
+    while (n < samples) {
+        uint32_t block = st->sample / block_samples;
+        uint32_t index = st->sample % block_samples;
+        uint32_t offset = block * wav_info->block_align;
+        uint32_t bytes;
+        uint8_t *codes;
+        if (st->has_pending) {
+            out[n++] = st->pending;
+            st->has_pending = false;
+            st->sample++;
+            continue;
+        }
+        if (index == 0) {
+            uint8_t header[AUDIO_ADPCM_HEADER_SIZE];
+            ret = data_func(info, offset, header, sizeof(header));
+            if (ret < 0) {
+                return -1;
+            }
+            if (ret < (int)sizeof(header)) {
+                /* truncated */
+                break;
+            }
+            out[n++] = audio_adpcm_decode_header(&st->adpcm, header);
+            st->sample++;
+            continue;
+        }
+        /* index is odd here, as even index is returned as pending */
+        offset += AUDIO_ADPCM_HEADER_SIZE + (index-1)/2;
+        bytes = (block_samples - index) / 2;
+        if (bytes > (uint32_t)(samples - n + 1) / 2) {
+            bytes = (samples - n + 1) / 2;
+        }
+        if (bytes > wav_info->coded_length - offset) {
+            bytes = wav_info->coded_length - offset;
+        }
+        if (bytes == 0) {
+            break;
+        }
+        codes = (uint8_t*)(out + samples) - bytes;
+        ret = data_func(info, offset, codes, bytes);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret < (int)bytes) {
+            /* truncated. codes read are not at tail of out, so stop here */
+            break;
+        }
+        if ((samples - n) % 2 == 0) {
+            audio_adpcm_decode(&st->adpcm, out + n, codes, bytes);
+            n += bytes * 2;
+            st->sample += bytes * 2;
+        } else {
+            /* last code has one more sample than requested */
+            int16_t last[2];
+            audio_adpcm_decode(&st->adpcm, out + n, codes, bytes - 1);
+            n += (bytes - 1) * 2;
+            audio_adpcm_decode(&st->adpcm, last, codes + bytes - 1, 1);
+            out[n++] = last[0];
+            st->pending = last[1];
+            st->has_pending = true;
+            st->sample += (bytes - 1) * 2 + 1;
+        }
+    }
+    return n;
+}
+
+/* read size bytes of decoded samples at offset. */
+static int wav_adpcm_read(struct wav_play_info *info, wav_copy_data_func_t data_func,
+    uint32_t offset, void *data, int size)
+{
+    struct wav_adpcm_state *st = &info->adpcm;
+    uint32_t sample = offset / 2;
+    int samples = size / 2;
+    int n;
+
+    if (st->sample != sample) {
+        /* seek to head of block and skip samples before offset */
+        int block_samples = audio_adpcm_block_samples(info->wav_info.block_align);
+        st->sample = sample - sample % block_samples;
+        st->has_pending = false;
+        while (st->sample < sample) {
+            int skip = sample - st->sample;
+            if (skip > samples) {
+                skip = samples;
+            }
+            if (wav_adpcm_decode(info, data_func, data, skip) <= 0) {
+                return -1;
+            }
+        }
+    }
+    n = wav_adpcm_decode(info, data_func, data, samples);
+    if (n < 0) {
+        return -1;
+    }
+    return n * 2;
+}
+
+/* read size bytes of audio at offset, decoding if needed. */
+static int wav_read(struct wav_play_info *info, wav_copy_data_func_t data_func,
+    uint32_t offset, void *data, int size)
+{
+    if (info->wav_info.format == AUDIO_ADPCM_FORMAT_TAG) {
+        return wav_adpcm_read(info, data_func, offset, data, size);
+    }
+    return data_func(info, offset, data, size);
+}
+
 esp_err_t audio_wav_play_init(struct wav_play_info *info,
     const void *wav_data, uint32_t wav_data_size)
 {
@@ -134,6 +311,7 @@ esp_err_t audio_wav_play_init(struct wav_play_info *info,
     info->wav_data = (const uint8_t*)wav_data+info->wav_info.data_offset;
     info->offset = 0;
     info->playsize = info->wav_info.data_length;
+    memset(&info->adpcm, 0, sizeof(info->adpcm));
     return ESP_OK;
 }
 
@@ -149,7 +327,7 @@ int audio_wav_data_func(void *arg, void *data, int *size)
 {
     struct wav_play_info *info = arg;
     wav_copy_data_func_t data_func;
-    uint32_t length, remaining;
+    uint32_t length, chunk;
     int ret;
 
     if (data == NULL && size == NULL) {
@@ -163,29 +341,38 @@ int audio_wav_data_func(void *arg, void *data, int *size)
     if (length > info->playsize) {
         length = info->playsize;
     }
+    if (info->wav_info.format == AUDIO_ADPCM_FORMAT_TAG) {
+        /* whole samples, or short read would be taken as end */
+        length &= ~1;
+    }
     *size = 0;
-    remaining = info->wav_info.data_length - info->offset;
-    if (remaining == 0) {
-        info->offset = 0;
-    } else if (length > remaining) {
-        ret = data_func(info, info->offset, data, remaining);
+    /* wave shorter than buffer loops more than once */
+    while (length > 0) {
+        if (info->offset >= info->wav_info.data_length) {
+            /* loop */
+            info->offset = 0;
+        }
+        chunk = info->wav_info.data_length - info->offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+        ret = wav_read(info, data_func, info->offset, data, chunk);
         if (ret < 0) {
             return 0;
         }
-        *size += remaining;
-        info->offset = 0;
-        info->playsize -= remaining;
-        data = (uint8_t*)data + remaining;
-        length -= remaining;
-    } else {
-        remaining = 0;
-    }
-    ret = data_func(info, info->offset, data, length);
-    if (ret < 0) {
-        return 0;
+        if (ret > (int)chunk) {
+            ret = chunk;
+        }
+        *size += ret;
+        info->offset += ret;
+        info->playsize -= ret;
+        data = (uint8_t*)data + ret;
+        length -= ret;
+        if (ret < (int)chunk) {
+            /* short read. rest of buffer is not audio, so end play */
+            info->playsize = 0;
+            break;
+        }
     }
-    *size = length + remaining;
-    info->offset += length;
-    info->playsize -= length;
     return info->playsize > 0;
 }
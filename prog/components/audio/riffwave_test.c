@@ -0,0 +1,324 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of riffwave.c. parses crafted headers and plays wav through
+ * audio_wav_data_func. audio.c is not linked, playing is done by the test. */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "riffwave.h"
+
+#define BLOCK_ALIGN     256
+/* odd, and last block is partial */
+#define SAMPLES         3001
+
+int sim_log_level = 0;
+
+static int s_failed = 0;
+
+/* riffwave.c starts play through these. not used by test. */
+void audio_play(audio_data_func_t callback, void *arg,
+    int samplerate, int channels, int bits,
+    audio_queue_mode_t mode)
+{
+}
+
+void audio_play_ex(audio_data_func_t callback, void *arg,
+    int samplerate, int channels, int bits,
+    audio_queue_mode_t mode, const audio_play_opts_t *opts)
+{
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_fcc(uint8_t *p, const char *fcc)
+{
+    memcpy(p, fcc, 4);
+    return p + 4;
+}
+
+/* 16 bit mono PCM header with extra chunk of given size before 'data' */
+static int make_pcm_header(uint8_t *buf, uint32_t extra_size, uint32_t data_size)
+{
+    uint8_t *p = buf;
+    p = put_fcc(p, "RIFF");
+    p = put32(p, 0);
+    p = put_fcc(p, "WAVE");
+    p = put_fcc(p, "fmt ");
+    p = put32(p, 16);
+    p = put16(p, 1);
+    p = put16(p, 1);
+    p = put32(p, 16000);
+    p = put32(p, 32000);
+    p = put16(p, 2);
+    p = put16(p, 16);
+    p = put_fcc(p, "LIST");
+    p = put32(p, extra_size);
+    p = put_fcc(p, "data");
+    p = put32(p, data_size);
+    put32(buf + 4, p - buf - 8 + data_size);
+    return p - buf;
+}
+
+static void test_parse_chunk_size(void)
+{
+    /* size adding exactly 0 in 32 bit, size wrapping back, and size past end */
+    static const uint32_t sizes[] = { 0xfffffff8, 0xfffffff0, 0x80000000, 1000 };
+    uint8_t buf[64];
+    struct wav_info info;
+    esp_err_t err;
+    size_t i;
+
+    for (i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+        int size = make_pcm_header(buf, sizes[i], 0);
+        err = audio_wav_parse(buf, sizeof(buf), size, &info);
+        if (err == ESP_OK) {
+            printf("FAIL parse: chunk size %08x accepted\n", sizes[i]);
+            s_failed++;
+            return;
+        }
+    }
+    /* empty chunk is skipped */
+    make_pcm_header(buf, 0, 100);
+    err = audio_wav_parse(buf, sizeof(buf), sizeof(buf) + 100, &info);
+    if (err != ESP_OK || info.data_offset != 52 || info.data_length != 100) {
+        printf("FAIL parse: err %d offset %u length %u\n", err, info.data_offset, info.data_length);
+        s_failed++;
+        return;
+    }
+    printf("ok   parse chunk size\n");
+}
+
+/* mono IMA ADPCM wav of src with 'fact' chunk. return size. */
+static int make_adpcm_wav(uint8_t *buf, const int16_t *src, int samples)
+{
+    int block_samples = audio_adpcm_block_samples(BLOCK_ALIGN);
+    int blocks = (samples + block_samples - 1) / block_samples;
+    audio_adpcm_t st;
+    uint8_t *p = buf;
+    int i;
+
+    p = put_fcc(p, "RIFF");
+    p = put32(p, 0);
+    p = put_fcc(p, "WAVE");
+    p = put_fcc(p, "fmt ");
+    p = put32(p, 20);
+    p = put16(p, AUDIO_ADPCM_FORMAT_TAG);
+    p = put16(p, 1);
+    p = put32(p, 16000);
+    p = put32(p, 16000 * BLOCK_ALIGN / block_samples);
+    p = put16(p, BLOCK_ALIGN);
+    p = put16(p, 4);
+    p = put16(p, 2);
+    p = put16(p, block_samples);
+    p = put_fcc(p, "fact");
+    p = put32(p, 4);
+    p = put32(p, samples);
+    p = put_fcc(p, "data");
+    p = put32(p, blocks * BLOCK_ALIGN);
+    memset(&st, 0, sizeof(st));
+    for (i = 0; i < blocks; i++) {
+        int n = samples - i * block_samples;
+        audio_adpcm_encode_block(&st, p, BLOCK_ALIGN, src + i * block_samples,
+            n < block_samples? n: block_samples);
+        p += BLOCK_ALIGN;
+    }
+    put32(buf + 4, p - buf - 8);
+    return p - buf;
+}
+
+/* decode whole blocks of coded data. ref has room for all samples of blocks. */
+static void decode_blocks(int16_t *ref, const uint8_t *coded, int blocks)
+{
+    int block_samples = audio_adpcm_block_samples(BLOCK_ALIGN);
+    audio_adpcm_t st;
+    int i;
+
+    for (i = 0; i < blocks; i++) {
+        const uint8_t *block = coded + i * BLOCK_ALIGN;
+        int16_t *out = ref + i * block_samples;
+        out[0] = audio_adpcm_decode_header(&st, block);
+        audio_adpcm_decode(&st, out + 1, block + AUDIO_ADPCM_HEADER_SIZE,
+            BLOCK_ALIGN - AUDIO_ADPCM_HEADER_SIZE);
+    }
+}
+
+static uint8_t s_wav[4096];
+static int16_t s_ref[8 * 505];
+static int s_cut;
+
+/* read size bytes by audio_wav_data_func in random sized chunks. odd sizes
+ * included. return bytes read, which ends early if play ends. */
+static int play_chunks(struct wav_play_info *info, uint8_t *out, int size)
+{
+    int n = 0;
+    while (n < size) {
+        int chunk = 1 + rand() % 300;
+        int more;
+        if (chunk > size - n) {
+            chunk = size - n;
+        }
+        more = audio_wav_data_func(info, out + n, &chunk);
+        n += chunk;
+        if (!more) {
+            break;
+        }
+    }
+    return n;
+}
+
+/* compare bytes of pcm against reference played from sample at offset, looping */
+static bool check_pcm(const char *name, const uint8_t *pcm, int size, uint32_t offset)
+{
+    int i;
+    for (i = 0; i < size / 2; i++) {
+        int16_t v;
+        int sample = (offset / 2 + i) % SAMPLES;
+        memcpy(&v, pcm + i * 2, sizeof(v));
+        if (v != s_ref[sample]) {
+            printf("FAIL %s: sample %d is %d, expected %d\n", name, sample, v, s_ref[sample]);
+            s_failed++;
+            return false;
+        }
+    }
+    return true;
+}
+
+/* data_func of wav truncated at s_cut bytes of coded data */
+static int cut_data_func(struct wav_play_info *info, int offset, void *data, int size)
+{
+    const uint8_t *wav_data = info->wav_data;
+    if (offset >= s_cut) {
+        return 0;
+    }
+    if (offset + size > s_cut) {
+        size = s_cut - offset;
+    }
+    memcpy(data, wav_data + offset, size);
+    return size;
+}
+
+static void test_adpcm_play(void)
+{
+    static int16_t src[SAMPLES];
+    static uint8_t pcm[SAMPLES * 2 * 3];
+    int block_samples = audio_adpcm_block_samples(BLOCK_ALIGN);
+    int blocks = (SAMPLES + block_samples - 1) / block_samples;
+    struct wav_play_info info;
+    int wav_size, n, i;
+    int offset;
+
+    for (i = 0; i < SAMPLES; i++) {
+        src[i] = (int16_t)lrint(12000 * sin(2 * M_PI * 440 * i / 16000.0));
+    }
+    wav_size = make_adpcm_wav(s_wav, src, SAMPLES);
+    if (audio_wav_play_init(&info, s_wav, wav_size) != ESP_OK ||
+            info.wav_info.data_length != SAMPLES * 2) {
+        printf("FAIL adpcm: init\n");
+        s_failed++;
+        return;
+    }
+    decode_blocks(s_ref, (const uint8_t*)info.wav_data, blocks);
+
+    /* whole wav in odd and unaligned chunks, stops at exact length */
+    n = play_chunks(&info, pcm, sizeof(pcm));
+    if (n != SAMPLES * 2) {
+        printf("FAIL adpcm: %d bytes played\n", n);
+        s_failed++;
+        return;
+    }
+    if (!check_pcm("adpcm", pcm, n, 0)) {
+        return;
+    }
+    printf("ok   adpcm chunks\n");
+
+    /* loop by playsize longer than wav */
+    audio_wav_play_init(&info, s_wav, wav_size);
+    info.playsize = SAMPLES * 2 * 2 + 1002;
+    n = play_chunks(&info, pcm, sizeof(pcm));
+    if (n != SAMPLES * 2 * 2 + 1002) {
+        printf("FAIL adpcm loop: %d bytes played\n", n);
+        s_failed++;
+        return;
+    }
+    if (!check_pcm("adpcm loop", pcm, n, 0)) {
+        return;
+    }
+    printf("ok   adpcm loop\n");
+
+    /* start at odd sample in middle of block, which seeks to head of block */
+    for (offset = 2 * 3; offset < SAMPLES * 2; offset += 2 * 777) {
+        audio_wav_play_init(&info, s_wav, wav_size);
+        info.offset = offset;
+        info.playsize = SAMPLES * 2 - offset;
+        n = play_chunks(&info, pcm, sizeof(pcm));
+        if (n != SAMPLES * 2 - offset) {
+            printf("FAIL adpcm seek: %d bytes from %d\n", n, offset);
+            s_failed++;
+            return;
+        }
+        if (!check_pcm("adpcm seek", pcm, n, offset)) {
+            return;
+        }
+    }
+    printf("ok   adpcm seek\n");
+
+    /* truncated in middle of block. play ends without garbage */
+    audio_wav_play_init(&info, s_wav, wav_size);
+    info.data_func = cut_data_func;
+    s_cut = BLOCK_ALIGN + 101;
+    memset(pcm, 0x55, sizeof(pcm));
+    n = play_chunks(&info, pcm, sizeof(pcm));
+    if (n >= SAMPLES * 2 || n < BLOCK_ALIGN * 2 || info.playsize != 0) {
+        printf("FAIL adpcm short: %d bytes played\n", n);
+        s_failed++;
+        return;
+    }
+    if (!check_pcm("adpcm short", pcm, n, 0)) {
+        return;
+    }
+    printf("ok   adpcm short read: %d bytes\n", n);
+}
+
+int main(void)
+{
+    srand(1);
+    test_parse_chunk_size();
+    test_adpcm_play();
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
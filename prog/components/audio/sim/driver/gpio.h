@@ -0,0 +1,42 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum {
+    GPIO_NUM_25 = 25,
+    GPIO_NUM_26 = 26,
+} gpio_num_t;
+
+typedef enum {
+    GPIO_MODE_DISABLE,
+    GPIO_MODE_OUTPUT,
+} gpio_mode_t;
+
+static inline esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    (void)gpio;
+    (void)level;
+    return ESP_OK;
+}
+
+static inline esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode)
+{
+    (void)gpio;
+    (void)mode;
+    return ESP_OK;
+}
@@ -0,0 +1,70 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+/* fake I2S driver of sim_i2s.c. only 16bit mono output is supported. */
+
+typedef enum {
+    I2S_NUM_0,
+    I2S_NUM_MAX,
+} i2s_port_t;
+
+#define I2S_MODE_MASTER         1
+#define I2S_MODE_TX             4
+#define I2S_MODE_DAC_BUILT_IN   16
+#define I2S_MODE_PDM            64
+
+#define I2S_COMM_FORMAT_I2S_MSB 3
+#define I2S_COMM_FORMAT_PCM     4
+
+#define I2S_BITS_PER_SAMPLE_16BIT   16
+#define I2S_CHANNEL_FMT_ONLY_RIGHT  3
+#define I2S_DAC_CHANNEL_RIGHT_EN    1
+#define I2S_PIN_NO_CHANGE           (-1)
+
+typedef struct {
+    int mode;
+    int sample_rate;
+    int bits_per_sample;
+    int channel_format;
+    int communication_format;
+    int intr_alloc_flags;
+    int dma_buf_count;
+    int dma_buf_len;
+} i2s_config_t;
+
+typedef struct {
+    int bck_io_num;
+    int ws_io_num;
+    int data_out_num;
+    int data_in_num;
+} i2s_pin_config_t;
+
+extern esp_err_t i2s_driver_install(i2s_port_t i2s_num, const i2s_config_t *config,
+    int queue_size, void *i2s_queue);
+extern esp_err_t i2s_driver_uninstall(i2s_port_t i2s_num);
+extern esp_err_t i2s_set_pin(i2s_port_t i2s_num, const i2s_pin_config_t *pin);
+extern esp_err_t i2s_set_dac_mode(int mode);
+extern esp_err_t i2s_start(i2s_port_t i2s_num);
+extern esp_err_t i2s_stop(i2s_port_t i2s_num);
+extern esp_err_t i2s_zero_dma_buffer(i2s_port_t i2s_num);
+extern esp_err_t i2s_write(i2s_port_t i2s_num, const void *src, size_t size,
+    size_t *bytes_written, TickType_t ticks_to_wait);
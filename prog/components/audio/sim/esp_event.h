@@ -0,0 +1,32 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef const char *esp_event_base_t;
+
+#define ESP_EVENT_DECLARE_BASE(id)  extern esp_event_base_t id
+#define ESP_EVENT_DEFINE_BASE(id)   esp_event_base_t id = #id
+
+/* events are not delivered. test may hook them, called by posting task. */
+extern void (*sim_event_hook)(esp_event_base_t event_base, int32_t event_id);
+
+extern esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+    void *event_data, size_t event_data_size, TickType_t ticks_to_wait);
@@ -0,0 +1,33 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+/* errors and warnings are printed. set SIM_LOG_LEVEL to 5 to see all. */
+extern int sim_log_level;
+
+#define SIM_LOG(level, letter, tag, format, ...) do { \
+        if (sim_log_level >= (level)) { \
+            fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...)  SIM_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  SIM_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  SIM_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  SIM_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)  SIM_LOG(5, "V", tag, format, ##__VA_ARGS__)
@@ -0,0 +1,42 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* minimal FreeRTOS API on pthreads for host simulation of audio component.
+ * tasks are threads, priorities are ignored and a tick is 1 msec. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+
+#define configTICK_RATE_HZ  1000
+#define portTICK_PERIOD_MS  (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY       ((TickType_t)0xffffffff)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms) * configTICK_RATE_HZ / 1000)
+
+/* defined by soc.h on ESP32, which FreeRTOS.h includes */
+#define BIT0    0x00000001
+#define BIT1    0x00000002
+#define BIT2    0x00000004
+#define BIT3    0x00000008
@@ -0,0 +1,29 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct sim_event_group *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+extern EventGroupHandle_t xEventGroupCreate(void);
+extern void vEventGroupDelete(EventGroupHandle_t group);
+extern EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+extern EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+extern EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+extern EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+    BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t ticks);
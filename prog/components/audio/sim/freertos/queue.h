@@ -0,0 +1,30 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct sim_queue *QueueHandle_t;
+
+extern QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+extern void vQueueDelete(QueueHandle_t queue);
+extern BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks);
+extern BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks);
+extern BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+extern BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks);
+extern UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#define xQueueSend  xQueueSendToBack
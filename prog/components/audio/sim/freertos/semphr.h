@@ -0,0 +1,27 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+typedef struct sim_sem *SemaphoreHandle_t;
+
+extern SemaphoreHandle_t xSemaphoreCreateMutex(void);
+extern SemaphoreHandle_t xSemaphoreCreateBinary(void);
+extern void vSemaphoreDelete(SemaphoreHandle_t sem);
+extern BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+extern BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
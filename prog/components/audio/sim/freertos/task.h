@@ -0,0 +1,29 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct sim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+extern BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack_depth,
+    void *arg, UBaseType_t priority, TaskHandle_t *handle);
+extern void vTaskDelete(TaskHandle_t task);
+extern void vTaskDelay(TickType_t ticks);
+extern TaskHandle_t xTaskGetCurrentTaskHandle(void);
+extern uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+extern BaseType_t xTaskNotifyGive(TaskHandle_t task);
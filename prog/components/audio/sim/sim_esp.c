@@ -0,0 +1,47 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* ESP-IDF services used by audio component. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_event.h"
+
+int sim_log_level = 2;
+void (*sim_event_hook)(esp_event_base_t event_base, int32_t event_id);
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+    void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    (void)event_data;
+    (void)event_data_size;
+    (void)ticks_to_wait;
+    if (sim_event_hook != NULL) {
+        sim_event_hook(event_base, event_id);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,338 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* fake I2S driver recording output stream. see sim_i2s.h. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "driver/i2s.h"
+#include "sim_i2s.h"
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool installed;
+    bool zeroed;
+    bool hold;
+    bool running;
+    int speed;
+    int rate;
+    int dma_samples;
+    int dma_buf_len;
+    int64_t dma_end;    /* time when DMA plays out written samples when paced */
+    int starts;
+    int installs;
+    int16_t *samples;
+    size_t count;
+    size_t capacity;
+    sim_i2s_log_t *log;
+    size_t log_count;
+    size_t log_capacity;
+} s_i2s = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void append_samples(const int16_t *src, size_t count)
+{
+    if (s_i2s.count + count > s_i2s.capacity) {
+        size_t capacity = s_i2s.capacity? s_i2s.capacity: 16000;
+        while (capacity < s_i2s.count + count) {
+            capacity *= 2;
+        }
+        s_i2s.samples = realloc(s_i2s.samples, capacity * sizeof(*s_i2s.samples));
+        if (s_i2s.samples == NULL) {
+            abort();
+        }
+        s_i2s.capacity = capacity;
+    }
+    if (src != NULL) {
+        memcpy(s_i2s.samples + s_i2s.count, src, count * sizeof(*src));
+    } else {
+        memset(s_i2s.samples + s_i2s.count, 0, count * sizeof(*src));
+    }
+    s_i2s.count += count;
+}
+
+static void append_log(sim_i2s_event_t event, uint32_t samples)
+{
+    sim_i2s_log_t *entry;
+    if (s_i2s.log_count == s_i2s.log_capacity) {
+        s_i2s.log_capacity = s_i2s.log_capacity? s_i2s.log_capacity * 2: 256;
+        s_i2s.log = realloc(s_i2s.log, s_i2s.log_capacity * sizeof(*s_i2s.log));
+        if (s_i2s.log == NULL) {
+            abort();
+        }
+    }
+    entry = &s_i2s.log[s_i2s.log_count++];
+    entry->time = esp_timer_get_time();
+    entry->position = s_i2s.count;
+    entry->samples = samples;
+    entry->event = event;
+}
+
+static int64_t samples_to_usec(int64_t samples)
+{
+    return samples * 1000000 / s_i2s.rate / s_i2s.speed;
+}
+
+static int64_t usec_to_samples(int64_t usec)
+{
+    return usec * s_i2s.rate * s_i2s.speed / 1000000;
+}
+
+esp_err_t i2s_driver_install(i2s_port_t i2s_num, const i2s_config_t *config,
+    int queue_size, void *i2s_queue)
+{
+    (void)queue_size;
+    (void)i2s_queue;
+    if (i2s_num != I2S_NUM_0 || config->bits_per_sample != I2S_BITS_PER_SAMPLE_16BIT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_i2s.lock);
+    if (s_i2s.installed) {
+        pthread_mutex_unlock(&s_i2s.lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_i2s.installed = true;
+    s_i2s.installs++;
+    s_i2s.rate = config->sample_rate;
+    s_i2s.dma_samples = config->dma_buf_count * config->dma_buf_len;
+    s_i2s.dma_buf_len = config->dma_buf_len;
+    pthread_mutex_unlock(&s_i2s.lock);
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t i2s_num)
+{
+    (void)i2s_num;
+    pthread_mutex_lock(&s_i2s.lock);
+    s_i2s.installed = false;
+    pthread_mutex_unlock(&s_i2s.lock);
+    return ESP_OK;
+}
+
+esp_err_t i2s_set_pin(i2s_port_t i2s_num, const i2s_pin_config_t *pin)
+{
+    (void)i2s_num;
+    (void)pin;
+    return ESP_OK;
+}
+
+esp_err_t i2s_set_dac_mode(int mode)
+{
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t i2s_zero_dma_buffer(i2s_port_t i2s_num)
+{
+    (void)i2s_num;
+    pthread_mutex_lock(&s_i2s.lock);
+    s_i2s.zeroed = true;
+    pthread_mutex_unlock(&s_i2s.lock);
+    return ESP_OK;
+}
+
+esp_err_t i2s_start(i2s_port_t i2s_num)
+{
+    (void)i2s_num;
+    pthread_mutex_lock(&s_i2s.lock);
+    append_log(SIM_I2S_START, 0);
+    s_i2s.starts++;
+    s_i2s.running = true;
+    if (s_i2s.speed > 0) {
+        s_i2s.dma_end = esp_timer_get_time();
+    }
+    if (s_i2s.zeroed) {
+        /* DMA plays zeroed buffers before written samples */
+        append_samples(NULL, s_i2s.dma_samples);
+        if (s_i2s.speed > 0) {
+            s_i2s.dma_end += samples_to_usec(s_i2s.dma_samples);
+        }
+        s_i2s.zeroed = false;
+    }
+    pthread_mutex_unlock(&s_i2s.lock);
+    return ESP_OK;
+}
+
+esp_err_t i2s_stop(i2s_port_t i2s_num)
+{
+    (void)i2s_num;
+    pthread_mutex_lock(&s_i2s.lock);
+    append_log(SIM_I2S_STOP, 0);
+    s_i2s.running = false;
+    pthread_mutex_unlock(&s_i2s.lock);
+    return ESP_OK;
+}
+
+esp_err_t i2s_write(i2s_port_t i2s_num, const void *src, size_t size,
+    size_t *bytes_written, TickType_t ticks_to_wait)
+{
+    const int16_t *pcm = (const int16_t*)src;
+    uint32_t samples = size / 2;
+    uint32_t done = 0;
+    (void)i2s_num;
+    (void)ticks_to_wait;
+    pthread_mutex_lock(&s_i2s.lock);
+    while (s_i2s.hold) {
+        pthread_cond_wait(&s_i2s.cond, &s_i2s.lock);
+    }
+    while (done < samples) {
+        uint32_t n = samples - done;
+        if (s_i2s.speed > 0) {
+            /* fill DMA buffers as they are freed like driver */
+            int64_t now = esp_timer_get_time();
+            int64_t room;
+            if (s_i2s.dma_end < now) {
+                if (s_i2s.running && s_i2s.dma_end != 0 && s_i2s.speed == 1) {
+                    /* DMA ran out and played silence until now */
+                    append_samples(NULL, usec_to_samples(now - s_i2s.dma_end));
+                }
+                s_i2s.dma_end = now;
+            }
+            room = s_i2s.dma_samples - usec_to_samples(s_i2s.dma_end - now);
+            if (room < n && room < s_i2s.dma_buf_len) {
+                int64_t wait = s_i2s.dma_end - now - samples_to_usec(s_i2s.dma_samples - s_i2s.dma_buf_len);
+                pthread_mutex_unlock(&s_i2s.lock);
+                struct timespec ts = { wait / 1000000, wait % 1000000 * 1000 };
+                nanosleep(&ts, NULL);
+                pthread_mutex_lock(&s_i2s.lock);
+                continue;
+            }
+            if (n > room) {
+                n = room;
+            }
+            s_i2s.dma_end += samples_to_usec(n);
+        }
+        append_log(SIM_I2S_WRITE, n);
+        append_samples(pcm + done, n);
+        done += n;
+    }
+    pthread_mutex_unlock(&s_i2s.lock);
+    *bytes_written = samples * 2;
+    return ESP_OK;
+}
+
+void sim_i2s_reset(void)
+{
+    pthread_mutex_lock(&s_i2s.lock);
+    s_i2s.count = 0;
+    s_i2s.log_count = 0;
+    s_i2s.starts = 0;
+    pthread_mutex_unlock(&s_i2s.lock);
+}
+
+void sim_i2s_set_speed(int speed)
+{
+    pthread_mutex_lock(&s_i2s.lock);
+    s_i2s.speed = speed;
+    s_i2s.dma_end = 0;
+    pthread_mutex_unlock(&s_i2s.lock);
+}
+
+void sim_i2s_hold(bool hold)
+{
+    pthread_mutex_lock(&s_i2s.lock);
+    s_i2s.hold = hold;
+    pthread_cond_broadcast(&s_i2s.cond);
+    pthread_mutex_unlock(&s_i2s.lock);
+}
+
+const int16_t *sim_i2s_get_samples(size_t *count)
+{
+    *count = s_i2s.count;
+    return s_i2s.samples;
+}
+
+const sim_i2s_log_t *sim_i2s_get_log(size_t *count)
+{
+    *count = s_i2s.log_count;
+    return s_i2s.log;
+}
+
+int sim_i2s_get_starts(void)
+{
+    return s_i2s.starts;
+}
+
+int sim_i2s_get_installs(void)
+{
+    return s_i2s.installs;
+}
+
+int sim_i2s_get_dma_samples(void)
+{
+    return s_i2s.dma_samples;
+}
+
+static void put_le(FILE *fp, uint32_t value, int bytes)
+{
+    while (bytes-- > 0) {
+        fputc(value & 0xff, fp);
+        value >>= 8;
+    }
+}
+
+esp_err_t sim_i2s_save_wav(const char *path)
+{
+    uint32_t data_length = s_i2s.count * 2;
+    size_t i;
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return ESP_FAIL;
+    }
+    fwrite("RIFF", 1, 4, fp);
+    put_le(fp, 36 + data_length, 4);
+    fwrite("WAVEfmt ", 1, 8, fp);
+    put_le(fp, 16, 4);
+    put_le(fp, 1, 2);
+    put_le(fp, 1, 2);
+    put_le(fp, s_i2s.rate, 4);
+    put_le(fp, s_i2s.rate * 2, 4);
+    put_le(fp, 2, 2);
+    put_le(fp, 16, 2);
+    fwrite("data", 1, 4, fp);
+    put_le(fp, data_length, 4);
+    for (i = 0; i < s_i2s.count; i++) {
+        put_le(fp, (uint16_t)s_i2s.samples[i], 2);
+    }
+    return fclose(fp) == 0? ESP_OK: ESP_FAIL;
+}
+
+esp_err_t sim_i2s_save_log(const char *path)
+{
+    static const char *names[] = { "start", "write", "stop" };
+    size_t i;
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        return ESP_FAIL;
+    }
+    fprintf(fp, "time,position,samples,event\n");
+    for (i = 0; i < s_i2s.log_count; i++) {
+        const sim_i2s_log_t *entry = &s_i2s.log[i];
+        fprintf(fp, "%lld,%u,%u,%s\n", (long long)entry->time, entry->position,
+            entry->samples, names[entry->event]);
+    }
+    return fclose(fp) == 0? ESP_OK: ESP_FAIL;
+}
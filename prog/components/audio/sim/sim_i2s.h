@@ -0,0 +1,74 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @file
+ * control of fake I2S driver for host simulation of audio component.
+ * every sample written to I2S is recorded with time stamp, so that
+ * output stream can be checked by tests or saved as WAV file.
+ * DMA buffers zeroed before start are recorded as silence like hardware plays them.
+ */
+
+/** event of log. */
+typedef enum {
+    SIM_I2S_START,      /**< i2s_start. */
+    SIM_I2S_WRITE,      /**< i2s_write. */
+    SIM_I2S_STOP,       /**< i2s_stop. */
+} sim_i2s_event_t;
+
+/** entry of log. */
+typedef struct {
+    int64_t time;       /**< esp_timer_get_time() of event. */
+    uint32_t position;  /**< number of samples recorded before event. */
+    uint32_t samples;   /**< number of samples written. */
+    sim_i2s_event_t event;
+} sim_i2s_log_t;
+
+/** @brief clear recorded samples and log. */
+extern void sim_i2s_reset(void);
+/**
+ * @brief set speed of DMA consuming samples.
+ * at real time, silence is recorded for time DMA ran out of samples while started,
+ * so position in recording is time since start. it is not at faster speed,
+ * as host cannot keep DMA fed by then.
+ * @param[in] speed     times of real time. 0 to consume instantly, which is default.
+ */
+extern void sim_i2s_set_speed(int speed);
+/**
+ * @brief block i2s_write like DMA is stalled, to queue audio before any is played.
+ * @note audio_stop does not return while held.
+ */
+extern void sim_i2s_hold(bool hold);
+/** @brief return recorded samples and set number of them to count. */
+extern const int16_t *sim_i2s_get_samples(size_t *count);
+/** @brief return log and set number of entries to count. */
+extern const sim_i2s_log_t *sim_i2s_get_log(size_t *count);
+/** @brief return number of times i2s_start is called after reset. */
+extern int sim_i2s_get_starts(void);
+/** @brief return number of times driver is installed since start of program. */
+extern int sim_i2s_get_installs(void);
+/** @brief return DMA buffer size of installed driver in samples. */
+extern int sim_i2s_get_dma_samples(void);
+/** @brief save recorded samples as 16bit mono WAV file. */
+extern esp_err_t sim_i2s_save_wav(const char *path);
+/** @brief save log as CSV file. */
+extern esp_err_t sim_i2s_save_log(const char *path);
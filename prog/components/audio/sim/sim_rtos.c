@@ -0,0 +1,417 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* FreeRTOS API used by audio component, implemented with pthreads. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+struct sim_task {
+    pthread_t thread;
+    TaskFunction_t func;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+};
+
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+struct sim_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+struct sim_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+static __thread struct sim_task *s_current = NULL;
+
+static void init_sync(pthread_mutex_t *lock, pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_mutex_init(lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* wait on cond until deadline. return false on timeout. */
+static bool wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline)
+{
+    if (deadline == NULL) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+/* deadline of ticks from now, or NULL to wait forever. */
+static const struct timespec *deadline_of(TickType_t ticks, struct timespec *ts)
+{
+    int64_t ns;
+    if (ticks == portMAX_DELAY) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ns = ts->tv_nsec + (int64_t)ticks * portTICK_PERIOD_MS * 1000000;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+    return ts;
+}
+
+static struct sim_task *new_task(TaskFunction_t func, void *arg)
+{
+    struct sim_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return NULL;
+    }
+    task->func = func;
+    task->arg = arg;
+    init_sync(&task->lock, &task->cond);
+    return task;
+}
+
+static void *task_main(void *arg)
+{
+    struct sim_task *task = arg;
+    s_current = task;
+    task->func(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack_depth,
+    void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    struct sim_task *task = new_task(func, arg);
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    if (handle != NULL) {
+        *handle = task;
+    }
+    if (pthread_create(&task->thread, NULL, task_main, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == s_current) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(task->thread);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec = ticks * portTICK_PERIOD_MS / 1000,
+        .tv_nsec = (long)(ticks * portTICK_PERIOD_MS % 1000) * 1000000,
+    };
+    nanosleep(&ts, NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    /* threads not created by xTaskCreate, e.g. main, get a task on demand */
+    if (s_current == NULL) {
+        s_current = new_task(NULL, NULL);
+    }
+    return s_current;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct sim_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec ts;
+    const struct timespec *deadline = deadline_of(ticks, &ts);
+    uint32_t value;
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && wait_until(&task->cond, &task->lock, deadline)) {
+    }
+    value = task->notify;
+    if (value > 0) {
+        task->notify = clear? 0: value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct sim_queue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->items = malloc(length * item_size);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    init_sync(&queue->lock, &queue->cond);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void *item, TickType_t ticks, bool front)
+{
+    struct timespec ts;
+    const struct timespec *deadline = deadline_of(ticks, &ts);
+    UBaseType_t index;
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (ticks == 0 || !wait_until(&queue->cond, &queue->lock, deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    if (front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        index = queue->head;
+    } else {
+        index = (queue->head + queue->count) % queue->length;
+    }
+    memcpy(queue->items + index * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return queue_send(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return queue_send(queue, item, ticks, true);
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void *item, TickType_t ticks, bool peek)
+{
+    struct timespec ts;
+    const struct timespec *deadline = deadline_of(ticks, &ts);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (ticks == 0 || !wait_until(&queue->cond, &queue->lock, deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    if (!peek) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    return queue_receive(queue, item, ticks, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    return queue_receive(queue, item, ticks, true);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count;
+    pthread_mutex_lock(&queue->lock);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+static SemaphoreHandle_t new_sem(UBaseType_t count, UBaseType_t max)
+{
+    struct sim_sem *sem = calloc(1, sizeof(*sem));
+    if (sem == NULL) {
+        return NULL;
+    }
+    sem->count = count;
+    sem->max = max;
+    init_sync(&sem->lock, &sem->cond);
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    /* priority inheritance and recursion are not needed by audio */
+    return new_sem(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return new_sem(0, 1);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    free(sem);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    struct timespec ts;
+    const struct timespec *deadline = deadline_of(ticks, &ts);
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0) {
+        if (ticks == 0 || !wait_until(&sem->cond, &sem->lock, deadline)) {
+            pthread_mutex_unlock(&sem->lock);
+            return pdFAIL;
+        }
+    }
+    sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t ret = pdFAIL;
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max) {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+        ret = pdPASS;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct sim_event_group *group = calloc(1, sizeof(*group));
+    if (group == NULL) {
+        return NULL;
+    }
+    init_sync(&group->lock, &group->cond);
+    return group;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    free(group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t value;
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    value = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t value;
+    pthread_mutex_lock(&group->lock);
+    /* returns bits before clear like FreeRTOS */
+    value = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    EventBits_t value;
+    pthread_mutex_lock(&group->lock);
+    value = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+    BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t ticks)
+{
+    struct timespec ts;
+    const struct timespec *deadline = deadline_of(ticks, &ts);
+    EventBits_t value;
+    pthread_mutex_lock(&group->lock);
+    while (1) {
+        bool satisfied = wait_for_all? (group->bits & bits) == bits: (group->bits & bits) != 0;
+        if (satisfied) {
+            value = group->bits;
+            if (clear_on_exit) {
+                group->bits &= ~bits;
+            }
+            break;
+        }
+        if (ticks == 0 || !wait_until(&group->cond, &group->lock, deadline)) {
+            value = group->bits;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
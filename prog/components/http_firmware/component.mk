@@ -1,3 +1,4 @@
 COMPONENT_NAME := http_firmware
+COMPONENT_OBJS := http_firmware.o ota_helper.o spiffs_upd.o flash_pipe.o inflate_stream.o
 
 COMPONENT_EMBED_FILES += html/http_firmware.html
@@ -0,0 +1,350 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include <json_str.h>
+
+#include "flash_pipe.h"
+#include "inflate_stream.h"
+
+#define TAG "flash_pipe"
+
+/* buffer passed from httpd task to writer task. data is NULL to end writer. */
+typedef struct {
+    char *data;
+    int size;
+} pipe_buf_t;
+
+typedef struct {
+    flash_pipe_write_func_t write;
+    void *ctx;
+    QueueHandle_t filled;
+    QueueHandle_t free;
+    SemaphoreHandle_t done;
+    esp_err_t err;
+    int64_t flash_time;
+    int64_t flash_stall;
+} pipe_writer_t;
+
+static void writer_task(void *arg)
+{
+    pipe_writer_t *writer = (pipe_writer_t*)arg;
+    pipe_buf_t buf;
+    bool started = false;
+    int64_t t0, t1;
+
+    while (1) {
+        t0 = esp_timer_get_time();
+        xQueueReceive(writer->filled, &buf, portMAX_DELAY);
+        t1 = esp_timer_get_time();
+        if (buf.data == NULL) {
+            break;
+        }
+        /* waiting for first buffer is not a stall */
+        if (started) {
+            writer->flash_stall += t1 - t0;
+        }
+        started = true;
+        if (writer->err == ESP_OK) {
+            __atomic_store_n(&writer->err,
+                ESP_ERROR_CHECK_WITHOUT_ABORT(writer->write(writer->ctx, buf.data, buf.size)),
+                __ATOMIC_RELEASE);
+            writer->flash_time += esp_timer_get_time() - t1;
+        }
+        xQueueSend(writer->free, &buf, portMAX_DELAY);
+    }
+    xSemaphoreGive(writer->done);
+    vTaskDelete(NULL);
+}
+
+/* httpd task side of pipe */
+typedef struct {
+    httpd_req_t *req;
+    int remaining_size;
+    pipe_writer_t *writer;
+    pipe_buf_t buf;         /* buffer being filled. data is NULL if none */
+    flash_pipe_stats_t *stats;
+    int64_t feedwdt_time;
+    esp_err_t err;
+} pipe_reader_t;
+
+/* get free buffer to fill, if not yet */
+static esp_err_t reader_get_buf(pipe_reader_t *reader)
+{
+    int64_t t0;
+    esp_err_t err;
+
+    if (reader->buf.data != NULL) {
+        return ESP_OK;
+    }
+    t0 = esp_timer_get_time();
+    xQueueReceive(reader->writer->free, &reader->buf, portMAX_DELAY);
+    reader->stats->recv_stall += esp_timer_get_time() - t0;
+    reader->buf.size = 0;
+    err = __atomic_load_n(&reader->writer->err, __ATOMIC_ACQUIRE);
+    if (err != ESP_OK) {
+        /* give back so that cleanup does not depend on which buffer is held */
+        xQueueSend(reader->writer->free, &reader->buf, portMAX_DELAY);
+        reader->buf.data = NULL;
+    }
+    return err;
+}
+
+/* pass filled buffer to writer */
+static void reader_send_buf(pipe_reader_t *reader)
+{
+    if (reader->buf.data == NULL) {
+        return;
+    }
+    if (reader->buf.size > 0) {
+        xQueueSend(reader->writer->filled, &reader->buf, portMAX_DELAY);
+        reader->stats->decoded += reader->buf.size;
+    } else {
+        xQueueSend(reader->writer->free, &reader->buf, portMAX_DELAY);
+    }
+    reader->buf.data = NULL;
+}
+
+/* receive at most size bytes of remaining body */
+static int reader_recv(pipe_reader_t *reader, char *buf, int size)
+{
+    int64_t t0;
+    int recv_size;
+
+    size = MIN(size, reader->remaining_size);
+    if (size <= 0) {
+        return 0;
+    }
+    t0 = esp_timer_get_time();
+    recv_size = httpd_req_recv(reader->req, buf, size);
+    reader->stats->recv_time += esp_timer_get_time() - t0;
+    if (recv_size <= 0) {
+        reader->err = ESP_ERR_TIMEOUT;
+        return recv_size;
+    }
+    reader->remaining_size -= recv_size;
+    reader->stats->bytes += recv_size;
+
+    if (t0 - reader->feedwdt_time >= (CONFIG_TASK_WDT_TIMEOUT_S*1000000)/2) {
+        ESP_LOGI(TAG, "received %u bytes, decoded %u bytes",
+            reader->stats->bytes, reader->stats->decoded);
+        reader->feedwdt_time = t0;
+        vTaskDelay(1);
+    }
+    return recv_size;
+}
+
+static esp_err_t receive_raw(pipe_reader_t *reader)
+{
+    int recv_size;
+    esp_err_t err;
+
+    while (reader->remaining_size > 0) {
+        err = reader_get_buf(reader);
+        if (err != ESP_OK) {
+            return err;
+        }
+        /* fill whole buffer so that flash is written by sector */
+        while (reader->buf.size < FLASH_PIPE_BUF_SIZE && reader->remaining_size > 0) {
+            recv_size = reader_recv(reader, reader->buf.data + reader->buf.size,
+                FLASH_PIPE_BUF_SIZE - reader->buf.size);
+            if (recv_size <= 0) {
+                return reader->err;
+            }
+            reader->buf.size += recv_size;
+        }
+        reader_send_buf(reader);
+    }
+    return ESP_OK;
+}
+
+static int inflate_read(void *ctx, uint8_t *buf, int size)
+{
+    return reader_recv((pipe_reader_t*)ctx, (char*)buf, size);
+}
+
+static int inflate_write(void *ctx, const uint8_t *data, size_t size)
+{
+    pipe_reader_t *reader = (pipe_reader_t*)ctx;
+    size_t n;
+
+    while (size > 0) {
+        reader->err = reader_get_buf(reader);
+        if (reader->err != ESP_OK) {
+            return -1;
+        }
+        n = MIN(size, FLASH_PIPE_BUF_SIZE - reader->buf.size);
+        memcpy(reader->buf.data + reader->buf.size, data, n);
+        reader->buf.size += n;
+        data += n;
+        size -= n;
+        if (reader->buf.size == FLASH_PIPE_BUF_SIZE) {
+            reader_send_buf(reader);
+        }
+    }
+    return 0;
+}
+
+static esp_err_t receive_deflated(pipe_reader_t *reader)
+{
+    inflate_stream_t *inflate;
+    int trailing;
+    int ret;
+
+    inflate = malloc(sizeof(*inflate));
+    if (inflate == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ret = inflate_stream_run(inflate, inflate_read, reader, inflate_write, reader);
+    /* padding bits of last byte are fine, but not whole bytes read with last block */
+    trailing = inflate->in_len - inflate->in_pos;
+    free(inflate);
+    if (ret == INFLATE_OK && (trailing > 0 || reader->remaining_size > 0)) {
+        ESP_LOGE(TAG, "%d bytes after end of compressed data", trailing + reader->remaining_size);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ret != INFLATE_OK && reader->err != ESP_OK) {
+        return reader->err;
+    }
+    if (ret != INFLATE_OK) {
+        ESP_LOGE(TAG, "invalid compressed data (%d) at %u bytes", ret, reader->stats->bytes);
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* last partial buffer */
+    reader_send_buf(reader);
+    return ESP_OK;
+}
+
+static esp_err_t pipe_run(httpd_req_t *req, size_t size, bool deflated,
+    flash_pipe_write_func_t write, void *ctx, flash_pipe_stats_t *stats)
+{
+    pipe_writer_t writer = { 0 };
+    pipe_reader_t reader = { 0 };
+    pipe_buf_t buf;
+    char *mem;
+    int64_t start_time;
+    esp_err_t err = ESP_OK;
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    writer.write = write;
+    writer.ctx = ctx;
+    mem = malloc(FLASH_PIPE_BUF_SIZE * FLASH_PIPE_BUF_COUNT);
+    /* one more room for end marker */
+    writer.filled = xQueueCreate(FLASH_PIPE_BUF_COUNT + 1, sizeof(pipe_buf_t));
+    writer.free = xQueueCreate(FLASH_PIPE_BUF_COUNT, sizeof(pipe_buf_t));
+    writer.done = xSemaphoreCreateBinary();
+    if (mem == NULL || writer.filled == NULL || writer.free == NULL || writer.done == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+    for (i = 0; i < FLASH_PIPE_BUF_COUNT; i++) {
+        buf.data = mem + i * FLASH_PIPE_BUF_SIZE;
+        buf.size = 0;
+        xQueueSend(writer.free, &buf, 0);
+    }
+    if (xTaskCreate(writer_task, "flash_writer", 3072, &writer,
+            uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        err = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    start_time = esp_timer_get_time();
+    vTaskDelay(1);
+
+    reader.req = req;
+    reader.remaining_size = size;
+    reader.writer = &writer;
+    reader.stats = stats;
+    reader.feedwdt_time = start_time;
+    if (deflated) {
+        err = receive_deflated(&reader);
+    } else {
+        err = receive_raw(&reader);
+    }
+    if (reader.buf.data != NULL) {
+        /* failed while filling. drop partial buffer */
+        reader.buf.size = 0;
+        reader_send_buf(&reader);
+    }
+
+    /* wait for writer to write queued buffers */
+    buf.data = NULL;
+    xQueueSend(writer.filled, &buf, portMAX_DELAY);
+    xSemaphoreTake(writer.done, portMAX_DELAY);
+    if (err == ESP_OK) {
+        err = writer.err;
+    }
+    stats->elapsed = esp_timer_get_time() - start_time;
+    stats->flash_time = writer.flash_time;
+    stats->flash_stall = writer.flash_stall;
+    ESP_LOGI(TAG, "%u bytes (%u decoded) in %d msec. recv %d (stall %d) msec, flash %d (stall %d) msec",
+        stats->bytes, stats->decoded, (int)(stats->elapsed/1000),
+        (int)(stats->recv_time/1000), (int)(stats->recv_stall/1000),
+        (int)(stats->flash_time/1000), (int)(stats->flash_stall/1000));
+
+cleanup:
+    if (writer.done != NULL) {
+        vSemaphoreDelete(writer.done);
+    }
+    if (writer.free != NULL) {
+        vQueueDelete(writer.free);
+    }
+    if (writer.filled != NULL) {
+        vQueueDelete(writer.filled);
+    }
+    free(mem);
+    return err;
+}
+
+esp_err_t flash_pipe_run(httpd_req_t *req, size_t size,
+    flash_pipe_write_func_t write, void *ctx, flash_pipe_stats_t *stats)
+{
+    return pipe_run(req, size, false, write, ctx, stats);
+}
+
+esp_err_t flash_pipe_run_deflated(httpd_req_t *req, size_t size,
+    flash_pipe_write_func_t write, void *ctx, flash_pipe_stats_t *stats)
+{
+    return pipe_run(req, size, true, write, ctx, stats);
+}
+
+int flash_pipe_stats_to_json(json_str_t *json, const char *key, const flash_pipe_stats_t *stats)
+{
+    int err;
+    JSON_STR_OBJECT_WITH(json, key, err, return err, {
+        JSON_STR_CHECK(json_str_add_integer(json, "bytes", stats->bytes), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "decoded", stats->decoded), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "elapsed", (int)stats->elapsed), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "throughput", flash_pipe_throughput(stats)), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "recv_time", (int)stats->recv_time), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "recv_stall", (int)stats->recv_stall), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "flash_time", (int)stats->flash_time), err, return err);
+        JSON_STR_CHECK(json_str_add_integer(json, "flash_stall", (int)stats->flash_stall), err, return err);
+    });
+    return JSON_STR_OK;
+}
@@ -0,0 +1,79 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLASH_PIPE_H
+#define FLASH_PIPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <json_str.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* request body is received into a ring of buffers while a writer task
+ * writes filled buffers to flash, so that network receive overlaps flash
+ * erase and program. */
+
+#define FLASH_PIPE_BUF_SIZE     4096
+#define FLASH_PIPE_BUF_COUNT    4
+
+/* write data to flash. called in writer task. */
+typedef esp_err_t (*flash_pipe_write_func_t)(void *ctx, const void *data, size_t size);
+
+/* time in usec */
+typedef struct {
+    uint32_t bytes;         /* received */
+    uint32_t decoded;       /* written to flash. differs from bytes if compressed */
+    int64_t elapsed;        /* from start of receive to end of last write */
+    int64_t recv_time;      /* in httpd_req_recv */
+    int64_t recv_stall;     /* receiver waited for free buffer. flash is bottleneck */
+    int64_t flash_time;     /* in write function */
+    int64_t flash_stall;    /* writer waited for filled buffer. network is bottleneck */
+} flash_pipe_stats_t;
+
+/*
+ * receive size bytes of request body and write it by write function.
+ * returns ESP_ERR_TIMEOUT if receive failed, or error of write function.
+ */
+esp_err_t flash_pipe_run(httpd_req_t *req, size_t size,
+    flash_pipe_write_func_t write, void *ctx, flash_pipe_stats_t *stats);
+
+/*
+ * same as flash_pipe_run but request body is raw deflate stream (see
+ * inflate_stream.h) and decoded data is written. returns ESP_ERR_INVALID_ARG
+ * if compressed data is invalid or has trailing bytes.
+ */
+esp_err_t flash_pipe_run_deflated(httpd_req_t *req, size_t size,
+    flash_pipe_write_func_t write, void *ctx, flash_pipe_stats_t *stats);
+
+/* received bytes per second */
+static inline uint32_t flash_pipe_throughput(const flash_pipe_stats_t *stats)
+{
+    return stats->elapsed > 0? (uint32_t)(stats->bytes * 1000000LL / stats->elapsed): 0;
+}
+
+/* add stats as object of key */
+int flash_pipe_stats_to_json(json_str_t *json, const char *key, const flash_pipe_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FLASH_PIPE_H */
@@ -20,6 +20,7 @@
 #include <freertos/task.h>
 #include <esp_idf_version.h>
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <esp_ota_ops.h>
 #include <esp_err.h>
 #include <esp_log.h>
@@ -31,14 +32,16 @@
 #include <json_str.h>
 
 #include "spiffs_upd.h"
+#include "flash_pipe.h"
 #include "http_firmware.h"
 #include "http_firmware_update_callbacks.h"
 
 #define TAG "firmware"
 #define FIRMWARE_URI  "/firmware"
 #define OCTET_STREAM_TYPE   "application/octet-stream"
+/* raw deflate with window of at most 4KB. see inflate_stream.h */
+#define DEFLATE_TYPE        "application/x-deflate"
 
-#define BUF_SIZE    1024
 #define MIN_IMAGE_SIZE  0x8000
 
 static const firmware_update_callbacks_t default_update_callbacks;
@@ -47,7 +50,8 @@ static const firmware_update_callbacks_t *s_update_callbacks = &default_update_c
 typedef struct {
     const esp_partition_t *partition;
     size_t image_len;
-    int64_t elapsed;
+    bool deflated;
+    flash_pipe_stats_t stats;
 } ota_work_t;
 
 static MAKE_EMBEDDED_HANDLER(http_firmware_html, "text/html")
@@ -76,16 +80,77 @@ static esp_err_t send_precond_fail_json(httpd_req_t *req, enum firmware_update_r
     return ESP_FAIL;
 }
 
-static bool is_octet_stream(httpd_req_t *req)
+/* accept octet-stream for raw image and x-deflate for compressed image.
+ * sends error response and returns ESP_FAIL for others. */
+static esp_err_t check_image_type(httpd_req_t *req, bool *deflated)
 {
-    char content_type[sizeof(OCTET_STREAM_TYPE)+4];
+    char content_type[sizeof(DEFLATE_TYPE)+4];
     esp_err_t err;
 
     err = httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
     if (err == ESP_OK) {
         ESP_LOGI(TAG, "Content-Type: %s", content_type);
     }
-    return (err == ESP_OK && strcmp(content_type, OCTET_STREAM_TYPE) == 0);
+    if (err == ESP_OK && strcmp(content_type, OCTET_STREAM_TYPE) == 0) {
+        *deflated = false;
+        return ESP_OK;
+    }
+    if (err == ESP_OK && strcmp(content_type, DEFLATE_TYPE) == 0) {
+        *deflated = true;
+        return ESP_OK;
+    }
+    if (httpd_req_get_hdr_value_len(req, "Content-Type") == 0) {
+        return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Content-Type is required\"}");
+    } else {
+        return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Unsupported Content-Type\"}");
+    }
+}
+
+static esp_err_t send_update_error_json(httpd_req_t *req, esp_err_t err)
+{
+    if (err == ESP_ERR_TIMEOUT) {
+        return http_cmn_send_error_json(req, HTTP_CMN_ERR_SOCK_TIMEOUT);
+    } else if (err == ESP_ERR_OTA_VALIDATE_FAILED || err == ESP_ERR_INVALID_ARG) {
+        /* invalid image or compressed data */
+        return http_cmn_send_error_json(req, HTTP_CMN_ERR_INVALID_REQ);
+    } else if (err == ESP_ERR_INVALID_SIZE) {
+        /* decoded image exceeds partition */
+        return http_cmn_send_error_json(req, HTTP_CMN_ERR_TOO_LARGE);
+    } else {
+        return http_cmn_send_error_json(req, err);
+    }
+}
+
+/* send result with throughput of receive and flash write. */
+static esp_err_t send_updated_json(httpd_req_t *req, const char *what, const flash_pipe_stats_t *stats)
+{
+    json_str_t *json;
+    char message[80];
+    esp_err_t err;
+
+    json = new_json_str(384);
+    if (json == NULL) {
+        return http_cmn_send_error_json(req, HTTP_CMN_FAIL);
+    }
+    if (stats->decoded != stats->bytes) {
+        snprintf(message, sizeof(message), "%s updated in %d.%06d sec (%u KB/s, %u%% compressed)\nRebooting...",
+            what, (int)(stats->elapsed/1000000), (int)(stats->elapsed%1000000),
+            flash_pipe_throughput(stats) / 1024,
+            stats->decoded > 0? (unsigned)(stats->bytes * 100ULL / stats->decoded): 0);
+    } else {
+        snprintf(message, sizeof(message), "%s updated in %d.%06d sec (%u KB/s)\nRebooting...",
+            what, (int)(stats->elapsed/1000000), (int)(stats->elapsed%1000000),
+            flash_pipe_throughput(stats) / 1024);
+    }
+    json_str_begin_object(json, NULL);
+    json_str_add_integer(json, "status", -1);
+    json_str_add_string(json, "message", message);
+    flash_pipe_stats_to_json(json, "stats", stats);
+    json_str_end_object(json);
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    err = httpd_resp_sendstr(req, json_str_finalize(json));
+    delete_json_str(json);
+    return err;
 }
 
 static esp_err_t http_get_version_handler(httpd_req_t *req)
@@ -152,50 +217,31 @@ static esp_err_t http_get_partinfo_handler(httpd_req_t *req)
     return err;
 }
 
+static esp_err_t ota_write(void *ctx, const void *data, size_t size)
+{
+    return esp_ota_write(*(esp_ota_handle_t*)ctx, data, size);
+}
+
 static esp_err_t update_firmware(httpd_req_t *req, ota_work_t *work)
 {
     esp_ota_handle_t handle;
-    char *buf;
-    int recv_size;
-    int remaining_size;
-    int64_t start_time, feedwdt_time;
     esp_err_t err;
 
-    buf = malloc(BUF_SIZE);
-    if (buf == NULL) {
-        return ESP_ERR_NO_MEM;
-    }
-
     ESP_LOGI(TAG, "Start OTA update");
     handle = 0;
-    err = esp_ota_begin(work->partition, work->image_len, &handle);
+    /* decoded size is not known until end of stream */
+    err = esp_ota_begin(work->partition, work->deflated? OTA_SIZE_UNKNOWN: work->image_len, &handle);
     if (err != ESP_OK) {
         return ESP_FAIL;
     }
 
-    start_time = feedwdt_time = esp_timer_get_time();
-    vTaskDelay(1);
-
-    remaining_size = work->image_len;
-    while (remaining_size > 0) {
-        recv_size = MIN(remaining_size, BUF_SIZE);
-
-        recv_size = httpd_req_recv(req, buf, recv_size);
-        if (recv_size <= 0) {
-            err = ESP_ERR_TIMEOUT;
-            goto fail;
-        }
-
-        err = ESP_ERROR_CHECK_WITHOUT_ABORT(esp_ota_write(handle, buf, recv_size));
-        if (err != ESP_OK) {
-            goto fail;
-        }
-
-        remaining_size -= recv_size;
-        if (esp_timer_get_time() - feedwdt_time >= (CONFIG_TASK_WDT_TIMEOUT_S*1000000)/2) {
-            feedwdt_time = esp_timer_get_time();
-            vTaskDelay(1);
-        }
+    if (work->deflated) {
+        err = flash_pipe_run_deflated(req, work->image_len, ota_write, &handle, &work->stats);
+    } else {
+        err = flash_pipe_run(req, work->image_len, ota_write, &handle, &work->stats);
+    }
+    if (err != ESP_OK) {
+        goto fail;
     }
 
     err = ESP_ERROR_CHECK_WITHOUT_ABORT(esp_ota_end(handle));
@@ -209,9 +255,7 @@ static esp_err_t update_firmware(httpd_req_t *req, ota_work_t *work)
         goto fail;
     }
 
-    work->elapsed = esp_timer_get_time() - start_time;
     ESP_LOGI(TAG, "Finished writing firmware.");
-    free(buf);
     return ESP_OK;
 
 fail:
@@ -219,7 +263,6 @@ fail:
         esp_ota_end(handle);
     }
     ESP_LOGI(TAG, "OTA update failed");
-    free(buf);
     return err;
 }
 
@@ -227,7 +270,6 @@ static esp_err_t http_post_update_handler(httpd_req_t *req)
 {
     enum firmware_update_result precond;
     ota_work_t work;
-    char json[96];
     esp_err_t err;
 
     precond = s_update_callbacks->prestart();
@@ -248,117 +290,80 @@ static esp_err_t http_post_update_handler(httpd_req_t *req)
     if (work.image_len == 0) {
         return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Content-Length is required\"}");
     }
-    if (work.image_len < MIN_IMAGE_SIZE) {
+    if (check_image_type(req, &work.deflated) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    /* size of compressed image is checked only against partition */
+    if (!work.deflated && work.image_len < MIN_IMAGE_SIZE) {
         return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Image is too small\"}");
     }
     if (work.image_len > work.partition->size) {
         return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Image is too large\"}");
     }
 
-    if (!is_octet_stream(req)) {
-        if (httpd_req_get_hdr_value_len(req, "Content-Type") == 0) {
-            return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Content-Type is required\"}");
-        } else {
-            return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Unsupported Content-Type\"}");
-        }
-    }
-
     s_update_callbacks->started();
     err = update_firmware(req, &work);
 
     if (err != ESP_OK) {
-        if (err == ESP_ERR_TIMEOUT) {
-            http_cmn_send_error_json(req, HTTP_CMN_ERR_SOCK_TIMEOUT);
-        } else if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
-            http_cmn_send_error_json(req, HTTP_CMN_ERR_INVALID_REQ);
-        } else {
-            http_cmn_send_error_json(req, err);
-        }
+        send_update_error_json(req, err);
         s_update_callbacks->finished(FIRMWARE_UPDATE_E_FAIL);
         return ESP_FAIL;
     }
 
-    snprintf(json, sizeof(json), "{\"status\":-1,\"message\":\"Firmware updated in %d.%06d sec\\nRebooting...\"}",
-        (int)(work.elapsed/1000000), (int)(work.elapsed%1000000));
-    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
-    err = httpd_resp_sendstr(req, json);
+    err = send_updated_json(req, "Firmware", &work.stats);
 
     s_update_callbacks->finished(FIRMWARE_UPDATE_OK);
 
     return err;
 }
 
+static esp_err_t spiffs_write(void *ctx, const void *data, size_t size)
+{
+    return spiffs_upd_write(*(spiffs_upd_handle_t*)ctx, data, size);
+}
+
 static esp_err_t update_spiffs(httpd_req_t *req, ota_work_t *work)
 {
-    esp_ota_handle_t handle;
-    char *buf;
-    int recv_size;
-    int remaining_size;
-    int64_t start_time, feedwdt_time;
+    spiffs_upd_handle_t handle;
     esp_err_t err;
 
-    buf = malloc(BUF_SIZE);
-    if (buf == NULL) {
-        return ESP_ERR_NO_MEM;
-    }
-
     ESP_LOGI(TAG, "Start SPIFFS update");
-    handle = 0;
-    err = spiffs_upd_begin(work->partition, work->image_len, &handle);
+    err = spiffs_upd_begin(work->partition, work->partition->size, &handle);
     if (err != ESP_OK) {
         return ESP_FAIL;
     }
 
-    start_time = feedwdt_time = esp_timer_get_time();
-    vTaskDelay(1);
-
-    remaining_size = work->image_len;
-    while (remaining_size > 0) {
-        recv_size = MIN(remaining_size, BUF_SIZE);
-
-        recv_size = httpd_req_recv(req, buf, recv_size);
-        if (recv_size <= 0) {
-            err = ESP_ERR_TIMEOUT;
-            goto fail;
-        }
-
-        err = ESP_ERROR_CHECK_WITHOUT_ABORT(spiffs_upd_write(handle, buf, recv_size));
-        if (err != ESP_OK) {
-            goto fail;
-        }
-
-        remaining_size -= recv_size;
-        if (esp_timer_get_time() - feedwdt_time >= (CONFIG_TASK_WDT_TIMEOUT_S*1000000)/2) {
-            feedwdt_time = esp_timer_get_time();
-            vTaskDelay(1);
+    /* sectors are erased by spiffs_upd_write while next data is received */
+    if (work->deflated) {
+        err = flash_pipe_run_deflated(req, work->image_len, spiffs_write, &handle, &work->stats);
+        if (err == ESP_OK && work->stats.decoded != work->partition->size) {
+            ESP_LOGE(TAG, "decoded image size %u != partition size %u",
+                work->stats.decoded, work->partition->size);
+            err = ESP_ERR_INVALID_ARG;
         }
+    } else {
+        err = flash_pipe_run(req, work->image_len, spiffs_write, &handle, &work->stats);
+    }
+    if (err != ESP_OK) {
+        spiffs_upd_end(handle);
+        ESP_LOGI(TAG, "spiffs update failed");
+        return err;
     }
 
     err = ESP_ERROR_CHECK_WITHOUT_ABORT(spiffs_upd_end(handle));
-    handle = 0;
     if (err != ESP_OK) {
-        goto fail;
+        ESP_LOGI(TAG, "spiffs update failed");
+        return err;
     }
 
-    work->elapsed = esp_timer_get_time() - start_time;
     ESP_LOGI(TAG, "Finished writing spiffs.");
-    free(buf);
     return ESP_OK;
-
-fail:
-    if (handle != 0) {
-        spiffs_upd_end(handle);
-    }
-    ESP_LOGI(TAG, "spiffs update failed");
-    free(buf);
-    return err;
 }
 
 static esp_err_t http_post_spiffs_handler(httpd_req_t *req)
 {
     enum firmware_update_result precond;
     ota_work_t work;
-    char json[96];
     esp_err_t err;
 
     precond = s_update_callbacks->prestart();
@@ -380,40 +385,26 @@ static esp_err_t http_post_spiffs_handler(httpd_req_t *req)
     if (work.image_len == 0) {
         return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Content-Length is required\"}");
     }
-    if (work.image_len < work.partition->size) {
+    if (check_image_type(req, &work.deflated) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (!work.deflated && work.image_len < work.partition->size) {
         return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Image is too small\"}");
     }
     if (work.image_len > work.partition->size) {
         return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Image is too large\"}");
     }
 
-    if (!is_octet_stream(req)) {
-        if (httpd_req_get_hdr_value_len(req, "Content-Type") == 0) {
-            return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Content-Type is required\"}");
-        } else {
-            return send_bad_request_json(req, "{\"status\":-1,\"message\":\"Unsupported Content-Type\"}");
-        }
-    }
-
     s_update_callbacks->started();
     err = update_spiffs(req, &work);
 
     if (err != ESP_OK) {
-        if (err == ESP_ERR_TIMEOUT) {
-            http_cmn_send_error_json(req, HTTP_CMN_ERR_SOCK_TIMEOUT);
-        } else if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
-            http_cmn_send_error_json(req, HTTP_CMN_ERR_INVALID_REQ);
-        } else {
-            http_cmn_send_error_json(req, err);
-        }
+        send_update_error_json(req, err);
         s_update_callbacks->finished(FIRMWARE_UPDATE_E_FAIL);
         return ESP_FAIL;
     }
 
-    snprintf(json, sizeof(json), "{\"status\":-1,\"message\":\"SPIFFS updated in %d.%06d sec\\nRebooting...\"}",
-        (int)(work.elapsed/1000000), (int)(work.elapsed%1000000));
-    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
-    err = httpd_resp_sendstr(req, json);
+    err = send_updated_json(req, "SPIFFS", &work.stats);
 
     s_update_callbacks->finished(FIRMWARE_UPDATE_OK);
 
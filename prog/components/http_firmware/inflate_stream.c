@@ -0,0 +1,370 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* raw deflate decoder. decoding follows puff.c of zlib by Mark Adler,
+ * input is pulled and output is pushed through fixed size buffers. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "inflate_stream.h"
+
+#define MAXBITS     15
+#define MAXLCODES   286
+#define MAXDCODES   30
+#define MAXCODES    (MAXLCODES+MAXDCODES)
+#define FIXLCODES   288
+
+#define WINDOW_MASK (INFLATE_WINDOW_SIZE - 1)
+
+static int refill(inflate_stream_t *s)
+{
+    int n;
+    if (s->err != INFLATE_OK) {
+        return -1;
+    }
+    n = s->read(s->read_ctx, s->in, sizeof(s->in));
+    if (n <= 0) {
+        s->err = INFLATE_ERR_INPUT;
+        return -1;
+    }
+    s->in_pos = 0;
+    s->in_len = n;
+    s->in_total += n;
+    return 0;
+}
+
+/* return need bits. returns 0 and sets err when input fails. */
+static int bits(inflate_stream_t *s, int need)
+{
+    uint32_t val = s->bitbuf;
+    while (s->bitcnt < need) {
+        if (s->in_pos == s->in_len && refill(s) != 0) {
+            return 0;
+        }
+        val |= (uint32_t)s->in[s->in_pos++] << s->bitcnt;
+        s->bitcnt += 8;
+    }
+    s->bitbuf = val >> need;
+    s->bitcnt -= need;
+    return (int)(val & ((1U << need) - 1));
+}
+
+static void flush(inflate_stream_t *s, size_t size)
+{
+    if (s->err == INFLATE_OK && size > 0 && s->write(s->write_ctx, s->window, size) != 0) {
+        s->err = INFLATE_ERR_OUTPUT;
+    }
+}
+
+static inline void put(inflate_stream_t *s, uint8_t c)
+{
+    s->window[s->out_total & WINDOW_MASK] = c;
+    s->out_total++;
+    if ((s->out_total & WINDOW_MASK) == 0) {
+        flush(s, INFLATE_WINDOW_SIZE);
+    }
+}
+
+static int stored(inflate_stream_t *s)
+{
+    unsigned len;
+
+    /* discard leftover bits of current byte */
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+    len = bits(s, 16);
+    if ((unsigned)bits(s, 16) != (~len & 0xffff)) {
+        return s->err != INFLATE_OK? s->err: INFLATE_ERR_DATA;
+    }
+    while (len > 0 && s->err == INFLATE_OK) {
+        if (s->in_pos == s->in_len && refill(s) != 0) {
+            break;
+        }
+        put(s, s->in[s->in_pos++]);
+        len--;
+    }
+    return s->err;
+}
+
+/* decode a symbol. returns negative value for invalid code. */
+static int decode(inflate_stream_t *s, const inflate_huffman_t *h)
+{
+    int code = 0, first = 0, index = 0;
+    int len, count;
+    for (len = 1; len <= MAXBITS; len++) {
+        code |= bits(s, 1);
+        count = h->count[len];
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+/* build huffman table from code lengths. returns 0 for complete code,
+ * positive for incomplete code and negative for over-subscribed code. */
+static int construct(inflate_huffman_t *h, const int16_t *length, int n)
+{
+    int16_t offs[MAXBITS+1];
+    int symbol, len, left;
+
+    memset(h->count, 0, sizeof(h->count));
+    for (symbol = 0; symbol < n; symbol++) {
+        h->count[length[symbol]]++;
+    }
+    if (h->count[0] == n) {
+        return 0;
+    }
+    left = 1;
+    for (len = 1; len <= MAXBITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) {
+            return left;
+        }
+    }
+    offs[1] = 0;
+    for (len = 1; len < MAXBITS; len++) {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+    for (symbol = 0; symbol < n; symbol++) {
+        if (length[symbol] != 0) {
+            h->symbol[offs[length[symbol]]++] = symbol;
+        }
+    }
+    return left;
+}
+
+static int codes(inflate_stream_t *s)
+{
+    static const int16_t lbase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int16_t lext[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int16_t dbase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577};
+    static const int16_t dext[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+        12, 12, 13, 13};
+    int symbol, len;
+    uint32_t dist;
+
+    while (1) {
+        symbol = decode(s, &s->lencode);
+        if (s->err != INFLATE_OK) {
+            return s->err;
+        }
+        if (symbol < 0) {
+            return INFLATE_ERR_DATA;
+        }
+        if (symbol < 256) {
+            put(s, symbol);
+            continue;
+        }
+        if (symbol == 256) {
+            return s->err;
+        }
+        symbol -= 257;
+        if (symbol >= 29) {
+            return INFLATE_ERR_DATA;
+        }
+        len = lbase[symbol] + bits(s, lext[symbol]);
+        symbol = decode(s, &s->distcode);
+        if (s->err != INFLATE_OK) {
+            return s->err;
+        }
+        if (symbol < 0 || symbol >= 30) {
+            return INFLATE_ERR_DATA;
+        }
+        dist = dbase[symbol] + bits(s, dext[symbol]);
+        if (s->err != INFLATE_OK) {
+            return s->err;
+        }
+        /* window is fixed, so data compressed with larger window is rejected */
+        if (dist > INFLATE_WINDOW_SIZE || dist > s->out_total) {
+            return INFLATE_ERR_DATA;
+        }
+        while (len-- > 0) {
+            put(s, s->window[(s->out_total - dist) & WINDOW_MASK]);
+        }
+        if (s->err != INFLATE_OK) {
+            return s->err;
+        }
+    }
+}
+
+static int fixed(inflate_stream_t *s)
+{
+    int16_t lengths[FIXLCODES];
+    int symbol;
+
+    for (symbol = 0; symbol < 144; symbol++) {
+        lengths[symbol] = 8;
+    }
+    for (; symbol < 256; symbol++) {
+        lengths[symbol] = 9;
+    }
+    for (; symbol < 280; symbol++) {
+        lengths[symbol] = 7;
+    }
+    for (; symbol < FIXLCODES; symbol++) {
+        lengths[symbol] = 8;
+    }
+    construct(&s->lencode, lengths, FIXLCODES);
+    for (symbol = 0; symbol < MAXDCODES; symbol++) {
+        lengths[symbol] = 5;
+    }
+    construct(&s->distcode, lengths, MAXDCODES);
+    return codes(s);
+}
+
+static int dynamic(inflate_stream_t *s)
+{
+    static const int16_t order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    int16_t lengths[MAXCODES];
+    int nlen, ndist, ncode;
+    int index, err;
+
+    nlen = bits(s, 5) + 257;
+    ndist = bits(s, 5) + 1;
+    ncode = bits(s, 4) + 4;
+    if (s->err != INFLATE_OK) {
+        return s->err;
+    }
+    if (nlen > MAXLCODES || ndist > MAXDCODES) {
+        return INFLATE_ERR_DATA;
+    }
+
+    /* code lengths of code length code */
+    for (index = 0; index < ncode; index++) {
+        lengths[order[index]] = bits(s, 3);
+    }
+    for (; index < 19; index++) {
+        lengths[order[index]] = 0;
+    }
+    if (s->err != INFLATE_OK) {
+        return s->err;
+    }
+    /* lencode is used temporarily for code length code, which must be complete */
+    if (construct(&s->lencode, lengths, 19) != 0) {
+        return INFLATE_ERR_DATA;
+    }
+
+    index = 0;
+    while (index < nlen + ndist) {
+        int symbol, len;
+        symbol = decode(s, &s->lencode);
+        if (s->err != INFLATE_OK) {
+            return s->err;
+        }
+        if (symbol < 0) {
+            return INFLATE_ERR_DATA;
+        }
+        if (symbol < 16) {
+            lengths[index++] = symbol;
+            continue;
+        }
+        len = 0;
+        if (symbol == 16) {
+            if (index == 0) {
+                return INFLATE_ERR_DATA;
+            }
+            len = lengths[index - 1];
+            symbol = 3 + bits(s, 2);
+        } else if (symbol == 17) {
+            symbol = 3 + bits(s, 3);
+        } else {
+            symbol = 11 + bits(s, 7);
+        }
+        if (index + symbol > nlen + ndist) {
+            return INFLATE_ERR_DATA;
+        }
+        while (symbol-- > 0) {
+            lengths[index++] = len;
+        }
+    }
+    if (s->err != INFLATE_OK) {
+        return s->err;
+    }
+    /* end of block code is required */
+    if (lengths[256] == 0) {
+        return INFLATE_ERR_DATA;
+    }
+
+    /* incomplete code is allowed only for single length 1 code */
+    err = construct(&s->lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - s->lencode.count[0] != 1)) {
+        return INFLATE_ERR_DATA;
+    }
+    err = construct(&s->distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - s->distcode.count[0] != 1)) {
+        return INFLATE_ERR_DATA;
+    }
+    return codes(s);
+}
+
+int inflate_stream_run(inflate_stream_t *s,
+    inflate_read_func_t read, void *read_ctx,
+    inflate_write_func_t write, void *write_ctx)
+{
+    int last, type, err;
+
+    s->read = read;
+    s->read_ctx = read_ctx;
+    s->write = write;
+    s->write_ctx = write_ctx;
+    s->in_total = 0;
+    s->out_total = 0;
+    s->err = INFLATE_OK;
+    s->in_pos = 0;
+    s->in_len = 0;
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+
+    do {
+        last = bits(s, 1);
+        type = bits(s, 2);
+        if (s->err != INFLATE_OK) {
+            return s->err;
+        }
+        if (type == 0) {
+            err = stored(s);
+        } else if (type == 1) {
+            err = fixed(s);
+        } else if (type == 2) {
+            err = dynamic(s);
+        } else {
+            err = INFLATE_ERR_DATA;
+        }
+        if (err != INFLATE_OK) {
+            return err;
+        }
+    } while (!last);
+
+    flush(s, s->out_total & WINDOW_MASK);
+    return s->err;
+}
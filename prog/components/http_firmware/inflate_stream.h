@@ -0,0 +1,82 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INFLATE_STREAM_H
+#define INFLATE_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* streaming decoder of raw deflate (RFC 1951) with fixed size window.
+ * compressed data is pulled by read function as needed and decoded data is
+ * pushed to write function every time window fills, so memory use does not
+ * depend on size of data. data must be compressed with window of at most
+ * INFLATE_WINDOW_BITS, e.g. zlib deflateInit2() with windowBits -12. */
+
+#define INFLATE_WINDOW_BITS 12
+#define INFLATE_WINDOW_SIZE (1 << INFLATE_WINDOW_BITS)
+#define INFLATE_IN_SIZE     1024
+
+#define INFLATE_OK          0
+#define INFLATE_ERR_DATA    -1  /* invalid data, or distance exceeds window */
+#define INFLATE_ERR_INPUT   -2  /* read function failed or data ended before last block */
+#define INFLATE_ERR_OUTPUT  -3  /* write function failed */
+
+/* read at most size bytes into buf. return number of bytes read, or 0 or less for error. */
+typedef int (*inflate_read_func_t)(void *ctx, uint8_t *buf, int size);
+/* consume decoded data. return 0 for success. */
+typedef int (*inflate_write_func_t)(void *ctx, const uint8_t *data, size_t size);
+
+/* huffman code in canonical form */
+typedef struct {
+    int16_t count[16];      /* number of codes of each length */
+    int16_t symbol[288];    /* symbols ordered by code */
+} inflate_huffman_t;
+
+/* state of decoder. about 6KB, allocate on heap. */
+typedef struct {
+    inflate_read_func_t read;
+    void *read_ctx;
+    inflate_write_func_t write;
+    void *write_ctx;
+    uint32_t in_total;      /* compressed bytes read */
+    uint32_t out_total;     /* decoded bytes */
+    int err;
+    int in_pos;
+    int in_len;
+    uint32_t bitbuf;
+    int bitcnt;
+    inflate_huffman_t lencode;
+    inflate_huffman_t distcode;
+    uint8_t in[INFLATE_IN_SIZE];
+    uint8_t window[INFLATE_WINDOW_SIZE];
+} inflate_stream_t;
+
+/* decode whole stream. returns INFLATE_OK or INFLATE_ERR_*. bytes after last block are not
+ * decoded. ones already read are left in in[in_pos..in_len). */
+int inflate_stream_run(inflate_stream_t *s,
+    inflate_read_func_t read, void *read_ctx,
+    inflate_write_func_t write, void *write_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INFLATE_STREAM_H */
@@ -0,0 +1,304 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host round trip test of inflate_stream.c against zlib.
+ * usage: inflate_stream_test [IMAGE] [bench]
+ * IMAGE defaults to app image in build directory. synthetic data is used
+ * when it is not built. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "inflate_stream.h"
+
+#define DEFAULT_IMAGE   "../../build/wifi-voice-clock.bin"
+
+static int s_failed = 0;
+
+struct source {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    unsigned seed;
+};
+
+struct sink {
+    const uint8_t *expect;
+    size_t size;
+    size_t pos;
+    int mismatch;
+};
+
+/* return random sized chunks like httpd_req_recv */
+static int source_read(void *ctx, uint8_t *buf, int size)
+{
+    struct source *src = (struct source*)ctx;
+    int n;
+    if (src->pos >= src->size) {
+        return 0;
+    }
+    src->seed = src->seed * 1103515245 + 12345;
+    n = 1 + (src->seed >> 16) % size;
+    if ((size_t)n > src->size - src->pos) {
+        n = src->size - src->pos;
+    }
+    memcpy(buf, src->data + src->pos, n);
+    src->pos += n;
+    return n;
+}
+
+static int sink_write(void *ctx, const uint8_t *data, size_t size)
+{
+    struct sink *dst = (struct sink*)ctx;
+    if (dst->pos + size > dst->size || memcmp(dst->expect + dst->pos, data, size) != 0) {
+        dst->mismatch = 1;
+        return -1;
+    }
+    dst->pos += size;
+    return 0;
+}
+
+static int null_write(void *ctx, const uint8_t *data, size_t size)
+{
+    (void)ctx;
+    (void)data;
+    (void)size;
+    return 0;
+}
+
+static uint8_t *compress_raw(const uint8_t *data, size_t size, int level, int window_bits,
+    int strategy, size_t *out_size)
+{
+    z_stream z;
+    size_t cap = deflateBound(NULL, size) + 1024;
+    uint8_t *out = malloc(cap);
+    memset(&z, 0, sizeof(z));
+    if (out == NULL || deflateInit2(&z, level, Z_DEFLATED, -window_bits, 8, strategy) != Z_OK) {
+        abort();
+    }
+    z.next_in = (uint8_t*)data;
+    z.avail_in = size;
+    z.next_out = out;
+    z.avail_out = cap;
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+        abort();
+    }
+    *out_size = z.total_out;
+    deflateEnd(&z);
+    return out;
+}
+
+/* app image like data: code like random words, strings and zero padding */
+static uint8_t *make_synthetic(size_t size)
+{
+    static const char *words[] = { "esp_err_t", "audio", "ESP_OK", "httpd_req_recv",
+        "spiffs", "%s: %d\n", "alarm", "wifi_voice_clock" };
+    uint8_t *data = malloc(size);
+    unsigned seed = 1;
+    size_t pos = 0;
+    while (pos < size) {
+        size_t n, i;
+        seed = seed * 1103515245 + 12345;
+        switch ((seed >> 16) % 4) {
+        case 0:
+            n = strlen(words[(seed >> 8) % 8]);
+            n = n < size - pos? n: size - pos;
+            memcpy(data + pos, words[(seed >> 8) % 8], n);
+            break;
+        case 1:
+            n = (seed >> 20) % 64;
+            n = n < size - pos? n: size - pos;
+            memset(data + pos, 0, n);
+            break;
+        default:
+            n = (seed >> 20) % 32;
+            n = n < size - pos? n: size - pos;
+            for (i = 0; i < n; i++) {
+                seed = seed * 1103515245 + 12345;
+                data[pos + i] = (seed >> 16) & 0x3f;
+            }
+            break;
+        }
+        pos += n;
+    }
+    return data;
+}
+
+static void round_trip(const char *name, const uint8_t *data, size_t size,
+    int level, int window_bits, int strategy, int expect)
+{
+    inflate_stream_t *s = malloc(sizeof(*s));
+    struct source src;
+    struct sink dst;
+    size_t csize;
+    uint8_t *comp = compress_raw(data, size, level, window_bits, strategy, &csize);
+    int err;
+
+    src = (struct source){ comp, csize, 0, 1 };
+    dst = (struct sink){ data, size, 0, 0 };
+    err = inflate_stream_run(s, source_read, &src, sink_write, &dst);
+    if (err != expect) {
+        printf("FAIL %s: result %d, expected %d\n", name, err, expect);
+        s_failed++;
+    } else if (expect == INFLATE_OK && (dst.pos != size || s->out_total != size || s->in_total != csize)) {
+        printf("FAIL %s: decoded %u/%u bytes from %u/%u\n", name,
+            (unsigned)dst.pos, (unsigned)size, (unsigned)s->in_total, (unsigned)csize);
+        s_failed++;
+    } else if (expect == INFLATE_OK) {
+        printf("ok   %s: %u -> %u bytes (%.1f%%)\n", name, (unsigned)size, (unsigned)csize,
+            100.0 * csize / size);
+    } else {
+        printf("ok   %s: rejected\n", name);
+    }
+    free(comp);
+    free(s);
+}
+
+static void test_truncated(const uint8_t *data, size_t size)
+{
+    inflate_stream_t *s = malloc(sizeof(*s));
+    struct source src;
+    struct sink dst;
+    size_t csize;
+    uint8_t *comp = compress_raw(data, size, 9, INFLATE_WINDOW_BITS, Z_DEFAULT_STRATEGY, &csize);
+    int err;
+
+    src = (struct source){ comp, csize / 2, 0, 1 };
+    dst = (struct sink){ data, size, 0, 0 };
+    err = inflate_stream_run(s, source_read, &src, sink_write, &dst);
+    if (err != INFLATE_ERR_INPUT || dst.mismatch) {
+        printf("FAIL truncated: result %d, mismatch %d\n", err, dst.mismatch);
+        s_failed++;
+    } else {
+        printf("ok   truncated\n");
+    }
+    free(comp);
+    free(s);
+}
+
+/* bytes after last block are left unread in input buffer or source */
+static void test_trailing(const char *name, const uint8_t *data, size_t size)
+{
+    static const uint8_t junk[] = { 0x00, 0xff, 0x55, 0xaa, 0x01 };
+    inflate_stream_t *s = malloc(sizeof(*s));
+    struct source src;
+    struct sink dst;
+    size_t csize;
+    uint8_t *comp = compress_raw(data, size, 9, INFLATE_WINDOW_BITS, Z_DEFAULT_STRATEGY, &csize);
+    size_t left;
+    int err;
+
+    comp = realloc(comp, csize + sizeof(junk));
+    memcpy(comp + csize, junk, sizeof(junk));
+    src = (struct source){ comp, csize + sizeof(junk), 0, 1 };
+    dst = (struct sink){ data, size, 0, 0 };
+    err = inflate_stream_run(s, source_read, &src, sink_write, &dst);
+    left = (s->in_len - s->in_pos) + (src.size - src.pos);
+    if (err != INFLATE_OK || dst.pos != size || left != sizeof(junk)) {
+        printf("FAIL %s: result %d, decoded %u/%u bytes, %u bytes left\n", name, err,
+            (unsigned)dst.pos, (unsigned)size, (unsigned)left);
+        s_failed++;
+    } else {
+        printf("ok   %s: %d bytes unread in buffer\n", name, s->in_len - s->in_pos);
+    }
+    free(comp);
+    free(s);
+}
+
+static void bench(const uint8_t *data, size_t size)
+{
+    inflate_stream_t *s = malloc(sizeof(*s));
+    struct source src;
+    size_t csize;
+    uint8_t *comp = compress_raw(data, size, 9, INFLATE_WINDOW_BITS, Z_DEFAULT_STRATEGY, &csize);
+    clock_t start;
+    double sec;
+    int i, rounds = 10;
+
+    start = clock();
+    for (i = 0; i < rounds; i++) {
+        src = (struct source){ comp, csize, 0, 1 };
+        inflate_stream_run(s, source_read, &src, null_write, NULL);
+    }
+    sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("inflate %.1f MB/s of decoded data, %.1f nsec/byte\n",
+        size * rounds / sec / 1e6, sec * 1e9 / (size * rounds));
+    free(comp);
+    free(s);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = DEFAULT_IMAGE;
+    uint8_t *data = NULL;
+    size_t size = 0;
+    int do_bench = 0;
+    FILE *fp;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "bench") == 0) {
+            do_bench = 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    fp = fopen(path, "rb");
+    if (fp != NULL) {
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        data = malloc(size);
+        if (fread(data, 1, size, fp) != size) {
+            printf("FAIL read %s\n", path);
+            return 1;
+        }
+        fclose(fp);
+        printf("image: %s\n", path);
+    } else {
+        size = 1200 * 1024;
+        data = make_synthetic(size);
+        printf("image: synthetic (%s not found)\n", path);
+    }
+
+    if (do_bench) {
+        bench(data, size);
+        free(data);
+        return 0;
+    }
+    round_trip("dynamic", data, size, 9, INFLATE_WINDOW_BITS, Z_DEFAULT_STRATEGY, INFLATE_OK);
+    round_trip("small window", data, size, 9, 9, Z_DEFAULT_STRATEGY, INFLATE_OK);
+    round_trip("fixed", data, size, 6, INFLATE_WINDOW_BITS, Z_FIXED, INFLATE_OK);
+    round_trip("stored", data, size, 0, INFLATE_WINDOW_BITS, Z_DEFAULT_STRATEGY, INFLATE_OK);
+    round_trip("huffman only", data, size, 9, INFLATE_WINDOW_BITS, Z_HUFFMAN_ONLY, INFLATE_OK);
+    round_trip("empty", data, 0, 9, INFLATE_WINDOW_BITS, Z_DEFAULT_STRATEGY, INFLATE_OK);
+    /* distances beyond fixed window */
+    round_trip("large window", data, size, 9, 15, Z_DEFAULT_STRATEGY, INFLATE_ERR_DATA);
+    test_truncated(data, size);
+    test_trailing("trailing", data, size);
+    /* whole stream and junk fit in one read */
+    test_trailing("trailing short", data, 200);
+    free(data);
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
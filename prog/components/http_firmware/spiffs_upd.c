@@ -19,7 +19,6 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <assert.h>
 
 #include <esp_err.h>
 #include <esp_partition.h>
@@ -30,9 +29,13 @@
 
 #define TAG "spiffs_upd"
 
+/* erased at once ahead of write pointer. aligned 64KB is erased by block, faster than sectors. */
+#define ERASE_AHEAD_SIZE    0x10000
+
 typedef struct spiffs_ops_entry {
     uint32_t handle;
     const esp_partition_t *part;
+    uint32_t erase_limit;
     uint32_t erased_size;
     uint32_t wrote_size;
 } spiffs_ops_entry_t;
@@ -60,8 +63,7 @@ esp_err_t spiffs_upd_verify(const esp_partition_t *p)
 
 esp_err_t spiffs_upd_begin(const esp_partition_t *partition, size_t image_size, spiffs_upd_handle_t *out_handle)
 {
-    uint32_t erased_size;
-    esp_err_t ret;
+    uint32_t erase_limit;
 
     if ((partition == NULL) || (out_handle == NULL)) {
         return ESP_ERR_INVALID_ARG;
@@ -80,25 +82,25 @@ esp_err_t spiffs_upd_begin(const esp_partition_t *partition, size_t image_size,
     }
 
     if ((image_size == 0) || (image_size == OTA_SIZE_UNKNOWN)) {
-        erased_size = partition->size;
+        erase_limit = partition->size;
+    } else if (image_size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
     } else {
-        erased_size = ((image_size+SPI_FLASH_SEC_SIZE-1) / SPI_FLASH_SEC_SIZE) * SPI_FLASH_SEC_SIZE;
+        erase_limit = ((image_size+SPI_FLASH_SEC_SIZE-1) / SPI_FLASH_SEC_SIZE) * SPI_FLASH_SEC_SIZE;
     }
 
     if (esp_spiffs_mounted(partition->label)) {
         esp_vfs_spiffs_unregister(partition->label);
     }
-    ret = esp_partition_erase_range(partition, 0, erased_size);
-    if (ret != ESP_OK) {
-        return ret;
-    }
 
-    s_spiffs_ops_entry = malloc(sizeof(s_spiffs_ops_entry));
+    s_spiffs_ops_entry = malloc(sizeof(*s_spiffs_ops_entry));
     if (s_spiffs_ops_entry == NULL) {
         return ESP_ERR_NO_MEM;
     }
 
-    s_spiffs_ops_entry->erased_size = erased_size;
+    /* erased lazily by spiffs_upd_write so that erase overlaps receiving image */
+    s_spiffs_ops_entry->erase_limit = erase_limit;
+    s_spiffs_ops_entry->erased_size = 0;
 
     s_spiffs_ops_entry->part = partition;
     s_spiffs_ops_entry->handle = ++s_last_handle;
@@ -107,6 +109,31 @@ esp_err_t spiffs_upd_begin(const esp_partition_t *partition, size_t image_size,
     return ESP_OK;
 }
 
+/* erase sectors up to end, rounded up to ERASE_AHEAD_SIZE boundary */
+static esp_err_t erase_ahead(spiffs_ops_entry_t *it, uint32_t end)
+{
+    uint32_t erase_end;
+    esp_err_t ret;
+
+    if (end <= it->erased_size) {
+        return ESP_OK;
+    }
+    if (end > it->erase_limit) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    erase_end = ((end+ERASE_AHEAD_SIZE-1) / ERASE_AHEAD_SIZE) * ERASE_AHEAD_SIZE;
+    if (erase_end > it->erase_limit) {
+        erase_end = it->erase_limit;
+    }
+    ret = esp_partition_erase_range(it->part, it->erased_size, erase_end - it->erased_size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ESP_LOGD(TAG, "erased %#x-%#x", it->erased_size, erase_end);
+    it->erased_size = erase_end;
+    return ESP_OK;
+}
+
 esp_err_t spiffs_upd_write(spiffs_upd_handle_t handle, const void *data, size_t size)
 {
     const uint8_t *data_bytes = (const uint8_t *)data;
@@ -127,8 +154,10 @@ esp_err_t spiffs_upd_write(spiffs_upd_handle_t handle, const void *data, size_t
     }
 
     it = s_spiffs_ops_entry;
-    // must erase the partition before writing to it
-    assert(it->erased_size > 0 && "must erase the partition before writing to it");
+    ret = erase_ahead(it, it->wrote_size + size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
     ret = esp_partition_write(it->part, it->wrote_size, data_bytes, size);
     if(ret == ESP_OK){
@@ -151,7 +180,7 @@ esp_err_t spiffs_upd_end(spiffs_upd_handle_t handle)
     it = s_spiffs_ops_entry;
 
     // spiffs_upd_end() is only valid if some data was written to this handle
-    if ((it->erased_size == 0) || (it->wrote_size == 0)) {
+    if (it->wrote_size == 0) {
         ret = ESP_ERR_INVALID_ARG;
         goto cleanup;
     }
@@ -164,6 +193,7 @@ esp_err_t spiffs_upd_end(spiffs_upd_handle_t handle)
  cleanup:
     s_spiffs_ops_entry->handle = 0;
     free(s_spiffs_ops_entry);
+    s_spiffs_ops_entry = NULL;
     return ret;
 }
 
@@ -41,16 +41,17 @@ typedef uint32_t spiffs_upd_handle_t;
 /**
  * @brief   Commence an OTA update writing to the specified partition.
 
- * The specified partition is erased to the specified image size.
+ * Nothing is erased here. spiffs_upd_write() erases the partition just
+ * ahead of the write pointer, up to the specified image size.
  *
- * If image size is not yet known, pass OTA_SIZE_UNKNOWN which will
- * cause the entire partition to be erased.
+ * If image size is not yet known, pass OTA_SIZE_UNKNOWN which allows
+ * writing to the entire partition.
  *
  * On success, this function allocates memory that remains in use
  * until spiffs_upd_end() is called with the returned handle.
  *
  * @param partition Pointer to info for partition which will receive the OTA update. Required.
- * @param image_size Size of new spiffs image. Partition will be erased in order to receive this size of image. If 0 or OTA_SIZE_UNKNOWN, the entire partition is erased.
+ * @param image_size Size of new spiffs image. Partition will be erased in order to receive this size of image. If 0 or OTA_SIZE_UNKNOWN, the entire partition can be written.
  * @param out_handle On success, returns a handle which should be used for subsequent spiffs_upd_write() and spiffs_upd_end() calls.
 
  * @return
@@ -58,7 +59,7 @@ typedef uint32_t spiffs_upd_handle_t;
  *    - ESP_ERR_INVALID_ARG: partition or out_handle arguments were NULL, or partition doesn't point to an spiffs partition.
  *    - ESP_ERR_NO_MEM: Cannot allocate memory for OTA operation.
  *    - ESP_ERR_NOT_FOUND: Partition argument not found in partition table.
- *    - ESP_ERR_INVALID_SIZE: Partition doesn't fit in configured flash size.
+ *    - ESP_ERR_INVALID_SIZE: Partition doesn't fit in configured flash size, or image_size exceeds partition.
  *    - ESP_ERR_FLASH_OP_TIMEOUT or ESP_ERR_FLASH_OP_FAIL: Flash write failed.
  */
 esp_err_t spiffs_upd_begin(const esp_partition_t* partition, size_t image_size, spiffs_upd_handle_t* out_handle);
@@ -68,7 +69,8 @@ esp_err_t spiffs_upd_begin(const esp_partition_t* partition, size_t image_size,
  *
  * This function can be called multiple times as
  * data is received during the OTA operation. Data is written
- * sequentially to the partition.
+ * sequentially to the partition. Sectors are erased before being
+ * written, 64KB at a time, so a call may take time of an erase.
  *
  * @param handle  Handle obtained from spiffs_upd_begin
  * @param data    Data buffer to write
@@ -77,6 +79,7 @@ esp_err_t spiffs_upd_begin(const esp_partition_t* partition, size_t image_size,
  * @return
  *    - ESP_OK: Data was written to flash successfully.
  *    - ESP_ERR_INVALID_ARG: handle is invalid.
+ *    - ESP_ERR_INVALID_SIZE: data exceeds image size given to spiffs_upd_begin().
  *    - ESP_ERR_OTA_VALIDATE_FAILED: image contains invalid spiffs image magic bytes.
  *    - ESP_ERR_FLASH_OP_TIMEOUT or ESP_ERR_FLASH_OP_FAIL: Flash write failed.
  */
@@ -0,0 +1,75 @@
+#!/usr/bin/perl
+# upload firmware or SPIFFS image to device in settings mode and report throughput.
+#
+# usage: upload.pl [--spiffs] [--deflate] [--host HOST] IMAGE
+#
+# --deflate compresses image with raw deflate of 4KB window, which device
+# decodes while writing flash.
+#
+# prints time measured by this script and stats of receive/flash pipeline
+# returned by device. "recv_stall" is time the device waited for flash,
+# "flash_stall" is time flash waited for network.
+# note that device reboots after successful update.
+use strict;
+use warnings;
+use Getopt::Long;
+use LWP::UserAgent;
+use HTTP::Request;
+use Time::HiRes qw(time);
+use JSON;
+use Compress::Raw::Zlib;
+
+my $host = '192.168.4.1';
+my $spiffs = 0;
+my $deflate = 0;
+my $usage = "usage: $0 [--spiffs] [--deflate] [--host HOST] IMAGE\n";
+GetOptions(
+    'host=s' => \$host,
+    'spiffs' => \$spiffs,
+    'deflate' => \$deflate,
+) or die $usage;
+my $image = shift or die $usage;
+
+open(my $fh, '<:raw', $image) or die "$image: $!\n";
+my $data = do { local $/; <$fh> };
+close($fh);
+my $type = 'application/octet-stream';
+if ($deflate) {
+    # must match INFLATE_WINDOW_BITS of inflate_stream.h
+    my ($d, $status) = Compress::Raw::Zlib::Deflate->new(
+        -Level => Z_BEST_COMPRESSION, -WindowBits => -12, -AppendOutput => 1);
+    die "deflate: $status\n" unless $d;
+    my $out = '';
+    $d->deflate($data, $out) == Z_OK or die "deflate failed\n";
+    $d->flush($out) == Z_OK or die "deflate failed\n";
+    printf "deflated %d -> %d bytes (%.1f %%)\n", length($data), length($out),
+        100 * length($out) / length($data);
+    $data = $out;
+    $type = 'application/x-deflate';
+}
+
+my $url = "http://$host/firmware/".($spiffs? 'spiffs': 'update');
+my $req = HTTP::Request->new(POST => $url);
+$req->header('Content-Type' => $type);
+$req->content($data);
+
+my $ua = LWP::UserAgent->new(timeout => 120);
+printf "POST %s (%d bytes)\n", $url, length($data);
+my $start = time;
+my $res = $ua->request($req);
+my $wall = time - $start;
+die "error: ".$res->status_line."\n".$res->decoded_content."\n" unless $res->is_success;
+
+my $json = eval { decode_json($res->decoded_content) };
+die "invalid response: ".$res->decoded_content."\n" unless $json;
+print "message: $json->{message}\n" if defined($json->{message});
+printf "%-12s %10.3f sec %8.1f KB/s\n", 'wall', $wall, length($data) / 1024 / $wall;
+my $stats = $json->{stats};
+exit(0) unless $stats;
+printf "%-12s %10.3f sec %8.1f KB/s\n", 'elapsed', $stats->{elapsed} / 1e6, $stats->{throughput} / 1024;
+printf "%-12s %10d bytes, decoded %d bytes\n", 'received', $stats->{bytes}, $stats->{decoded}
+    if defined($stats->{decoded});
+for my $key (qw(recv_time recv_stall flash_time flash_stall)) {
+    printf "%-12s %10.3f sec %7.1f %%\n", $key, $stats->{$key} / 1e6,
+        $stats->{elapsed}? 100 * $stats->{$key} / $stats->{elapsed}: 0;
+}
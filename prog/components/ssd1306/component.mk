@@ -1 +1,2 @@
 COMPONENT_NAME := ssd1306
+COMPONENT_OBJS := ssd1306.o lcd_ssd1306.o
@@ -23,6 +23,11 @@
 extern "C" {
 #endif
 
+/* transactions in flight at once if async */
+#define SSD1306_TRANS_MAX       16
+/* bytes of commands packed in one transaction. holds whole init sequence of reset */
+#define SSD1306_TRANS_CMD_SIZE  24
+
 typedef struct {
     short width;
     short height;
@@ -38,8 +43,45 @@ typedef struct {
     };
     gpio_num_t dc;
     gpio_num_t reset;
+    /* keep copy of last sent frame and send only changed bytes. costs buffer size of memory. */
+    bool use_shadow;
+    /* flush queues DMA transfers from front buffer and returns without waiting,
+     * as do write and on. sleep and deinit wait until sent. only for spi device
+     * added by ssd1306_init_gpio, which sets DC in pre transfer callback. */
+    bool async_flush;
 } ssd1306_param_t;
 
+/* operations counted separately in ssd1306_stats_t.ops */
+typedef enum {
+    SSD1306_OP_RESET,
+    SSD1306_OP_POWER,       /* ssd1306_on and ssd1306_sleep */
+    SSD1306_OP_FLUSH,
+    SSD1306_OP_WRITE,
+    SSD1306_OP_MAX,
+} ssd1306_op_t;
+
+/* SPI transactions and bytes on the wire of one kind of operation */
+typedef struct {
+    uint32_t calls;
+    uint32_t transactions;
+    uint32_t bytes;
+} ssd1306_op_stats_t;
+
+/* counters of ssd1306_flush. bytes include command bytes. time in usec. */
+typedef struct {
+    uint32_t flushes;       /* flushes which sent dirty window */
+    uint32_t skipped;       /* flushes with nothing dirty */
+    uint32_t bytes;
+    uint32_t last_bytes;
+    uint32_t spans;         /* windows sent. more than one per flush with shadow */
+    uint32_t last_spans;
+    int64_t time;           /* in flush. queueing only if async */
+    int32_t last_time;
+    uint32_t waits;         /* times blocked by previous async flush */
+    int64_t wait_time;
+    ssd1306_op_stats_t ops[SSD1306_OP_MAX];
+} ssd1306_stats_t;
+
 typedef struct {
     short width;
     short height;
@@ -49,6 +91,25 @@ typedef struct {
     gpio_num_t reset;
     uint8_t *buffer;
     size_t buffer_size;
+    uint8_t *tx_buffer;     /* front buffer. dirty window gathered to be sent at once */
+    uint8_t *tx_cmds;       /* commands of each transaction */
+    bool async;
+    spi_transaction_t trans[SSD1306_TRANS_MAX];
+    int trans_next;
+    int trans_queued;
+    /* transaction whose commands are being packed. -1 if none */
+    int batch_index;
+    int batch_len;
+    ssd1306_op_t op;
+    /* window modified since last flush, inclusive. empty if dirty_col1 > dirty_col2 */
+    short dirty_col1;
+    short dirty_col2;
+    short dirty_page1;
+    short dirty_page2;
+    uint8_t *shadow;        /* content of display RAM if shadow_valid. NULL if not used */
+    bool shadow_valid;
+    int diff_gap;           /* max unchanged bytes sent to join changed runs */
+    ssd1306_stats_t stats;
     int lock;
 } ssd1306_t;
 
@@ -58,10 +119,22 @@ extern esp_err_t ssd1306_deinit(ssd1306_t *device);
 
 extern void ssd1306_reset(ssd1306_t *device);
 extern void ssd1306_on(ssd1306_t *device);
+/* returns after display off is sent, so deep sleep can follow */
 extern void ssd1306_sleep(ssd1306_t *device);
 extern void ssd1306_begin(ssd1306_t *device);
 extern void ssd1306_end(ssd1306_t *device);
+/* send dirty window of buffer. nothing is sent if buffer is not modified.
+ * if async, data is copied to front buffer and queued, so buffer can be drawn while sent. */
 extern void ssd1306_flush(ssd1306_t *device);
+/* mark rectangle of buffer modified. coordinates are inclusive and clipped. */
+extern void ssd1306_set_dirty(ssd1306_t *device, int x1, int y1, int x2, int y2);
+extern void ssd1306_set_dirty_all(ssd1306_t *device);
+extern void ssd1306_get_stats(ssd1306_t *device, ssd1306_stats_t *stats);
+/* wait until queued transactions are sent. flush and reset call this before reusing
+ * front buffer or resetting panel. */
+extern void ssd1306_wait(ssd1306_t *device);
+/* return true if queued transactions are being sent */
+extern bool ssd1306_is_busy(ssd1306_t *device);
 
 extern void ssd1306_write(ssd1306_t *device, int x, int y, uint8_t c);
 extern void ssd1306_send_buffer(ssd1306_t *device,
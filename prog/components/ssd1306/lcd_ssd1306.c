@@ -56,6 +56,7 @@ static void lcd_ssd1306_clear(abstract_lcd_t *this)
 {
     ssd1306_t *device = get_device(this);
     memset(device->buffer, 0, device->buffer_size);
+    ssd1306_set_dirty_all(device);
 }
 static void lcd_ssd1306_flush(abstract_lcd_t *this)
 {
@@ -116,6 +117,7 @@ static void lcd_ssd1306_drawpixel(abstract_lcd_t *this, int x, int y)
         pixel_func_t pixel_func = get_pixel_func(lcd->fg_color, lcd->drawmode);
         if (pixel_func != NULL) {
             pixel_func(device->buffer, pos, b);
+            ssd1306_set_dirty(device, x, y, x, y);
         }
     }
 }
@@ -126,6 +128,7 @@ static void lcd_ssd1306_hline(abstract_lcd_t *this,
     lcd_ssd1306_t *lcd = get_lcd(this);
     gfx_bitmap_t dst = get_dst(lcd->device);
     lcd_1bit_vert_hline(&dst, lcd->fg_color, lcd->drawmode, x1, x2, y);
+    ssd1306_set_dirty(lcd->device, x1, y, x2, y);
 }
 
 static void lcd_ssd1306_vline(abstract_lcd_t *this,
@@ -134,6 +137,7 @@ static void lcd_ssd1306_vline(abstract_lcd_t *this,
     lcd_ssd1306_t *lcd = get_lcd(this);
     gfx_bitmap_t dst = get_dst(lcd->device);
     lcd_1bit_vert_vline(&dst, lcd->fg_color, lcd->drawmode, x, y1, y2);
+    ssd1306_set_dirty(lcd->device, x, y1, x, y2);
 }
 
 static void lcd_ssd1306_fillrect(abstract_lcd_t *this,
@@ -142,6 +146,7 @@ static void lcd_ssd1306_fillrect(abstract_lcd_t *this,
     lcd_ssd1306_t *lcd = get_lcd(this);
     gfx_bitmap_t dst = get_dst(lcd->device);
     lcd_1bit_vert_fillrect(&dst, lcd->fg_color, lcd->drawmode, x1, y1, x2, y2);
+    ssd1306_set_dirty(lcd->device, x1, y1, x2, y2);
 }
 
 static void lcd_ssd1306_drawbitmap(abstract_lcd_t *this,
@@ -151,6 +156,7 @@ static void lcd_ssd1306_drawbitmap(abstract_lcd_t *this,
     lcd_ssd1306_t *lcd = get_lcd(this);
     gfx_bitmap_t dst = get_dst(lcd->device);
     lcd_1bit_vert_drawbitmap(&dst, src, src_x, src_y, x, y, width, height);
+    ssd1306_set_dirty(lcd->device, x, y, x+width-1, y+height-1);
 }
 
 static abstract_lcd_t base = {
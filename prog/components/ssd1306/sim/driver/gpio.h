@@ -0,0 +1,61 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_5 = 5,
+    GPIO_NUM_18 = 18,
+    GPIO_NUM_19 = 19,
+    GPIO_NUM_22 = 22,
+    GPIO_NUM_23 = 23,
+} gpio_num_t;
+
+typedef enum {
+    GPIO_MODE_DISABLE,
+    GPIO_MODE_OUTPUT,
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE,
+    GPIO_PULLUP_ENABLE,
+} gpio_pullup_t;
+
+typedef enum {
+    GPIO_PULLDOWN_DISABLE,
+    GPIO_PULLDOWN_ENABLE,
+} gpio_pulldown_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE,
+} gpio_int_type_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+/* level of DC and RESET pins of panel are seen by sim_panel */
+extern esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level);
+extern esp_err_t gpio_config(const gpio_config_t *config);
+extern esp_err_t gpio_reset_pin(gpio_num_t gpio);
@@ -0,0 +1,101 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* SPI master API of IDF v4.0 on simulated SSD1306 panel. see sim_panel.h */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+    SPI_HOST = 0,
+    HSPI_HOST = 1,
+    VSPI_HOST = 2,
+} spi_host_device_t;
+
+#define SPICOMMON_BUSFLAG_MASTER    (1<<0)
+#define SPICOMMON_BUSFLAG_SCLK      (1<<1)
+#define SPICOMMON_BUSFLAG_MISO      (1<<2)
+#define SPICOMMON_BUSFLAG_MOSI      (1<<3)
+
+#define SPI_TRANS_USE_RXDATA        (1<<2)
+#define SPI_TRANS_USE_TXDATA        (1<<3)
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+    uint32_t flags;
+    int intr_flags;
+} spi_bus_config_t;
+
+typedef struct spi_transaction_t spi_transaction_t;
+typedef void (*transaction_cb_t)(spi_transaction_t *trans);
+
+typedef struct {
+    uint8_t command_bits;
+    uint8_t address_bits;
+    uint8_t dummy_bits;
+    uint8_t mode;
+    uint16_t duty_cycle_pos;
+    uint16_t cs_ena_pretrans;
+    uint8_t cs_ena_posttrans;
+    int clock_speed_hz;
+    int input_delay_ns;
+    int spics_io_num;
+    uint32_t flags;
+    int queue_size;
+    transaction_cb_t pre_cb;
+    transaction_cb_t post_cb;
+} spi_device_interface_config_t;
+
+struct spi_transaction_t {
+    uint32_t flags;
+    uint16_t cmd;
+    uint64_t addr;
+    size_t length;          /* in bits */
+    size_t rxlength;
+    void *user;
+    union {
+        const void *tx_buffer;
+        uint8_t tx_data[4];
+    };
+    union {
+        void *rx_buffer;
+        uint8_t rx_data[4];
+    };
+};
+
+typedef struct spi_device_t *spi_device_handle_t;
+
+extern esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config, int dma_chan);
+extern esp_err_t spi_bus_free(spi_host_device_t host);
+extern esp_err_t spi_bus_add_device(spi_host_device_t host,
+    const spi_device_interface_config_t *dev_config, spi_device_handle_t *handle);
+extern esp_err_t spi_bus_remove_device(spi_device_handle_t handle);
+extern esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans, TickType_t ticks_to_wait);
+extern esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans, TickType_t ticks_to_wait);
+extern esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans);
+extern esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans);
+extern esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait);
+extern void spi_device_release_bus(spi_device_handle_t dev);
@@ -0,0 +1,28 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef const char *esp_event_base_t;
+
+#define ESP_EVENT_DECLARE_BASE(id)  extern esp_event_base_t id
+#define ESP_EVENT_DEFINE_BASE(id)   esp_event_base_t id = #id
+
+typedef void (*esp_event_handler_t)(void *event_handler_arg, esp_event_base_t event_base,
+    int32_t event_id, void *event_data);
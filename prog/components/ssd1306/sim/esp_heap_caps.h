@@ -0,0 +1,29 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_DMA      (1<<3)
+#define MALLOC_CAP_8BIT     (1<<2)
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
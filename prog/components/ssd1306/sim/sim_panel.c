@@ -0,0 +1,365 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sim_panel.h"
+
+#define QUEUE_MAX   32
+
+struct spi_device_t {
+    spi_device_interface_config_t config;
+    spi_transaction_t *queue[QUEUE_MAX];
+    int64_t done_time[QUEUE_MAX];
+    int queue_head;
+    int queue_len;
+    int64_t busy_until;     /* end of last queued transaction on wire */
+};
+
+static struct {
+    gpio_num_t dc_pin;
+    gpio_num_t reset_pin;
+    int dc;
+    bool on;
+    /* addressing */
+    int mode;
+    int col, col_start, col_end;
+    int page, page_start, page_end;
+    /* command being received */
+    uint8_t cmd[8];
+    int cmd_len;
+    int cmd_need;
+    uint8_t ram[SIM_PANEL_COLUMNS * SIM_PANEL_PAGES];
+    sim_panel_stats_t stats;
+    bool hold;
+} s_panel = { .dc = -1 };
+
+int sim_log_level = 2;
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    (void)ticks;
+}
+
+static void panel_reset(void)
+{
+    s_panel.on = false;
+    s_panel.mode = 2;
+    s_panel.col = s_panel.col_start = 0;
+    s_panel.col_end = SIM_PANEL_COLUMNS - 1;
+    s_panel.page = s_panel.page_start = 0;
+    s_panel.page_end = SIM_PANEL_PAGES - 1;
+    s_panel.cmd_len = 0;
+}
+
+void sim_panel_init(gpio_num_t dc, gpio_num_t reset)
+{
+    int i;
+    memset(&s_panel, 0, sizeof(s_panel));
+    s_panel.dc_pin = dc;
+    s_panel.reset_pin = reset;
+    s_panel.dc = -1;
+    /* RAM is not cleared by reset */
+    for (i = 0; i < (int)sizeof(s_panel.ram); i++) {
+        s_panel.ram[i] = (uint8_t)(i * 37 + 0xa5);
+    }
+    panel_reset();
+}
+
+void sim_panel_get_stats(sim_panel_stats_t *stats)
+{
+    *stats = s_panel.stats;
+}
+
+void sim_panel_reset_stats(void)
+{
+    memset(&s_panel.stats, 0, sizeof(s_panel.stats));
+}
+
+const uint8_t *sim_panel_get_ram(void)
+{
+    return s_panel.ram;
+}
+
+void sim_panel_hold(bool hold)
+{
+    s_panel.hold = hold;
+}
+
+bool sim_panel_is_on(void)
+{
+    return s_panel.on;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    if (gpio == s_panel.dc_pin) {
+        s_panel.dc = level? 1: 0;
+    } else if (gpio == s_panel.reset_pin && level == 0) {
+        panel_reset();
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio)
+{
+    (void)gpio;
+    return ESP_OK;
+}
+
+/* number of argument bytes of command */
+static int command_args(uint8_t c)
+{
+    switch (c) {
+    case 0x81: case 0x20: case 0xA8: case 0xD3: case 0xD5:
+    case 0xD9: case 0xDA: case 0xDB: case 0x8D:
+        return 1;
+    case 0x21: case 0x22: case 0xA3:
+        return 2;
+    case 0x29: case 0x2A:
+        return 5;
+    case 0x26: case 0x27:
+        return 6;
+    }
+    return 0;
+}
+
+static void execute_command(const uint8_t *cmd)
+{
+    uint8_t c = cmd[0];
+    if (c == 0x20) {
+        s_panel.mode = cmd[1] & 3;
+    } else if (c == 0x21) {
+        s_panel.col = s_panel.col_start = cmd[1] & 0x7f;
+        s_panel.col_end = cmd[2] & 0x7f;
+    } else if (c == 0x22) {
+        s_panel.page = s_panel.page_start = cmd[1] & 7;
+        s_panel.page_end = cmd[2] & 7;
+    } else if (c <= 0x0f) {
+        s_panel.col = (s_panel.col & 0xf0) | c;
+    } else if (c <= 0x1f) {
+        s_panel.col = (s_panel.col & 0x0f) | ((c & 0x0f) << 4);
+    } else if ((c & 0xf8) == 0xb0) {
+        s_panel.page = c & 7;
+    } else if ((c & 0xfe) == 0xae) {
+        s_panel.on = c & 1;
+    }
+}
+
+static void receive_command(uint8_t c)
+{
+    if (s_panel.cmd_len == 0) {
+        s_panel.cmd_need = 1 + command_args(c);
+    }
+    s_panel.cmd[s_panel.cmd_len++] = c;
+    if (s_panel.cmd_len == s_panel.cmd_need) {
+        execute_command(s_panel.cmd);
+        s_panel.cmd_len = 0;
+    }
+}
+
+static void receive_data(uint8_t d)
+{
+    if (s_panel.cmd_len > 0) {
+        s_panel.stats.errors++;
+        return;
+    }
+    s_panel.ram[s_panel.col * SIM_PANEL_PAGES + s_panel.page] = d;
+    if (s_panel.mode == 0) {
+        /* horizontal */
+        if (++s_panel.col > s_panel.col_end) {
+            s_panel.col = s_panel.col_start;
+            if (++s_panel.page > s_panel.page_end) {
+                s_panel.page = s_panel.page_start;
+            }
+        }
+    } else if (s_panel.mode == 1) {
+        /* vertical */
+        if (++s_panel.page > s_panel.page_end) {
+            s_panel.page = s_panel.page_start;
+            if (++s_panel.col > s_panel.col_end) {
+                s_panel.col = s_panel.col_start;
+            }
+        }
+    } else {
+        /* page */
+        if (++s_panel.col >= SIM_PANEL_COLUMNS) {
+            s_panel.col = 0;
+        }
+    }
+}
+
+static int64_t trans_time(spi_device_handle_t handle, const spi_transaction_t *trans)
+{
+    return (int64_t)trans->length * 1000000 / handle->config.clock_speed_hz;
+}
+
+static void execute_trans(spi_device_handle_t handle, spi_transaction_t *trans)
+{
+    const uint8_t *data;
+    size_t size, i;
+
+    if (handle->config.pre_cb != NULL) {
+        handle->config.pre_cb(trans);
+    }
+    data = (trans->flags & SPI_TRANS_USE_TXDATA)? trans->tx_data: (const uint8_t*)trans->tx_buffer;
+    size = trans->length / 8;
+    s_panel.stats.transactions++;
+    s_panel.stats.bus_time += trans_time(handle, trans);
+    if (s_panel.dc < 0) {
+        s_panel.stats.errors++;
+    } else if (s_panel.dc == 0) {
+        s_panel.stats.command_bytes += size;
+        for (i = 0; i < size; i++) {
+            receive_command(data[i]);
+        }
+    } else {
+        s_panel.stats.data_bytes += size;
+        for (i = 0; i < size; i++) {
+            receive_data(data[i]);
+        }
+    }
+    if (handle->config.post_cb != NULL) {
+        handle->config.post_cb(trans);
+    }
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config, int dma_chan)
+{
+    (void)host;
+    (void)bus_config;
+    (void)dma_chan;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host)
+{
+    (void)host;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host,
+    const spi_device_interface_config_t *dev_config, spi_device_handle_t *handle)
+{
+    (void)host;
+    if (dev_config->queue_size > QUEUE_MAX || dev_config->clock_speed_hz <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *handle = calloc(1, sizeof(struct spi_device_t));
+    if (*handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    (*handle)->config = *dev_config;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle)
+{
+    if (handle->queue_len > 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(handle);
+    return ESP_OK;
+}
+
+/* transaction is executed when its result is taken, which is latest time DMA may
+ * read buffer. so buffer modified before that is caught by tests.
+ * it is done after time on wire from end of previous one, as seen by polling. */
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans, TickType_t ticks_to_wait)
+{
+    int64_t now = esp_timer_get_time();
+    int index;
+
+    (void)ticks_to_wait;
+    if (handle->queue_len >= handle->config.queue_size) {
+        return ESP_ERR_TIMEOUT;
+    }
+    if (handle->busy_until < now) {
+        handle->busy_until = now;
+    }
+    handle->busy_until += trans_time(handle, trans);
+    index = (handle->queue_head + handle->queue_len) % QUEUE_MAX;
+    handle->queue[index] = trans;
+    handle->done_time[index] = handle->busy_until;
+    handle->queue_len++;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans, TickType_t ticks_to_wait)
+{
+    if (handle->queue_len == 0) {
+        return ESP_ERR_TIMEOUT;
+    }
+    /* waiting is not simulated. only polling sees transaction in flight */
+    if (ticks_to_wait == 0 && (s_panel.hold || esp_timer_get_time() < handle->done_time[handle->queue_head])) {
+        return ESP_ERR_TIMEOUT;
+    }
+    *trans = handle->queue[handle->queue_head];
+    execute_trans(handle, *trans);
+    handle->queue_head = (handle->queue_head + 1) % QUEUE_MAX;
+    handle->queue_len--;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans)
+{
+    if (handle->queue_len > 0) {
+        /* IDF requires queued transactions to be taken first */
+        return ESP_ERR_INVALID_STATE;
+    }
+    execute_trans(handle, trans);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans)
+{
+    return spi_device_transmit(handle, trans);
+}
+
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait)
+{
+    (void)device;
+    (void)wait;
+    return ESP_OK;
+}
+
+void spi_device_release_bus(spi_device_handle_t dev)
+{
+    (void)dev;
+}
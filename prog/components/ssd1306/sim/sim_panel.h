@@ -0,0 +1,61 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+/**
+ * @file
+ * model of SSD1306 panel behind SPI master API for host simulation of ssd1306 component.
+ * commands and data sent over SPI are decoded into display RAM, so tests can check
+ * what the panel shows, and bytes and transactions on the wire are counted.
+ */
+
+#define SIM_PANEL_COLUMNS   128
+#define SIM_PANEL_PAGES     8
+
+/** counters of SPI traffic. */
+typedef struct {
+    uint32_t transactions;
+    uint32_t command_bytes;
+    uint32_t data_bytes;
+    uint32_t errors;        /**< data in middle of command, or transaction without DC set. */
+    int64_t bus_time;       /**< usec to shift all bytes at clock speed of device. */
+} sim_panel_stats_t;
+
+/**
+ * @brief set pins of panel and fill display RAM with garbage like power on.
+ * call before ssd1306_init_gpio.
+ */
+extern void sim_panel_init(gpio_num_t dc, gpio_num_t reset);
+extern void sim_panel_get_stats(sim_panel_stats_t *stats);
+extern void sim_panel_reset_stats(void);
+/**
+ * @brief return display RAM in layout of ssd1306_t buffer of 128x64 panel,
+ * i.e. byte of page p of column c is at c*SIM_PANEL_PAGES+p.
+ */
+extern const uint8_t *sim_panel_get_ram(void);
+/**
+ * @brief keep queued transactions in flight when polled, like DMA is slow.
+ * waiting for result still completes them.
+ */
+extern void sim_panel_hold(bool hold);
+/** @brief return true if panel is on. */
+extern bool sim_panel_is_on(void);
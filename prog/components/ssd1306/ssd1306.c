@@ -20,12 +20,37 @@
 #include <driver/gpio.h>
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
 
 #include "ssd1306.h"
 #include "ssd1306_common.h"
 
 #define TAG "ssd1306"
 
+/* SETMAM, SETCOLADDR and SETPAGEADDR sent before data by flush */
+#define FLUSH_COMMAND_BYTES 8
+/* SETCOLADDR and SETPAGEADDR sent before each span of shadow diff */
+#define SPAN_COMMAND_BYTES  6
+/* unchanged bytes between changed runs are sent rather than starting new
+ * span, while they are cheaper than commands and transaction of new span. */
+#define SSD1306_DIFF_GAP_DEFAULT    8
+/* shadow diff keeps run state per page */
+#define SSD1306_MAX_PAGES   SSD1306_ROWS(64)
+
+/* DC level of transaction is passed to pre transfer callback by user field.
+ * bit 1 marks that user is set by this driver. */
+#define DC_USER(device, level)  ((void*)(uintptr_t)(((device)->dc << 2) | 2 | ((level)? 1: 0)))
+
+static void IRAM_ATTR ssd1306_pre_transfer(spi_transaction_t *t)
+{
+    uintptr_t user = (uintptr_t)t->user;
+    if (user & 2) {
+        gpio_set_level(user >> 2, user & 1);
+    }
+}
+
 static inline void ssd1306_delay_ms(int ms)
 {
     vTaskDelay((ms+portTICK_PERIOD_MS-1)/portTICK_PERIOD_MS);
@@ -39,10 +64,28 @@ static esp_err_t ssd1306_init_device(ssd1306_t *device, const ssd1306_param_t *p
     device->height = param->height;
     device->buffer_size = SSD1306_BUFSIZE(device->width, device->height);
     device->buffer = malloc(device->buffer_size);
-    if (device->buffer == NULL) {
+    device->tx_buffer = heap_caps_malloc(device->buffer_size + SSD1306_TRANS_MAX * SSD1306_TRANS_CMD_SIZE,
+        MALLOC_CAP_DMA);
+    if (device->buffer == NULL || device->tx_buffer == NULL) {
         ssd1306_deinit(device);
         return ESP_ERR_NO_MEM;
     }
+    if (param->use_shadow && SSD1306_ROWS(device->height) <= SSD1306_MAX_PAGES) {
+        device->shadow = malloc(device->buffer_size);
+        if (device->shadow == NULL) {
+            ssd1306_deinit(device);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    device->shadow_valid = false;
+    device->diff_gap = SSD1306_DIFF_GAP_DEFAULT;
+    device->tx_cmds = device->tx_buffer + device->buffer_size;
+    device->batch_index = -1;
+    if (param->async_flush && !device->is_spi_managed) {
+        ESP_LOGW(TAG, "async flush needs spi device added by ssd1306_init_gpio");
+    }
+    device->async = param->async_flush && device->is_spi_managed;
+    ssd1306_set_dirty_all(device);
 
     device->dc = param->dc;
     device->reset = param->reset;
@@ -90,7 +133,8 @@ esp_err_t ssd1306_init_gpio(ssd1306_t *device, const ssd1306_param_t *param)
     devcfg.duty_cycle_pos = 0;
     devcfg.clock_speed_hz = 4*1000*1000;
     devcfg.spics_io_num = param->gpio.cs;
-    devcfg.queue_size = 7;
+    devcfg.queue_size = SSD1306_TRANS_MAX;
+    devcfg.pre_cb = ssd1306_pre_transfer;
 
     err = spi_bus_initialize(VSPI_HOST, &buscfg, 1);
     ESP_ERROR_CHECK(err);
@@ -123,6 +167,7 @@ esp_err_t ssd1306_deinit(ssd1306_t *device)
     if (device->spi == NULL) {
         return ESP_OK;
     }
+    ssd1306_wait(device);
     gpio_reset_pin(device->dc);
     gpio_reset_pin(device->reset);
     if (device->is_spi_managed) {
@@ -135,49 +180,131 @@ esp_err_t ssd1306_deinit(ssd1306_t *device)
         device->buffer = NULL;
         device->buffer_size = 0;
     }
+    if (device->tx_buffer != NULL) {
+        free(device->tx_buffer);
+        device->tx_buffer = NULL;
+        device->tx_cmds = NULL;
+    }
+    if (device->shadow != NULL) {
+        free(device->shadow);
+        device->shadow = NULL;
+    }
     return ESP_OK;
 }
 
-static esp_err_t ssd1306_send(ssd1306_t *device, uint8_t c)
+/* operation is built as list of transactions. consecutive commands are packed
+ * into one transaction, and data follows in its own one since DC differs.
+ * if async, transactions are queued back to back and DC is switched by pre
+ * transfer callback. otherwise each is sent after setting DC. */
+
+static void batch_begin(ssd1306_t *device, ssd1306_op_t op)
+{
+    device->op = op;
+    if (!device->async) {
+        ssd1306_begin(device);
+    }
+}
+
+/* take free transaction. oldest one is waited if all are in flight. */
+static int batch_get_trans(ssd1306_t *device)
+{
+    spi_transaction_t *t;
+    int index = device->trans_next;
+
+    if (device->trans_queued == SSD1306_TRANS_MAX) {
+        ESP_ERROR_CHECK(spi_device_get_trans_result(device->spi, &t, portMAX_DELAY));
+        device->trans_queued--;
+    }
+    device->trans_next = (index + 1) % SSD1306_TRANS_MAX;
+    memset(&device->trans[index], 0, sizeof(spi_transaction_t));
+    return index;
+}
+
+static void batch_submit(ssd1306_t *device, spi_transaction_t *t, int dc)
 {
     esp_err_t err;
-    if (device->spi == NULL) {
-        return ESP_ERR_INVALID_STATE;
+
+    /* pre transfer callback of other owner of spi device may use user */
+    t->user = device->is_spi_managed? DC_USER(device, dc): NULL;
+    device->stats.ops[device->op].transactions++;
+    device->stats.ops[device->op].bytes += t->length / 8;
+    if (device->async) {
+        err = spi_device_queue_trans(device->spi, t, portMAX_DELAY);
+        if (err == ESP_OK) {
+            device->trans_queued++;
+        }
+    } else {
+        gpio_set_level(device->dc, dc);
+        err = spi_device_transmit(device->spi, t);
     }
-    spi_transaction_t t = {};
-    t.length = 8;
-    t.tx_buffer = &c;
-    err = spi_device_transmit(device->spi, &t);
-    assert(err==ESP_OK);
-    return err;
+    ESP_ERROR_CHECK(err);
 }
 
-static esp_err_t ssd1306_send_command(ssd1306_t *device, uint8_t c)
+/* send commands packed so far */
+static void batch_send_commands(ssd1306_t *device)
 {
-    gpio_set_level(device->dc, 0);
-    return ssd1306_send(device, c);
+    spi_transaction_t *t;
+    int index = device->batch_index;
+
+    if (index < 0) {
+        return;
+    }
+    device->batch_index = -1;
+    t = &device->trans[index];
+    t->length = device->batch_len * 8;
+    t->tx_buffer = device->tx_cmds + index * SSD1306_TRANS_CMD_SIZE;
+    batch_submit(device, t, 0);
 }
 
-#define ssd1306_send_commands(device, ...) \
-    _ssd1306_send_commands(device, (uint8_t[])__VA_ARGS__, sizeof((uint8_t[])__VA_ARGS__))
+#define batch_commands(device, ...) \
+    _batch_commands(device, (uint8_t[])__VA_ARGS__, sizeof((uint8_t[])__VA_ARGS__))
 
-static esp_err_t _ssd1306_send_commands(ssd1306_t *device, uint8_t *commands, int cmdlen)
+static void _batch_commands(ssd1306_t *device, const uint8_t *commands, int cmdlen)
 {
-    gpio_set_level(device->dc, 0);
+    int n;
+
     while (cmdlen > 0) {
-        esp_err_t err = ssd1306_send(device, *commands++);
-        if (err != ESP_OK) {
-            return err;
+        if (device->batch_index >= 0 && device->batch_len == SSD1306_TRANS_CMD_SIZE) {
+            batch_send_commands(device);
+        }
+        if (device->batch_index < 0) {
+            device->batch_index = batch_get_trans(device);
+            device->batch_len = 0;
         }
-        cmdlen--;
+        n = cmdlen < SSD1306_TRANS_CMD_SIZE - device->batch_len?
+            cmdlen: SSD1306_TRANS_CMD_SIZE - device->batch_len;
+        memcpy(device->tx_cmds + device->batch_index * SSD1306_TRANS_CMD_SIZE + device->batch_len,
+            commands, n);
+        device->batch_len += n;
+        commands += n;
+        cmdlen -= n;
     }
-    return ESP_OK;
 }
 
-static esp_err_t ssd1306_send_data(ssd1306_t *device, uint8_t d)
+/* data must stay until sent, i.e. be in front buffer, unless it fits in transaction */
+static void batch_data(ssd1306_t *device, const uint8_t *data, int size)
 {
-    gpio_set_level(device->dc, 1);
-    return ssd1306_send(device, d);
+    spi_transaction_t *t;
+
+    batch_send_commands(device);
+    t = &device->trans[batch_get_trans(device)];
+    t->length = size * 8;
+    if (size <= sizeof(t->tx_data)) {
+        t->flags = SPI_TRANS_USE_TXDATA;
+        memcpy(t->tx_data, data, size);
+    } else {
+        t->tx_buffer = data;
+    }
+    batch_submit(device, t, 1);
+}
+
+/* async operation returns without waiting. next one is queued after it. */
+static void batch_end(ssd1306_t *device)
+{
+    batch_send_commands(device);
+    if (!device->async) {
+        ssd1306_end(device);
+    }
 }
 
 void ssd1306_write(ssd1306_t *device, int x, int y, uint8_t c)
@@ -189,23 +316,31 @@ void ssd1306_write(ssd1306_t *device, int x, int y, uint8_t c)
     } else {
         device->buffer[pos] &= ~b;
     }
-    ssd1306_send_commands(device, {
+    if (device->shadow != NULL) {
+        device->shadow[pos] = device->buffer[pos];
+    }
+    device->stats.ops[SSD1306_OP_WRITE].calls++;
+    batch_begin(device, SSD1306_OP_WRITE);
+    batch_commands(device, {
         SSD1306_CMD_SETMAM(2),
         SSD1306_CMD_SETLCSAFORPAM(SSD1306_X2COL(x)),
         SSD1306_CMD_SETHCSAFORPAM(SSD1306_X2COL(x)>>4),
         SSD1306_CMD_SETPAGESTARTADDR(SSD1306_Y2ROW(y)),
     });
-    ssd1306_send_data(device, device->buffer[pos]);
+    batch_data(device, &device->buffer[pos], 1);
+    batch_end(device);
 }
 
 void ssd1306_send_buffer(ssd1306_t *device, const uint8_t *buffer, int size)
 {
     esp_err_t err;
+    ssd1306_wait(device);
     ssd1306_begin(device);
     gpio_set_level(device->dc, 1);
     spi_transaction_t t = {};
     t.length = size*8;
     t.tx_buffer = buffer;
+    t.user = device->is_spi_managed? DC_USER(device, 1): NULL;
     err = spi_device_transmit(device->spi, &t);
     ssd1306_end(device);
     ESP_ERROR_CHECK(err);
@@ -214,12 +349,18 @@ void ssd1306_send_buffer(ssd1306_t *device, const uint8_t *buffer, int size)
 void ssd1306_reset(ssd1306_t *device)
 {
     ESP_LOGD(TAG, "> reset");
+    device->stats.ops[SSD1306_OP_RESET].calls++;
+    ssd1306_wait(device);
     memset(device->buffer, 0, device->buffer_size);
+    ssd1306_set_dirty_all(device);
+    /* content of display RAM is unknown after reset */
+    device->shadow_valid = false;
     gpio_set_level(device->reset, 0);
     ssd1306_delay_ms(10);
     gpio_set_level(device->reset, 1);
     ssd1306_delay_ms(10);
-    ssd1306_send_commands(device, {
+    batch_begin(device, SSD1306_OP_RESET);
+    batch_commands(device, {
         SSD1306_CMD_SETDISPLAYON(0),
         SSD1306_CMD_SETCLOCKDIVOSCFREQ(0, 15),
         SSD1306_CMD_SETMUXRATIO(63),
@@ -235,23 +376,42 @@ void ssd1306_reset(ssd1306_t *device)
         SSD1306_CMD_ENTIREDISPLAYON(0),
         SSD1306_CMD_SETINVERTDISPLAY(0),
     });
+    batch_end(device);
     ssd1306_flush(device);
+    /* display on after RAM is cleared */
+    ssd1306_wait(device);
     ssd1306_delay_ms(1);
-    ssd1306_send_command(device, SSD1306_CMD_SETDISPLAYON(1));
+    batch_begin(device, SSD1306_OP_RESET);
+    batch_commands(device, {
+        SSD1306_CMD_SETDISPLAYON(1),
+    });
+    batch_end(device);
     ESP_LOGD(TAG, "< reset");
 }
 
 void ssd1306_on(ssd1306_t *device)
 {
-    ESP_LOGD(TAG, "> sleep");
-    ssd1306_send_command(device, SSD1306_CMD_SETDISPLAYON(1));
-    ESP_LOGD(TAG, "< sleep");
+    ESP_LOGD(TAG, "> on");
+    device->stats.ops[SSD1306_OP_POWER].calls++;
+    batch_begin(device, SSD1306_OP_POWER);
+    batch_commands(device, {
+        SSD1306_CMD_SETDISPLAYON(1),
+    });
+    batch_end(device);
+    ESP_LOGD(TAG, "< on");
 }
 
 void ssd1306_sleep(ssd1306_t *device)
 {
     ESP_LOGD(TAG, "> sleep");
-    ssd1306_send_command(device, SSD1306_CMD_SETDISPLAYON(0));
+    device->stats.ops[SSD1306_OP_POWER].calls++;
+    batch_begin(device, SSD1306_OP_POWER);
+    batch_commands(device, {
+        SSD1306_CMD_SETDISPLAYON(0),
+    });
+    batch_end(device);
+    /* caller may enter deep sleep right after. display off must reach panel */
+    ssd1306_wait(device);
     ESP_LOGD(TAG, "< sleep");
 }
 
@@ -269,12 +429,248 @@ void ssd1306_end(ssd1306_t *device)
     }
 }
 
-void ssd1306_flush(ssd1306_t *device)
+void ssd1306_set_dirty(ssd1306_t *device, int x1, int y1, int x2, int y2)
 {
-    ssd1306_send_commands(device, {
+    int col1, col2, page1, page2;
+
+    x1 = x1 < 0? 0: x1;
+    y1 = y1 < 0? 0: y1;
+    x2 = x2 >= device->width? device->width-1: x2;
+    y2 = y2 >= device->height? device->height-1: y2;
+    if (x1 > x2 || y1 > y2) {
+        return;
+    }
+    col1 = SSD1306_X2COL(x1);
+    col2 = SSD1306_X2COL(x2);
+    page1 = SSD1306_Y2ROW(y1);
+    page2 = SSD1306_Y2ROW(y2);
+    if (device->dirty_col1 > device->dirty_col2) {
+        device->dirty_col1 = col1;
+        device->dirty_col2 = col2;
+        device->dirty_page1 = page1;
+        device->dirty_page2 = page2;
+        return;
+    }
+    if (col1 < device->dirty_col1) {
+        device->dirty_col1 = col1;
+    }
+    if (col2 > device->dirty_col2) {
+        device->dirty_col2 = col2;
+    }
+    if (page1 < device->dirty_page1) {
+        device->dirty_page1 = page1;
+    }
+    if (page2 > device->dirty_page2) {
+        device->dirty_page2 = page2;
+    }
+}
+
+void ssd1306_set_dirty_all(ssd1306_t *device)
+{
+    ssd1306_set_dirty(device, 0, 0, device->width-1, device->height-1);
+}
+
+void ssd1306_get_stats(ssd1306_t *device, ssd1306_stats_t *stats)
+{
+    *stats = device->stats;
+}
+
+void ssd1306_wait(ssd1306_t *device)
+{
+    spi_transaction_t *t;
+    int64_t t0;
+
+    if (device->trans_queued == 0) {
+        return;
+    }
+    t0 = esp_timer_get_time();
+    while (device->trans_queued > 0) {
+        ESP_ERROR_CHECK(spi_device_get_trans_result(device->spi, &t, portMAX_DELAY));
+        device->trans_queued--;
+    }
+    device->stats.waits++;
+    device->stats.wait_time += esp_timer_get_time() - t0;
+}
+
+bool ssd1306_is_busy(ssd1306_t *device)
+{
+    spi_transaction_t *t;
+
+    while (device->trans_queued > 0 && spi_device_get_trans_result(device->spi, &t, 0) == ESP_OK) {
+        device->trans_queued--;
+    }
+    return device->trans_queued > 0;
+}
+
+/* send window of buffer. returns bytes sent. */
+static int flush_window(ssd1306_t *device, int col1, int col2, int page1, int page2)
+{
+    const int rows = SSD1306_ROWS(device->height);
+    int pages = page2 - page1 + 1;
+    int size = (col2 - col1 + 1) * pages;
+    int col;
+
+    if (pages == rows) {
+        /* columns are contiguous in vertical addressing mode */
+        memcpy(device->tx_buffer, device->buffer + col1 * rows, size);
+    } else {
+        for (col = col1; col <= col2; col++) {
+            memcpy(device->tx_buffer + (col - col1) * pages, device->buffer + col * rows + page1, pages);
+        }
+    }
+    batch_commands(device, {
         SSD1306_CMD_SETMAM(1),
-        SSD1306_CMD_SETCOLADDR(0, SSD1306_X2COL(device->width-1)),
-        SSD1306_CMD_SETPAGEADDR(0, SSD1306_Y2ROW(device->height-1)),
+        SSD1306_CMD_SETCOLADDR(col1, col2),
+        SSD1306_CMD_SETPAGEADDR(page1, page2),
     });
-    ssd1306_send_buffer(device, device->buffer, device->buffer_size);
+    batch_data(device, device->tx_buffer, size);
+    device->stats.last_spans = 1;
+    return size + FLUSH_COMMAND_BYTES;
+}
+/* state of shadow diff. changed bytes are coalesced into runs of columns per page. */
+typedef struct {
+    ssd1306_t *device;
+    bool emit;
+    int spans;
+    int bytes;
+    int tx_size;
+    short run_col1[SSD1306_MAX_PAGES];
+    short run_col2[SSD1306_MAX_PAGES];
+} diff_t;
+
+static void diff_end_run(diff_t *diff, int page)
+{
+    ssd1306_t *device = diff->device;
+    const int rows = SSD1306_ROWS(device->height);
+    int col1 = diff->run_col1[page], col2 = diff->run_col2[page];
+    int size = col2 - col1 + 1;
+    uint8_t *data;
+    int col;
+
+    if (col1 < 0) {
+        return;
+    }
+    diff->run_col1[page] = -1;
+    diff->spans++;
+    diff->bytes += size + SPAN_COMMAND_BYTES;
+    if (!diff->emit) {
+        return;
+    }
+    data = device->tx_buffer + diff->tx_size;
+    for (col = col1; col <= col2; col++) {
+        *data++ = device->buffer[col * rows + page];
+    }
+    batch_commands(device, {
+        SSD1306_CMD_SETCOLADDR(col1, col2),
+        SSD1306_CMD_SETPAGEADDR(page, page),
+    });
+    batch_data(device, device->tx_buffer + diff->tx_size, size);
+    diff->tx_size += size;
+}
+
+/* find changed runs in window. sends them if emit. */
+static void diff_window(diff_t *diff, int col1, int col2, int page1, int page2)
+{
+    ssd1306_t *device = diff->device;
+    const int rows = SSD1306_ROWS(device->height);
+    const int pages = page2 - page1 + 1;
+    const uint8_t *buf, *shadow;
+    int col, page;
+
+    diff->spans = 0;
+    diff->bytes = 2;    /* SETMAM */
+    diff->tx_size = 0;
+    for (page = page1; page <= page2; page++) {
+        diff->run_col1[page] = -1;
+    }
+    for (col = col1; col <= col2; col++) {
+        buf = device->buffer + col * rows;
+        shadow = device->shadow + col * rows;
+        /* most columns are unchanged. memcmp compares by word */
+        if (memcmp(buf + page1, shadow + page1, pages) == 0) {
+            continue;
+        }
+        for (page = page1; page <= page2; page++) {
+            if (buf[page] == shadow[page]) {
+                continue;
+            }
+            if (diff->run_col1[page] >= 0 && col - diff->run_col2[page] - 1 > device->diff_gap) {
+                diff_end_run(diff, page);
+            }
+            if (diff->run_col1[page] < 0) {
+                diff->run_col1[page] = col;
+            }
+            diff->run_col2[page] = col;
+        }
+    }
+    for (page = page1; page <= page2; page++) {
+        diff_end_run(diff, page);
+    }
+}
+
+/* send changed spans of window if cheaper than whole window. returns bytes sent. */
+static int flush_diff(ssd1306_t *device, int col1, int col2, int page1, int page2)
+{
+    const int rows = SSD1306_ROWS(device->height);
+    const int pages = page2 - page1 + 1;
+    diff_t diff = { .device = device };
+    int col;
+
+    diff_window(&diff, col1, col2, page1, page2);
+    if (diff.bytes >= (col2 - col1 + 1) * pages + FLUSH_COMMAND_BYTES) {
+        return flush_window(device, col1, col2, page1, page2);
+    }
+    device->stats.last_spans = diff.spans;
+    if (diff.spans > 0) {
+        diff.emit = true;
+        /* packed with commands of first span */
+        batch_commands(device, {
+            SSD1306_CMD_SETMAM(1),
+        });
+        diff_window(&diff, col1, col2, page1, page2);
+    }
+    /* unchanged bytes in window are same in shadow, so copy whole window */
+    for (col = col1; col <= col2; col++) {
+        memcpy(device->shadow + col * rows + page1, device->buffer + col * rows + page1, pages);
+    }
+    return diff.spans > 0? diff.bytes: 0;
+}
+
+void ssd1306_flush(ssd1306_t *device)
+{
+    const int rows = SSD1306_ROWS(device->height);
+    int col1 = device->dirty_col1, col2 = device->dirty_col2;
+    int page1 = device->dirty_page1, page2 = device->dirty_page2;
+    int64_t t0;
+    int bytes;
+
+    if (col1 > col2) {
+        device->stats.skipped++;
+        return;
+    }
+    device->dirty_col1 = 1;
+    device->dirty_col2 = 0;
+
+    /* front buffer is reused. rendering of this frame overlapped previous flush */
+    ssd1306_wait(device);
+    t0 = esp_timer_get_time();
+    device->stats.ops[SSD1306_OP_FLUSH].calls++;
+    batch_begin(device, SSD1306_OP_FLUSH);
+    if (device->shadow != NULL && device->shadow_valid) {
+        bytes = flush_diff(device, col1, col2, page1, page2);
+    } else {
+        bytes = flush_window(device, col1, col2, page1, page2);
+        if (device->shadow != NULL) {
+            memcpy(device->shadow, device->buffer, device->buffer_size);
+            device->shadow_valid = col1 == 0 && col2 == device->width-1 && page1 == 0 && page2 == rows-1;
+        }
+    }
+    batch_end(device);
+
+    device->stats.flushes++;
+    device->stats.last_bytes = bytes;
+    device->stats.bytes += bytes;
+    device->stats.spans += device->stats.last_spans;
+    device->stats.last_time = esp_timer_get_time() - t0;
+    device->stats.time += device->stats.last_time;
 }
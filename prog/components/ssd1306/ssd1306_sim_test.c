@@ -0,0 +1,445 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* host test and benchmark of ssd1306 flush on simulated panel.
+ * replays frames of app_display_clock() second by second, checks that display
+ * RAM of panel matches buffer after each flush and counts bytes on the wire.
+ * usage: ssd1306_sim_test [bench] */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gfx.h>
+#include "ssd1306.h"
+#include "lcd_ssd1306.h"
+#include "ssd1306_common.h"
+#include "esp_log.h"
+#include "sim_panel.h"
+#include "app_display.h"
+#include "app_display_clock.h"
+
+/* height of date line cleared by update_clock of app_mode_clock.c */
+#define DATE_LINE_HEIGHT    14
+
+typedef enum {
+    MODE_FULL,      /* whole buffer every frame, as before dirty tracking */
+    MODE_DIRTY,     /* dirty window */
+    MODE_SHADOW,    /* dirty window diffed against shadow */
+} flush_mode_t;
+
+static const char *s_mode_names[] = { "full", "dirty", "shadow" };
+
+static const ssd1306_param_t s_param = {
+    .width = LCD_WIDTH,
+    .height = LCD_HEIGHT,
+    .gpio = {
+        .mosi = GPIO_NUM_23,
+        .sclk = GPIO_NUM_18,
+        .cs = GPIO_NUM_5,
+    },
+    .dc = GPIO_NUM_22,
+    .reset = GPIO_NUM_19,
+};
+
+static lcd_ssd1306_t s_lcd;
+static ssd1306_t s_device;
+static int s_failed = 0;
+
+abstract_lcd_t *app_display_get(void)
+{
+    return &s_lcd.base;
+}
+
+static void open_device(flush_mode_t mode, bool async)
+{
+    ssd1306_param_t param = s_param;
+    param.use_shadow = mode == MODE_SHADOW;
+    param.async_flush = async;
+    sim_panel_init(param.dc, param.reset);
+    if (ssd1306_init_gpio(&s_device, &param) != ESP_OK ||
+            lcd_ssd1306_init(&s_lcd, &s_device) != ESP_OK) {
+        printf("FAIL init\n");
+        exit(1);
+    }
+    ssd1306_reset(&s_device);
+    /* display on of reset may be in flight */
+    ssd1306_wait(&s_device);
+    memset(&s_device.stats, 0, sizeof(s_device.stats));
+    sim_panel_reset_stats();
+}
+
+static void close_device(void)
+{
+    ssd1306_deinit(&s_device);
+}
+
+static bool check_panel_with(const char *name, time_t t, const uint8_t *expect)
+{
+    if (memcmp(sim_panel_get_ram(), expect, s_device.buffer_size) != 0) {
+        printf("FAIL %s: panel differs from buffer at %ld\n", name, (long)t);
+        s_failed++;
+        return false;
+    }
+    return true;
+}
+
+static bool check_panel(const char *name, time_t t)
+{
+    ssd1306_wait(&s_device);
+    return check_panel_with(name, t, s_device.buffer);
+}
+
+static void draw_frame(time_t t, bool date_line)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    if (date_line) {
+        gfx_set_fg_color(LCD, COLOR_BLACK);
+        gfx_fill_rect(LCD, 2, LCD_HEIGHT-DATE_LINE_HEIGHT, LCD_WIDTH-2, LCD_HEIGHT);
+    }
+    app_display_clock(&tm);
+}
+
+typedef struct {
+    int frames;
+    sim_panel_stats_t panel;
+    ssd1306_stats_t flush;
+} replay_result_t;
+
+static bool replay(flush_mode_t mode, bool async, int gap, time_t start, int frames, bool date_line,
+    bool check, replay_result_t *result)
+{
+    uint8_t expect[SSD1306_BUFSIZE(LCD_WIDTH, LCD_HEIGHT)];
+    time_t t;
+
+    open_device(mode, async);
+    if (gap >= 0) {
+        s_device.diff_gap = gap;
+    }
+    for (t = start; t < start + frames; t++) {
+        draw_frame(t, date_line);
+        if (mode == MODE_FULL) {
+            ssd1306_set_dirty_all(&s_device);
+        }
+        ssd1306_flush(&s_device);
+        if (check && async) {
+            /* render next frame while this frame is sent */
+            memcpy(expect, s_device.buffer, sizeof(expect));
+            draw_frame(t + 1, date_line);
+            ssd1306_wait(&s_device);
+            if (!check_panel_with(s_mode_names[mode], t, expect)) {
+                close_device();
+                return false;
+            }
+        } else if (check && !check_panel(s_mode_names[mode], t)) {
+            close_device();
+            return false;
+        }
+    }
+    result->frames = frames;
+    sim_panel_get_stats(&result->panel);
+    ssd1306_get_stats(&s_device, &result->flush);
+    close_device();
+    if (result->panel.errors > 0) {
+        printf("FAIL %s: %u protocol errors\n", s_mode_names[mode], result->panel.errors);
+        s_failed++;
+        return false;
+    }
+    return true;
+}
+
+static void print_result(const char *name, const replay_result_t *r, const replay_result_t *full)
+{
+    uint32_t bytes = r->panel.command_bytes + r->panel.data_bytes;
+    uint32_t full_bytes = full->panel.command_bytes + full->panel.data_bytes;
+    printf("%-12s %8.1f %6.1f%% %8.1f %10.1f %10.2f\n", name,
+        (double)bytes / r->frames, 100.0 * bytes / full_bytes,
+        (double)r->panel.transactions / r->frames,
+        (double)r->panel.bus_time / r->frames,
+        (double)r->flush.time / r->frames);
+}
+
+static void test_modes(void)
+{
+    /* over change of hour, with and without date line */
+    const time_t start = 9*3600 + 58*60;
+    replay_result_t result;
+    flush_mode_t mode;
+    int date_line, async;
+
+    for (async = 0; async <= 1; async++) {
+        for (date_line = 0; date_line <= 1; date_line++) {
+            for (mode = MODE_FULL; mode <= MODE_SHADOW; mode++) {
+                if (replay(mode, async, -1, start, 240, date_line, true, &result)) {
+                    printf("ok   %s%s%s: %u bytes in %d frames\n", s_mode_names[mode],
+                        async? " async": "", date_line? " with date line": "",
+                        result.panel.command_bytes + result.panel.data_bytes, result.frames);
+                }
+            }
+        }
+    }
+}
+
+static void test_unchanged(void)
+{
+    flush_mode_t mode;
+    sim_panel_stats_t stats;
+
+    for (mode = MODE_DIRTY; mode <= MODE_SHADOW; mode++) {
+        open_device(mode, false);
+        draw_frame(0, true);
+        ssd1306_flush(&s_device);
+        sim_panel_reset_stats();
+        /* same frame again */
+        draw_frame(0, true);
+        ssd1306_flush(&s_device);
+        ssd1306_flush(&s_device);
+        sim_panel_get_stats(&stats);
+        check_panel(s_mode_names[mode], 0);
+        if (mode == MODE_SHADOW && stats.data_bytes != 0) {
+            printf("FAIL shadow: %u bytes sent for unchanged frame\n", stats.data_bytes);
+            s_failed++;
+        } else if (s_device.stats.skipped != 1) {
+            printf("FAIL %s: %u flushes skipped\n", s_mode_names[mode], s_device.stats.skipped);
+            s_failed++;
+        } else {
+            printf("ok   %s: unchanged frame\n", s_mode_names[mode]);
+        }
+        close_device();
+    }
+}
+
+static void test_write_mode(flush_mode_t mode, bool async)
+{
+    open_device(mode, async);
+    draw_frame(0, false);
+    ssd1306_flush(&s_device);
+    /* write waits for flush in flight */
+    ssd1306_write(&s_device, 100, 40, 1);
+    ssd1306_write(&s_device, 3, 5, 1);
+    ssd1306_write(&s_device, 100, 40, 0);
+    if (check_panel(s_mode_names[mode], 0)) {
+        /* flush after direct write uses vertical addressing again */
+        draw_frame(1, false);
+        ssd1306_flush(&s_device);
+        if (check_panel(s_mode_names[mode], 1)) {
+            printf("ok   %s%s: write pixel\n", s_mode_names[mode], async? " async": "");
+        }
+    }
+    close_device();
+}
+
+static void test_write(void)
+{
+    flush_mode_t mode;
+    int async;
+
+    for (mode = MODE_DIRTY; mode <= MODE_SHADOW; mode++) {
+        for (async = 0; async <= 1; async++) {
+            test_write_mode(mode, async);
+        }
+    }
+}
+
+static void test_async_busy(void)
+{
+    ssd1306_stats_t stats;
+
+    open_device(MODE_SHADOW, true);
+    draw_frame(0, true);
+    sim_panel_hold(true);
+    ssd1306_flush(&s_device);
+    if (!ssd1306_is_busy(&s_device)) {
+        printf("FAIL async: not busy after flush\n");
+        s_failed++;
+        sim_panel_hold(false);
+    } else {
+        /* next flush waits for previous one. it is the only wait */
+        draw_frame(1, true);
+        ssd1306_flush(&s_device);
+        ssd1306_get_stats(&s_device, &stats);
+        ssd1306_wait(&s_device);
+        sim_panel_hold(false);
+        if (stats.waits != 1 || ssd1306_is_busy(&s_device) || !check_panel("async", 1)) {
+            printf("FAIL async: %u waits\n", stats.waits);
+            s_failed++;
+        } else {
+            printf("ok   async: fence\n");
+        }
+    }
+    close_device();
+}
+
+/* display off must reach panel before sleep returns, as deep sleep may follow */
+static void test_async_sleep(void)
+{
+    open_device(MODE_SHADOW, true);
+    draw_frame(0, true);
+    sim_panel_hold(true);
+    ssd1306_flush(&s_device);
+    ssd1306_sleep(&s_device);
+    sim_panel_hold(false);
+    if (sim_panel_is_on() || ssd1306_is_busy(&s_device) || !check_panel("async sleep", 0)) {
+        printf("FAIL async sleep: panel %s\n", sim_panel_is_on()? "on": "off");
+        s_failed++;
+    } else {
+        printf("ok   async sleep\n");
+    }
+    close_device();
+}
+
+static const char *s_op_names[] = { "reset", "power", "flush", "write" };
+
+/* transactions of each operation, counted by driver and by panel */
+static void test_op_counts(void)
+{
+    ssd1306_stats_t stats;
+    sim_panel_stats_t panel;
+    uint32_t total = 0;
+    int async, op;
+
+    for (async = 0; async <= 1; async++) {
+        open_device(MODE_SHADOW, async);
+        memset(&s_device.stats, 0, sizeof(s_device.stats));
+        ssd1306_reset(&s_device);
+        ssd1306_sleep(&s_device);
+        ssd1306_on(&s_device);
+        draw_frame(0, true);
+        ssd1306_flush(&s_device);
+        ssd1306_write(&s_device, 100, 40, 1);
+        ssd1306_write(&s_device, 100, 40, 0);
+        ssd1306_get_stats(&s_device, &stats);
+        ssd1306_wait(&s_device);
+        sim_panel_get_stats(&panel);
+        total = 0;
+        for (op = 0; op < SSD1306_OP_MAX; op++) {
+            total += stats.ops[op].transactions;
+        }
+        /* init sequence and display on after clearing RAM */
+        if (stats.ops[SSD1306_OP_RESET].transactions != 2 ||
+                stats.ops[SSD1306_OP_POWER].transactions != 2 ||
+                stats.ops[SSD1306_OP_FLUSH].transactions != 2 * stats.spans ||
+                stats.ops[SSD1306_OP_WRITE].transactions != 2 * stats.ops[SSD1306_OP_WRITE].calls ||
+                total != panel.transactions || panel.errors > 0 || !check_panel("ops", 0)) {
+            printf("FAIL%s ops:", async? " async": "");
+            for (op = 0; op < SSD1306_OP_MAX; op++) {
+                printf(" %s %u/%u", s_op_names[op], stats.ops[op].transactions, stats.ops[op].calls);
+            }
+            printf(", panel %u\n", panel.transactions);
+            s_failed++;
+        } else {
+            printf("ok   %sops: %u transactions\n", async? "async ": "", total);
+        }
+        close_device();
+    }
+}
+
+static void print_ops(const char *name, const ssd1306_stats_t *stats)
+{
+    int op;
+
+    for (op = 0; op < SSD1306_OP_MAX; op++) {
+        if (stats->ops[op].calls == 0) {
+            continue;
+        }
+        printf("%-12s %-6s %8u %8.1f %8.1f\n", name, s_op_names[op], stats->ops[op].calls,
+            (double)stats->ops[op].transactions / stats->ops[op].calls,
+            (double)stats->ops[op].bytes / stats->ops[op].calls);
+    }
+}
+
+static void bench_ops(void)
+{
+    ssd1306_stats_t stats;
+    int async, i;
+
+    printf("transactions per operation\n");
+    printf("%-12s %-6s %8s %8s %8s\n", "mode", "op", "calls", "trans", "bytes");
+    for (async = 0; async <= 1; async++) {
+        open_device(MODE_SHADOW, async);
+        memset(&s_device.stats, 0, sizeof(s_device.stats));
+        ssd1306_reset(&s_device);
+        ssd1306_sleep(&s_device);
+        ssd1306_on(&s_device);
+        for (i = 0; i < 3600; i++) {
+            draw_frame(i, true);
+            ssd1306_flush(&s_device);
+        }
+        for (i = 0; i < 128; i++) {
+            ssd1306_write(&s_device, i, i / 2, 1);
+        }
+        ssd1306_wait(&s_device);
+        ssd1306_get_stats(&s_device, &stats);
+        print_ops(async? "shadow async": "shadow", &stats);
+        close_device();
+    }
+}
+
+static void bench(void)
+{
+    const int frames = 24*3600;
+    const int gaps[] = { 0, 4, 8, 16, 32 };
+    replay_result_t full, result;
+    char name[32];
+    int date_line;
+    size_t i;
+
+    for (date_line = 0; date_line <= 1; date_line++) {
+        printf("24 hours of clock%s, %d frames\n", date_line? " and date line": "", frames);
+        printf("%-12s %8s %7s %8s %10s %10s\n", "mode", "bytes", "ratio", "trans", "bus usec", "cpu usec");
+        replay(MODE_FULL, false, -1, 0, frames, date_line, false, &full);
+        print_result("full", &full, &full);
+        replay(MODE_DIRTY, false, -1, 0, frames, date_line, false, &result);
+        print_result("dirty", &result, &full);
+        for (i = 0; i < sizeof(gaps)/sizeof(gaps[0]); i++) {
+            replay(MODE_SHADOW, false, gaps[i], 0, frames, date_line, false, &result);
+            snprintf(name, sizeof(name), "shadow/%d", gaps[i]);
+            print_result(name, &result, &full);
+        }
+        replay(MODE_SHADOW, true, -1, 0, frames, date_line, false, &result);
+        print_result("shadow async", &result, &full);
+    }
+    printf("per frame. bus usec is time on wire at clock of device without gaps between transactions,\n"
+        "cpu usec is time in ssd1306_flush on host.\n");
+    bench_ops();
+}
+
+int main(int argc, char *argv[])
+{
+    if (getenv("SIM_LOG_LEVEL") != NULL) {
+        sim_log_level = atoi(getenv("SIM_LOG_LEVEL"));
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+    test_modes();
+    test_unchanged();
+    test_write();
+    test_async_busy();
+    test_async_sleep();
+    test_op_counts();
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
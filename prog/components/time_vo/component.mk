@@ -0,0 +1,2 @@
+COMPONENT_NAME := time_vo
+COMPONENT_OBJS := time_vo.o
@@ -0,0 +1,96 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * phrase table of time_vo.bin, which tells voice files to say hour and minute.
+ *
+ * layout of version 2, all values are little endian:
+ * - header: magic "TMVO", u16 version, u16 number of names,
+ *   u16 size of string pool, u16 reserved, u32 CRC-32 of rest of file
+ * - phrases: (24 + 60) * @ref TIMEVO_MAX_LEN u8 name indices, 0xff terminates
+ * - names: u16 offset in string pool * number of names
+ * - string pool: NUL terminated names
+ *
+ * version 1 has no header and names are @ref TIMEVO_MAX_NAME + 1 bytes fixed length
+ * after phrases. it is still accepted.
+ */
+
+#define TIMEVO_MAX_NAME     15
+#define TIMEVO_MAX_LEN      8
+#define TIMEVO_MAGIC        0x4f564d54  /* "TMVO" */
+#define TIMEVO_VERSION      2
+
+/** error of @ref timevo_parse. */
+typedef enum {
+    TIMEVO_OK = 0,
+    TIMEVO_ERR_FORMAT = -1,     /**< broken or unknown layout */
+    TIMEVO_ERR_CHECKSUM = -2,   /**< CRC mismatch */
+    TIMEVO_ERR_NO_MEM = -3,     /**< failed to allocate string pool */
+} timevo_err_t;
+
+/** handle of a voice clip. offset of its name in string pool. */
+typedef uint16_t timevo_clip_t;
+
+/** list of clips to say an hour or a minute. */
+typedef struct {
+    uint8_t count;
+    timevo_clip_t clips[TIMEVO_MAX_LEN];
+} timevo_phrase_t;
+
+/** parsed time_vo.bin. */
+typedef struct {
+    timevo_phrase_t hours[24];
+    timevo_phrase_t mins[60];
+    char *pool;             /**< interned names */
+    uint16_t pool_size;
+} timevo_t;
+
+/**
+ * @brief parse whole time_vo.bin on memory.
+ * names are interned into pool so that each name is stored once.
+ * data can be released after this.
+ * @param[out] tv       parsed table. release with @ref timevo_free.
+ * @param[in] data      content of time_vo.bin.
+ * @param[in] size      size of data.
+ * @return TIMEVO_OK for success, other for error.
+ */
+extern timevo_err_t timevo_parse(timevo_t *tv, const void *data, uint32_t size);
+/**
+ * @brief release resources of table.
+ */
+extern void timevo_free(timevo_t *tv);
+/**
+ * @brief CRC-32 (IEEE 802.3) of data. used as checksum of version 2.
+ */
+extern uint32_t timevo_crc32(const void *data, uint32_t size);
+
+/** @brief name of clip. */
+static inline const char *timevo_clip_name(const timevo_t *tv, timevo_clip_t clip)
+{
+    return tv->pool + clip;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,182 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "time_vo.h"
+
+#define PHRASES         (24+60)
+#define PHRASES_SIZE    (PHRASES*TIMEVO_MAX_LEN)
+#define HEADER_SIZE     16
+#define V1_NAME_SIZE    (TIMEVO_MAX_NAME+1)
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t timevo_crc32(const void *data, uint32_t size)
+{
+    const uint8_t *p = data;
+    uint32_t crc = 0xffffffff;
+    int i;
+    while (size-- > 0) {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/* add name to pool unless it is already there. return offset or -1. */
+static int intern(timevo_t *tv, uint16_t capacity, const char *name, int len)
+{
+    int pos = 0;
+    while (pos < tv->pool_size) {
+        int n = strlen(tv->pool + pos);
+        if (n == len && memcmp(tv->pool + pos, name, len) == 0) {
+            return pos;
+        }
+        pos += n + 1;
+    }
+    if (tv->pool_size + len + 1 > capacity) {
+        return -1;
+    }
+    memcpy(tv->pool + pos, name, len);
+    tv->pool[pos + len] = '\0';
+    tv->pool_size += len + 1;
+    return pos;
+}
+
+/* build phrases from indices, mapping each name index to its interned clip. */
+static timevo_err_t build_phrases(timevo_t *tv, const uint8_t *indices,
+    const timevo_clip_t *clips, int count)
+{
+    int i, j;
+    for (i = 0; i < PHRASES; i++) {
+        timevo_phrase_t *phrase = i < 24? &tv->hours[i]: &tv->mins[i-24];
+        phrase->count = 0;
+        for (j = 0; j < TIMEVO_MAX_LEN; j++) {
+            uint8_t index = indices[i*TIMEVO_MAX_LEN+j];
+            if (index == 0xff) {
+                break;
+            }
+            if (index >= count) {
+                return TIMEVO_ERR_FORMAT;
+            }
+            phrase->clips[phrase->count++] = clips[index];
+        }
+    }
+    return TIMEVO_OK;
+}
+
+static timevo_err_t parse_v1(timevo_t *tv, const uint8_t *data, uint32_t size)
+{
+    timevo_clip_t clips[255];
+    const uint8_t *names = data + PHRASES_SIZE;
+    int count = (size - PHRASES_SIZE) / V1_NAME_SIZE;
+    int i;
+
+    if (count > 255) {
+        count = 255;
+    }
+    tv->pool = malloc(count * V1_NAME_SIZE);
+    if (tv->pool == NULL && count > 0) {
+        return TIMEVO_ERR_NO_MEM;
+    }
+    for (i = 0; i < count; i++) {
+        const char *name = (const char*)names + i*V1_NAME_SIZE;
+        int offset = intern(tv, count * V1_NAME_SIZE, name, strnlen(name, TIMEVO_MAX_NAME));
+        if (offset < 0) {
+            return TIMEVO_ERR_FORMAT;
+        }
+        clips[i] = offset;
+    }
+    return build_phrases(tv, data, clips, count);
+}
+
+static timevo_err_t parse_v2(timevo_t *tv, const uint8_t *data, uint32_t size)
+{
+    timevo_clip_t clips[255];
+    int count = get_u16(data + 6);
+    uint16_t pool_size = get_u16(data + 8);
+    const uint8_t *offsets = data + HEADER_SIZE + PHRASES_SIZE;
+    const char *pool = (const char*)offsets + count*2;
+    int i;
+
+    if (get_u16(data + 4) != TIMEVO_VERSION || count > 255 ||
+        (uint32_t)(HEADER_SIZE + PHRASES_SIZE + count*2 + pool_size) != size) {
+        return TIMEVO_ERR_FORMAT;
+    }
+    if (timevo_crc32(data + HEADER_SIZE, size - HEADER_SIZE) != get_u32(data + 12)) {
+        return TIMEVO_ERR_CHECKSUM;
+    }
+    tv->pool = malloc(pool_size);
+    if (tv->pool == NULL && pool_size > 0) {
+        return TIMEVO_ERR_NO_MEM;
+    }
+    for (i = 0; i < count; i++) {
+        uint16_t offset = get_u16(offsets + i*2);
+        int len, interned;
+        if (offset >= pool_size) {
+            return TIMEVO_ERR_FORMAT;
+        }
+        len = strnlen(pool + offset, pool_size - offset);
+        if (offset + len >= pool_size || len > TIMEVO_MAX_NAME) {
+            /* not terminated in pool */
+            return TIMEVO_ERR_FORMAT;
+        }
+        interned = intern(tv, pool_size, pool + offset, len);
+        if (interned < 0) {
+            return TIMEVO_ERR_FORMAT;
+        }
+        clips[i] = interned;
+    }
+    return build_phrases(tv, data + HEADER_SIZE, clips, count);
+}
+
+timevo_err_t timevo_parse(timevo_t *tv, const void *data, uint32_t size)
+{
+    const uint8_t *p = data;
+    timevo_err_t err;
+
+    memset(tv, 0, sizeof(*tv));
+    if (size >= HEADER_SIZE && get_u32(p) == TIMEVO_MAGIC) {
+        err = parse_v2(tv, p, size);
+    } else if (size >= PHRASES_SIZE) {
+        err = parse_v1(tv, p, size);
+    } else {
+        err = TIMEVO_ERR_FORMAT;
+    }
+    if (err != TIMEVO_OK) {
+        timevo_free(tv);
+    }
+    return err;
+}
+
+void timevo_free(timevo_t *tv)
+{
+    free(tv->pool);
+    tv->pool = NULL;
+    tv->pool_size = 0;
+}
@@ -0,0 +1,145 @@
+/* Copyright 2021 Kawashima Teruaki
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* host test of time_vo.c.
+ * usage: time_vo_test time_vo.bin time_vo.txt
+ * parses time_vo.bin made by tools/time_vo.pl and compares with time_vo.txt. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "time_vo.h"
+
+static int s_failed = 0;
+
+static void check(const char *name, int ok)
+{
+    if (!ok) {
+        printf("FAIL %s\n", name);
+        s_failed++;
+    } else {
+        printf("ok   %s\n", name);
+    }
+}
+
+static uint8_t *read_file(const char *path, uint32_t *size)
+{
+    FILE *fp = fopen(path, "rb");
+    uint8_t *data;
+    long n;
+    if (fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    data = malloc(n);
+    if (data != NULL && fread(data, 1, n, fp) != (size_t)n) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    *size = n;
+    return data;
+}
+
+/* compare phrase with names in line of time_vo.txt */
+static int match_phrase(const timevo_t *tv, const timevo_phrase_t *phrase, char *names)
+{
+    char *name, *save;
+    int i = 0;
+    for (name = strtok_r(names, " \t\r\n", &save); name != NULL; name = strtok_r(NULL, " \t\r\n", &save)) {
+        if (i >= phrase->count || strcmp(timevo_clip_name(tv, phrase->clips[i]), name) != 0) {
+            return 0;
+        }
+        i++;
+    }
+    return i == phrase->count;
+}
+
+static void test_text(const timevo_t *tv, const char *path)
+{
+    char line[256];
+    int n, matched = 0, lines = 0;
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        check("open text", 0);
+        return;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *names = strchr(line, ':');
+        if (names == NULL) {
+            continue;
+        }
+        lines++;
+        if (sscanf(line, "hour%d:", &n) == 1 && n >= 0 && n < 24) {
+            matched += match_phrase(tv, &tv->hours[n], names + 1);
+        } else if (sscanf(line, "min%d:", &n) == 1 && n >= 0 && n < 60) {
+            matched += match_phrase(tv, &tv->mins[n], names + 1);
+        }
+    }
+    fclose(fp);
+    check("phrases match text", lines == 24 + 60 && matched == lines);
+}
+
+static void test_pool(const timevo_t *tv)
+{
+    /* every name appears once in pool */
+    int pos, dup = 0;
+    for (pos = 0; pos < tv->pool_size; pos += strlen(tv->pool + pos) + 1) {
+        int other;
+        for (other = 0; other < pos; other += strlen(tv->pool + other) + 1) {
+            dup += strcmp(tv->pool + pos, tv->pool + other) == 0;
+        }
+    }
+    check("pool interned", dup == 0);
+}
+
+int main(int argc, char *argv[])
+{
+    timevo_t tv;
+    uint8_t *data;
+    uint32_t size;
+
+    check("crc32", timevo_crc32("123456789", 9) == 0xcbf43926);
+    if (argc < 3) {
+        printf("usage: %s time_vo.bin time_vo.txt\n", argv[0]);
+        return 1;
+    }
+    data = read_file(argv[1], &size);
+    if (data == NULL) {
+        printf("FAIL read %s\n", argv[1]);
+        return 1;
+    }
+    check("parse", timevo_parse(&tv, data, size) == TIMEVO_OK);
+    test_text(&tv, argv[2]);
+    test_pool(&tv);
+    timevo_free(&tv);
+
+    check("truncated", timevo_parse(&tv, data, size - 1) != TIMEVO_OK);
+    if (size > 16 && memcmp(data, "TMVO", 4) == 0) {
+        data[size - 2] ^= 1;
+        check("corrupted", timevo_parse(&tv, data, size) == TIMEVO_ERR_CHECKSUM);
+    }
+    free(data);
+
+    if (s_failed) {
+        printf("%d test(s) failed\n", s_failed);
+        return 1;
+    }
+    return 0;
+}
@@ -90,6 +90,8 @@ app_mode_t app_mode_clock(void)
     struct clock_mode_state state = { 0, 15, 8, };
     ESP_LOGD(TAG, "handle_clock");
     ESP_ERROR_CHECK( app_display_ensure_init() );
+    /* start staging announcement to say time without delay */
+    voice_ensure_init();
 
     app_display_ensure_reset();
     app_display_clear();
@@ -14,8 +14,13 @@
  */
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <sys/param.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
 #include <esp_wifi.h>
 #include <esp_http_server.h>
 #include <esp_err.h>
@@ -30,12 +35,17 @@
 #include <http_firmware_update_callbacks.h>
 #include <lan_manager.h>
 #include <audio.h>
+#include <audio_json.h>
+#include <json_str.h>
 #include <alarm.h>
 
 #include "app_event.h"
 #include "app_clock.h"
 #include "app_switches.h"
 #include "app_wifi.h"
+#include "storage.h"
+#include "sound.h"
+#include "voice.h"
 #include "misc.h"
 #include "app_mode.h"
 
@@ -45,6 +55,10 @@
 
 #define TAG "settings"
 
+#define ASSET_URI       "/asset"
+#define ASSET_BUF_SIZE  1024
+#define OCTET_STREAM_TYPE   "application/octet-stream"
+
 static bool s_is_updating = false, s_is_exiting = false;
 
 static enum firmware_update_result update_prestart(void)
@@ -60,11 +74,14 @@ static enum firmware_update_result update_prestart(void)
 static void update_started(void)
 {
     s_is_updating = true;
+    /* SPIFFS may be rewritten */
+    storage_invalidate();
     app_event_send_args(APP_EVENT_UPDATE, 0, 0);
 }
 static void update_finished(enum firmware_update_result result)
 {
     s_is_updating = false;
+    storage_invalidate();
     app_event_send_args(APP_EVENT_UPDATE, 1, result);
 }
 
@@ -107,6 +124,206 @@ esp_err_t http_index_unregister(httpd_handle_t handle)
     return ESP_OK;
 }
 
+static esp_err_t http_get_audio_stats_handler(httpd_req_t *req)
+{
+    audio_stats_t stats;
+    storage_cache_stats_t cache_stats;
+    audio_pool_stats_t sounds, alarms, phrases, heads;
+    voice_stats_t voice_stats;
+    json_str_t *json;
+    esp_err_t err;
+
+    json = new_json_str(1024);
+    if (json == NULL) {
+        return http_cmn_send_error_json(req, HTTP_CMN_FAIL);
+    }
+    audio_get_stats(&stats);
+    storage_get_cache_stats(&cache_stats);
+    sound_get_pool_stats(&sounds);
+    misc_get_alarm_pool_stats(&alarms);
+    voice_get_pool_stats(&phrases, &heads);
+    voice_get_stats(&voice_stats);
+    json_str_begin_object(json, NULL);
+    json_str_add_integer(json, "status", 1);
+    audio_stats_to_json(json, "audio", &stats);
+    json_str_begin_object(json, "wav_cache");
+    json_str_add_integer(json, "hits", cache_stats.hits);
+    json_str_add_integer(json, "misses", cache_stats.misses);
+    json_str_end_object(json);
+    /* pools of app next to beeps of audio */
+    json_str_begin_object(json, "pools");
+    audio_pool_stats_to_json(json, "sounds", &sounds);
+    audio_pool_stats_to_json(json, "alarms", &alarms);
+    audio_pool_stats_to_json(json, "phrases", &phrases);
+    audio_pool_stats_to_json(json, "heads", &heads);
+    json_str_end_object(json);
+    json_str_begin_object(json, "voice");
+    json_str_add_integer(json, "requests", voice_stats.requests);
+    json_str_add_integer(json, "hits", voice_stats.hits);
+    json_str_add_integer(json, "stages", voice_stats.stages);
+    json_str_add_integer(json, "stage_time_max", voice_stats.stage_time_max);
+    json_str_add_integer(json, "latency_count", voice_stats.latency_count);
+    json_str_add_integer(json, "latency_last", voice_stats.latency_last);
+    json_str_add_integer(json, "latency_min", voice_stats.latency_min);
+    json_str_add_integer(json, "latency_max", voice_stats.latency_max);
+    json_str_add_integer(json, "latency_mean", voice_stats.latency_count > 0?
+        (int)(voice_stats.latency_sum / voice_stats.latency_count): 0);
+    json_str_end_object(json);
+    json_str_end_object(json);
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    err = httpd_resp_sendstr(req, json_str_finalize(json));
+    delete_json_str(json);
+    return err;
+}
+
+static esp_err_t http_audio_stats_register(httpd_handle_t handle)
+{
+    esp_err_t err;
+
+    static httpd_uri_t http_uri;
+    http_uri.method = HTTP_GET;
+    http_uri.handler = http_get_audio_stats_handler;
+    http_uri.user_ctx = NULL;
+
+    http_uri.uri = "/audio_stats";
+    err = httpd_register_uri_handler(handle, &http_uri);
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_HANDLER_EXISTS) {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t send_asset_error_json(httpd_req_t *req, const char *status, const char *json)
+{
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    httpd_resp_sendstr(req, json);
+    return ESP_FAIL;
+}
+
+/* stream body into storage through fixed buffer. */
+static esp_err_t receive_asset(httpd_req_t *req, storage_upload_t *upload)
+{
+    char *buf;
+    int recv_size;
+    int remaining_size;
+    int64_t feedwdt_time;
+    esp_err_t err = ESP_OK;
+
+    buf = malloc(ASSET_BUF_SIZE);
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    feedwdt_time = esp_timer_get_time();
+    remaining_size = req->content_len;
+    while (remaining_size > 0) {
+        recv_size = MIN(remaining_size, ASSET_BUF_SIZE);
+        recv_size = httpd_req_recv(req, buf, recv_size);
+        if (recv_size <= 0) {
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+        err = storage_upload_write(upload, buf, recv_size);
+        if (err != ESP_OK) {
+            break;
+        }
+        remaining_size -= recv_size;
+        if (esp_timer_get_time() - feedwdt_time >= (CONFIG_TASK_WDT_TIMEOUT_S*1000000)/2) {
+            feedwdt_time = esp_timer_get_time();
+            vTaskDelay(1);
+        }
+    }
+    free(buf);
+    return err;
+}
+
+/* POST /asset?name=alarm1.wav replaces one wav file without rewriting whole SPIFFS. */
+static esp_err_t http_post_asset_handler(httpd_req_t *req)
+{
+    char query[48], name[36], content_type[sizeof(OCTET_STREAM_TYPE)+4];
+    storage_upload_t upload;
+    json_str_t *json;
+    int64_t start_time, elapsed;
+    esp_err_t err;
+
+    if (s_is_updating || s_is_exiting) {
+        return send_asset_error_json(req, "200 OK", "{\"status\":-1,\"message\":\"Busy\"}");
+    }
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "name", name, sizeof(name)) != ESP_OK) {
+        return send_asset_error_json(req, "400 Bad Request", "{\"status\":-1,\"message\":\"name is required\"}");
+    }
+    if (req->content_len == 0) {
+        return send_asset_error_json(req, "400 Bad Request", "{\"status\":-1,\"message\":\"Content-Length is required\"}");
+    }
+    if (httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type)) != ESP_OK ||
+        strcmp(content_type, OCTET_STREAM_TYPE) != 0) {
+        return send_asset_error_json(req, "400 Bad Request", "{\"status\":-1,\"message\":\"Unsupported Content-Type\"}");
+    }
+
+    err = storage_upload_begin(&upload, name, req->content_len);
+    if (err == ESP_ERR_INVALID_ARG) {
+        return send_asset_error_json(req, "400 Bad Request", "{\"status\":-1,\"message\":\"Invalid name\"}");
+    } else if (err == ESP_ERR_INVALID_SIZE) {
+        return http_cmn_send_error_json(req, HTTP_CMN_ERR_TOO_LARGE);
+    } else if (err != ESP_OK) {
+        return http_cmn_send_error_json(req, err);
+    }
+    ESP_LOGI(TAG, "Upload %s: %d bytes", name, (int)req->content_len);
+    start_time = esp_timer_get_time();
+    err = receive_asset(req, &upload);
+    if (err == ESP_OK) {
+        /* playing audio may be reading old file */
+        if (audio_is_playing()) {
+            audio_stop();
+        }
+        err = storage_upload_end(&upload);
+    }
+    storage_upload_abort(&upload);
+    elapsed = esp_timer_get_time() - start_time;
+    if (err == ESP_ERR_INVALID_ARG) {
+        return send_asset_error_json(req, "400 Bad Request", "{\"status\":-1,\"message\":\"Invalid WAV\"}");
+    } else if (err == ESP_ERR_TIMEOUT) {
+        return http_cmn_send_error_json(req, HTTP_CMN_ERR_SOCK_TIMEOUT);
+    } else if (err != ESP_OK) {
+        return http_cmn_send_error_json(req, err);
+    }
+
+    json = new_json_str(128);
+    if (json == NULL) {
+        return http_cmn_send_error_json(req, HTTP_CMN_FAIL);
+    }
+    json_str_begin_object(json, NULL);
+    json_str_add_integer(json, "status", 1);
+    json_str_add_string(json, "name", name);
+    json_str_add_integer(json, "size", upload.size);
+    json_str_add_integer(json, "elapsed", elapsed);
+    json_str_end_object(json);
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    err = httpd_resp_sendstr(req, json_str_finalize(json));
+    delete_json_str(json);
+    return err;
+}
+
+static esp_err_t http_asset_register(httpd_handle_t handle)
+{
+    esp_err_t err;
+
+    static httpd_uri_t http_uri;
+    http_uri.method = HTTP_POST;
+    http_uri.handler = http_post_asset_handler;
+    http_uri.user_ctx = NULL;
+
+    http_uri.uri = ASSET_URI;
+    err = httpd_register_uri_handler(handle, &http_uri);
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_HANDLER_EXISTS) {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
 static void start_settings_httpd(httpd_handle_t *httpd)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
@@ -125,6 +342,8 @@ static void start_settings_httpd(httpd_handle_t *httpd)
     ESP_ERROR_CHECK( http_alarm_conf_register(*httpd) );
     ESP_ERROR_CHECK( http_clock_conf_register(*httpd) );
     ESP_ERROR_CHECK( http_firmware_register(*httpd) );
+    ESP_ERROR_CHECK( http_audio_stats_register(*httpd) );
+    ESP_ERROR_CHECK( http_asset_register(*httpd) );
     http_firmware_set_update_callbacks(&update_callbacks);
 }
 
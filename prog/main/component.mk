@@ -9,4 +9,3 @@ COMPONENT_EMBED_FILES += gen/nvskey.dat
 COMPONENT_EMBED_FILES += gen/font_shinonome14.fnt
 COMPONENT_EMBED_FILES += gen/font_shinonome12.fnt
 COMPONENT_EMBED_FILES += html/index.html
-COMPONENT_EMBED_FILES += data/alarm.wav
@@ -23,7 +23,9 @@
 #include <clock_conf.h>
 #include <alarm.h>
 #include <audio.h>
-#include <riffwave.h>
+#include <audio_pool.h>
+#include <audio_synth.h>
+#include <audio_note.h>
 #include <simple_wifi_event.h>
 #include <lan_manager.h>
 #if CONFIG_USE_SYSLOG
@@ -47,6 +49,35 @@ static time_t s_task_check_time = 0;
 static uint8_t s_playing_alarm = 0;
 static struct alarm s_alarm;
 
+/* default alarm is generated at output rate of audio not to be resampled */
+#ifdef CONFIG_AUDIO_OUTPUT_SAMPLE_RATE
+#define ALARM_SAMPLE_RATE   CONFIG_AUDIO_OUTPUT_SAMPLE_RATE
+#else
+#define ALARM_SAMPLE_RATE   16000
+#endif
+
+/* four short buzzes and a pause, repeated for about 15 sec */
+static const audio_melody_note_t s_default_alarm_notes[] = {
+    { NOTE_C7, 100, AUDIO_ENV_FLAT, 160 },
+    { 0, 50, AUDIO_ENV_FLAT, 0 },
+    { NOTE_C7, 100, AUDIO_ENV_FLAT, 160 },
+    { 0, 50, AUDIO_ENV_FLAT, 0 },
+    { NOTE_C7, 100, AUDIO_ENV_FLAT, 160 },
+    { 0, 50, AUDIO_ENV_FLAT, 0 },
+    { NOTE_C7, 100, AUDIO_ENV_FLAT, 160 },
+    { 0, 650, AUDIO_ENV_FLAT, 0 },
+};
+
+static const audio_melody_t s_default_alarm = {
+    s_default_alarm_notes,
+    sizeof(s_default_alarm_notes) / sizeof(s_default_alarm_notes[0]),
+    AUDIO_WAVE_SOFT_SQUARE,
+    12,
+};
+
+/* default alarm is played one at a time */
+AUDIO_POOL_DEFINE(alarm_pool, audio_melody_player_t, 1)
+
 #if CONFIG_USE_SYSLOG
 void misc_ensure_init_udplog(void)
 {
@@ -166,13 +197,14 @@ static void on_notify_end(void)
 
 static int misc_play_data_func(void *arg, void *data, int *size)
 {
+    audio_melody_player_t *player = (audio_melody_player_t*)arg;
     if (data == NULL && size == NULL) {
-        audio_wav_data_func(arg, NULL, NULL);
         on_notify_end();
-        free(arg);
+        alarm_pool_release(player);
         return 0;
     }
-    return audio_wav_data_func(arg, data, size);
+    *size = audio_melody_render(player, (int16_t*)data, *size/2) * 2;
+    return !audio_melody_finished(player);
 }
 
 bool misc_is_playing_alarm(void)
@@ -180,6 +212,11 @@ bool misc_is_playing_alarm(void)
     return s_playing_alarm > 0;
 }
 
+void misc_get_alarm_pool_stats(audio_pool_stats_t *stats)
+{
+    audio_pool_get_stats(&alarm_pool, stats);
+}
+
 void misc_play_alarm(const struct alarm *alarm)
 {
     char name[16];
@@ -192,7 +229,7 @@ void misc_play_alarm(const struct alarm *alarm)
     snprintf(name, sizeof(name), "alarm%d.wav", s_alarm.alarm_id);
     err = sound_play_repeat_notify(name, 15*1000, on_notify_end);
     if (err != ESP_OK) {
-        /* failed to play alarm in spiffs. fallback to wav embedded in program */
+        /* failed to play alarm in spiffs. fallback to tone generated by program */
         misc_play_default_alarm();
     } else {
         s_playing_alarm++;
@@ -201,11 +238,11 @@ void misc_play_alarm(const struct alarm *alarm)
 
 void misc_play_default_alarm(void)
 {
-    extern const uint8_t alarm_start[] asm("_binary_alarm_wav_start");
-    extern const uint8_t alarm_end[] asm("_binary_alarm_wav_end");
-    const uint32_t alarm_size = alarm_end - alarm_start;
-    struct wav_play_info *info;
-    struct wav_info *wav_info;
+    audio_play_opts_t opts = {
+        .gain = AUDIO_GAIN_UNITY,
+        .profile = AUDIO_PROFILE_THROUGHPUT,
+    };
+    audio_melody_player_t *player;
     esp_err_t err;
 
     if (s_playing_alarm) {
@@ -216,21 +253,13 @@ void misc_play_default_alarm(void)
         ESP_LOGE(TAG, "failed to init audio: %d", err);
         return;
     }
-    info = malloc(sizeof(struct wav_play_info));
-    if (info == NULL) {
-        ESP_LOGE(TAG, "failed to allocate memory");
-        return;
-    }
-    err = audio_wav_play_init(info, alarm_start, alarm_size);
-    if (err != ESP_OK) {
-        free(info);
-        ESP_LOGE(TAG, "failed to parse default alarm.wav");
+    player = alarm_pool_acquire();
+    if (player == NULL) {
+        ESP_LOGE(TAG, "default alarm is still playing");
         return;
     }
-    wav_info = &info->wav_info;
-    info->offset = 0;
-    info->playsize = wav_info_duration_to_bytes(15000, wav_info);
-    audio_wav_play(info, misc_play_data_func);
+    audio_melody_start(player, &s_default_alarm, ALARM_SAMPLE_RATE);
+    audio_play_ex(misc_play_data_func, player, ALARM_SAMPLE_RATE, 1, 16, AUDIO_ENQUEUE, &opts);
     s_playing_alarm++;
 }
 
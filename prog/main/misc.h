@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include <vcc.h>
 #include <alarm.h>
+#include <audio_pool.h>
 
 #include "app_event.h"
 
@@ -38,6 +39,7 @@ extern bool misc_process_time_task(void);
 extern void misc_handle_event(const app_event_t *event);
 
 extern bool misc_is_playing_alarm(void);
+extern void misc_get_alarm_pool_stats(audio_pool_stats_t *stats);
 extern void misc_play_alarm(const struct alarm *alarm);
 extern void misc_play_default_alarm(void);
 extern esp_err_t misc_beep(int duration);
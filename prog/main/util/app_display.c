@@ -38,6 +38,8 @@ static const ssd1306_param_t s_param = {
     },
     .dc = GPIO_NUM_22,
     .reset = GPIO_NUM_19,
+    .use_shadow = true,
+    .async_flush = true,
 };
 
 static lcd_ssd1306_t s_lcd = {};
@@ -121,10 +123,19 @@ void app_display_off(void)
 void app_display_clear(void)
 {
     memset(s_device.buffer, 0, s_device.buffer_size);
+    ssd1306_set_dirty_all(&s_device);
 }
 
 void app_display_update(void)
 {
+    ssd1306_stats_t stats;
+
     ssd1306_flush(&s_device);
     app_display_on();
+    ssd1306_get_stats(&s_device, &stats);
+    if (stats.flushes > 0 && stats.flushes % 60 == 0 && stats.last_bytes > 0) {
+        ESP_LOGD(TAG, "flush: %u bytes/frame avg, %d usec/frame avg, last %u bytes %d usec, %u skipped",
+            stats.bytes / stats.flushes, (int)(stats.time / stats.flushes),
+            stats.last_bytes, stats.last_time, stats.skipped);
+    }
 }
@@ -22,6 +22,7 @@
 
 #include <clock.h>
 #include <audio.h>
+#include <audio_pool.h>
 #include <riffwave.h>
 
 #include "storage.h"
@@ -30,6 +31,8 @@
 #define TAG "sound"
 
 #define ERR_UNSET   -2
+/* playback at least this long uses throughput profile of audio */
+#define SOUND_LONG_PLAY_MS  5000
 
 struct sound_play_info {
     struct wav_play_info base;
@@ -41,6 +44,8 @@ static esp_err_t s_init_err = ERR_UNSET;
 
 static uint8_t s_sound_play_count = 0;
 
+AUDIO_POOL_DEFINE(sound_pool, struct sound_play_info, AUDIO_MAX_ITEMS)
+
 static int sound_play_file_func(void *arg, void *data, int *size)
 {
     struct sound_play_info *play_info = (struct sound_play_info *)arg;
@@ -55,7 +60,7 @@ static int sound_play_file_func(void *arg, void *data, int *size)
         if (play_info->notify_end_func != NULL) {
             play_info->notify_end_func();
         }
-        free(play_info);
+        sound_pool_release(play_info);
         s_sound_play_count--;
         return 0;
     }
@@ -95,6 +100,9 @@ esp_err_t sound_ensure_init(void)
 
 esp_err_t sound_play_repeat_notify(const char *name, int duration, void (*notify_end_func)(void))
 {
+    audio_play_opts_t opts = {
+        .gain = AUDIO_GAIN_UNITY,
+    };
     struct sound_play_info *play_info;
     struct wav_play_info *base;
     struct wav_info *wav_info;
@@ -103,34 +111,29 @@ esp_err_t sound_play_repeat_notify(const char *name, int duration, void (*notify
     if (name == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-    if (s_sound_play_count > 64) {
-        ESP_LOGW(TAG, "queued too many sounds: %d", s_sound_play_count);
-        return ESP_ERR_INVALID_STATE;
-    }
-
     err = sound_ensure_init();
     if (err != ESP_OK) {
         return ESP_FAIL;
     }
 
-    play_info = malloc(sizeof(struct sound_play_info));
+    play_info = sound_pool_acquire();
     if (play_info == NULL) {
-        return ESP_ERR_NO_MEM;
+        ESP_LOGW(TAG, "queued too many sounds: %d", s_sound_play_count);
+        return ESP_ERR_INVALID_STATE;
     }
     base = &play_info->base;
 
     strcpy(play_info->path, CONFIG_STORAGE_BASE_PATH "/");
     strlcat(play_info->path, name, sizeof(play_info->path));
-    err = storage_wav_open(play_info->path, base);
+    /* parse header without keeping FD. file is opened when played */
+    wav_info = &base->wav_info;
+    err = storage_wav_get_info(play_info->path, wav_info);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "wav open error: %s: %d", play_info->path, err);
-        free(play_info);
+        sound_pool_release(play_info);
         return ESP_FAIL;
     }
-    /* close FILE to save FD */
-    storage_wav_close(base);
-
-    wav_info = &base->wav_info;
+    base->wav_data = NULL;
     base->offset = 0;
     if (duration < 0) {
         /* count to size */
@@ -144,7 +147,11 @@ esp_err_t sound_play_repeat_notify(const char *name, int duration, void (*notify
         play_info->path, wav_info->data_length,
         (long)wav_info_bytes_to_duration(wav_info->data_length, wav_info));
     s_sound_play_count++;
-    audio_wav_play(base, sound_play_file_func);
+    /* long playback like alarm is buffered deeper not to stutter while wifi is busy */
+    opts.profile = wav_info_bytes_to_duration(base->playsize, wav_info) >= SOUND_LONG_PLAY_MS?
+        AUDIO_PROFILE_THROUGHPUT: AUDIO_PROFILE_DEFAULT;
+    audio_play_ex(sound_play_file_func, base,
+        wav_info->samplerate, wav_info->channels, wav_info->bits, AUDIO_ENQUEUE, &opts);
     return ESP_OK;
 }
 
@@ -158,6 +165,11 @@ esp_err_t sound_play(const char *name)
     return sound_play_repeat(name, -1);
 }
 
+void sound_get_pool_stats(audio_pool_stats_t *stats)
+{
+    audio_pool_get_stats(&sound_pool, stats);
+}
+
 bool sound_is_playing(void)
 {
     return s_sound_play_count > 0 || audio_is_playing();
@@ -165,8 +177,6 @@ bool sound_is_playing(void)
 
 void sound_stop(void)
 {
+    /* play done of all sounds is notified before audio_stop returns */
     audio_stop();
-    while (sound_is_playing()) {
-        vTaskDelay(100 / portTICK_PERIOD_MS);
-    }
 }
@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include <time.h>
 #include <esp_err.h>
+#include <audio_pool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +30,7 @@ extern esp_err_t sound_play_repeat_notify(const char *name, int duration,
 extern esp_err_t sound_play_repeat(const char *name, int duration);
 extern esp_err_t sound_play(const char *name);
 extern bool sound_is_playing(void);
+extern void sound_get_pool_stats(audio_pool_stats_t *stats);
 extern void sound_stop(void);
 
 #ifdef __cplusplus
@@ -14,7 +14,12 @@
  */
 
 #include <sys/stat.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <esp_spiffs.h>
 #include <esp_err.h>
 #include <esp_log.h>
@@ -25,6 +30,104 @@
 
 #define TAG "storage"
 
+#ifdef CONFIG_SPIFFS_OBJ_NAME_LEN
+#define SPIFFS_NAME_LEN CONFIG_SPIFFS_OBJ_NAME_LEN
+#else
+#define SPIFFS_NAME_LEN 32
+#endif
+
+/* SPIFFS cannot rename over existing file, so upload is written here first */
+#define UPLOAD_TMP_NAME "upload.tmp"
+
+#ifdef CONFIG_STORAGE_WAV_CACHE_SIZE
+#define WAV_CACHE_SIZE  CONFIG_STORAGE_WAV_CACHE_SIZE
+#else
+#define WAV_CACHE_SIZE  8
+#endif
+
+/* parsed header of a file. valid while generation matches. */
+struct wav_cache_entry {
+    char path[40];
+    uint32_t generation;
+    uint32_t last_used;
+    struct wav_info info;
+};
+
+static struct wav_cache_entry s_wav_cache[WAV_CACHE_SIZE];
+static SemaphoreHandle_t s_wav_cache_mutex;
+/* starts from 1 so that zero cleared entries are invalid */
+static uint32_t s_generation = 1;
+static uint32_t s_wav_cache_tick = 0;
+static storage_cache_stats_t s_wav_cache_stats;
+static const char *s_base_path = CONFIG_STORAGE_BASE_PATH;
+static const char *s_partition = CONFIG_STORAGE_PARTITION_NAME;
+
+static bool wav_cache_get(const char *path, struct wav_info *info)
+{
+    bool hit = false;
+    int i;
+    if (s_wav_cache_mutex == NULL) {
+        return false;
+    }
+    xSemaphoreTake(s_wav_cache_mutex, portMAX_DELAY);
+    for (i = 0; i < WAV_CACHE_SIZE; i++) {
+        struct wav_cache_entry *entry = &s_wav_cache[i];
+        if (entry->generation == s_generation && strcmp(entry->path, path) == 0) {
+            entry->last_used = ++s_wav_cache_tick;
+            *info = entry->info;
+            hit = true;
+            break;
+        }
+    }
+    if (hit) {
+        s_wav_cache_stats.hits++;
+    } else {
+        s_wav_cache_stats.misses++;
+    }
+    xSemaphoreGive(s_wav_cache_mutex);
+    return hit;
+}
+
+static void wav_cache_put(const char *path, const struct wav_info *info, uint32_t generation)
+{
+    struct wav_cache_entry *victim = &s_wav_cache[0];
+    int i;
+    if (s_wav_cache_mutex == NULL || strlen(path) >= sizeof(victim->path)) {
+        return;
+    }
+    xSemaphoreTake(s_wav_cache_mutex, portMAX_DELAY);
+    /* file may be updated while parsing */
+    if (generation == s_generation) {
+        for (i = 0; i < WAV_CACHE_SIZE; i++) {
+            struct wav_cache_entry *entry = &s_wav_cache[i];
+            if (entry->generation != s_generation) {
+                victim = entry;
+                break;
+            }
+            if (entry->last_used < victim->last_used) {
+                victim = entry;
+            }
+        }
+        strcpy(victim->path, path);
+        victim->generation = generation;
+        victim->last_used = ++s_wav_cache_tick;
+        victim->info = *info;
+    }
+    xSemaphoreGive(s_wav_cache_mutex);
+}
+
+static void wav_cache_remove(const char *path)
+{
+    int i;
+    xSemaphoreTake(s_wav_cache_mutex, portMAX_DELAY);
+    for (i = 0; i < WAV_CACHE_SIZE; i++) {
+        if (strcmp(s_wav_cache[i].path, path) == 0) {
+            s_wav_cache[i].generation = 0;
+        }
+    }
+    xSemaphoreGive(s_wav_cache_mutex);
+}
+
 esp_err_t storage_init(const char *base_path, const char *partition)
 {
     esp_vfs_spiffs_conf_t conf = {
@@ -37,6 +140,14 @@ esp_err_t storage_init(const char *base_path, const char *partition)
 
     ESP_LOGI(TAG, "Initializing SPIFFS");
 
+    if (s_wav_cache_mutex == NULL) {
+        s_wav_cache_mutex = xSemaphoreCreateMutex();
+        if (s_wav_cache_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    storage_invalidate();
+
     if (base_path == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
@@ -44,6 +155,9 @@ esp_err_t storage_init(const char *base_path, const char *partition)
         return ESP_ERR_INVALID_ARG;
     }
 
+    s_base_path = base_path;
+    s_partition = partition;
+
     /* Use settings defined above to initialize and mount SPIFFS filesystem.
      * Note: esp_vfs_spiffs_register is an all-in-one convenience function. */
     ret = esp_vfs_spiffs_register(&conf);
@@ -60,22 +174,16 @@ esp_err_t storage_init(const char *base_path, const char *partition)
     return ret;
 }
 
-esp_err_t storage_wav_open(const char *path, struct wav_play_info *info)
+/* open and parse file. fp is left open if not NULL. */
+static esp_err_t wav_parse_file(const char *path, struct wav_info *info, FILE **fp_out)
 {
-    char header[80];
+    char header[STORAGE_WAV_HEADER_SIZE];
     struct stat st;
     FILE *fp;
     int rsize;
+    uint32_t generation = s_generation;
     esp_err_t err;
 
-    if (path == NULL) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    if (info == NULL) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    info->wav_data = NULL;
-
     if (stat(path, &st) != 0) {
         ESP_LOGE(TAG, "No file: %s", path);
         return ESP_ERR_NOT_FOUND;
@@ -92,15 +200,62 @@ esp_err_t storage_wav_open(const char *path, struct wav_play_info *info)
         fclose(fp);
         return ESP_FAIL;
     }
-    err = audio_wav_parse(header, rsize, st.st_size, &info->wav_info);
+    err = audio_wav_parse(header, rsize, st.st_size, info);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Parse header error: %s: %d", path, err);
         fclose(fp);
         return ESP_FAIL;
     }
+    wav_cache_put(path, info, generation);
+    if (fp_out != NULL) {
+        *fp_out = fp;
+    } else {
+        fclose(fp);
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_wav_get_info(const char *path, struct wav_info *info)
+{
+    if (path == NULL || info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (wav_cache_get(path, info)) {
+        return ESP_OK;
+    }
+    return wav_parse_file(path, info, NULL);
+}
+
+esp_err_t storage_wav_open(const char *path, struct wav_play_info *info)
+{
+    FILE *fp = NULL;
+    esp_err_t err;
+
+    if (path == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    info->wav_data = NULL;
+
+    if (wav_cache_get(path, &info->wav_info)) {
+        fp = fopen(path, "r");
+        if (fp == NULL) {
+            /* removed since cached */
+            wav_cache_remove(path);
+        }
+    }
+    if (fp == NULL) {
+        err = wav_parse_file(path, &info->wav_info, &fp);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
 
     info->offset = 0;
     info->playsize = info->wav_info.data_length;
+    memset(&info->adpcm, 0, sizeof(info->adpcm));
     info->data_func = storage_wav_copy_data_func;
     info->wav_data = fp;
     return ESP_OK;
@@ -119,13 +274,14 @@ esp_err_t storage_wav_read(struct wav_play_info *info, uint32_t offset, void *da
     if (data == NULL || length == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
-    if (offset >= info->wav_info.data_length) {
-        ESP_LOGE(TAG, "Offset exceeds data length: %u/%u", offset, info->wav_info.data_length);
+    /* offset is of coded data, which differs from data_length when compressed */
+    if (offset >= info->wav_info.coded_length) {
+        ESP_LOGE(TAG, "Offset exceeds data length: %u/%u", offset, info->wav_info.coded_length);
         return ESP_ERR_INVALID_ARG;
     }
     fp = (FILE*)info->wav_data;
     n = *length;
-    m = info->wav_info.data_length - offset;
+    m = info->wav_info.coded_length - offset;
     if (n > m) {
         n = m;
     }
@@ -155,3 +311,175 @@ int storage_wav_copy_data_func(struct wav_play_info *info, int offset, void *dat
     }
     return length;
 }
+
+void storage_invalidate(void)
+{
+    __atomic_add_fetch(&s_generation, 1, __ATOMIC_RELAXED);
+}
+
+uint32_t storage_generation(void)
+{
+    return __atomic_load_n(&s_generation, __ATOMIC_RELAXED);
+}
+
+void storage_get_cache_stats(storage_cache_stats_t *stats)
+{
+    if (s_wav_cache_mutex == NULL) {
+        *stats = s_wav_cache_stats;
+        return;
+    }
+    xSemaphoreTake(s_wav_cache_mutex, portMAX_DELAY);
+    *stats = s_wav_cache_stats;
+    xSemaphoreGive(s_wav_cache_mutex);
+}
+
+static bool is_valid_upload_name(const char *name)
+{
+    size_t len = strlen(name);
+    size_t i;
+    /* path must fit wav cache entry, and object name of SPIFFS */
+    if (len <= 4 || len + strlen(s_base_path) + 1 >= sizeof(((struct wav_cache_entry*)0)->path) ||
+        len + 2 > SPIFFS_NAME_LEN) {
+        return false;
+    }
+    if (name[0] == '.' || strcmp(name + len - 4, ".wav") != 0) {
+        return false;
+    }
+    for (i = 0; i < len; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == '_' || c == '-' || c == '.')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void upload_tmp_path(char *path, size_t size)
+{
+    snprintf(path, size, "%s/" UPLOAD_TMP_NAME, s_base_path);
+}
+
+esp_err_t storage_upload_begin(storage_upload_t *upload, const char *name, uint32_t size)
+{
+    char tmp_path[48];
+    size_t total, used;
+    esp_err_t err;
+
+    memset(upload, 0, sizeof(*upload));
+    if (name == NULL || !is_valid_upload_name(name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (size < MIN_RIFFWAVE_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    snprintf(upload->path, sizeof(upload->path), "%s/%s", s_base_path, name);
+    upload->size = size;
+    /* left by interrupted upload */
+    upload_tmp_path(tmp_path, sizeof(tmp_path));
+    unlink(tmp_path);
+    /* old file is kept until new one is complete */
+    err = esp_spiffs_info(s_partition, &total, &used);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (used + size > total) {
+        ESP_LOGE(TAG, "No room for %s: %u bytes, %u free", name, size, (unsigned)(total - used));
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t upload_put(storage_upload_t *upload, const void *data, uint32_t size)
+{
+    if (size == 0) {
+        return ESP_OK;
+    }
+    if (fwrite(data, 1, size, upload->fp) != size) {
+        ESP_LOGE(TAG, "Write error: %s", upload->path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t storage_upload_write(storage_upload_t *upload, const void *data, uint32_t size)
+{
+    char tmp_path[48];
+    struct wav_info info;
+    uint32_t header_size, n;
+    esp_err_t err;
+
+    if (size > upload->size - upload->received) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    upload->received += size;
+    if (upload->fp != NULL) {
+        return upload_put(upload, data, size);
+    }
+
+    /* collect head of file and validate it same as wav_parse_file does on play */
+    header_size = upload->size < sizeof(upload->header)? upload->size: sizeof(upload->header);
+    n = header_size - upload->header_len;
+    if (n > size) {
+        n = size;
+    }
+    memcpy(upload->header + upload->header_len, data, n);
+    upload->header_len += n;
+    if (upload->header_len < header_size) {
+        return ESP_OK;
+    }
+    err = audio_wav_parse(upload->header, upload->header_len, upload->size, &info);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Parse header error: %s: %d", upload->path, err);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    upload_tmp_path(tmp_path, sizeof(tmp_path));
+    upload->fp = fopen(tmp_path, "w");
+    if (upload->fp == NULL) {
+        ESP_LOGE(TAG, "Open error: %s", tmp_path);
+        return ESP_FAIL;
+    }
+    err = upload_put(upload, upload->header, upload->header_len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return upload_put(upload, (const uint8_t*)data + n, size - n);
+}
+
+esp_err_t storage_upload_end(storage_upload_t *upload)
+{
+    char tmp_path[48];
+    int ret;
+
+    if (upload->fp == NULL || upload->received != upload->size) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ret = fclose(upload->fp);
+    upload->fp = NULL;
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Write error: %s", upload->path);
+        return ESP_FAIL;
+    }
+    upload_tmp_path(tmp_path, sizeof(tmp_path));
+    /* file is missing only between unlink and rename */
+    unlink(upload->path);
+    if (rename(tmp_path, upload->path) != 0) {
+        ESP_LOGE(TAG, "Rename error: %s", upload->path);
+        return ESP_FAIL;
+    }
+    storage_invalidate();
+    ESP_LOGI(TAG, "Updated %s: %u bytes", upload->path, upload->size);
+    return ESP_OK;
+}
+
+void storage_upload_abort(storage_upload_t *upload)
+{
+    char tmp_path[48];
+    if (upload->fp != NULL) {
+        fclose(upload->fp);
+        upload->fp = NULL;
+    }
+    upload_tmp_path(tmp_path, sizeof(tmp_path));
+    unlink(tmp_path);
+}
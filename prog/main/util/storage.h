@@ -16,6 +16,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
 #include <esp_err.h>
 
 #include <riffwave.h>
@@ -30,12 +31,51 @@ extern "C" {
 #ifndef CONFIG_STORAGE_PARTITION_NAME
 #define CONFIG_STORAGE_PARTITION_NAME   "storage"
 #endif
+#ifndef CONFIG_STORAGE_AUDIO_PARTITION_NAME
+#define CONFIG_STORAGE_AUDIO_PARTITION_NAME "audio"
+#endif
+
+/* size of head of wav file parsed to get header */
+#define STORAGE_WAV_HEADER_SIZE 80
+
+/** state of streaming one file into storage. see storage_upload_begin. */
+typedef struct {
+    FILE *fp;
+    char path[40];
+    uint32_t size;
+    uint32_t received;
+    /* head of file is held until header is validated, so invalid file never touches flash */
+    uint32_t header_len;
+    uint8_t header[STORAGE_WAV_HEADER_SIZE];
+} storage_upload_t;
+
+/** hit/miss counts of parsed wav header cache. */
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+} storage_cache_stats_t;
 
 extern esp_err_t storage_init(const char *base_path, const char *partition);
+/* get parsed header of wav file. cached by path. */
+extern esp_err_t storage_wav_get_info(const char *path, struct wav_info *info);
 extern esp_err_t storage_wav_open(const char *path, struct wav_play_info *info);
 extern esp_err_t storage_wav_read(struct wav_play_info *info, uint32_t offset, void *data, uint32_t *length);
 extern void storage_wav_close(struct wav_play_info *info);
 extern int storage_wav_copy_data_func(struct wav_play_info *info, int offset, void *data, int size);
+/* bump generation to drop cached headers. call when files in storage are updated. */
+extern void storage_invalidate(void);
+extern uint32_t storage_generation(void);
+extern void storage_get_cache_stats(storage_cache_stats_t *stats);
+/* replace or add a wav file by streaming. name is a plain file name like "alarm1.wav".
+ * data is written to temporary file and renamed to name by storage_upload_end.
+ * returns ESP_ERR_INVALID_ARG for bad name, ESP_ERR_INVALID_SIZE if no room. */
+extern esp_err_t storage_upload_begin(storage_upload_t *upload, const char *name, uint32_t size);
+/* returns ESP_ERR_INVALID_ARG if header is not a playable wav, or exceeds size. */
+extern esp_err_t storage_upload_write(storage_upload_t *upload, const void *data, uint32_t size);
+/* rename to name after all bytes are written, and invalidate cached headers. */
+extern esp_err_t storage_upload_end(storage_upload_t *upload);
+/* discard temporary file. safe to call after end or failure. */
+extern void storage_upload_abort(storage_upload_t *upload);
 
 #ifdef __cplusplus
 }
@@ -14,15 +14,22 @@
  */
 
 #include <time.h>
+#include <stdlib.h>
 #include <string.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 
 #include <clock.h>
 #include <audio.h>
+#include <audio_asset.h>
+#include <audio_bank.h>
+#include <audio_pool.h>
 #include <riffwave.h>
+#include <time_vo.h>
 
 #include "storage.h"
 #include "sound.h"
@@ -32,75 +39,401 @@
 
 #define TIMEVO_FILE     CONFIG_STORAGE_BASE_PATH "/time_vo.bin"
 
-#define TIMEVO_MAX_NAME     15
-#define TIMEVO_MAX_LEN       8
+#ifdef CONFIG_VOICE_PREFETCH_MS
+#define VOICE_PREFETCH_MS       CONFIG_VOICE_PREFETCH_MS
+#else
+#define VOICE_PREFETCH_MS       300
+#endif
+#ifdef CONFIG_VOICE_PREFETCH_LEAD
+#define VOICE_PREFETCH_LEAD     CONFIG_VOICE_PREFETCH_LEAD
+#else
+#define VOICE_PREFETCH_LEAD     5
+#endif
+
+/* head of voice decoded in RAM, as 16bit mono at 16kHz. shorter for higher rate */
+#define VOICE_HEAD_SIZE         (VOICE_PREFETCH_MS * 16 * 2)
+/* a stage for current and next minute, and one being played */
+#define VOICE_POOL_SIZE         3
 
 #define ERR_UNSET   -2
 
-struct timevo {
-    uint8_t indices[TIMEVO_MAX_LEN];
+/* phrase resolved in voice bank. released when play is done. */
+struct voice_phrase {
+    audio_bank_play_t play;
+    audio_bank_range_t ranges[TIMEVO_MAX_LEN*2];
+    int64_t request_time;   /* when say was requested, 0 after first sample */
+};
+
+/* first file of phrase whose head is decoded in RAM. released when play is done. */
+struct voice_head {
+    struct wav_play_info base;
+    char path[40];
+    int64_t request_time;
+    uint32_t pos;
+    uint32_t size;
+    uint8_t buf[VOICE_HEAD_SIZE];
 };
 
-struct timevo_name {
-    char name[TIMEVO_MAX_NAME+1];
+/* announcement staged for a minute. */
+struct voice_stage {
+    time_t minute;          /* time/60 of the announcement, -1 if empty */
+    bool taken;             /* played already. kept so that minute is not staged again */
+    int count;
+    const char *names[TIMEVO_MAX_LEN*2];
+    struct voice_phrase *phrase;    /* resolved in voice bank, or NULL */
+    struct voice_head *head;        /* head of first file, or NULL */
 };
 
+AUDIO_POOL_DEFINE(phrase_pool, struct voice_phrase, VOICE_POOL_SIZE)
+AUDIO_POOL_DEFINE(head_pool, struct voice_head, VOICE_POOL_SIZE)
+
 static esp_err_t s_init_err = ERR_UNSET;
-static struct timevo s_hours[24];
-static struct timevo s_mins[60];
-static struct timevo_name s_names[TIMEVO_MAX_LEN*2];
+static SemaphoreHandle_t s_stage_mutex;
+/* indexed by minute % 2 to keep current and next minute */
+static struct voice_stage s_stages[2] = { { .minute = -1 }, { .minute = -1 } };
+/* updated by audio task, clock task and caller of say */
+static SemaphoreHandle_t s_stats_mutex;
+static voice_stats_t s_stats;
+static timevo_t s_timevo;
+static audio_asset_t s_bank_asset;
+static audio_bank_t s_bank;
+static bool s_bank_loaded = false;
 
+/* read time_vo.bin once and keep phrases in memory. */
 static esp_err_t load_timevo_indices(void)
 {
     FILE *fp;
+    uint8_t *data;
+    long size;
     int rsize;
+    timevo_err_t terr;
 
     fp = fopen(TIMEVO_FILE, "r");
     if (fp == NULL) {
         ESP_LOGD(TAG, "failed to open time_vo.bin");
         return ESP_ERR_NOT_FOUND;
     }
-    rsize = fread(s_hours, 1, sizeof(s_hours), fp);
-    if (rsize != sizeof(s_hours)) {
-        ESP_LOGD(TAG, "time_vo: Not enough hours");
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(fp);
         return ESP_ERR_INVALID_SIZE;
     }
-    rsize = fread(s_mins, 1, sizeof(s_mins), fp);
-    if (rsize != sizeof(s_mins)) {
-        ESP_LOGD(TAG, "time_vo: Not enough min");
+    data = malloc(size);
+    if (data == NULL) {
+        fclose(fp);
+        return ESP_ERR_NO_MEM;
+    }
+    rsize = fread(data, 1, size, fp);
+    fclose(fp);
+    if (rsize != size) {
+        free(data);
         return ESP_ERR_INVALID_SIZE;
     }
+    terr = timevo_parse(&s_timevo, data, size);
+    free(data);
+    if (terr == TIMEVO_ERR_NO_MEM) {
+        return ESP_ERR_NO_MEM;
+    } else if (terr != TIMEVO_OK) {
+        ESP_LOGE(TAG, "time_vo.bin is broken: %d", terr);
+        return ESP_ERR_INVALID_CRC;
+    }
+    ESP_LOGD(TAG, "time_vo: %d bytes of names", s_timevo.pool_size);
     return ESP_OK;
 }
 
-static int load_timevo_names(const struct timevo *timevo, struct timevo_name *names)
+/* append names of phrase. return new count. */
+static int add_names(const char **names, int count, const timevo_phrase_t *phrase)
 {
-    FILE *fp;
     int i;
+    for (i = 0; i < phrase->count; i++) {
+        names[count++] = timevo_clip_name(&s_timevo, phrase->clips[i]);
+    }
+    return count;
+}
 
-    if (s_init_err != ESP_OK) {
-        return -1;
+static void load_voice_bank(void)
+{
+    if (audio_asset_open(&s_bank_asset, CONFIG_STORAGE_AUDIO_PARTITION_NAME) != 0) {
+        return;
     }
-    fp = fopen(TIMEVO_FILE, "r");
-    if (fp == NULL) {
-        return -1;
+    if (audio_bank_init(&s_bank, s_bank_asset.data, s_bank_asset.size) != 0) {
+        ESP_LOGD(TAG, "no voice bank in partition");
+        audio_asset_close(&s_bank_asset);
+        return;
     }
-    for (i = 0; i < TIMEVO_MAX_LEN && timevo->indices[i] != 0xff; i++) {
-        int offset = TIMEVO_MAX_LEN*(24+60) + (TIMEVO_MAX_NAME+1) * timevo->indices[i];
-        int rsize;
-        if (fseek(fp, offset, SEEK_SET) < 0) {
-            continue;
+    ESP_LOGD(TAG, "voice bank: %d clips", s_bank.header->count);
+    s_bank_loaded = true;
+}
+
+static void record_latency(int64_t request_time)
+{
+    int32_t latency = esp_timer_get_time() - request_time;
+    voice_stats_t stats;
+    xSemaphoreTake(s_stats_mutex, portMAX_DELAY);
+    s_stats.latency_last = latency;
+    if (s_stats.latency_count == 0 || latency < s_stats.latency_min) {
+        s_stats.latency_min = latency;
+    }
+    if (latency > s_stats.latency_max) {
+        s_stats.latency_max = latency;
+    }
+    s_stats.latency_sum += latency;
+    s_stats.latency_count++;
+    stats = s_stats;
+    xSemaphoreGive(s_stats_mutex);
+    ESP_LOGI(TAG, "first sample in %d us (max %d us, %u/%u staged)",
+        latency, stats.latency_max, stats.hits, stats.requests);
+}
+
+static int voice_phrase_func(void *arg, void *data, int *size)
+{
+    if (data == NULL && size == NULL) {
+        phrase_pool_release(arg);
+    } else {
+        /* audio is read by voice_phrase_ptr_func */
+        *size = 0;
+    }
+    return 0;
+}
+
+static int voice_phrase_ptr_func(void *arg, const void **data, int *size)
+{
+    struct voice_phrase *phrase = arg;
+    if (phrase->request_time != 0) {
+        record_latency(phrase->request_time);
+        phrase->request_time = 0;
+    }
+    return audio_bank_data_ptr_func(&phrase->play, data, size);
+}
+
+/* resolve names in voice bank. */
+static struct voice_phrase *stage_phrase(const char *const *names, int count)
+{
+    struct voice_phrase *phrase;
+
+    phrase = phrase_pool_acquire();
+    if (phrase == NULL) {
+        ESP_LOGW(TAG, "no free phrase");
+        return NULL;
+    }
+    if (audio_bank_resolve(&s_bank, names, count, phrase->ranges) < 0) {
+        ESP_LOGD(TAG, "some of voice is not in voice bank");
+        phrase_pool_release(phrase);
+        return NULL;
+    }
+    audio_bank_play_init(&phrase->play, phrase->ranges, count);
+    phrase->request_time = 0;
+    return phrase;
+}
+
+/* play all names as one audio from voice bank. */
+static void play_phrase(struct voice_phrase *phrase)
+{
+    audio_play_opts_t opts = {
+        .gain = AUDIO_GAIN_UNITY,
+        .data_ptr_func = voice_phrase_ptr_func,
+    };
+    audio_play_ex(voice_phrase_func, phrase,
+        s_bank.header->samplerate, s_bank.header->channels, s_bank.header->bits,
+        AUDIO_ENQUEUE, &opts);
+}
+
+static void free_head(struct voice_head *head)
+{
+    storage_wav_close(&head->base);
+    head_pool_release(head);
+}
+
+static int voice_head_func(void *arg, void *data, int *size)
+{
+    struct voice_head *head = arg;
+    struct wav_play_info *base = &head->base;
+
+    if (data == NULL && size == NULL) {
+        free_head(head);
+        return 0;
+    }
+    if (head->request_time != 0) {
+        record_latency(head->request_time);
+        head->request_time = 0;
+    }
+    if (head->pos < head->size) {
+        int n = head->size - head->pos;
+        if (n > *size) {
+            n = *size;
         }
-        rsize = fread(names, 1, sizeof(*names), fp);
-        if (rsize != sizeof(*names)) {
+        memcpy(data, head->buf + head->pos, n);
+        head->pos += n;
+        *size = n;
+        return head->pos < head->size || base->playsize > 0;
+    }
+    if (base->wav_data == NULL) {
+        /* reopen rest of file, keeping position and decoder state */
+        struct wav_play_info saved = *base;
+        if (storage_wav_open(head->path, base) != ESP_OK) {
+            *size = 0;
+            return 0;
+        }
+        saved.wav_data = base->wav_data;
+        *base = saved;
+    }
+    return audio_wav_data_func(base, data, size);
+}
+
+/* open file and decode its head into RAM. */
+static struct voice_head *stage_head(const char *name)
+{
+    struct wav_play_info info;
+    struct voice_head *head;
+    char path[sizeof(head->path)];
+    int64_t head_size;
+    uint32_t n = 0;
+
+    strcpy(path, CONFIG_STORAGE_BASE_PATH "/");
+    strlcat(path, name, sizeof(path));
+    if (storage_wav_open(path, &info) != ESP_OK) {
+        return NULL;
+    }
+    head_size = wav_info_duration_to_bytes(VOICE_PREFETCH_MS, &info.wav_info);
+    if (head_size > info.wav_info.data_length) {
+        head_size = info.wav_info.data_length;
+    }
+    if (head_size > VOICE_HEAD_SIZE) {
+        head_size = VOICE_HEAD_SIZE;
+    }
+    head = head_pool_acquire();
+    if (head == NULL) {
+        ESP_LOGW(TAG, "no free voice head");
+        storage_wav_close(&info);
+        return NULL;
+    }
+    head->base = info;
+    strcpy(head->path, path);
+    while (n < head_size) {
+        int size = head_size - n;
+        int more = audio_wav_data_func(&head->base, head->buf + n, &size);
+        n += size;
+        if (!more || size == 0) {
+            break;
+        }
+    }
+    /* close FILE to save FD until rest is played */
+    storage_wav_close(&head->base);
+    head->size = n;
+    head->pos = 0;
+    head->request_time = 0;
+    return head;
+}
+
+static void play_head(struct voice_head *head)
+{
+    const struct wav_info *wav_info = &head->base.wav_info;
+    audio_play(voice_head_func, head,
+        wav_info->samplerate, wav_info->channels, wav_info->bits,
+        AUDIO_ENQUEUE);
+}
+
+static void clear_stage(struct voice_stage *stage)
+{
+    if (stage->phrase != NULL) {
+        phrase_pool_release(stage->phrase);
+    }
+    if (stage->head != NULL) {
+        free_head(stage->head);
+    }
+    memset(stage, 0, sizeof(*stage));
+    stage->minute = -1;
+}
+
+/* look up names and prepare audio to say the minute. */
+static void build_stage(struct voice_stage *stage, time_t minute)
+{
+    time_t time = minute * 60;
+    int64_t start = esp_timer_get_time();
+    int32_t elapsed;
+    struct tm tm;
+
+    memset(stage, 0, sizeof(*stage));
+    stage->minute = minute;
+    localtime_r(&time, &tm);
+    stage->count = add_names(stage->names, stage->count, &s_timevo.hours[tm.tm_hour]);
+    stage->count = add_names(stage->names, stage->count, &s_timevo.mins[tm.tm_min]);
+    ESP_LOGD(TAG, "%02d:%02d: %d names", tm.tm_hour, tm.tm_min, stage->count);
+    if (stage->count == 0) {
+        return;
+    }
+    if (s_bank_loaded) {
+        stage->phrase = stage_phrase(stage->names, stage->count);
+    }
+    if (stage->phrase == NULL) {
+        stage->head = stage_head(stage->names[0]);
+    }
+    elapsed = esp_timer_get_time() - start;
+    xSemaphoreTake(s_stats_mutex, portMAX_DELAY);
+    if (elapsed > s_stats.stage_time_max) {
+        s_stats.stage_time_max = elapsed;
+    }
+    s_stats.stages++;
+    xSemaphoreGive(s_stats_mutex);
+}
+
+/* play staged audio. stage is cleared as audio takes its buffers. */
+static esp_err_t play_stage(struct voice_stage *stage, int64_t request_time)
+{
+    esp_err_t err = ESP_OK;
+    int i = 0;
+
+    if (stage->phrase != NULL) {
+        stage->phrase->request_time = request_time;
+        play_phrase(stage->phrase);
+        stage->phrase = NULL;
+        i = stage->count;
+    } else if (stage->head != NULL) {
+        stage->head->request_time = request_time;
+        play_head(stage->head);
+        stage->head = NULL;
+        i = 1;
+    }
+    /* play rest of files one by one */
+    for (; i < stage->count && err == ESP_OK; i++) {
+        err = sound_play(stage->names[i]);
+    }
+    clear_stage(stage);
+    return err;
+}
+
+/* stage current and next minute ahead of time. runs in clock task. */
+static void prefetch(time_t time)
+{
+    time_t minutes[2] = { time / 60, (time + VOICE_PREFETCH_LEAD) / 60 };
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        struct voice_stage *slot = &s_stages[minutes[i] % 2];
+        struct voice_stage stage, old;
+        bool staged;
+        xSemaphoreTake(s_stage_mutex, portMAX_DELAY);
+        staged = slot->minute == minutes[i];
+        xSemaphoreGive(s_stage_mutex);
+        if (staged) {
             continue;
         }
-        ESP_LOGD(TAG, "loaded %d: %s", timevo->indices[i], names->name);
-        names->name[TIMEVO_MAX_NAME] = '\0';
-        names++;
+        build_stage(&stage, minutes[i]);
+        xSemaphoreTake(s_stage_mutex, portMAX_DELAY);
+        old = *slot;
+        *slot = stage;
+        xSemaphoreGive(s_stage_mutex);
+        clear_stage(&old);
+    }
+}
+
+static void voice_clock_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    if (event_base == CLOCK && event_id == CLOCK_EVENT_SECOND) {
+        prefetch(*(time_t*)event_data);
     }
-    fclose(fp);
-    return i;
 }
 
 esp_err_t voice_ensure_init(void)
@@ -116,6 +449,17 @@ esp_err_t voice_ensure_init(void)
             s_init_err = err;
             return err;
         }
+        load_voice_bank();
+        s_stage_mutex = xSemaphoreCreateMutex();
+        s_stats_mutex = xSemaphoreCreateMutex();
+        if (s_stage_mutex == NULL || s_stats_mutex == NULL) {
+            s_init_err = ESP_ERR_NO_MEM;
+            return s_init_err;
+        }
+        err = clock_register_event_handler(voice_clock_handler, NULL);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "prefetch disabled: %d", err);
+        }
         s_init_err = ESP_OK;
     } else if (s_init_err != ESP_OK) {
         return s_init_err;
@@ -125,9 +469,10 @@ esp_err_t voice_ensure_init(void)
 
 esp_err_t voice_saytime(time_t time)
 {
-    struct tm tm;
-    int count = 0;
-    int i;
+    int64_t request_time = esp_timer_get_time();
+    time_t minute = time / 60;
+    struct voice_stage stage;
+    struct voice_stage *slot;
     esp_err_t err;
 
     err = voice_ensure_init();
@@ -135,29 +480,47 @@ esp_err_t voice_saytime(time_t time)
         return ESP_FAIL;
     }
 
-    localtime_r(&time, &tm);
-    i = load_timevo_names(&s_hours[tm.tm_hour], s_names+count);
-    ESP_LOGD(TAG, "hour%02d: %d names", tm.tm_hour, i);
-    if (i < 0) {
-        return ESP_FAIL;
+    slot = &s_stages[minute % 2];
+    xSemaphoreTake(s_stage_mutex, portMAX_DELAY);
+    stage = *slot;
+    if (stage.minute == minute && !stage.taken) {
+        /* take it. prefetch only stages next minute to this slot */
+        memset(slot, 0, sizeof(*slot));
+        slot->minute = minute;
+        slot->taken = true;
     }
-    count += i;
-    i = load_timevo_names(&s_mins[tm.tm_min], s_names+count);
-    ESP_LOGD(TAG, "min%02d: %d names", tm.tm_min, i);
-    if (i < 0) {
-        return ESP_FAIL;
+    xSemaphoreGive(s_stage_mutex);
+    xSemaphoreTake(s_stats_mutex, portMAX_DELAY);
+    s_stats.requests++;
+    if (stage.minute == minute && !stage.taken) {
+        s_stats.hits++;
     }
-    count += i;
-    for (i = 0; i < count; i++) {
-        err = sound_play(s_names[i].name);
-        if (err != ESP_OK) {
-            return err;
-        }
+    xSemaphoreGive(s_stats_mutex);
+    if (stage.minute != minute || stage.taken) {
+        build_stage(&stage, minute);
     }
-    return ESP_OK;
+    return play_stage(&stage, request_time);
 }
 
 esp_err_t voice_saynow(void)
 {
-    return voice_saytime(clock_time(NULL)+3);
+    return voice_saytime(clock_time(NULL));
+}
+
+void voice_get_stats(voice_stats_t *stats)
+{
+    if (s_stats_mutex == NULL) {
+        /* not initialized yet */
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(s_stats_mutex, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_stats_mutex);
+}
+
+void voice_get_pool_stats(audio_pool_stats_t *phrases, audio_pool_stats_t *heads)
+{
+    audio_pool_get_stats(&phrase_pool, phrases);
+    audio_pool_get_stats(&head_pool, heads);
 }
@@ -16,16 +16,38 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 #include <esp_err.h>
+#include <audio_pool.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** statistics of saying time. times are in microseconds. */
+typedef struct {
+    uint32_t requests;      /**< number of times said */
+    uint32_t hits;          /**< number of times announcement was already staged */
+    uint32_t stages;        /**< number of announcements staged */
+    int32_t stage_time_max; /**< longest time to stage an announcement */
+    uint32_t latency_count; /**< number of latency samples */
+    int32_t latency_last;   /**< request to first sample taken by audio */
+    int32_t latency_min;
+    int32_t latency_max;
+    int64_t latency_sum;
+} voice_stats_t;
+
+/**
+ * @brief initialize voice and start staging announcement of next minute
+ * at each CLOCK_EVENT_SECOND.
+ */
 extern esp_err_t voice_ensure_init(void);
 extern esp_err_t voice_saytime(time_t time);
 extern esp_err_t voice_saynow();
+extern void voice_get_stats(voice_stats_t *stats);
+/** @brief get usage of pools of phrases resolved in voice bank and heads decoded in RAM. */
+extern void voice_get_pool_stats(audio_pool_stats_t *phrases, audio_pool_stats_t *heads);
 
 #ifdef __cplusplus
 }
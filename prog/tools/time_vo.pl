@@ -5,6 +5,8 @@ use warnings;
 package TimeVo;
 
 use Getopt::Long qw(:config posix_default no_ignore_case gnu_compat);
+use File::Basename qw(dirname);
+use Compress::Zlib ();
 
 sub MAX_NAME() { 15 };
 sub MAX_LEN() { 8 };
@@ -79,21 +81,95 @@ sub checkfiles {
     return $ret;
 }
 
-sub save_bin {
-    my ($self, $file) = @_;
-    open my $fh, ">", $file or die $!;
-    binmode($fh);
+sub pack_phrases {
+    my ($self) = @_;
+    my $bin = '';
     for my $h (@HOURS) {
         my $indices = $self->{hours}->{$h} or die "hour$h is not defined";
-        print $fh pack "C".MAX_LEN, @$indices, (255)x MAX_LEN;
+        $bin .= pack "C".MAX_LEN, @$indices, (255)x MAX_LEN;
     }
     for my $m (@MINS) {
         my $indices = $self->{mins}->{$m} or die "min$m is not defined";
-        print $fh pack "C".MAX_LEN, @$indices, (255)x MAX_LEN;
+        $bin .= pack "C".MAX_LEN, @$indices, (255)x MAX_LEN;
     }
+    return $bin;
+}
+
+# version 1: phrases then fixed length names.
+sub pack_v1 {
+    my ($self) = @_;
+    my $bin = $self->pack_phrases;
     for my $file (@{$self->{files}}) {
-        print $fh pack "Z".(MAX_NAME+1), $file;
+        $bin .= pack "Z".(MAX_NAME+1), $file;
+    }
+    return $bin;
+}
+
+# version 2: header, phrases, offsets of names and string pool. see time_vo.h.
+sub pack_v2 {
+    my ($self) = @_;
+    my ($pool, @offsets) = ('');
+    for my $file (@{$self->{files}}) {
+        push @offsets, length($pool);
+        $pool .= $file."\0";
+    }
+    die "too many names" if (@offsets > 255 || length($pool) > 0xffff);
+    my $body = $self->pack_phrases . pack("v*", @offsets) . $pool;
+    return pack("a4 v v v v V", "TMVO", 2, scalar(@offsets), length($pool), 0,
+        Compress::Zlib::crc32($body)) . $body;
+}
+
+sub save_bin {
+    my ($self, $file, $version) = @_;
+    open my $fh, ">", $file or die $!;
+    binmode($fh);
+    print $fh ($version // 2) == 1? $self->pack_v1: $self->pack_v2;
+    close($fh);
+}
+
+sub save_adpcm {
+    my ($self, $dir, $outdir) = @_;
+    for my $file (@{$self->{files}}) {
+        AdpcmWav::convert($dir."/".$file, $outdir."/".$file);
+    }
+}
+
+# 32bit FNV-1a, same as audio_bank_hash
+sub name_hash {
+    my ($name) = @_;
+    my $hash = 2166136261;
+    for my $c (unpack "C*", $name) {
+        $hash = (($hash ^ $c) * 16777619) & 0xffffffff;
+    }
+    return $hash;
+}
+
+# save all files as voice bank. see audio_bank.h for layout.
+sub save_bank {
+    my ($self, $dir, $file) = @_;
+    my ($rate, $data, @entries, %hashes) = (undef, '');
+    for my $name (@{$self->{files}}) {
+        my ($r, $samples) = AdpcmWav::read_pcm($dir."/".$name);
+        $rate = $r unless (defined($rate));
+        die "$name: sampling rate $r differs from $rate" if ($r != $rate);
+        my $hash = name_hash($name);
+        die "hash of $name collides with $hashes{$hash}" if (exists($hashes{$hash}));
+        $hashes{$hash} = $name;
+        my $pcm = pack "s<*", @$samples;
+        push @entries, [$hash, length($data), length($pcm)];
+        # align each clip to 4 bytes
+        $data .= $pcm . ("\0" x (-length($pcm) & 3));
+    }
+    @entries = sort { $a->[0] <=> $b->[0] } @entries;
+    my $data_offset = 24 + 16 * scalar(@entries);
+    open my $fh, ">", $file or die $!;
+    binmode($fh);
+    print $fh pack "a4 v v V v v V V", "VBNK", 1, scalar(@entries),
+        $rate // 16000, 1, 16, $data_offset, length($data);
+    for my $e (@entries) {
+        print $fh pack "V V V v v", @$e, 1, 0;
     }
+    print $fh $data;
     close($fh);
 }
 
@@ -124,6 +200,8 @@ sub getopt {
         in|i=s
         out|o=s
         dir=s
+        adpcm=s
+        version=i
     ));
 
     if (exists $opts->{in}) {
@@ -153,6 +231,11 @@ sub getopt {
             die "$opts->{dir} is not directory";
         }
     }
+    if (exists $opts->{adpcm}) {
+        unless (-d $opts->{adpcm}) {
+            die "$opts->{adpcm} is not directory";
+        }
+    }
 }
 
 sub checkopt {
@@ -165,6 +248,120 @@ sub checkopt {
     }
 }
 
+package AdpcmWav;
+
+# IMA ADPCM (WAVE format tag 0x11) encoder for mono voice files.
+
+sub BLOCK_ALIGN() { 256 };
+
+my @INDEX_TABLE = (-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8);
+my @STEP_TABLE = (
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+);
+
+# read PCM wav and return (samplerate, samples) downmixed to mono 16bit.
+sub read_pcm {
+    my ($file) = @_;
+    open my $fh, "<", $file or die "$file: $!";
+    binmode($fh);
+    local $/;
+    my $data = <$fh>;
+    close($fh);
+    my ($riff, $wave) = unpack "a4 x4 a4", $data;
+    die "$file: not wav" unless ($riff eq 'RIFF' && $wave eq 'WAVE');
+    my $pos = 12;
+    my ($tag, $channels, $rate, $bits, $pcm);
+    while ($pos + 8 <= length($data)) {
+        my ($id, $size) = unpack "a4 V", substr($data, $pos, 8);
+        if ($id eq 'fmt ') {
+            ($tag, $channels, $rate, $bits) = unpack "v v V x4 x2 v", substr($data, $pos+8, 16);
+        } elsif ($id eq 'data') {
+            $pcm = substr($data, $pos+8, $size);
+            last;
+        }
+        $pos += 8 + $size + ($size & 1);
+    }
+    die "$file: no fmt or data" unless (defined($tag) && defined($pcm));
+    die "$file: not PCM" unless ($tag == 1);
+    die "$file: unsupported bits $bits" unless ($bits == 8 || $bits == 16);
+    my @s = $bits == 8? map { ($_ - 128) * 256 } unpack("C*", $pcm): unpack("s<*", $pcm);
+    if ($channels == 2) {
+        # arithmetic shift for negative values
+        use integer;
+        @s = map { ($s[$_*2] + $s[$_*2+1]) >> 1 } 0..@s/2-1;
+    } elsif ($channels != 1) {
+        die "$file: unsupported channels $channels";
+    }
+    return ($rate, \@s);
+}
+
+sub encode_nibble {
+    my ($st, $sample) = @_;
+    my $step = $STEP_TABLE[$st->{index}];
+    my $diff = $sample - $st->{predictor};
+    my $code = 0;
+    if ($diff < 0) { $code = 8; $diff = -$diff; }
+    if ($diff >= $step) { $code |= 4; $diff -= $step; }
+    if ($diff >= ($step >> 1)) { $code |= 2; $diff -= $step >> 1; }
+    if ($diff >= ($step >> 2)) { $code |= 1; }
+    # update state as decoder does
+    my $d = $step >> 3;
+    $d += $step >> 2 if ($code & 1);
+    $d += $step >> 1 if ($code & 2);
+    $d += $step if ($code & 4);
+    my $p = $st->{predictor} + (($code & 8)? -$d: $d);
+    $st->{predictor} = $p > 32767? 32767: $p < -32768? -32768: $p;
+    my $i = $st->{index} + $INDEX_TABLE[$code];
+    $st->{index} = $i < 0? 0: $i > 88? 88: $i;
+    return $code;
+}
+
+sub encode {
+    my ($samples) = @_;
+    my $block_samples = (BLOCK_ALIGN - 4) * 2 + 1;
+    my $st = { predictor => 0, index => 0 };
+    my $out = '';
+    for (my $pos = 0; $pos < @$samples; $pos += $block_samples) {
+        my @b = @$samples[$pos .. ($pos + $block_samples > @$samples? $#$samples: $pos + $block_samples - 1)];
+        # pad last block with last sample
+        push @b, ($b[-1]) x ($block_samples - @b);
+        $st->{predictor} = $b[0];
+        $out .= pack "s< C C", $b[0], $st->{index}, 0;
+        for (my $i = 1; $i < $block_samples; $i += 2) {
+            my $lo = encode_nibble($st, $b[$i]);
+            my $hi = encode_nibble($st, $b[$i+1]);
+            $out .= pack "C", $lo | ($hi << 4);
+        }
+    }
+    return $out;
+}
+
+sub convert {
+    my ($in, $out) = @_;
+    my ($rate, $samples) = read_pcm($in);
+    my $coded = encode($samples);
+    my $block_samples = (BLOCK_ALIGN - 4) * 2 + 1;
+    my $fmt = pack "v v V V v v v v", 0x11, 1, $rate,
+        int($rate * BLOCK_ALIGN / $block_samples), BLOCK_ALIGN, 4, 2, $block_samples;
+    my $fact = pack "V", scalar(@$samples);
+    my $body = "WAVE"
+        . "fmt " . pack("V", length($fmt)) . $fmt
+        . "fact" . pack("V", length($fact)) . $fact
+        . "data" . pack("V", length($coded)) . $coded;
+    open my $fh, ">", $out or die "$out: $!";
+    binmode($fh);
+    print $fh "RIFF", pack("V", length($body)), $body;
+    close($fh);
+}
+
 package PlayVo;
 
 sub playall {
@@ -215,12 +412,24 @@ if ($0 eq __FILE__) {
     }
     if ($command eq 'convert') {
         TimeVo::checkopt(\%opts, qw(out));
-        $obj->save_bin($opts{out});
+        $obj->save_bin($opts{out}, $opts{version});
         if (exists($opts{dir})) {
             unless ($obj->checkfiles($opts{dir})) {
                 exit 1;
             }
         }
+        if (exists($opts{adpcm})) {
+            TimeVo::checkopt(\%opts, qw(dir));
+            $obj->save_adpcm($opts{dir}, $opts{adpcm});
+        }
+        exit 0;
+    }
+    if ($command eq 'bank') {
+        TimeVo::checkopt(\%opts, qw(out dir));
+        unless ($obj->checkfiles($opts{dir})) {
+            exit 1;
+        }
+        $obj->save_bank($opts{dir}, $opts{out});
         exit 0;
     }
     if ($command eq 'playall') {